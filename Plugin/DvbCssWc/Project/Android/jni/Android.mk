@@ -9,6 +9,7 @@ LOCAL_MODULE           := DvbCssWc
 LOCAL_SRC_FILES        := $(DVB_CSS_WC_SOURCE_PATH)/gstdvbcsswcclient.c \
                           $(DVB_CSS_WC_SOURCE_PATH)/gstdvbcsswcpacket.c \
                           $(DVB_CSS_WC_SOURCE_PATH)/gstdvbcsswcserver.c \
+                          $(DVB_CSS_WC_SOURCE_PATH)/gstdvbcsswcshm.c \
                           $(DVB_CSS_WC_SOURCE_PATH)/export/client-export.c \
                           $(DVB_CSS_WC_SOURCE_PATH)/export/server-export.c
 LOCAL_SHARED_LIBRARIES := gstreamer_android
@@ -33,6 +33,28 @@ gst_dvb_css_wc_client_start(const gchar *name, const gchar *remote_address, gint
 	return dvb_css_wc_client;
 }
 
+extern EXPORT_API GstClock*
+gst_dvb_css_wc_client_start_shared(const gchar *name, const gchar *remote_address, gint remote_port, GstClockTime base_time, const gchar *shm_name)
+{
+	GstClock* dvb_css_wc_client = NULL;
+
+	if(remote_address == NULL || shm_name == NULL)
+	{
+		GST_ERROR("dvb_css_wc_client clock not created, no address or shared memory name\n");
+		return NULL;
+	}
+
+	dvb_css_wc_client = g_object_new(GST_TYPE_DVB_CSS_WC_CLIENT_CLOCK, "name", name, "address", remote_address, "port", remote_port,
+		"base-time", base_time, "shm-name", shm_name, NULL);
+	if(dvb_css_wc_client == NULL)
+	{
+		GST_ERROR("dvb_css_wc_client clock not created\n");
+		return NULL;
+	}
+
+	return dvb_css_wc_client;
+}
+
 extern EXPORT_API void
 gst_dvb_css_wc_client_stop(GstClock *dvb_css_wc_client)
 {
@@ -71,4 +93,14 @@ gst_dvb_css_wc_client_get_time_local(GstClock *dvb_css_wc_client)
 	time = gst_clock_get_time(clock);
 	gst_object_unref(clock);
 	return time;
-}
\ No newline at end of file
+}
+
+extern EXPORT_API gboolean
+gst_dvb_css_wc_client_get_stats(GstClock *dvb_css_wc_client, GstDvbCssWcClientStats *stats)
+{
+	if(dvb_css_wc_client != NULL && stats != NULL)
+	{
+		return gst_dvb_css_wc_client_clock_get_stats(dvb_css_wc_client, stats);
+	}
+	return FALSE;
+}
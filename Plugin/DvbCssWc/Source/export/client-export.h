@@ -20,6 +20,7 @@
 #ifndef __DVB_CSS_WC_CLIENT_EXPORT_H__
 #define __DVB_CSS_WC_CLIENT_EXPORT_H__
 #include <gst/gst.h>
+#include "../gstdvbcsswcclient.h"
 
 #ifdef _WIN32
 #define EXPORT_API __declspec(dllexport)
@@ -41,6 +42,22 @@
  */
 extern EXPORT_API GstClock* gst_dvb_css_wc_client_start(const gchar *name, const gchar *remote_address, gint remote_port, GstClockTime base_time);
 
+/**
+ * gst_dvb_css_wc_client_start_shared:
+ * @name: a name for the client
+ * @remote_address: the address or hostname of the remote clock provider
+ * @remote_port: the port of the remote clock provider
+ * @base_time: initial time of the clock
+ * @shm_name: shared memory segment the time is shared in, e.g. "/dvbcsswc-5000"
+ *
+ * Like gst_dvb_css_wc_client_start(), but only the first client on this host
+ * polls the server and publishes its time in @shm_name. The clients started
+ * while it runs read the time from there.
+ *
+ * Returns: a new #GstClock* that receives a time from the remote clock.
+ */
+extern EXPORT_API GstClock* gst_dvb_css_wc_client_start_shared(const gchar *name, const gchar *remote_address, gint remote_port, GstClockTime base_time, const gchar *shm_name);
+
 /**
  * gst_dvb_css_wc_stop:
  * @dvb_css_wc_client: client that will be stopped
@@ -81,5 +98,17 @@ extern EXPORT_API GstClockTime gst_dvb_css_wc_client_get_time(GstClock *dvb_css_
 */
 extern EXPORT_API GstClockTime gst_dvb_css_wc_client_get_time_local(GstClock *dvb_css_wc_client);
 
+/**
+* gst_dvb_css_wc_client_get_stats:
+* @dvb_css_wc_client: client whose synchronization quality is read
+* @stats: filled in with the offset, round-trip time, dispersion, candidate age,
+*         poll interval and counters of the client
+*
+* Get the synchronization statistics of the client, without blocking its thread
+*
+* Returns: TRUE if @stats was filled in or FALSE in other case
+*/
+extern EXPORT_API gboolean gst_dvb_css_wc_client_get_stats(GstClock *dvb_css_wc_client, GstDvbCssWcClientStats *stats);
+
 
 #endif /* __DVB_CSS_WC_CLIENT_EXPORT_H__ */
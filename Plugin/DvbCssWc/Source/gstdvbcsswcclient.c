@@ -23,8 +23,10 @@
 #include "gstdvbcsswcclient.h"
 #include "gstdvbcsswcpacket.h"
 #include "gstdvbcsswccommon.h"
+#include "gstdvbcsswcshm.h"
 
 #include <gio/gio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #define DEFAULT_ADDRESS          "127.0.0.1"
@@ -32,7 +34,42 @@
 #define DEFAULT_TIMEOUT          GST_SECOND
 #define DEFAULT_BASE_TIME        0
 #define DEFAULT_MAX_FREQ_ERR_PPM 500
-#define DEFAULT_SOCKET_TIMEOUT   G_USEC_PER_SEC / 2
+#define DEFAULT_FILTER           GST_DVB_CSS_WC_CLIENT_FILTER_DISPERSION
+#define DEFAULT_MIN_POLL_INTERVAL (50 * GST_MSECOND)
+#define DEFAULT_MAX_POLL_INTERVAL (4 * GST_SECOND)
+#define DEFAULT_BURST_SIZE       8
+#define DEFAULT_KERNEL_TIMESTAMPS FALSE
+#define DEFAULT_SLEW_THRESHOLD   0
+#define DEFAULT_MAX_SLEW_PPM     500
+#define DEFAULT_SHM_NAME         NULL
+
+/* Every poll interval is randomly stretched or shrunk by up to this fraction,
+ * so that many clients started together do not poll in lockstep */
+#define POLL_JITTER              0.1
+/* Unanswered requests, outside a burst, after which a new burst is started */
+#define POLL_MAX_MISSED          3
+
+/* A slewed correction is spread over at least this long, or two poll
+ * intervals, so that it is not complete before the next update */
+#define SLEW_MIN_PERIOD          GST_SECOND
+
+/* Number of past candidates kept for the frequency estimate */
+#define CANDIDATE_HISTORY_SIZE   32
+/* The frequency is only estimated once the history holds this many candidates
+ * spread over at least DRIFT_MIN_SPAN; before that the clock runs at rate 1 */
+#define DRIFT_MIN_CANDIDATES     4
+#define DRIFT_MIN_SPAN           (2 * GST_SECOND)
+/* Calibration rate denominator, resolution of 1 ppb */
+#define RATE_DENOM               GST_SECOND
+
+/* GST_DVB_CSS_WC_CLIENT_FILTER_LOWEST_RTT averages 1/LOWEST_RTT_FRACTION of the history */
+#define LOWEST_RTT_FRACTION      4
+/* Tuning of GST_DVB_CSS_WC_CLIENT_FILTER_HUBER, in robust standard deviations */
+#define HUBER_K                  1.345
+#define HUBER_ITERATIONS         5
+
+/* Reads of the statistics retried while the client thread updates them */
+#define STATS_READ_ATTEMPTS      10000
 
 GST_DEBUG_CATEGORY_STATIC (dvbcss_wc_client);
 #define GST_CAT_DEFAULT   (dvbcss_wc_client)
@@ -46,9 +83,43 @@ enum
   PROP_BUS,
   PROP_BASE_TIME,
   PROP_INTERNAL_CLOCK,
+  PROP_FILTER,
+  PROP_MIN_POLL_INTERVAL,
+  PROP_MAX_POLL_INTERVAL,
+  PROP_BURST_SIZE,
+  PROP_KERNEL_TIMESTAMPS,
+  PROP_SLEW_THRESHOLD,
+  PROP_MAX_SLEW,
+  PROP_SHM_NAME,
 };
 
 
+//==============================================================================
+// GST_DVB_CSS_WC_CLIENT_FILTER
+//==============================================================================
+
+GType
+gst_dvb_css_wc_client_filter_get_type (void)
+{
+  static gsize id = 0;
+  static const GEnumValue values[] = {
+    {GST_DVB_CSS_WC_CLIENT_FILTER_DISPERSION, "Candidate with the lowest dispersion", "dispersion"},
+    {GST_DVB_CSS_WC_CLIENT_FILTER_LOWEST_RTT, "Mean of the lowest round-trip time candidates", "lowest-rtt"},
+    {GST_DVB_CSS_WC_CLIENT_FILTER_MEDIAN, "Median of the candidates", "median"},
+    {GST_DVB_CSS_WC_CLIENT_FILTER_HUBER, "Huber-weighted mean of the candidates", "huber"},
+    {0, NULL, NULL}
+  };
+
+  if (g_once_init_enter (&id))
+  {
+    GType tmp = g_enum_register_static ("GstDvbCssWcClientFilter", values);
+    g_once_init_leave (&id, tmp);
+  }
+
+  return (GType) id;
+}
+
+
 //==============================================================================
 // CANDIDATE
 //==============================================================================
@@ -65,19 +136,37 @@ struct candidate
   GstClockTimeDiff  offset;
   gdouble           precision_secs;
   guint32           max_freq_error_ppm;
+  GstClockTime      dispersion;   /* at the time it was received */
   GstDvbCssWcPacket msg;
 };
 
-static Candidate*   candidate_new     (GstDvbCssWcPacket *msg);
+/* What gst_dvb_css_wc_client_clock_get_stats reports, as of the last update */
+typedef struct
+{
+  GstClockTimeDiff  offset;
+  GstClockTime      rtt;
+  GstClockTime      dispersion;     /* of the best candidate when it was received */
+  GstClockTime      received;       /* local time the best candidate was received */
+  guint32           growth_ppm;     /* how fast its dispersion grows since */
+  GstClockTime      poll_interval;
+  gdouble           freq_error_ppm;
+  guint64           responses;
+  guint64           missed_responses;
+} ClientStats;
+
+static void         candidate_init    (Candidate *candidate, GstDvbCssWcPacket *msg);
 static GstClockTime calc_dispersion   (GstClock *clock, gdouble local_precision_sec, guint32 local_max_freq_err_ppm, Candidate *candidate);
+static gboolean     estimate_drift    (const Candidate *history, guint count, gdouble *drift);
+static gint         compare_double    (gconstpointer a, gconstpointer b);
+static gdouble      median            (gdouble *values, guint count);
+static gdouble      filter_offset     (GstDvbCssWcClientFilter filter, const Candidate *history, guint count, GstClockTime anchor, GstClockTimeDiff reference, gdouble drift);
 
 //==============================================================================
 //==============================================================================
 
-static Candidate*
-candidate_new (GstDvbCssWcPacket *msg)
+static void
+candidate_init (Candidate *ret, GstDvbCssWcPacket *msg)
 {
-  Candidate* ret          = g_malloc (sizeof (Candidate));
   ret->t1                 = wc_timestamp_to_gst_clock_time(msg->originate_timevalue_secs, msg->originate_timevalue_nanos);
   ret->t2                 = msg->receive_timevalue;
   ret->t3                 = msg->transmit_timevalue;
@@ -86,7 +175,7 @@ candidate_new (GstDvbCssWcPacket *msg)
   ret->offset             = (GstClockTimeDiff)((ret->t3 + ret->t2) - (ret->t4 + ret->t1)) / 2;
   ret->precision_secs     = gst_dvb_css_wc_packet_decode_precision(msg->precision);
   ret->max_freq_error_ppm = (guint32)gst_dvb_css_wc_packet_decode_max_freq_error(msg->max_freq_error);
-  return ret;
+  ret->dispersion         = GST_CLOCK_TIME_NONE;
 }
 
 static GstClockTime
@@ -105,6 +194,166 @@ calc_dispersion (GstClock *clock, gdouble local_precision_sec, guint32 local_max
   return dispersion;
 }
 
+/* Weighted least-squares fit of the offset against the local time of the
+ * candidates, (t2+t3)/2 - (t1+t4)/2 against (t1+t4)/2. The slope is the
+ * frequency error of the local clock relative to the server. Candidates are
+ * weighted by the inverse square of their dispersion, so samples delayed on
+ * the network barely count. */
+static gboolean
+estimate_drift (const Candidate *history, guint count, gdouble *drift)
+{
+  GstClockTime reference = history[0].t1 / 2 + history[0].t4 / 2;
+  GstClockTime first     = reference;
+  GstClockTime last      = reference;
+  gdouble      sw = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+  gdouble      denom;
+  guint        i;
+
+  if (count < DRIFT_MIN_CANDIDATES)
+  {
+    return FALSE;
+  }
+
+  for (i = 0; i < count; ++i)
+  {
+    const Candidate *c     = &history[i];
+    GstClockTime     local = c->t1 / 2 + c->t4 / 2;
+    /* relative to the first candidate and in seconds, to keep the sums well conditioned */
+    gdouble          x     = (gdouble)GST_CLOCK_DIFF (reference, local) / GST_SECOND;
+    gdouble          y     = (gdouble)c->offset / GST_SECOND;
+    gdouble          d     = (gdouble)MAX (c->dispersion, 1) / GST_SECOND;
+    gdouble          w     = 1.0 / (d * d);
+
+    first = MIN (first, local);
+    last  = MAX (last, local);
+
+    sw  += w;
+    sx  += w * x;
+    sy  += w * y;
+    sxx += w * x * x;
+    sxy += w * x * y;
+  }
+
+  if (last - first < DRIFT_MIN_SPAN)
+  {
+    return FALSE;
+  }
+
+  denom = sw * sxx - sx * sx;
+  if (denom <= 0)
+  {
+    return FALSE;
+  }
+
+  *drift = (sw * sxy - sx * sy) / denom;
+  return TRUE;
+}
+
+static gint
+compare_double (gconstpointer a, gconstpointer b)
+{
+  gdouble da = *(const gdouble *)a;
+  gdouble db = *(const gdouble *)b;
+  return (da > db) - (da < db);
+}
+
+/* Sorts values */
+static gdouble
+median (gdouble *values, guint count)
+{
+  qsort (values, count, sizeof (gdouble), compare_double);
+  if (count % 2)
+  {
+    return values[count / 2];
+  }
+  return (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+/* Offset picked by filter from the history, in nanoseconds relative to
+ * reference. Every candidate's offset is first carried forward to the local
+ * time anchor with the estimated drift, so old and new candidates agree. */
+static gdouble
+filter_offset (GstDvbCssWcClientFilter filter, const Candidate *history, guint count, GstClockTime anchor, GstClockTimeDiff reference, gdouble drift)
+{
+  gdouble offsets[CANDIDATE_HISTORY_SIZE];
+  gdouble deviations[CANDIDATE_HISTORY_SIZE];
+  guint   i;
+
+  g_return_val_if_fail (count > 0 && count <= CANDIDATE_HISTORY_SIZE, 0);
+
+  for (i = 0; i < count; ++i)
+  {
+    GstClockTime local = history[i].t1 / 2 + history[i].t4 / 2;
+    offsets[i] = (gdouble)(history[i].offset - reference) + drift * GST_CLOCK_DIFF (local, anchor);
+  }
+
+  switch (filter)
+  {
+    case GST_DVB_CSS_WC_CLIENT_FILTER_LOWEST_RTT:
+    {
+      guint   order[CANDIDATE_HISTORY_SIZE];
+      guint   used = MAX (count / LOWEST_RTT_FRACTION, 1);
+      gdouble sum  = 0;
+      guint   j;
+
+      /* insertion sort of the indices by round-trip time, the history is small */
+      for (i = 0; i < count; ++i)
+      {
+        for (j = i; j > 0 && history[order[j - 1]].rtt > history[i].rtt; --j)
+        {
+          order[j] = order[j - 1];
+        }
+        order[j] = i;
+      }
+      for (i = 0; i < used; ++i)
+      {
+        sum += offsets[order[i]];
+      }
+      return sum / used;
+    }
+    case GST_DVB_CSS_WC_CLIENT_FILTER_MEDIAN:
+    {
+      return median (offsets, count);
+    }
+    case GST_DVB_CSS_WC_CLIENT_FILTER_HUBER:
+    {
+      gdouble center = median (offsets, count);
+      gdouble k;
+      guint   iteration;
+
+      /* scale from the median absolute deviation, which the outliers cannot inflate */
+      for (i = 0; i < count; ++i)
+      {
+        deviations[i] = ABS (offsets[i] - center);
+      }
+      k = HUBER_K * 1.4826 * median (deviations, count);
+      if (k < 1)
+      {
+        return center;
+      }
+
+      for (iteration = 0; iteration < HUBER_ITERATIONS; ++iteration)
+      {
+        gdouble sw = 0, swx = 0;
+        for (i = 0; i < count; ++i)
+        {
+          gdouble residual = ABS (offsets[i] - center);
+          gdouble w        = residual <= k ? 1.0 : k / residual;
+          sw  += w;
+          swx += w * offsets[i];
+        }
+        center = swx / sw;
+      }
+      return center;
+    }
+    default:
+    {
+      g_assert_not_reached ();
+      return 0;
+    }
+  }
+}
+
 //==============================================================================
 // GST_DVB_CSS_WC_CLIENT_INTERNAL_CLOCK
 //==============================================================================
@@ -128,6 +377,7 @@ struct _GstDvbCssWcClientInternalClock
 
   GSocket        *socket;
   GSocketAddress *servaddr;
+  GstDvbCssWcAddress server_address;
   GCancellable   *cancel;
   gboolean        made_cancel_fd;
 
@@ -138,9 +388,38 @@ struct _GstDvbCssWcClientInternalClock
   GList          *busses;
 
   //algorithm specific
-  Candidate      *best_candidate;
+  GstDvbCssWcClientFilter filter;
+  Candidate       best_candidate;
+  gboolean        have_best_candidate;
+  Candidate       history[CANDIDATE_HISTORY_SIZE];
+  guint           history_next;
+  guint           history_count;
+  GstClockTime    rate_num;
   guint32         max_freq_error_ppm;
-  gint64          socket_timeout;
+
+  /* poll scheduling, settings protected by OBJECT_LOCK */
+  GstClockTime    min_poll_interval;
+  GstClockTime    max_poll_interval;
+  guint           burst_size;
+  gboolean        burst_restart;  /* burst-size changed, start a new burst */
+  GstClockTime    poll_interval;
+  guint           burst_remaining;
+  guint           missed_responses;
+  gboolean        awaiting_response;
+
+  /* slewing, protected by OBJECT_LOCK */
+  GstClockTime    slew_threshold;
+  guint           max_slew_ppm;
+
+  /* calibration published to other processes, protected by OBJECT_LOCK */
+  gchar                *shm_name;
+  GstDvbCssWcShmWriter *shm_writer;
+
+  /* written by the client thread only, read through the stats_seq seqlock */
+  gint            stats_seq;          /* odd while stats is being updated */
+  ClientStats     stats;
+
+  gboolean        kernel_timestamps;  /* ATOMIC */
   gdouble         clock_precision_sec;
 };
 
@@ -163,8 +442,13 @@ static gboolean           gst_dvb_css_wc_client_internal_clock_start        (Gst
 static void               gst_dvb_css_wc_client_internal_clock_stop         (GstDvbCssWcClientInternalClock *self);
 static gpointer           gst_dvb_css_wc_client_internal_clock_thread       (gpointer data);
 static gboolean           gst_dvb_css_wc_client_internal_clock_send_request (gpointer data);
-static GstDvbCssWcPacket* gst_dvb_css_wc_client_internal_clock_receive_msg  (gpointer data);
+static gboolean           gst_dvb_css_wc_client_internal_clock_receive_msg  (gpointer data, gint64 timeout, GstDvbCssWcPacket *resp);
+static gint64             gst_dvb_css_wc_client_internal_clock_schedule     (GstDvbCssWcClientInternalClock *self);
 static void               gst_dvb_css_wc_client_internal_clock_update       (GstDvbCssWcClientInternalClock *self, GstDvbCssWcPacket *pkt);
+static gboolean           gst_dvb_css_wc_client_internal_clock_slew         (GstDvbCssWcClientInternalClock *self, GstClockTime internal, GstClockTime external);
+static void               gst_dvb_css_wc_client_internal_clock_publish      (GstDvbCssWcClientInternalClock *self);
+static void               gst_dvb_css_wc_client_internal_clock_report       (GstDvbCssWcClientInternalClock *self, const Candidate *candidate, GstClockTimeDiff offset);
+static gboolean           gst_dvb_css_wc_client_internal_clock_get_stats    (GstDvbCssWcClientInternalClock *self, GstDvbCssWcClientStats *stats);
 
 //==============================================================================
 //==============================================================================
@@ -190,6 +474,46 @@ gst_dvb_css_wc_client_internal_clock_class_init (GstDvbCssWcClientInternalClockC
           "The port on which the remote server is listening", 0, G_MAXUINT16,
           DEFAULT_PORT,
           G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_FILTER,
+      g_param_spec_enum ("filter", "Filter",
+          "How the offset is picked from the recent candidates",
+          GST_TYPE_DVB_CSS_WC_CLIENT_FILTER, DEFAULT_FILTER,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MIN_POLL_INTERVAL,
+      g_param_spec_uint64 ("min-poll-interval", "Minimum poll interval",
+          "Interval between the requests of a burst, sent at start up and when the server stops answering", 1,
+          G_MAXUINT64, DEFAULT_MIN_POLL_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MAX_POLL_INTERVAL,
+      g_param_spec_uint64 ("max-poll-interval", "Maximum poll interval",
+          "Longest interval between requests once the clock is stable", 1,
+          G_MAXUINT64, DEFAULT_MAX_POLL_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_BURST_SIZE,
+      g_param_spec_uint ("burst-size", "Burst size",
+          "Number of requests sent at the minimum poll interval to converge quickly", 1,
+          CANDIDATE_HISTORY_SIZE, DEFAULT_BURST_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_KERNEL_TIMESTAMPS,
+      g_param_spec_boolean ("kernel-timestamps", "Kernel timestamps",
+          "Take the time responses arrive from kernel socket timestamps (Linux only)",
+          DEFAULT_KERNEL_TIMESTAMPS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_SLEW_THRESHOLD,
+      g_param_spec_uint64 ("slew-threshold", "Slew threshold",
+          "Offset corrections up to this size are slewed by adjusting the rate, larger ones step the clock (0 = always step)", 0,
+          G_MAXUINT64, DEFAULT_SLEW_THRESHOLD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MAX_SLEW,
+      g_param_spec_uint ("max-slew", "Maximum slew",
+          "Largest rate adjustment in ppm used to slew the clock", 1,
+          100000, DEFAULT_MAX_SLEW_PPM,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_SHM_NAME,
+      g_param_spec_string ("shm-name", "Shared memory name",
+          "Publish the calibration in this shared memory segment for GstDvbCssWcShmClocks in other processes (NULL = off)",
+          DEFAULT_SHM_NAME,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -203,10 +527,33 @@ gst_dvb_css_wc_client_internal_clock_init (GstDvbCssWcClientInternalClock *self)
   self->servaddr                  = NULL;
   self->address                   = g_strdup (DEFAULT_ADDRESS);
   self->port                      = DEFAULT_PORT;
-  self->best_candidate            = NULL;
+  self->filter                    = DEFAULT_FILTER;
+  self->have_best_candidate       = FALSE;
+  self->history_next              = 0;
+  self->history_count             = 0;
+  self->rate_num                  = RATE_DENOM;
   self->max_freq_error_ppm        = DEFAULT_MAX_FREQ_ERR_PPM;
-  self->socket_timeout            = DEFAULT_SOCKET_TIMEOUT;
+  self->min_poll_interval         = DEFAULT_MIN_POLL_INTERVAL;
+  self->max_poll_interval         = DEFAULT_MAX_POLL_INTERVAL;
+  self->burst_size                = DEFAULT_BURST_SIZE;
+  self->poll_interval             = DEFAULT_MIN_POLL_INTERVAL;
+  self->burst_restart             = FALSE;
+  self->burst_remaining           = 0;
+  self->missed_responses          = 0;
+  self->awaiting_response         = FALSE;
+  self->slew_threshold            = DEFAULT_SLEW_THRESHOLD;
+  self->max_slew_ppm              = DEFAULT_MAX_SLEW_PPM;
+  self->shm_name                  = g_strdup (DEFAULT_SHM_NAME);
+  self->shm_writer                = NULL;
+  self->kernel_timestamps         = DEFAULT_KERNEL_TIMESTAMPS;
   self->clock_precision_sec       = measure_precision_sec (GST_CLOCK_CAST (self));
+
+  self->stats_seq                 = 0;
+  memset (&self->stats, 0, sizeof (self->stats));
+  self->stats.rtt                 = GST_CLOCK_TIME_NONE;
+  self->stats.dispersion          = GST_CLOCK_TIME_NONE;
+  self->stats.received            = GST_CLOCK_TIME_NONE;
+  self->stats.poll_interval       = DEFAULT_MIN_POLL_INTERVAL;
 }
 
 static void
@@ -222,6 +569,14 @@ gst_dvb_css_wc_client_internal_clock_finalize (GObject *object)
   g_free (self->address);
   self->address = NULL;
 
+  if (self->shm_writer != NULL)
+  {
+    gst_dvb_css_wc_shm_writer_free (self->shm_writer);
+    self->shm_writer = NULL;
+  }
+  g_free (self->shm_name);
+  self->shm_name = NULL;
+
   if (self->servaddr != NULL)
   {
     g_object_unref (self->servaddr);
@@ -269,6 +624,100 @@ gst_dvb_css_wc_client_internal_clock_set_property (GObject *object, guint prop_i
       GST_OBJECT_UNLOCK (self);
       break;
     }
+    case PROP_FILTER:
+    {
+      GST_OBJECT_LOCK (self);
+      self->filter = g_value_get_enum (value);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    }
+    case PROP_MIN_POLL_INTERVAL:
+    {
+      GST_OBJECT_LOCK (self);
+      self->min_poll_interval = g_value_get_uint64 (value);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    }
+    case PROP_MAX_POLL_INTERVAL:
+    {
+      GST_OBJECT_LOCK (self);
+      self->max_poll_interval = g_value_get_uint64 (value);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    }
+    case PROP_BURST_SIZE:
+    {
+      GST_OBJECT_LOCK (self);
+      self->burst_size = g_value_get_uint (value);
+      self->burst_restart = TRUE;
+      GST_OBJECT_UNLOCK (self);
+      break;
+    }
+    case PROP_SLEW_THRESHOLD:
+    {
+      GST_OBJECT_LOCK (self);
+      self->slew_threshold = g_value_get_uint64 (value);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    }
+    case PROP_MAX_SLEW:
+    {
+      GST_OBJECT_LOCK (self);
+      self->max_slew_ppm = g_value_get_uint (value);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    }
+    case PROP_SHM_NAME:
+    {
+      const gchar          *shm_name = g_value_get_string (value);
+      GstDvbCssWcShmWriter *writer   = NULL;
+      GstClockType          clock_type;
+      GError               *error    = NULL;
+
+      GST_OBJECT_LOCK (self);
+      if (g_strcmp0 (shm_name, self->shm_name) == 0)
+      {
+        GST_OBJECT_UNLOCK (self);
+        break;
+      }
+      GST_OBJECT_UNLOCK (self);
+
+      if (shm_name != NULL)
+      {
+        /* readers must use the clock the calibration refers to */
+        g_object_get (self, "clock-type", &clock_type, NULL);
+        writer = gst_dvb_css_wc_shm_writer_new (shm_name, clock_type, &error);
+        if (writer == NULL)
+        {
+          GST_WARNING_OBJECT (self, "Not publishing the calibration: %s", error->message);
+          g_clear_error (&error);
+        }
+      }
+
+      GST_OBJECT_LOCK (self);
+      if (self->shm_writer != NULL)
+      {
+        gst_dvb_css_wc_shm_writer_free (self->shm_writer);
+      }
+      self->shm_writer = writer;
+      g_free (self->shm_name);
+      self->shm_name = writer != NULL ? g_strdup (shm_name) : NULL;
+      GST_OBJECT_UNLOCK (self);
+
+      gst_dvb_css_wc_client_internal_clock_publish (self);
+      break;
+    }
+    case PROP_KERNEL_TIMESTAMPS:
+    {
+      gboolean enable = g_value_get_boolean (value);
+      /* the socket lives as long as the thread, set up by start otherwise */
+      if (enable && self->socket && !gst_dvb_css_wc_packet_enable_timestamping (self->socket, FALSE))
+      {
+        enable = FALSE;
+      }
+      g_atomic_int_set (&self->kernel_timestamps, enable);
+      break;
+    }
     default:
     {
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -296,6 +745,60 @@ gst_dvb_css_wc_client_internal_clock_get_property (GObject *object, guint prop_i
       g_value_set_int (value, self->port);
       break;
     }
+    case PROP_FILTER:
+    {
+      GST_OBJECT_LOCK (self);
+      g_value_set_enum (value, self->filter);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    }
+    case PROP_MIN_POLL_INTERVAL:
+    {
+      GST_OBJECT_LOCK (self);
+      g_value_set_uint64 (value, self->min_poll_interval);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    }
+    case PROP_MAX_POLL_INTERVAL:
+    {
+      GST_OBJECT_LOCK (self);
+      g_value_set_uint64 (value, self->max_poll_interval);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    }
+    case PROP_BURST_SIZE:
+    {
+      GST_OBJECT_LOCK (self);
+      g_value_set_uint (value, self->burst_size);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    }
+    case PROP_KERNEL_TIMESTAMPS:
+    {
+      g_value_set_boolean (value, g_atomic_int_get (&self->kernel_timestamps));
+      break;
+    }
+    case PROP_SLEW_THRESHOLD:
+    {
+      GST_OBJECT_LOCK (self);
+      g_value_set_uint64 (value, self->slew_threshold);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    }
+    case PROP_MAX_SLEW:
+    {
+      GST_OBJECT_LOCK (self);
+      g_value_set_uint (value, self->max_slew_ppm);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    }
+    case PROP_SHM_NAME:
+    {
+      GST_OBJECT_LOCK (self);
+      g_value_set_string (value, self->shm_name);
+      GST_OBJECT_UNLOCK (self);
+      break;
+    }
     default:
     {
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -357,6 +860,13 @@ gst_dvb_css_wc_client_internal_clock_start (GstDvbCssWcClientInternalClock *self
 
   g_assert (servaddr != NULL);
 
+  /* converted once, requests are sent to it without allocating */
+  if (!gst_dvb_css_wc_address_set (&self->server_address, servaddr))
+  {
+    g_object_unref (servaddr);
+    goto unsupported_address;
+  }
+
   GST_INFO_OBJECT (self, "connecting to %s:%d", self->address, self->port);
 
   socket = g_socket_new (family, G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, &error);
@@ -392,9 +902,22 @@ gst_dvb_css_wc_client_internal_clock_start (GstDvbCssWcClientInternalClock *self
   self->cancel = g_cancellable_new ();
   self->made_cancel_fd = g_cancellable_make_pollfd (self->cancel, &dummy_pollfd);
 
+  if (self->kernel_timestamps && !gst_dvb_css_wc_packet_enable_timestamping (socket, FALSE))
+  {
+    self->kernel_timestamps = FALSE;
+  }
+
   self->socket = socket;
   self->servaddr = G_SOCKET_ADDRESS (servaddr);
 
+  /* the first requests go out as a burst of the configured size */
+  GST_OBJECT_LOCK (self);
+  self->burst_remaining  = self->burst_size;
+  self->burst_restart    = FALSE;
+  self->poll_interval    = self->min_poll_interval;
+  self->missed_responses = 0;
+  GST_OBJECT_UNLOCK (self);
+
   self->thread = g_thread_try_new ("GstDvbCssWcClientInternalClock", gst_dvb_css_wc_client_internal_clock_thread, self, &error);
   if (error != NULL)
   {
@@ -424,6 +947,11 @@ getsockname_error:
     g_object_unref (socket);
     return FALSE;
   }
+unsupported_address:
+  {
+    GST_ERROR_OBJECT (self, "unsupported address '%s'", self->address);
+    return FALSE;
+  }
 failed_to_resolve:
   {
     GST_ERROR_OBJECT (self, "resolving '%s' failed: %s",
@@ -480,10 +1008,11 @@ gst_dvb_css_wc_client_internal_clock_thread (gpointer data)
 {
   GstDvbCssWcClientInternalClock *self          = data;
   GSocket                        *socket        = self->socket;
-  gboolean                        success       = FALSE;
   guint8                          last_msg_type = GST_DVB_CSS_WC_MSG_REQUEST;
-  GstDvbCssWcPacket              *resp          = NULL;
+  GstDvbCssWcPacket               resp;
   GstClockTime                    response_time;
+  gint64                          now;
+  gint64                          next_poll     = g_get_monotonic_time ();
 
   GST_TRACE_OBJECT (self, "dvb client clock thread running, socket=%p", socket);
 
@@ -492,136 +1021,219 @@ gst_dvb_css_wc_client_internal_clock_thread (gpointer data)
 
   while (!g_cancellable_is_cancelled (self->cancel))
   {
-    success = gst_dvb_css_wc_client_internal_clock_send_request(data);
-    if(success == TRUE)
+    now = g_get_monotonic_time ();
+    if (now >= next_poll)
     {
-      while( (resp = gst_dvb_css_wc_client_internal_clock_receive_msg(data)) != NULL )
+      gst_dvb_css_wc_client_internal_clock_send_request(data);
+      next_poll = now + gst_dvb_css_wc_client_internal_clock_schedule(self);
+    }
+
+    /* read until the next request is due */
+    if (!gst_dvb_css_wc_client_internal_clock_receive_msg(data, next_poll - now, &resp))
+    {
+      continue;
+    }
+
+    switch(resp.message_type)
+    {
+      case GST_DVB_CSS_WC_MSG_REQUEST:
+      {
+        break;
+      }
+      case GST_DVB_CSS_WC_MSG_RESPONSE:
+      {
+        GST_LOG_OBJECT(self, "RESPONSE received on %" GST_TIME_FORMAT, GST_TIME_ARGS(resp.response_timevalue));
+        gst_dvb_css_wc_client_internal_clock_update(self, &resp);
+        break;
+      }
+      case GST_DVB_CSS_WC_MSG_RESPONSE_WITH_FOLLOWUP:
       {
-        switch(resp->message_type)
+        GST_LOG_OBJECT(self, "RESPONSE received on %" GST_TIME_FORMAT ", wait for FOLLOWUP", GST_TIME_ARGS(resp.response_timevalue));
+        response_time = resp.response_timevalue;
+        break;
+      }
+      case GST_DVB_CSS_WC_MSG_FOLLOWUP:
+      {
+        if(last_msg_type == GST_DVB_CSS_WC_MSG_RESPONSE_WITH_FOLLOWUP)
         {
-          case GST_DVB_CSS_WC_MSG_REQUEST:
-          {
-            continue;
-            break;
-          }
-          case GST_DVB_CSS_WC_MSG_RESPONSE:
-          {
-            GST_LOG_OBJECT(self, "RESPONSE received on %" GST_TIME_FORMAT, GST_TIME_ARGS(resp->response_timevalue));
-            gst_dvb_css_wc_client_internal_clock_update(self, resp);
-          }
-          case GST_DVB_CSS_WC_MSG_RESPONSE_WITH_FOLLOWUP:
-          {
-            GST_LOG_OBJECT(self, "RESPONSE received on %" GST_TIME_FORMAT ", wait for FOLLOWUP", GST_TIME_ARGS(resp->response_timevalue));
-            response_time = resp->response_timevalue;
-            break;
-          }
-          case GST_DVB_CSS_WC_MSG_FOLLOWUP:
-          {
-            if(last_msg_type == GST_DVB_CSS_WC_MSG_RESPONSE_WITH_FOLLOWUP)
-            {
-              // in followup message we use time of receiving the last message
-              GST_LOG_OBJECT(self, "FOLLOWUP received, RESPONSE time is %" GST_TIME_FORMAT, GST_TIME_ARGS(response_time));
-              resp->response_timevalue = response_time;
-              gst_dvb_css_wc_client_internal_clock_update(self, resp);
-            }
-            break;
-          }
-          default:
-          {
-            GST_ERROR_OBJECT (self, "received unsupported message type");
-          }
+          // in followup message we use time of receiving the last message
+          GST_LOG_OBJECT(self, "FOLLOWUP received, RESPONSE time is %" GST_TIME_FORMAT, GST_TIME_ARGS(response_time));
+          resp.response_timevalue = response_time;
+          gst_dvb_css_wc_client_internal_clock_update(self, &resp);
         }
-
-        last_msg_type = resp->message_type;
-        gst_dvb_css_wc_packet_free(resp);
+        break;
+      }
+      default:
+      {
+        GST_ERROR_OBJECT (self, "received unsupported message type");
       }
     }
+
+    last_msg_type = resp.message_type;
   }
   GST_TRACE_OBJECT (self, "shutting down dvb client clock thread");
   return NULL;
 }
 
+/* Called after every request, returns the microseconds until the next one.
+ * Polls at min-poll-interval during a burst, then doubles the interval up to
+ * max-poll-interval for as long as the dispersion the clock gains by waiting
+ * stays below the dispersion of the measurement itself. */
+static gint64
+gst_dvb_css_wc_client_internal_clock_schedule (GstDvbCssWcClientInternalClock *self)
+{
+  GstClockTime min_interval;
+  GstClockTime max_interval;
+  guint        burst_size;
+  gboolean     missed = FALSE;
+  gdouble      jitter;
+
+  GST_OBJECT_LOCK (self);
+  min_interval = self->min_poll_interval;
+  max_interval = MAX (self->max_poll_interval, min_interval);
+  burst_size   = self->burst_size;
+  if (self->burst_restart)
+  {
+    self->burst_remaining = burst_size;
+    self->burst_restart   = FALSE;
+  }
+  GST_OBJECT_UNLOCK (self);
+
+  /* requests of a burst are expected to overtake each other's responses */
+  if (self->burst_remaining == 0)
+  {
+    missed = self->awaiting_response;
+    self->missed_responses = missed ? self->missed_responses + 1 : 0;
+    if (self->missed_responses >= POLL_MAX_MISSED)
+    {
+      GST_INFO_OBJECT (self, "no response to the last %u requests, polling faster", self->missed_responses);
+      self->burst_remaining  = burst_size;
+      self->missed_responses = 0;
+    }
+  }
+  self->awaiting_response = TRUE;
+
+  if (self->burst_remaining > 0)
+  {
+    self->burst_remaining--;
+    self->poll_interval = min_interval;
+  }
+  else if (self->have_best_candidate)
+  {
+    guint64 max_freq_error_ppm = self->max_freq_error_ppm + self->best_candidate.max_freq_error_ppm;
+    GstClockTime growth = gst_util_uint64_scale (2 * self->poll_interval, max_freq_error_ppm, 1000000);
+    if (growth < self->best_candidate.dispersion)
+    {
+      self->poll_interval *= 2;
+    }
+  }
+  self->poll_interval = CLAMP (self->poll_interval, min_interval, max_interval);
+
+  if (missed)
+  {
+    gst_dvb_css_wc_client_internal_clock_report (self, NULL, 0);
+  }
+
+  jitter = g_random_double_range (1.0 - POLL_JITTER, 1.0 + POLL_JITTER);
+  GST_TRACE_OBJECT (self, "next request in %" GST_TIME_FORMAT, GST_TIME_ARGS (self->poll_interval));
+  return (gint64)(GST_TIME_AS_USECONDS (self->poll_interval) * jitter);
+}
+
 static gboolean
 gst_dvb_css_wc_client_internal_clock_send_request (gpointer data)
 {
   GstDvbCssWcClientInternalClock *self    = data;
   GError                         *err     = NULL;
-  GstDvbCssWcPacket              *req;
+  GstDvbCssWcPacket               req;
   GstClockTime                    time;
   gboolean                        success;
 
-  req = gst_dvb_css_wc_packet_new (NULL);
-  req->message_type = GST_DVB_CSS_WC_MSG_REQUEST;
+  gst_dvb_css_wc_packet_parse_into (NULL, &req);
+  req.message_type = GST_DVB_CSS_WC_MSG_REQUEST;
 
   time = gst_clock_get_internal_time( GST_CLOCK_CAST (self));
-  req->originate_timevalue_secs  = gst_clock_time_to_wc_timestamp_seconds(time);
-  req->originate_timevalue_nanos = gst_clock_time_to_wc_timestamp_fraction(time);
+  req.originate_timevalue_secs  = gst_clock_time_to_wc_timestamp_seconds(time);
+  req.originate_timevalue_nanos = gst_clock_time_to_wc_timestamp_fraction(time);
 
-  success = gst_dvb_css_wc_packet_send (req, self->socket, self->servaddr, &err);
+  success = gst_dvb_css_wc_packet_send_to (&req, self->socket, &self->server_address, &err);
   if (err != NULL)
   {
     GST_ERROR_OBJECT (self, "request send error: %s", err->message);
     g_error_free (err);
     err = NULL;
   }
-  gst_dvb_css_wc_packet_free (req);
 
   return success;
 }
 
-static GstDvbCssWcPacket*
-gst_dvb_css_wc_client_internal_clock_receive_msg(gpointer data)
+static gboolean
+gst_dvb_css_wc_client_internal_clock_receive_msg(gpointer data, gint64 timeout, GstDvbCssWcPacket *resp)
 {
   GstDvbCssWcClientInternalClock *self = data;
   GError                         *err  = NULL;
-  GstDvbCssWcPacket              *resp;
   GstClockTime                    time;
 
-  GST_TRACE_OBJECT (self, "set timeout: %" G_GINT64_FORMAT "us", self->socket_timeout);
-  if (!g_socket_condition_timed_wait (self->socket, G_IO_IN, self->socket_timeout, self->cancel, &err))
+  GST_TRACE_OBJECT (self, "set timeout: %" G_GINT64_FORMAT "us", timeout);
+  if (!g_socket_condition_timed_wait (self->socket, G_IO_IN, MAX (timeout, 0), self->cancel, &err))
   {
     /* cancelled, timeout or error */
     if (err->code == G_IO_ERROR_CANCELLED)
     {
       GST_TRACE_OBJECT (self, "cancelled %s", err->message);
       g_clear_error (&err);
-      return NULL;
+      return FALSE;
+    }
+    if (err->code == G_IO_ERROR_TIMED_OUT)
+    {
+      /* next request is due */
+      GST_TRACE_OBJECT (self, "timeout: %s", err->message);
+    }
+    else
+    {
+      GST_WARNING_OBJECT (self, "socket error: %s", err->message);
+      /* try again */
+      g_usleep (G_USEC_PER_SEC / 10);
     }
-    if(err->code == G_IO_ERROR_TIMED_OUT) GST_TRACE_OBJECT (self, "timeout: %s", err->message);
-    else GST_WARNING_OBJECT (self, "socket error: %s", err->message);
-    /* try again */
-    g_usleep (G_USEC_PER_SEC / 10);
     g_error_free (err);
     err = NULL;
-    return NULL;
+    return FALSE;
   }
 
-  /* got data in */
-  time = gst_clock_get_internal_time( GST_CLOCK_CAST (self));
-  resp = gst_dvb_css_wc_packet_receive (self->socket, &self->servaddr, &err);
+  /* got data in, the sender is not needed as only the server answers */
+  if (g_atomic_int_get (&self->kernel_timestamps))
+  {
+    GstClockTimeDiff age;
+    gst_dvb_css_wc_packet_receive_into (self->socket, resp, NULL, &age, &err);
+    time = gst_clock_get_internal_time( GST_CLOCK_CAST (self)) - age;
+  }
+  else
+  {
+    time = gst_clock_get_internal_time( GST_CLOCK_CAST (self));
+    gst_dvb_css_wc_packet_receive_into (self->socket, resp, NULL, NULL, &err);
+  }
   if (err != NULL)
   {
     GST_ERROR_OBJECT (self, "receive error: %s", err->message);
     g_usleep (G_USEC_PER_SEC / 10);
     g_error_free (err);
     err = NULL;
-    return NULL;
+    return FALSE;
   }
 
   resp->response_timevalue = time;
-  return resp;
+  return TRUE;
 }
 
 static void
 gst_dvb_css_wc_client_internal_clock_update(GstDvbCssWcClientInternalClock *self, GstDvbCssWcPacket *pkt)
 {
-  Candidate    *candidate            = NULL;
-  GstClockTime  current_dispersion   = G_MAXUINT64;
-  GstClockTime  candidate_dispersion;
-  GstClockTime  internal             = 0;
-  GstClockTime  external             = 0;
-  GstClockTime  rate_num             = 0;
-  GstClockTime  rate_denom           = 0;
+  Candidate                candidate;
+  GstClockTime             current_dispersion   = G_MAXUINT64;
+  GstClockTime             internal             = 0;
+  GstClockTime             external             = 0;
+  GstClockTimeDiff         offset               = 0;
+  gdouble                  drift                = 0;
+  GstDvbCssWcClientFilter  filter;
 
   if(pkt == NULL)
   {
@@ -633,33 +1245,241 @@ gst_dvb_css_wc_client_internal_clock_update(GstDvbCssWcClientInternalClock *self
     return;
   }
 
-  if(self->best_candidate != NULL)
+  GST_OBJECT_LOCK (self);
+  filter = self->filter;
+  GST_OBJECT_UNLOCK (self);
+
+  if(self->have_best_candidate)
   {
-    current_dispersion = calc_dispersion(GST_CLOCK_CAST (self), self->clock_precision_sec, self->max_freq_error_ppm, self->best_candidate);
+    current_dispersion = calc_dispersion(GST_CLOCK_CAST (self), self->clock_precision_sec, self->max_freq_error_ppm, &self->best_candidate);
   }
 
-  candidate = candidate_new(pkt);
-  if(candidate != NULL)
+  self->awaiting_response = FALSE;
+
+  candidate_init(&candidate, pkt);
+  candidate.dispersion = calc_dispersion( GST_CLOCK_CAST (self), self->clock_precision_sec, self->max_freq_error_ppm, &candidate);
+
+  self->history[self->history_next] = candidate;
+  self->history_next = (self->history_next + 1) % CANDIDATE_HISTORY_SIZE;
+  self->history_count = MIN (self->history_count + 1, CANDIDATE_HISTORY_SIZE);
+
+  GST_LOG_OBJECT(self, "Current dispersion: %" G_GUINT64_FORMAT " \tCandidate dispersion: %" G_GUINT64_FORMAT "\n", current_dispersion, candidate.dispersion);
+  if(current_dispersion >= candidate.dispersion)
+  {
+    self->best_candidate = candidate;
+    self->have_best_candidate = TRUE;
+  }
+
+  if(estimate_drift(self->history, self->history_count, &drift))
   {
-    candidate_dispersion = calc_dispersion( GST_CLOCK_CAST (self), self->clock_precision_sec, self->max_freq_error_ppm, candidate);
-    GST_LOG_OBJECT(self, "Current dispersion: %" G_GUINT64_FORMAT " \tCandidate dispersion: %" G_GUINT64_FORMAT "\n", current_dispersion, candidate_dispersion);
-    if(current_dispersion >= candidate_dispersion)
+    /* a fit beyond what both ends declare they can drift is noise, keep the last rate */
+    gdouble max_drift = (self->max_freq_error_ppm + candidate.max_freq_error_ppm) / 1000000.0;
+    if(ABS (drift) <= max_drift)
     {
-      GST_DEBUG_OBJECT(self, "Clock updated. Offset: %" G_GINT64_FORMAT "\n", candidate->offset);
-      if(self->best_candidate != NULL)
-      {
-        g_free(self->best_candidate);
-      }
-      self->best_candidate = candidate;
-      gst_clock_get_calibration (GST_CLOCK_CAST (self), &internal, &external, &rate_num, &rate_denom);
-      gst_clock_set_calibration (GST_CLOCK_CAST (self), internal, candidate->offset, rate_num, rate_denom);
-      gst_clock_set_synced( GST_CLOCK (self), TRUE);
+      self->rate_num = (GstClockTime)(RATE_DENOM * (1.0 + drift) + 0.5);
+      GST_DEBUG_OBJECT(self, "Estimated frequency error: %.3f ppm", drift * 1000000.0);
     }
     else
     {
-      g_free(candidate);
+      GST_DEBUG_OBJECT(self, "Ignoring frequency error estimate of %.3f ppm", drift * 1000000.0);
+    }
+  }
+  drift = (gdouble)self->rate_num / RATE_DENOM - 1.0;
+
+  if(filter == GST_DVB_CSS_WC_CLIENT_FILTER_DISPERSION)
+  {
+    /* the best candidate measured the offset at its local midpoint, extrapolate from there */
+    internal = self->best_candidate.t1 / 2 + self->best_candidate.t4 / 2;
+    offset   = self->best_candidate.offset;
+  }
+  else
+  {
+    internal = candidate.t1 / 2 + candidate.t4 / 2;
+    offset   = candidate.offset + (GstClockTimeDiff)filter_offset(filter, self->history, self->history_count, internal, candidate.offset, drift);
+  }
+
+  GST_DEBUG_OBJECT(self, "Clock updated. Offset: %" G_GINT64_FORMAT "\n", offset);
+  external = internal + offset;
+  if(!gst_dvb_css_wc_client_internal_clock_slew(self, internal, external))
+  {
+    gst_clock_set_calibration (GST_CLOCK_CAST (self), internal, external, self->rate_num, RATE_DENOM);
+  }
+  gst_clock_set_synced( GST_CLOCK (self), TRUE);
+  gst_dvb_css_wc_client_internal_clock_publish (self);
+  gst_dvb_css_wc_client_internal_clock_report (self, &candidate, offset);
+}
+
+/* Updates the statistics after a response to candidate, or after a request
+ * went unanswered when candidate is NULL, and posts them on the busses of the
+ * client clocks sharing this one. Only called from the client thread. */
+static void
+gst_dvb_css_wc_client_internal_clock_report (GstDvbCssWcClientInternalClock *self, const Candidate *candidate, GstClockTimeDiff offset)
+{
+  GstDvbCssWcClientStats  stats;
+  GstStructure           *s;
+  GList                  *busses, *l;
+
+  g_atomic_int_inc (&self->stats_seq);
+  if (candidate != NULL)
+  {
+    self->stats.offset = offset;
+    self->stats.rtt    = (GstClockTime) MAX (candidate->rtt, 0);
+    self->stats.responses++;
+  }
+  else
+  {
+    self->stats.missed_responses++;
+  }
+  if (self->have_best_candidate)
+  {
+    self->stats.dispersion = self->best_candidate.dispersion;
+    self->stats.received   = self->best_candidate.t4;
+    self->stats.growth_ppm = self->max_freq_error_ppm + self->best_candidate.max_freq_error_ppm;
+  }
+  self->stats.poll_interval  = self->poll_interval;
+  self->stats.freq_error_ppm = ((gdouble)self->rate_num / RATE_DENOM - 1.0) * 1000000.0;
+  g_atomic_int_inc (&self->stats_seq);
+
+  if (!gst_dvb_css_wc_client_internal_clock_get_stats (self, &stats))
+  {
+    return;
+  }
+
+  s = gst_structure_new ("dvbcsswc-clock-statistics",
+      "synchronised",     G_TYPE_BOOLEAN, stats.synced,
+      "offset",           G_TYPE_INT64,   stats.offset,
+      "rtt",              G_TYPE_UINT64,  stats.rtt,
+      "dispersion",       G_TYPE_UINT64,  stats.dispersion,
+      "candidate-age",    G_TYPE_UINT64,  stats.candidate_age,
+      "poll-interval",    G_TYPE_UINT64,  stats.poll_interval,
+      "freq-error-ppm",   G_TYPE_DOUBLE,  stats.freq_error_ppm,
+      "responses",        G_TYPE_UINT64,  stats.responses,
+      "missed-responses", G_TYPE_UINT64,  stats.missed_responses,
+      NULL);
+  /* gst_bus_post can run sync handlers, which must not find the clock locked */
+  GST_OBJECT_LOCK (self);
+  busses = g_list_copy_deep (self->busses, (GCopyFunc) gst_object_ref, NULL);
+  GST_OBJECT_UNLOCK (self);
+  for (l = busses; l; l = l->next)
+  {
+    gst_bus_post (l->data, gst_message_new_element (GST_OBJECT (self), gst_structure_copy (s)));
+  }
+  g_list_free_full (busses, (GDestroyNotify) gst_object_unref);
+  gst_structure_free (s);
+}
+
+/* Lock-free, can be called from any thread */
+static gboolean
+gst_dvb_css_wc_client_internal_clock_get_stats (GstDvbCssWcClientInternalClock *self, GstDvbCssWcClientStats *stats)
+{
+  ClientStats   copy;
+  GstClockTime  now;
+  guint         attempt;
+
+  for (attempt = 0; attempt < STATS_READ_ATTEMPTS; attempt++)
+  {
+    /* the additions are full barriers, unlike plain atomic reads on every platform */
+    gint begin = g_atomic_int_add (&self->stats_seq, 0);
+    if (begin & 1)
+    {
+      continue;
     }
+    copy = self->stats;
+    if (g_atomic_int_add (&self->stats_seq, 0) == begin)
+    {
+      break;
+    }
+  }
+  if (attempt == STATS_READ_ATTEMPTS)
+  {
+    return FALSE;
+  }
+
+  stats->synced           = gst_clock_is_synced (GST_CLOCK_CAST (self));
+  stats->offset           = copy.offset;
+  stats->rtt              = copy.rtt;
+  stats->dispersion       = copy.dispersion;
+  stats->candidate_age    = GST_CLOCK_TIME_NONE;
+  stats->poll_interval    = copy.poll_interval;
+  stats->freq_error_ppm   = copy.freq_error_ppm;
+  stats->responses        = copy.responses;
+  stats->missed_responses = copy.missed_responses;
+
+  if (GST_CLOCK_TIME_IS_VALID (copy.received))
+  {
+    now = gst_clock_get_internal_time (GST_CLOCK_CAST (self));
+    stats->candidate_age = now > copy.received ? now - copy.received : 0;
+    stats->dispersion   += gst_util_uint64_scale (stats->candidate_age, copy.growth_ppm, 1000000);
   }
+  return TRUE;
+}
+
+/* Hands the current calibration to the clocks reading it from shared memory */
+static void
+gst_dvb_css_wc_client_internal_clock_publish (GstDvbCssWcClientInternalClock *self)
+{
+  GstClock     *clock = GST_CLOCK_CAST (self);
+  GstClockTime  internal, external, rate_num, rate_denom;
+  gboolean      synced;
+
+  /* both take the OBJECT_LOCK */
+  gst_clock_get_calibration (clock, &internal, &external, &rate_num, &rate_denom);
+  synced = gst_clock_is_synced (clock);
+
+  GST_OBJECT_LOCK (self);
+  if (self->shm_writer != NULL)
+  {
+    gst_dvb_css_wc_shm_writer_publish (self->shm_writer, synced, internal, external, rate_num, rate_denom,
+        self->have_best_candidate ? self->best_candidate.dispersion : GST_CLOCK_TIME_NONE);
+  }
+  GST_OBJECT_UNLOCK (self);
+}
+
+/* Moves the clock towards the calibration internal/external at rate_num
+ * without a jump, by running it slightly fast or slow from now on. Each
+ * update recomputes the remaining error, so the rate settles back to rate_num
+ * once the error is gone. Returns FALSE if the clock should be stepped: when
+ * it was not synced yet, slewing is off or the error is above the threshold. */
+static gboolean
+gst_dvb_css_wc_client_internal_clock_slew (GstDvbCssWcClientInternalClock *self, GstClockTime internal, GstClockTime external)
+{
+  GstClock         *clock = GST_CLOCK_CAST (self);
+  GstClockTime      slew_threshold;
+  guint             max_slew_ppm;
+  GstClockTime      c_internal, c_external, c_num, c_denom;
+  GstClockTime      now, current, target, period;
+  GstClockTimeDiff  error;
+  gdouble           slew;
+
+  GST_OBJECT_LOCK (self);
+  slew_threshold = self->slew_threshold;
+  max_slew_ppm   = self->max_slew_ppm;
+  GST_OBJECT_UNLOCK (self);
+
+  if(slew_threshold == 0 || !gst_clock_is_synced (clock))
+  {
+    return FALSE;
+  }
+
+  now = gst_clock_get_internal_time (clock);
+  gst_clock_get_calibration (clock, &c_internal, &c_external, &c_num, &c_denom);
+  current = gst_clock_adjust_with_calibration (clock, now, c_internal, c_external, c_num, c_denom);
+  target  = gst_clock_adjust_with_calibration (clock, now, internal, external, self->rate_num, RATE_DENOM);
+  error   = GST_CLOCK_DIFF (current, target);
+
+  if((GstClockTime) ABS (error) > slew_threshold)
+  {
+    GST_INFO_OBJECT(self, "Stepping clock by %" G_GINT64_FORMAT " ns", error);
+    return FALSE;
+  }
+
+  /* the next poll comes at most two intervals later, so the correction never overshoots */
+  period = MAX (2 * self->poll_interval, SLEW_MIN_PERIOD);
+  slew   = CLAMP ((gdouble) error / period, -(max_slew_ppm / 1000000.0), max_slew_ppm / 1000000.0);
+
+  GST_DEBUG_OBJECT(self, "Slewing clock by %" G_GINT64_FORMAT " ns at %.3f ppm", error, slew * 1000000.0);
+  gst_clock_set_calibration (clock, now, current, (GstClockTime)(self->rate_num + slew * RATE_DENOM + 0.5), RATE_DENOM);
+  return TRUE;
 }
 
 //==============================================================================
@@ -679,6 +1499,9 @@ struct _GstDvbCssWcClientClockPrivate
   gint          port;
   GstBus       *bus;
   gulong        synced_id;
+  /* settings shared through the internal clock that were set before it existed */
+  GstStructure *pending_settings;
+  gchar        *shm_name;
 };
 
 
@@ -688,8 +1511,12 @@ struct _GstDvbCssWcClientClockPrivate
 
 typedef struct
 {
-  GstClock *clock;              /* GstDvbCssWcClientInternalClock */
+  /* GstDvbCssWcClientInternalClock, or GstDvbCssWcShmClock when another
+   * process already published the server's time in the clocks' "shm-name" */
+  GstClock *clock;
   GList    *clocks;             /* GstDvbCssWcClientClocks */
+  gchar    *address;
+  gint      port;
 
   GstClockID remove_id;
 } ClockCache;
@@ -719,11 +1546,9 @@ finalize_clock_cache (GObject *object)
     if (cache->clock == self->priv->internal_clock)
     {
       cache->clocks = g_list_remove (cache->clocks, self);
-      if (cache->clocks)
-      {
-        update_clock_cache (cache);
-      }
-      else
+      /* also drops the last bus while the internal clock lingers */
+      update_clock_cache (cache);
+      if (!cache->clocks)
       {
         GstClock *sysclock = gst_system_clock_obtain ();
         GstClockTime time = gst_clock_get_time (sysclock) + 60 * GST_SECOND;
@@ -762,6 +1587,12 @@ update_clock_cache (ClockCache * cache)
   GList *l      = NULL;
   GList *busses = NULL;
 
+  /* a shm clock posts nothing */
+  if (!GST_IS_DVB_CSS_WC_CLIENT_INTERNAL_CLOCK (cache->clock))
+  {
+    return;
+  }
+
   GST_OBJECT_LOCK (cache->clock);
 
   g_list_free_full (GST_DVB_CSS_WC_CLIENT_INTERNAL_CLOCK (cache->clock)->busses, (GDestroyNotify) gst_object_unref);
@@ -790,9 +1621,8 @@ constructed_clock_cache (GObject *object)
   for (l = clocks; l; l = l->next)
   {
     ClockCache *tmp = l->data;
-    GstDvbCssWcClientInternalClock *internal_clock = GST_DVB_CSS_WC_CLIENT_INTERNAL_CLOCK (tmp->clock);
 
-    if (strcmp (internal_clock->address, self->priv->address) == 0 && internal_clock->port == self->priv->port)
+    if (strcmp (tmp->address, self->priv->address) == 0 && tmp->port == self->priv->port)
     {
       cache = tmp;
       if (cache->remove_id)
@@ -807,7 +1637,18 @@ constructed_clock_cache (GObject *object)
   if (!cache)
   {
     cache = g_new0 (ClockCache, 1);
-    cache->clock = g_object_new (GST_TYPE_DVB_CSS_WC_CLIENT_INTERNAL_CLOCK, "address", self->priv->address, "port", self->priv->port, NULL);
+    cache->address = g_strdup (self->priv->address);
+    cache->port    = self->priv->port;
+    /* one client per host talks to the server, the others read its time */
+    if (self->priv->shm_name != NULL && gst_dvb_css_wc_shm_is_published (self->priv->shm_name))
+    {
+      GST_INFO_OBJECT (self, "reading the time published in %s", self->priv->shm_name);
+      cache->clock = gst_dvb_css_wc_shm_clock_new (NULL, self->priv->shm_name);
+    }
+    else
+    {
+      cache->clock = g_object_new (GST_TYPE_DVB_CSS_WC_CLIENT_INTERNAL_CLOCK, "address", self->priv->address, "port", self->priv->port, NULL);
+    }
     clocks = g_list_prepend (clocks, cache);
 
     /* Not actually leaked but is cached for a while before being disposed,
@@ -817,6 +1658,8 @@ constructed_clock_cache (GObject *object)
   }
 
   cache->clocks = g_list_prepend (cache->clocks, self);
+  /* picks up a bus given at construction */
+  update_clock_cache (cache);
 
   G_UNLOCK (clocks_lock);
 
@@ -834,6 +1677,7 @@ remove_clock_cache (GstClock *clock, GstClockTime time, GstClockID id, gpointer
     gst_clock_id_unref (cache->remove_id);
     gst_object_unref (cache->clock);
     clocks = g_list_remove (clocks, cache);
+    g_free (cache->address);
     g_free (cache);
   }
   G_UNLOCK (clocks_lock);
@@ -906,6 +1750,48 @@ gst_dvb_css_wc_client_clock_class_init (GstDvbCssWcClientClockClass *klass)
       g_param_spec_object ("internal-clock", "Internal Clock",
           "Internal clock that directly slaved to the remote clock",
           GST_TYPE_CLOCK, G_PARAM_READABLE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_FILTER,
+      g_param_spec_enum ("filter", "Filter",
+          "How the offset is picked from the recent candidates. Shared by all clocks of the same server",
+          GST_TYPE_DVB_CSS_WC_CLIENT_FILTER, DEFAULT_FILTER,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+
+  g_object_class_install_property (gobject_class, PROP_MIN_POLL_INTERVAL,
+      g_param_spec_uint64 ("min-poll-interval", "Minimum poll interval",
+          "Interval between the requests of a burst, sent at start up and when the server stops answering. Shared by all clocks of the same server", 1,
+          G_MAXUINT64, DEFAULT_MIN_POLL_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MAX_POLL_INTERVAL,
+      g_param_spec_uint64 ("max-poll-interval", "Maximum poll interval",
+          "Longest interval between requests once the clock is stable. Shared by all clocks of the same server", 1,
+          G_MAXUINT64, DEFAULT_MAX_POLL_INTERVAL,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_BURST_SIZE,
+      g_param_spec_uint ("burst-size", "Burst size",
+          "Number of requests sent at the minimum poll interval to converge quickly. Shared by all clocks of the same server", 1,
+          CANDIDATE_HISTORY_SIZE, DEFAULT_BURST_SIZE,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_KERNEL_TIMESTAMPS,
+      g_param_spec_boolean ("kernel-timestamps", "Kernel timestamps",
+          "Take the time responses arrive from kernel socket timestamps (Linux only). Shared by all clocks of the same server",
+          DEFAULT_KERNEL_TIMESTAMPS,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_SLEW_THRESHOLD,
+      g_param_spec_uint64 ("slew-threshold", "Slew threshold",
+          "Offset corrections up to this size are slewed by adjusting the rate, larger ones step the clock (0 = always step). Shared by all clocks of the same server", 0,
+          G_MAXUINT64, DEFAULT_SLEW_THRESHOLD,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_MAX_SLEW,
+      g_param_spec_uint ("max-slew", "Maximum slew",
+          "Largest rate adjustment in ppm used to slew the clock. Shared by all clocks of the same server", 1,
+          100000, DEFAULT_MAX_SLEW_PPM,
+          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_SHM_NAME,
+      g_param_spec_string ("shm-name", "Shared memory name",
+          "Publish the calibration in this shared memory segment for GstDvbCssWcShmClocks in other processes, or read it from there without polling the server if another process already publishes (NULL = off). Shared by all clocks of the same server",
+          DEFAULT_SHM_NAME,
+          G_PARAM_READWRITE | G_PARAM_CONSTRUCT | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -923,6 +1809,8 @@ gst_dvb_css_wc_client_clock_init (GstDvbCssWcClientClock *self)
   priv->port                    = DEFAULT_PORT;
   priv->address                 = g_strdup (DEFAULT_ADDRESS);
   priv->base_time               = DEFAULT_BASE_TIME;
+  priv->pending_settings        = gst_structure_new_empty ("settings");
+  priv->shm_name                = g_strdup (DEFAULT_SHM_NAME);
   priv->internal_base_time      = gst_clock_get_time (clock);
 
   gst_object_unref (clock);
@@ -944,6 +1832,12 @@ gst_dvb_css_wc_client_clock_finalize (GObject *object)
   g_free (self->priv->address);
   self->priv->address = NULL;
 
+  g_free (self->priv->shm_name);
+  self->priv->shm_name = NULL;
+
+  gst_structure_free (self->priv->pending_settings);
+  self->priv->pending_settings = NULL;
+
   if (self->priv->bus != NULL)
   {
     gst_object_unref (self->priv->bus);
@@ -953,6 +1847,49 @@ gst_dvb_css_wc_client_clock_finalize (GObject *object)
   G_OBJECT_CLASS (gst_dvb_css_wc_client_clock_parent_class)->finalize (object);
 }
 
+/* Settings shared by all clocks of the same server live in the internal clock.
+ * Until it exists they wait in pending_settings, so that a new clock only
+ * forwards what its caller set and does not reset the others to defaults.
+ * Clocks reading a published time keep them there, they do not poll. */
+static void
+gst_dvb_css_wc_client_clock_set_shared (GstDvbCssWcClientClock *self, GParamSpec *pspec, const GValue *value)
+{
+  if (GST_IS_DVB_CSS_WC_CLIENT_INTERNAL_CLOCK (self->priv->internal_clock))
+  {
+    g_object_set_property (G_OBJECT (self->priv->internal_clock), pspec->name, value);
+  }
+  else
+  {
+    gst_structure_set_value (self->priv->pending_settings, pspec->name, value);
+  }
+}
+
+static void
+gst_dvb_css_wc_client_clock_get_shared (GstDvbCssWcClientClock *self, GParamSpec *pspec, GValue *value)
+{
+  const GValue *pending = gst_structure_get_value (self->priv->pending_settings, pspec->name);
+
+  if (GST_IS_DVB_CSS_WC_CLIENT_INTERNAL_CLOCK (self->priv->internal_clock))
+  {
+    g_object_get_property (G_OBJECT (self->priv->internal_clock), pspec->name, value);
+  }
+  else if (pending != NULL)
+  {
+    g_value_copy (pending, value);
+  }
+  else
+  {
+    g_param_value_set_default (pspec, value);
+  }
+}
+
+static gboolean
+gst_dvb_css_wc_client_clock_forward_setting (GQuark field, const GValue *value, gpointer internal_clock)
+{
+  g_object_set_property (G_OBJECT (internal_clock), g_quark_to_string (field), value);
+  return TRUE;
+}
+
 static void
 gst_dvb_css_wc_client_clock_set_property (GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
 {
@@ -1001,6 +1938,51 @@ gst_dvb_css_wc_client_clock_set_property (GObject *object, guint prop_id, const
       gst_object_unref (clock);
       break;
     }
+    case PROP_FILTER:
+    {
+      gst_dvb_css_wc_client_clock_set_shared (self, pspec, value);
+      break;
+    }
+    case PROP_MIN_POLL_INTERVAL:
+    {
+      gst_dvb_css_wc_client_clock_set_shared (self, pspec, value);
+      break;
+    }
+    case PROP_MAX_POLL_INTERVAL:
+    {
+      gst_dvb_css_wc_client_clock_set_shared (self, pspec, value);
+      break;
+    }
+    case PROP_BURST_SIZE:
+    {
+      gst_dvb_css_wc_client_clock_set_shared (self, pspec, value);
+      break;
+    }
+    case PROP_KERNEL_TIMESTAMPS:
+    {
+      gst_dvb_css_wc_client_clock_set_shared (self, pspec, value);
+      break;
+    }
+    case PROP_SLEW_THRESHOLD:
+    {
+      gst_dvb_css_wc_client_clock_set_shared (self, pspec, value);
+      break;
+    }
+    case PROP_MAX_SLEW:
+    {
+      gst_dvb_css_wc_client_clock_set_shared (self, pspec, value);
+      break;
+    }
+    case PROP_SHM_NAME:
+    {
+      g_free (self->priv->shm_name);
+      self->priv->shm_name = g_value_dup_string (value);
+      if (GST_IS_DVB_CSS_WC_CLIENT_INTERNAL_CLOCK (self->priv->internal_clock))
+      {
+        g_object_set (self->priv->internal_clock, "shm-name", self->priv->shm_name, NULL);
+      }
+      break;
+    }
     default:
     {
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -1050,6 +2032,46 @@ gst_dvb_css_wc_client_clock_get_property (GObject *object, guint prop_id, GValue
       g_value_set_object (value, self->priv->internal_clock);
       break;
     }
+    case PROP_FILTER:
+    {
+      gst_dvb_css_wc_client_clock_get_shared (self, pspec, value);
+      break;
+    }
+    case PROP_MIN_POLL_INTERVAL:
+    {
+      gst_dvb_css_wc_client_clock_get_shared (self, pspec, value);
+      break;
+    }
+    case PROP_MAX_POLL_INTERVAL:
+    {
+      gst_dvb_css_wc_client_clock_get_shared (self, pspec, value);
+      break;
+    }
+    case PROP_BURST_SIZE:
+    {
+      gst_dvb_css_wc_client_clock_get_shared (self, pspec, value);
+      break;
+    }
+    case PROP_KERNEL_TIMESTAMPS:
+    {
+      gst_dvb_css_wc_client_clock_get_shared (self, pspec, value);
+      break;
+    }
+    case PROP_SLEW_THRESHOLD:
+    {
+      gst_dvb_css_wc_client_clock_get_shared (self, pspec, value);
+      break;
+    }
+    case PROP_MAX_SLEW:
+    {
+      gst_dvb_css_wc_client_clock_get_shared (self, pspec, value);
+      break;
+    }
+    case PROP_SHM_NAME:
+    {
+      g_value_set_string (value, self->priv->shm_name);
+      break;
+    }
     default:
     {
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
@@ -1078,6 +2100,18 @@ gst_dvb_css_wc_client_clock_constructed (GObject *object)
   GST_OBJECT_UNLOCK (cache->clock);
 
   self->priv->internal_clock = internal_clock = cache->clock;
+  if (!GST_IS_DVB_CSS_WC_CLIENT_INTERNAL_CLOCK (internal_clock))
+  {
+    return;
+  }
+  /* only what was set explicitly, the other clocks of the same server may have set the rest */
+  gst_structure_foreach (self->priv->pending_settings, gst_dvb_css_wc_client_clock_forward_setting, internal_clock);
+  gst_structure_remove_all_fields (self->priv->pending_settings);
+  /* another clock of the same server may already publish */
+  if (self->priv->shm_name != NULL)
+  {
+    g_object_set (internal_clock, "shm-name", self->priv->shm_name, NULL);
+  }
 }
 
 static void
@@ -1131,3 +2165,42 @@ gst_dvb_css_wc_client_clock_new (const gchar *name, const gchar *remote_address,
   ret = g_object_new (GST_TYPE_DVB_CSS_WC_CLIENT_CLOCK, "address", remote_address, "port", remote_port, "base-time", base_time, NULL);
   return ret;
 }
+
+/**
+ * gst_dvb_css_wc_client_clock_get_stats:
+ * @clock: a #GstDvbCssWcClientClock
+ * @stats: (out): where to store the statistics
+ *
+ * Reads the current synchronization statistics of @clock, without locking.
+ *
+ * Returns: TRUE if @stats was filled in.
+ */
+gboolean
+gst_dvb_css_wc_client_clock_get_stats (GstClock *clock, GstDvbCssWcClientStats *stats)
+{
+  GstDvbCssWcClientClock *self;
+
+  g_return_val_if_fail (GST_IS_DVB_CSS_WC_CLIENT_CLOCK (clock), FALSE);
+  g_return_val_if_fail (stats != NULL, FALSE);
+
+  self = GST_DVB_CSS_WC_CLIENT_CLOCK (clock);
+  if (self->priv->internal_clock == NULL)
+  {
+    return FALSE;
+  }
+  if (GST_IS_DVB_CSS_WC_SHM_CLOCK (self->priv->internal_clock))
+  {
+    /* the publisher keeps the rest to itself */
+    stats->synced           = gst_clock_is_synced (self->priv->internal_clock);
+    stats->offset           = 0;
+    stats->rtt              = GST_CLOCK_TIME_NONE;
+    stats->dispersion       = gst_dvb_css_wc_shm_clock_get_dispersion (self->priv->internal_clock);
+    stats->candidate_age    = GST_CLOCK_TIME_NONE;
+    stats->poll_interval    = GST_CLOCK_TIME_NONE;
+    stats->freq_error_ppm   = 0.0;
+    stats->responses        = 0;
+    stats->missed_responses = 0;
+    return TRUE;
+  }
+  return gst_dvb_css_wc_client_internal_clock_get_stats (GST_DVB_CSS_WC_CLIENT_INTERNAL_CLOCK (self->priv->internal_clock), stats);
+}
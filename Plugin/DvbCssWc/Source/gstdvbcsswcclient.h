@@ -37,6 +37,53 @@ G_BEGIN_DECLS
 #define GST_IS_DVB_CSS_WC_CLIENT_CLOCK(obj)         (G_TYPE_CHECK_INSTANCE_TYPE((obj), GST_TYPE_DVB_CSS_WC_CLIENT_CLOCK))
 #define GST_IS_DVB_CSS_WC_CLIENT_CLOCK_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass),  GST_TYPE_DVB_CSS_WC_CLIENT_CLOCK))
 
+#define GST_TYPE_DVB_CSS_WC_CLIENT_FILTER           (gst_dvb_css_wc_client_filter_get_type())
+
+/**
+ * GstDvbCssWcClientFilter:
+ * @GST_DVB_CSS_WC_CLIENT_FILTER_DISPERSION: follow the single candidate with the lowest dispersion
+ * @GST_DVB_CSS_WC_CLIENT_FILTER_LOWEST_RTT: mean offset of the quarter of the history with the lowest round-trip time
+ * @GST_DVB_CSS_WC_CLIENT_FILTER_MEDIAN: median offset of the history
+ * @GST_DVB_CSS_WC_CLIENT_FILTER_HUBER: Huber-weighted mean offset of the history
+ *
+ * How the client clock picks its offset from the recent candidates.
+ */
+typedef enum
+{
+  GST_DVB_CSS_WC_CLIENT_FILTER_DISPERSION,
+  GST_DVB_CSS_WC_CLIENT_FILTER_LOWEST_RTT,
+  GST_DVB_CSS_WC_CLIENT_FILTER_MEDIAN,
+  GST_DVB_CSS_WC_CLIENT_FILTER_HUBER
+} GstDvbCssWcClientFilter;
+
+/**
+ * GstDvbCssWcClientStats:
+ * @synced: whether the clock is synchronized to the server
+ * @offset: offset of the server time from the local time applied by the last update, in nanoseconds
+ * @rtt: round-trip time of the last response, or GST_CLOCK_TIME_NONE before the first one
+ * @dispersion: bound on the current error of the best candidate, it grows while no better one arrives
+ * @candidate_age: time since the best candidate was received
+ * @poll_interval: current interval between requests
+ * @freq_error_ppm: estimated frequency error of the local clock, in parts per million
+ * @responses: number of responses received
+ * @missed_responses: number of requests that went unanswered
+ *
+ * Synchronization quality of a #GstDvbCssWcClientClock, see
+ * gst_dvb_css_wc_client_clock_get_stats().
+ */
+typedef struct
+{
+  gboolean          synced;
+  GstClockTimeDiff  offset;
+  GstClockTime      rtt;
+  GstClockTime      dispersion;
+  GstClockTime      candidate_age;
+  GstClockTime      poll_interval;
+  gdouble           freq_error_ppm;
+  guint64           responses;
+  guint64           missed_responses;
+} GstDvbCssWcClientStats;
+
 typedef struct _GstDvbCssWcClientClock        GstDvbCssWcClientClock;
 typedef struct _GstDvbCssWcClientClockClass   GstDvbCssWcClientClockClass;
 typedef struct _GstDvbCssWcClientClockPrivate GstDvbCssWcClientClockPrivate;
@@ -74,11 +121,33 @@ struct _GstDvbCssWcClientClockClass
  * provided by the #GstDvbCssWcServer on @remote_address and 
  * @remote_port.
  *
+ * If the "shm-name" property is set at construction and another process
+ * already publishes in it, the clock reads the time from there instead of
+ * polling the server itself, and keeps doing so while it lives.
+ *
  * Returns: a new #GstClock that receives a time from the remote
  * clock.
  */
 GstClock*	gst_dvb_css_wc_client_clock_new      (const gchar *name, const gchar *remote_address, gint remote_port, GstClockTime base_time);
+
+/**
+ * gst_dvb_css_wc_client_clock_get_stats:
+ * @clock: a #GstDvbCssWcClientClock
+ * @stats: (out): where to store the statistics
+ *
+ * Reads the current synchronization statistics of @clock without blocking
+ * the thread that updates them. The same values are posted as
+ * "dvbcsswc-clock-statistics" element messages on the #GstBus set in the
+ * "bus" property, after every response and every unanswered request.
+ * A clock that reads the time another process publishes in its "shm-name"
+ * only knows whether that process is synced and its dispersion, it posts
+ * nothing.
+ *
+ * Returns: TRUE if @stats was filled in.
+ */
+gboolean  gst_dvb_css_wc_client_clock_get_stats (GstClock *clock, GstDvbCssWcClientStats *stats);
 GType     gst_dvb_css_wc_client_clock_get_type (void);
+GType     gst_dvb_css_wc_client_filter_get_type (void);
 
 #ifdef G_DEFINE_AUTOPTR_CLEANUP_FUNC
 G_DEFINE_AUTOPTR_CLEANUP_FUNC(GstDvbCssWcClientClock, gst_object_unref)
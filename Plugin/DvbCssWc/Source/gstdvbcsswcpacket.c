@@ -22,13 +22,30 @@
 #endif
 
 #include <glib.h>
+#include <gio/gnetworking.h>
 #include <math.h>
+#include <string.h>
+
+#ifndef G_OS_WIN32
+# include <errno.h>
+#endif
 
 #ifdef __CYGWIN__
 # include <unistd.h>
 # include <fcntl.h>
 #endif
 
+#ifdef __linux__
+# include <poll.h>
+# include <time.h>
+# include <sys/socket.h>
+# include <netinet/in.h>
+# include <linux/net_tstamp.h>
+# include <linux/errqueue.h>
+/* How long to wait for the kernel to report the transmit timestamp of a packet */
+# define TX_TIMESTAMP_TIMEOUT_MS 5
+#endif
+
 #include "gstdvbcsswcpacket.h"
 
 GST_DEBUG_CATEGORY_STATIC (dvbcss_wc_packet);
@@ -83,6 +100,49 @@ gst_clock_time_to_wc_timestamp_fraction (GstClockTime gst)
             GST_TIME_ARGS(packet->response_timevalue)); \
     }
 
+/**
+ * gst_dvb_css_wc_packet_parse_into:
+ * @buffer: (array): a buffer received over the network, or NULL
+ * @packet: (out caller-allocates): the packet to fill in
+ *
+ * Like gst_dvb_css_wc_packet_new(), but fills in a packet owned by the
+ * caller, typically on its stack, so that nothing is allocated.
+ *
+ * MT safe.
+ */
+void
+gst_dvb_css_wc_packet_parse_into (const guint8 * buffer,
+    GstDvbCssWcPacket * packet)
+{
+  g_assert (sizeof (GstClockTime) == 8);
+
+  if (buffer) {
+      packet->version = GST_READ_UINT8(buffer);
+      packet->message_type = GST_READ_UINT8(buffer + 1);
+      packet->precision = GST_READ_UINT8(buffer + 2);
+      packet->reserved = GST_READ_UINT8(buffer + 3);
+      packet->max_freq_error = GST_READ_UINT32_BE(buffer + 4);
+      
+      packet->originate_timevalue_secs = GST_READ_UINT32_BE(buffer + 8);
+      packet->originate_timevalue_nanos = GST_READ_UINT32_BE(buffer + 12);
+      packet->receive_timevalue = wc_timestamp_to_gst_clock_time(GST_READ_UINT32_BE(buffer + 16), GST_READ_UINT32_BE(buffer + 20));
+      packet->transmit_timevalue = wc_timestamp_to_gst_clock_time(GST_READ_UINT32_BE(buffer + 24), GST_READ_UINT32_BE(buffer + 28));
+      packet->response_timevalue = 0;
+  } else {
+      packet->version = GST_DVB_CSS_WC_VERSION;
+      packet->message_type = GST_DVB_CSS_WC_MSG_REQUEST;
+      packet->precision = 0;
+      packet->reserved = 0;
+      packet->max_freq_error = 0;
+      
+      packet->originate_timevalue_secs = 0;
+      packet->originate_timevalue_nanos = 0;
+      packet->receive_timevalue = 0;
+      packet->transmit_timevalue = 0;
+      packet->response_timevalue = 0;
+  }
+}
+
 /**
  * gst_dvb_css_wc_packet_new:
  * @buffer: (array): a buffer from which to construct the packet, or NULL
@@ -104,35 +164,8 @@ gst_dvb_css_wc_packet_new (const guint8 * buffer)
   GstDvbCssWcPacket *ret;
   GType init = GST_DVB_CSS_WC_TYPE_PACKET;
 
-  g_assert (sizeof (GstClockTime) == 8);
-
-  ret = g_new0 (GstDvbCssWcPacket, 1);
-
-  if (buffer) {
-      ret->version = GST_READ_UINT8(buffer);
-      ret->message_type = GST_READ_UINT8(buffer + 1);
-      ret->precision = GST_READ_UINT8(buffer + 2);
-      ret->reserved = GST_READ_UINT8(buffer + 3);
-      ret->max_freq_error = GST_READ_UINT32_BE(buffer + 4);
-      
-      ret->originate_timevalue_secs = GST_READ_UINT32_BE(buffer + 8);
-      ret->originate_timevalue_nanos = GST_READ_UINT32_BE(buffer + 12);
-      ret->receive_timevalue = wc_timestamp_to_gst_clock_time(GST_READ_UINT32_BE(buffer + 16), GST_READ_UINT32_BE(buffer + 20));
-      ret->transmit_timevalue = wc_timestamp_to_gst_clock_time(GST_READ_UINT32_BE(buffer + 24), GST_READ_UINT32_BE(buffer + 28));
-      ret->response_timevalue = 0;
-  } else {
-      ret->version = GST_DVB_CSS_WC_VERSION;
-      ret->message_type = GST_DVB_CSS_WC_MSG_REQUEST;
-      ret->precision = 0;
-      ret->reserved = 0;
-      ret->max_freq_error = 0;
-      
-      ret->originate_timevalue_secs = 0;
-      ret->originate_timevalue_nanos = 0;
-      ret->receive_timevalue = 0;
-      ret->transmit_timevalue = 0;
-      ret->response_timevalue = 0;
-  }
+  ret = g_new (GstDvbCssWcPacket, 1);
+  gst_dvb_css_wc_packet_parse_into (buffer, ret);
 
   return ret;
 }
@@ -162,21 +195,45 @@ gst_dvb_css_wc_packet_copy (const GstDvbCssWcPacket * packet)
 {
   GstDvbCssWcPacket *ret;
 
-  ret = g_new0 (GstDvbCssWcPacket, 1);
-  ret->version = packet->version;
-  ret->message_type = packet->message_type;
-  ret->precision = packet->precision;
-  ret->reserved = packet->reserved;
-  ret->max_freq_error = packet->max_freq_error;
-  ret->originate_timevalue_secs = packet->originate_timevalue_secs;
-  ret->originate_timevalue_nanos = packet->originate_timevalue_nanos;
-  ret->receive_timevalue = packet->receive_timevalue;
-  ret->transmit_timevalue = packet->transmit_timevalue;
-  ret->response_timevalue = packet->response_timevalue;
+  ret = g_new (GstDvbCssWcPacket, 1);
+  *ret = *packet;
 
   return ret;
 }
 
+/**
+ * gst_dvb_css_wc_packet_serialize_into:
+ * @packet: the #GstDvbCssWcPacket
+ * @buffer: (out caller-allocates): #GST_DVB_CSS_WC_PACKET_SIZE bytes to
+ *          write the packet to
+ *
+ * Like gst_dvb_css_wc_packet_serialize(), but writes into a buffer owned by
+ * the caller.
+ *
+ * MT safe.
+ */
+void
+gst_dvb_css_wc_packet_serialize_into (const GstDvbCssWcPacket * packet,
+    guint8 buffer[GST_DVB_CSS_WC_PACKET_SIZE])
+{
+  g_assert (sizeof (GstClockTime) == 8);
+
+  GST_WRITE_UINT8(buffer, packet->version);  
+  GST_WRITE_UINT8(buffer + 1, packet->message_type);
+  GST_WRITE_UINT8(buffer + 2, packet->precision);
+  GST_WRITE_UINT8(buffer + 3, packet->reserved);
+  GST_WRITE_UINT32_BE(buffer + 4, packet->max_freq_error);
+  
+  GST_WRITE_UINT32_BE(buffer + 8, packet->originate_timevalue_secs);
+  GST_WRITE_UINT32_BE(buffer + 12, packet->originate_timevalue_nanos);
+  
+  GST_WRITE_UINT32_BE(buffer + 16, gst_clock_time_to_wc_timestamp_seconds(packet->receive_timevalue));
+  GST_WRITE_UINT32_BE(buffer + 20, gst_clock_time_to_wc_timestamp_fraction(packet->receive_timevalue));
+  
+  GST_WRITE_UINT32_BE(buffer + 24, gst_clock_time_to_wc_timestamp_seconds(packet->transmit_timevalue));
+  GST_WRITE_UINT32_BE(buffer + 28, gst_clock_time_to_wc_timestamp_fraction(packet->transmit_timevalue));
+}
+
 /**
  * gst_dvb_css_wc_packet_serialize:
  * @packet: the #GstDvbCssWcPacket
@@ -195,135 +252,592 @@ gst_dvb_css_wc_packet_serialize (const GstDvbCssWcPacket * packet)
 {
   guint8 *ret;
 
-  g_assert (sizeof (GstClockTime) == 8);
+  ret = g_new (guint8, GST_DVB_CSS_WC_PACKET_SIZE);
+  gst_dvb_css_wc_packet_serialize_into (packet, ret);
 
-  ret = g_new0 (guint8, GST_DVB_CSS_WC_PACKET_SIZE);
+  return ret;
+}
 
-  GST_WRITE_UINT8(ret, packet->version);  
-  GST_WRITE_UINT8(ret + 1, packet->message_type);
-  GST_WRITE_UINT8(ret + 2, packet->precision);
-  GST_WRITE_UINT8(ret + 3, packet->reserved);
-  GST_WRITE_UINT32_BE(ret + 4, packet->max_freq_error);
-  
-  GST_WRITE_UINT32_BE(ret + 8, packet->originate_timevalue_secs);
-  GST_WRITE_UINT32_BE(ret + 12, packet->originate_timevalue_nanos);
-  
-  GST_WRITE_UINT32_BE(ret + 16, gst_clock_time_to_wc_timestamp_seconds(packet->receive_timevalue));
-  GST_WRITE_UINT32_BE(ret + 20, gst_clock_time_to_wc_timestamp_fraction(packet->receive_timevalue));
-  
-  GST_WRITE_UINT32_BE(ret + 24, gst_clock_time_to_wc_timestamp_seconds(packet->transmit_timevalue));
-  GST_WRITE_UINT32_BE(ret + 28, gst_clock_time_to_wc_timestamp_fraction(packet->transmit_timevalue));
+/**
+ * gst_dvb_css_wc_address_set:
+ * @address: (out caller-allocates): the #GstDvbCssWcAddress to fill in
+ * @socket_address: the address to convert
+ *
+ * Converts @socket_address to the native form used by
+ * gst_dvb_css_wc_packet_send_to(). Do this once, not for every packet.
+ *
+ * Returns: TRUE if @socket_address could be converted.
+ */
+gboolean
+gst_dvb_css_wc_address_set (GstDvbCssWcAddress * address,
+    GSocketAddress * socket_address)
+{
+  gssize length;
 
-  return ret;
+  g_return_val_if_fail (address != NULL, FALSE);
+  g_return_val_if_fail (G_IS_SOCKET_ADDRESS (socket_address), FALSE);
+
+  length = g_socket_address_get_native_size (socket_address);
+  if (length < 0 || length > (gssize) sizeof (address->native))
+    return FALSE;
+  if (!g_socket_address_to_native (socket_address, address->native,
+          sizeof (address->native), NULL))
+    return FALSE;
+
+  address->length = (guint) length;
+  return TRUE;
+}
+
+#ifndef G_OS_WIN32
+static void
+set_errno_error (GError ** error, const gchar * what, int errsv)
+{
+  GST_DEBUG ("%s error: %s", what, g_strerror (errsv));
+  g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+      "%s error: %s", what, g_strerror (errsv));
 }
+#else
+static void
+set_wsa_error (GError ** error, const gchar * what, int errsv)
+{
+  gchar *msg = g_win32_error_message (errsv);
+
+  GST_DEBUG ("%s error: %s", what, msg);
+  g_set_error (error, G_IO_ERROR, g_io_error_from_win32_error (errsv),
+      "%s error: %s", what, msg);
+  g_free (msg);
+}
+#endif
 
 /**
- * gst_dvb_css_wc_packet_receive:
+ * gst_dvb_css_wc_packet_receive_into:
  * @socket: socket to receive the time packet on
- * @src_address: (out): address of variable to return sender address
+ * @packet: (out caller-allocates): the packet to fill in
+ * @src_address: (out caller-allocates) (allow-none): where to return the
+ *               sender address, or NULL
+ * @age: (out) (allow-none): how long ago the kernel received the packet, 0 if
+ *       unknown, or NULL. Only known if gst_dvb_css_wc_packet_enable_timestamping()
+ *       was called on @socket.
  * @error: return address for a #GError, or NULL
  *
- * Receives a #GstDvbCssWcPacket over a socket. Handles interrupted system
- * calls, but otherwise returns NULL on error.
+ * Receives a #GstDvbCssWcPacket over a socket without allocating anything,
+ * for threads answering or sending packets all the time. Waits for a packet
+ * if @socket is blocking, fails with #G_IO_ERROR_WOULD_BLOCK otherwise.
  *
- * Returns: (transfer full): a new #GstDvbCssWcPacket, or NULL on error. Free
- *    with gst_dvb_css_wc_packet_free() when done.
+ * On Windows the packet has to go through GLib, which tracks the socket
+ * events itself, and a #GSocketAddress is still allocated when @src_address
+ * is requested.
+ *
+ * Returns: TRUE if @packet was filled in.
  */
-GstDvbCssWcPacket *
-gst_dvb_css_wc_packet_receive (GSocket * socket,
-    GSocketAddress ** src_address, GError ** error)
+gboolean
+gst_dvb_css_wc_packet_receive_into (GSocket * socket,
+    GstDvbCssWcPacket * packet, GstDvbCssWcAddress * src_address,
+    GstClockTimeDiff * age, GError ** error)
 {
-  gchar buffer[GST_DVB_CSS_WC_PACKET_SIZE];
-  GError *err = NULL;
+  guint8 buffer[GST_DVB_CSS_WC_PACKET_SIZE];
   gssize ret;
+#ifndef G_OS_WIN32
+  guint8 control[256];
+  struct iovec iov;
+  struct msghdr msg;
+#endif
 
   g_return_val_if_fail (G_IS_SOCKET (socket), FALSE);
+  g_return_val_if_fail (packet != NULL, FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
+  /* the debug category is set up with the type, no packet may have been
+   * allocated yet */
+  g_type_ensure (GST_DVB_CSS_WC_TYPE_PACKET);
+
+  if (age)
+    *age = 0;
+
+#ifndef G_OS_WIN32
   while (TRUE) {
-    ret = g_socket_receive_from (socket, src_address, buffer,
-        GST_DVB_CSS_WC_PACKET_SIZE, NULL, &err);
+    iov.iov_base = buffer;
+    iov.iov_len = sizeof (buffer);
+    memset (&msg, 0, sizeof (msg));
+    if (src_address) {
+      msg.msg_name = src_address->native;
+      msg.msg_namelen = sizeof (src_address->native);
+    }
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (age) {
+      msg.msg_control = control;
+      msg.msg_controllen = sizeof (control);
+    }
 
-    if (ret < 0) {
-      if (err->code == G_IO_ERROR_WOULD_BLOCK) {
-        g_error_free (err);
-        err = NULL;
-        continue;
-      } else {
-        goto receive_error;
-      }
-    } else if (ret < GST_DVB_CSS_WC_PACKET_SIZE) {
-      goto short_packet;
-    } else {
-      GstDvbCssWcPacket *packet = gst_dvb_css_wc_packet_new ((const guint8 *) buffer);
-      PACKET_LOG("Received packet", packet);
-      return packet;
+    /* GLib keeps the descriptor non-blocking and waits itself */
+    ret = recvmsg (g_socket_get_fd (socket), &msg, 0);
+    if (ret >= 0)
+      break;
+
+    if (errno == EINTR)
+      continue;
+    if ((errno == EAGAIN || errno == EWOULDBLOCK)
+        && g_socket_get_blocking (socket)) {
+      if (!g_socket_condition_wait (socket, G_IO_IN, NULL, error))
+        return FALSE;
+      continue;
     }
+    set_errno_error (error, "receive", errno);
+    return FALSE;
   }
 
-receive_error:
+  if (ret < GST_DVB_CSS_WC_PACKET_SIZE)
+    goto short_packet;
+
+#ifdef __linux__
+  if (age)
+    gst_dvb_css_wc_packet_get_cmsg_age (&msg, age);
+#endif
+  if (src_address)
+    src_address->length = msg.msg_namelen;
+#else
   {
-    GST_DEBUG ("receive error: %s", err->message);
-    g_propagate_error (error, err);
-    return NULL;
+    GSocketAddress *from = NULL;
+    GError *err = NULL;
+
+    do {
+      g_clear_error (&err);
+      ret = g_socket_receive_from (socket, src_address ? &from : NULL,
+          (gchar *) buffer, GST_DVB_CSS_WC_PACKET_SIZE, NULL, &err);
+    } while (ret < 0 && g_socket_get_blocking (socket)
+        && err->code == G_IO_ERROR_WOULD_BLOCK);
+
+    if (ret < 0) {
+      GST_DEBUG ("receive error: %s", err->message);
+      g_propagate_error (error, err);
+      return FALSE;
+    }
+    if (from) {
+      gst_dvb_css_wc_address_set (src_address, from);
+      g_object_unref (from);
+    }
+    if (ret < GST_DVB_CSS_WC_PACKET_SIZE)
+      goto short_packet;
   }
+#endif
+
+  gst_dvb_css_wc_packet_parse_into (buffer, packet);
+  PACKET_LOG("Received packet", packet);
+  return TRUE;
+
 short_packet:
   {
     GST_DEBUG ("someone sent us a short packet (%" G_GSSIZE_FORMAT " < %d)",
         ret, GST_DVB_CSS_WC_PACKET_SIZE);
     g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_DATA,
         "short time packet (%d < %d)", (int) ret, GST_DVB_CSS_WC_PACKET_SIZE);
-    return NULL;
+    return FALSE;
   }
 }
 
 /**
- * gst_dvb_css_wc_packet_send:
+ * gst_dvb_css_wc_packet_send_to:
  * @packet: the #GstDvbCssWcPacket to send
  * @socket: socket to send the time packet on
  * @dest_address: address to send the time packet to
  * @error: return address for a #GError, or NULL
  *
- * Sends a #GstDvbCssWcPacket over a socket.
+ * Sends a #GstDvbCssWcPacket over a socket without allocating anything and
+ * without ever blocking, whatever the blocking mode of @socket. A packet that
+ * does not fit into the socket buffer is dropped with
+ * #G_IO_ERROR_WOULD_BLOCK, the protocol copes with lost packets anyway.
  *
  * MT safe.
  *
  * Returns: TRUE if successful, FALSE in case an error occurred.
  */
 gboolean
-gst_dvb_css_wc_packet_send (const GstDvbCssWcPacket * packet,
-    GSocket * socket, GSocketAddress * dest_address, GError ** error)
+gst_dvb_css_wc_packet_send_to (const GstDvbCssWcPacket * packet,
+    GSocket * socket, const GstDvbCssWcAddress * dest_address, GError ** error)
 {
-  gboolean was_blocking;
-  guint8 *buffer;
+  guint8 buffer[GST_DVB_CSS_WC_PACKET_SIZE];
   gssize res;
 
   g_return_val_if_fail (packet != NULL, FALSE);
   g_return_val_if_fail (G_IS_SOCKET (socket), FALSE);
-  g_return_val_if_fail (G_IS_SOCKET_ADDRESS (dest_address), FALSE);
+  g_return_val_if_fail (dest_address != NULL, FALSE);
   g_return_val_if_fail (error == NULL || *error == NULL, FALSE);
 
-  was_blocking = g_socket_get_blocking (socket);
-
-  if (was_blocking)
-    g_socket_set_blocking (socket, FALSE);
+  g_type_ensure (GST_DVB_CSS_WC_TYPE_PACKET);
 
   PACKET_LOG("Sending packet", packet);
-  /* FIXME: avoid pointless alloc/free, serialise into stack-allocated buffer */
-  buffer = gst_dvb_css_wc_packet_serialize (packet);
-
-  res = g_socket_send_to (socket, dest_address, (const gchar *) buffer,
-      GST_DVB_CSS_WC_PACKET_SIZE, NULL, error);
+  gst_dvb_css_wc_packet_serialize_into (packet, buffer);
+
+#ifndef G_OS_WIN32
+  do {
+    res = sendto (g_socket_get_fd (socket), buffer, GST_DVB_CSS_WC_PACKET_SIZE,
+        MSG_DONTWAIT, (const struct sockaddr *) dest_address->native,
+        dest_address->length);
+  } while (res < 0 && errno == EINTR);
+
+  if (res < 0) {
+    set_errno_error (error, "send", errno);
+    return FALSE;
+  }
+#else
+  /* there is no MSG_DONTWAIT here, but GLib keeps the socket non-blocking
+   * underneath and only a blocking GSocket would wait */
+  res = sendto ((SOCKET) g_socket_get_fd (socket), (const char *) buffer,
+      GST_DVB_CSS_WC_PACKET_SIZE, 0,
+      (const struct sockaddr *) dest_address->native, (int) dest_address->length);
+  if (res == SOCKET_ERROR) {
+    set_wsa_error (error, "send", WSAGetLastError ());
+    return FALSE;
+  }
+#endif
 
   /* datagram packets should be sent as a whole or not at all */
   g_assert (res < 0 || res == GST_DVB_CSS_WC_PACKET_SIZE);
 
-  g_free (buffer);
+  return (res == GST_DVB_CSS_WC_PACKET_SIZE);
+}
 
-  if (was_blocking)
-    g_socket_set_blocking (socket, TRUE);
+/**
+ * gst_dvb_css_wc_packet_receive:
+ * @socket: socket to receive the time packet on
+ * @src_address: (out): address of variable to return sender address
+ * @error: return address for a #GError, or NULL
+ *
+ * Receives a #GstDvbCssWcPacket over a socket. Handles interrupted system
+ * calls, but otherwise returns NULL on error.
+ *
+ * Returns: (transfer full): a new #GstDvbCssWcPacket, or NULL on error. Free
+ *    with gst_dvb_css_wc_packet_free() when done.
+ */
+GstDvbCssWcPacket *
+gst_dvb_css_wc_packet_receive (GSocket * socket,
+    GSocketAddress ** src_address, GError ** error)
+{
+  GstDvbCssWcPacket packet;
+  GstDvbCssWcAddress from;
 
-  return (res == GST_DVB_CSS_WC_PACKET_SIZE);
+  if (!gst_dvb_css_wc_packet_receive_into (socket, &packet,
+          src_address ? &from : NULL, NULL, error))
+    return NULL;
+
+  if (src_address)
+    *src_address = g_socket_address_new_from_native (from.native, from.length);
+
+  return gst_dvb_css_wc_packet_copy (&packet);
+}
+
+/**
+ * gst_dvb_css_wc_packet_send:
+ * @packet: the #GstDvbCssWcPacket to send
+ * @socket: socket to send the time packet on
+ * @dest_address: address to send the time packet to
+ * @error: return address for a #GError, or NULL
+ *
+ * Sends a #GstDvbCssWcPacket over a socket. See
+ * gst_dvb_css_wc_packet_send_to() to send many packets to the same address.
+ *
+ * MT safe.
+ *
+ * Returns: TRUE if successful, FALSE in case an error occurred.
+ */
+gboolean
+gst_dvb_css_wc_packet_send (const GstDvbCssWcPacket * packet,
+    GSocket * socket, GSocketAddress * dest_address, GError ** error)
+{
+  GstDvbCssWcAddress address;
+
+  g_return_val_if_fail (G_IS_SOCKET_ADDRESS (dest_address), FALSE);
+
+  if (!gst_dvb_css_wc_address_set (&address, dest_address)) {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT,
+        "unsupported destination address");
+    return FALSE;
+  }
+
+  return gst_dvb_css_wc_packet_send_to (packet, socket, &address, error);
+}
+
+#ifdef __linux__
+/* Finds the software timestamp in the control messages of msg */
+static gboolean
+find_timestamp (struct msghdr *msg, GstClockTime * timestamp)
+{
+  struct cmsghdr *cmsg;
+
+  for (cmsg = CMSG_FIRSTHDR (msg); cmsg; cmsg = CMSG_NXTHDR (msg, cmsg)) {
+    if (cmsg->cmsg_level != SOL_SOCKET)
+      continue;
+    if (cmsg->cmsg_type == SCM_TIMESTAMPNS) {
+      struct timespec *ts = (struct timespec *) CMSG_DATA (cmsg);
+      *timestamp = GST_TIMESPEC_TO_TIME (*ts);
+      return TRUE;
+    }
+    if (cmsg->cmsg_type == SCM_TIMESTAMPING) {
+      struct scm_timestamping *tss = (struct scm_timestamping *) CMSG_DATA (cmsg);
+      *timestamp = GST_TIMESPEC_TO_TIME (tss->ts[0]);
+      return *timestamp != 0;
+    }
+  }
+  return FALSE;
+}
+
+/* Kernel timestamps are on CLOCK_REALTIME, which is not the clock we are
+ * exporting. Only how long ago the timestamp was taken is carried over, so
+ * the caller can take it from its own clock. */
+static GstClockTimeDiff
+timestamp_age (GstClockTime timestamp)
+{
+  struct timespec now;
+  GstClockTimeDiff age;
+
+  clock_gettime (CLOCK_REALTIME, &now);
+  age = GST_CLOCK_DIFF (timestamp, GST_TIMESPEC_TO_TIME (now));
+
+  /* the wall clock was stepped in between, the timestamp is useless */
+  if (age < 0 || age > GST_SECOND)
+    return 0;
+  return age;
+}
+
+/**
+ * gst_dvb_css_wc_packet_get_cmsg_age:
+ * @msg: a message received with recvmsg() or recvmmsg() on a socket with
+ *       timestamping enabled
+ * @age: (out): how long ago the kernel received the message
+ *
+ * For callers reading packets themselves, see
+ * gst_dvb_css_wc_packet_receive_timestamped().
+ *
+ * Returns: TRUE if @msg carried a usable timestamp.
+ */
+gboolean
+gst_dvb_css_wc_packet_get_cmsg_age (struct msghdr * msg, GstClockTimeDiff * age)
+{
+  GstClockTime timestamp;
+
+  if (!find_timestamp (msg, &timestamp))
+    return FALSE;
+  *age = timestamp_age (timestamp);
+  return TRUE;
+}
+#endif
+
+/**
+ * gst_dvb_css_wc_packet_enable_timestamping:
+ * @socket: the socket packets are received and sent on
+ * @transmit: also timestamp outgoing packets, see
+ *            gst_dvb_css_wc_packet_get_transmit_age()
+ *
+ * Asks the kernel to timestamp the packets on @socket, for
+ * gst_dvb_css_wc_packet_receive_timestamped(). Only supported on Linux.
+ *
+ * Returns: TRUE if the kernel will timestamp the packets.
+ */
+gboolean
+gst_dvb_css_wc_packet_enable_timestamping (GSocket * socket, gboolean transmit)
+{
+#ifdef __linux__
+  gint fd;
+  int ret;
+
+  g_return_val_if_fail (G_IS_SOCKET (socket), FALSE);
+
+  fd = g_socket_get_fd (socket);
+  if (transmit) {
+    /* OPT_ID numbers the transmit timestamps in send order, starting at 0 */
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_TX_SOFTWARE |
+        SOF_TIMESTAMPING_SOFTWARE | SOF_TIMESTAMPING_OPT_TSONLY |
+        SOF_TIMESTAMPING_OPT_ID;
+    ret = setsockopt (fd, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof (flags));
+  } else {
+    int on = 1;
+    ret = setsockopt (fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof (on));
+  }
+
+  if (ret < 0) {
+    GST_WARNING ("could not enable kernel timestamps: %s", g_strerror (errno));
+    return FALSE;
+  }
+  return TRUE;
+#else
+  GST_WARNING ("kernel timestamps are not supported on this platform");
+  return FALSE;
+#endif
+}
+
+/**
+ * gst_dvb_css_wc_packet_disable_timestamping:
+ * @socket: a socket gst_dvb_css_wc_packet_enable_timestamping() was called on
+ *
+ * Turns kernel timestamps on @socket off again and drops the transmit
+ * timestamps still queued.
+ */
+void
+gst_dvb_css_wc_packet_disable_timestamping (GSocket * socket)
+{
+#ifdef __linux__
+  gint fd;
+  int off = 0;
+
+  g_return_if_fail (G_IS_SOCKET (socket));
+
+  fd = g_socket_get_fd (socket);
+  setsockopt (fd, SOL_SOCKET, SO_TIMESTAMPING, &off, sizeof (off));
+  setsockopt (fd, SOL_SOCKET, SO_TIMESTAMPNS, &off, sizeof (off));
+  gst_dvb_css_wc_packet_drain_transmit_timestamps (socket);
+#endif
+}
+
+/**
+ * gst_dvb_css_wc_packet_receive_timestamped:
+ * @socket: socket to receive the time packet on, with timestamping enabled
+ * @src_address: (out): address of variable to return sender address
+ * @age: (out): how long ago the kernel received the packet, 0 if unknown
+ * @error: return address for a #GError, or NULL
+ *
+ * Like gst_dvb_css_wc_packet_receive(), but also returns the kernel
+ * timestamp of the packet. The time the packet arrived is the current time of
+ * the caller's clock minus @age, which leaves out the time the receiving
+ * thread took to be scheduled.
+ *
+ * Returns: (transfer full): a new #GstDvbCssWcPacket, or NULL on error. Free
+ *    with gst_dvb_css_wc_packet_free() when done.
+ */
+GstDvbCssWcPacket *
+gst_dvb_css_wc_packet_receive_timestamped (GSocket * socket,
+    GSocketAddress ** src_address, GstClockTimeDiff * age, GError ** error)
+{
+  GstDvbCssWcPacket packet;
+  GstDvbCssWcAddress from;
+
+  g_return_val_if_fail (age != NULL, NULL);
+
+  if (!gst_dvb_css_wc_packet_receive_into (socket, &packet,
+          src_address ? &from : NULL, age, error))
+    return NULL;
+
+  if (src_address)
+    *src_address = g_socket_address_new_from_native (from.native, from.length);
+
+  return gst_dvb_css_wc_packet_copy (&packet);
+}
+
+#ifdef __linux__
+/* Takes the oldest message off the error queue of fd. @timestamp is
+ * GST_CLOCK_TIME_NONE when it was no transmit timestamp. Returns FALSE once the
+ * queue is empty. */
+static gboolean
+pop_transmit_timestamp (gint fd, guint32 * id, GstClockTime * timestamp)
+{
+  guint8 control[512];
+  struct msghdr msg;
+  struct cmsghdr *cmsg;
+  struct sock_extended_err *serr;
+  gboolean have_id = FALSE;
+  ssize_t ret;
+
+  do {
+    memset (&msg, 0, sizeof (msg));
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof (control);
+    ret = recvmsg (fd, &msg, MSG_ERRQUEUE | MSG_DONTWAIT);
+  } while (ret < 0 && errno == EINTR);
+
+  if (ret < 0) {
+    if (errno != EAGAIN && errno != EWOULDBLOCK)
+      GST_DEBUG ("could not read the error queue: %s", g_strerror (errno));
+    return FALSE;
+  }
+
+  for (cmsg = CMSG_FIRSTHDR (&msg); cmsg; cmsg = CMSG_NXTHDR (&msg, cmsg)) {
+    if ((cmsg->cmsg_level == SOL_IP && cmsg->cmsg_type == IP_RECVERR) ||
+        (cmsg->cmsg_level == SOL_IPV6 && cmsg->cmsg_type == IPV6_RECVERR)) {
+      serr = (struct sock_extended_err *) CMSG_DATA (cmsg);
+      if (serr->ee_errno == ENOMSG &&
+          serr->ee_origin == SO_EE_ORIGIN_TIMESTAMPING) {
+        *id = serr->ee_data;
+        have_id = TRUE;
+      }
+    }
+  }
+
+  if (!have_id || !find_timestamp (&msg, timestamp))
+    *timestamp = GST_CLOCK_TIME_NONE;
+  return TRUE;
+}
+#endif
+
+/**
+ * gst_dvb_css_wc_packet_drain_transmit_timestamps:
+ * @socket: socket with transmit timestamping enabled
+ *
+ * Drops every transmit timestamp queued on @socket. A pending one makes the
+ * socket report an error condition, so call this before waiting on it.
+ */
+void
+gst_dvb_css_wc_packet_drain_transmit_timestamps (GSocket * socket)
+{
+#ifdef __linux__
+  GstClockTime timestamp;
+  guint32 id;
+
+  g_return_if_fail (G_IS_SOCKET (socket));
+
+  while (pop_transmit_timestamp (g_socket_get_fd (socket), &id, &timestamp))
+    GST_LOG ("dropped stale transmit timestamp %u", id);
+#endif
+}
+
+/**
+ * gst_dvb_css_wc_packet_get_transmit_age:
+ * @socket: socket the packet was sent on, with transmit timestamping enabled
+ * @id: which packet sent on @socket since timestamping was enabled, counting
+ *      from 0
+ * @age: (out): how long ago the kernel sent the packet
+ *
+ * Takes the kernel transmit timestamp of packet @id. The timestamps of older
+ * packets that are still queued are dropped on the way.
+ *
+ * Returns: TRUE if the timestamp of packet @id was read.
+ */
+gboolean
+gst_dvb_css_wc_packet_get_transmit_age (GSocket * socket, guint32 id,
+    GstClockTimeDiff * age)
+{
+#ifdef __linux__
+  struct pollfd pfd;
+  GstClockTime timestamp;
+  guint32 key;
+  gint fd;
+  gint attempt;
+
+  g_return_val_if_fail (G_IS_SOCKET (socket), FALSE);
+  g_return_val_if_fail (age != NULL, FALSE);
+
+  fd = g_socket_get_fd (socket);
+
+  /* the timestamp is usually queued by the time send returns, wait a bit for it otherwise */
+  for (attempt = 0; attempt < 2; attempt++) {
+    while (pop_transmit_timestamp (fd, &key, &timestamp)) {
+      if (key == id && timestamp != GST_CLOCK_TIME_NONE) {
+        *age = timestamp_age (timestamp);
+        return TRUE;
+      }
+      GST_LOG ("dropped transmit timestamp %u waiting for %u", key, id);
+    }
+
+    if (attempt == 0) {
+      /* a pending error queue is always reported as POLLERR */
+      pfd.fd = fd;
+      pfd.events = 0;
+      pfd.revents = 0;
+      poll (&pfd, 1, TX_TIMESTAMP_TIMEOUT_MS);
+    }
+  }
+  GST_DEBUG ("no transmit timestamp for packet %u", id);
+#endif
+  return FALSE;
 }
 
 gint8 gst_dvb_css_wc_packet_encode_precision(gdouble precisionSecs)
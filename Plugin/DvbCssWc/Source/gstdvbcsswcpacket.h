@@ -63,6 +63,18 @@ struct _GstDvbCssWcPacket {
     GstClockTime response_timevalue;
 };
 
+/**
+ * GstDvbCssWcAddress:
+ *
+ * A socket address in its native form, so that it can live on the stack of
+ * the threads sending and receiving packets. On Windows, receiving still
+ * allocates the sender address, see gst_dvb_css_wc_packet_receive_into().
+ */
+typedef struct {
+    gint64 native[16];  /* room and alignment for a struct sockaddr_storage */
+    guint length;
+} GstDvbCssWcAddress;
+
 GType gst_dvb_css_wc_packet_get_type(void);
 
 GstDvbCssWcPacket* gst_dvb_css_wc_packet_new(const guint8 *buffer);
@@ -71,6 +83,25 @@ void gst_dvb_css_wc_packet_free(GstDvbCssWcPacket *packet);
 
 guint8* gst_dvb_css_wc_packet_serialize(const GstDvbCssWcPacket *packet);
 
+void gst_dvb_css_wc_packet_parse_into(const guint8 *buffer,
+        GstDvbCssWcPacket *packet);
+void gst_dvb_css_wc_packet_serialize_into(const GstDvbCssWcPacket *packet,
+        guint8 buffer[GST_DVB_CSS_WC_PACKET_SIZE]);
+
+gboolean gst_dvb_css_wc_address_set(GstDvbCssWcAddress *address,
+        GSocketAddress *socket_address);
+
+gboolean gst_dvb_css_wc_packet_receive_into(GSocket * socket,
+        GstDvbCssWcPacket * packet,
+        GstDvbCssWcAddress * src_address,
+        GstClockTimeDiff * age,
+        GError ** error);
+
+gboolean gst_dvb_css_wc_packet_send_to(const GstDvbCssWcPacket * packet,
+        GSocket * socket,
+        const GstDvbCssWcAddress * dest_address,
+        GError ** error);
+
 GstDvbCssWcPacket* gst_dvb_css_wc_packet_receive(GSocket * socket,
         GSocketAddress ** src_address,
         GError ** error);
@@ -80,6 +111,28 @@ gboolean gst_dvb_css_wc_packet_send(const GstDvbCssWcPacket * packet,
         GSocketAddress * dest_address,
         GError ** error);
 
+gboolean gst_dvb_css_wc_packet_enable_timestamping(GSocket * socket,
+        gboolean transmit);
+
+void gst_dvb_css_wc_packet_disable_timestamping(GSocket * socket);
+
+GstDvbCssWcPacket* gst_dvb_css_wc_packet_receive_timestamped(GSocket * socket,
+        GSocketAddress ** src_address,
+        GstClockTimeDiff * age,
+        GError ** error);
+
+gboolean gst_dvb_css_wc_packet_get_transmit_age(GSocket * socket,
+        guint32 id,
+        GstClockTimeDiff * age);
+
+void gst_dvb_css_wc_packet_drain_transmit_timestamps(GSocket * socket);
+
+#ifdef __linux__
+struct msghdr;
+gboolean gst_dvb_css_wc_packet_get_cmsg_age(struct msghdr * msg,
+        GstClockTimeDiff * age);
+#endif
+
 gint8 gst_dvb_css_wc_packet_encode_precision(gdouble precisionSecs);
 gdouble gst_dvb_css_wc_packet_decode_precision(gint8 precision);
 guint32 gst_dvb_css_wc_packet_encode_max_freq_error(gdouble max_freq_error_ppm);
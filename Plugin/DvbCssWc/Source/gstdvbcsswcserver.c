@@ -17,6 +17,11 @@
  * Boston, MA 02110-1301, USA.
  */
 
+#ifdef __linux__
+/* recvmmsg and sendmmsg */
+#define _GNU_SOURCE
+#endif
+
 #ifdef HAVE_CONFIG_H
 #include "config.h"
 #endif
@@ -26,11 +31,24 @@
 #include "gstdvbcsswccommon.h"
 #include <stdlib.h>
 
+#ifdef __linux__
+#include <errno.h>
+#include <string.h>
+#include <sys/socket.h>
+#endif
+
 GST_DEBUG_CATEGORY_STATIC (dvbcss_wc_server);
 #define GST_CAT_DEFAULT (dvbcss_wc_server)
 
 #define DEFAULT_ADDRESS         "0.0.0.0"
 #define DEFAULT_PORT            5637
+#define DEFAULT_THREADS         1
+#define DEFAULT_BATCH_SIZE      1
+#define MAX_THREADS             64
+#define MAX_BATCH_SIZE          1024
+
+/* Room for the receive timestamp of each datagram of a batch */
+#define BATCH_CONTROL_SIZE      64
 
 #define IS_ACTIVE(self) (g_atomic_int_get (&((self)->priv->active)))
 
@@ -42,9 +60,21 @@ enum
   PROP_CLOCK,
   PROP_ACTIVE,
   PROP_FOLLOWUP,
-  PROP_MAX_FREQ_ERROR_PPM
+  PROP_MAX_FREQ_ERROR_PPM,
+  PROP_KERNEL_TIMESTAMPS,
+  PROP_THREADS,
+  PROP_BATCH_SIZE
 };
 
+/* One thread serving its own socket. All sockets are bound to the same port,
+ * which SO_REUSEPORT lets the kernel balance the clients over. */
+typedef struct
+{
+  GstDvbCssWcServer *server;
+  GSocket *socket;
+  GThread *thread;
+} GstDvbCssWcServerWorker;
+
 #define GST_DVB_CSS_WC_SERVER_GET_PRIVATE(obj)  \
    (G_TYPE_INSTANCE_GET_PRIVATE ((obj), GST_TYPE_DVB_CSS_WC_SERVER, GstDvbCssWcServerPrivate))
 
@@ -53,19 +83,23 @@ struct _GstDvbCssWcServerPrivate
   gchar *address;
   int port;
 
-  GThread *thread;
+  GstDvbCssWcServerWorker *workers;
+  guint n_threads;
+  guint batch_size;
 
   GstClock *clock;
 
   gboolean active;              /* ATOMIC */
 
-  GSocket *socket;
   GCancellable *cancel;
   gboolean made_cancel_fd;
 
   gboolean followup;
   gdouble precision_secs;
   guint32 max_freq_error_ppm;
+  gboolean kernel_timestamps;
+  /* the kernel also timestamps the responses, for the followups to carry */
+  gboolean transmit_timestamps;
 };
 static void gst_dvb_css_wc_server_initable_iface_init (gpointer g_iface);
 
@@ -73,6 +107,9 @@ static gboolean gst_dvb_css_wc_server_start (GstDvbCssWcServer * bself, GError *
 static void gst_dvb_css_wc_server_stop (GstDvbCssWcServer * bself);
 
 static gpointer gst_dvb_css_wc_server_thread (gpointer data);
+#ifdef __linux__
+static gpointer gst_dvb_css_wc_server_batch_thread (gpointer data);
+#endif
 
 static void gst_dvb_css_wc_server_finalize (GObject * object);
 static void gst_dvb_css_wc_server_set_property (GObject * object, guint prop_id,
@@ -129,6 +166,23 @@ gst_dvb_css_wc_server_class_init (GstDvbCssWcServerClass * klass)
           "max freq error ppm", 0, G_MAXUINT32,
           0,
           G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY));
+  g_object_class_install_property (gobject_class, PROP_KERNEL_TIMESTAMPS,
+      g_param_spec_boolean ("kernel-timestamps", "Kernel timestamps",
+          "Take the receive times, and the transmit times sent in followup "
+          "messages if followup is set on construction, from kernel socket "
+          "timestamps (Linux only)", FALSE,
+          G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_THREADS,
+      g_param_spec_uint ("threads", "Threads",
+          "Number of threads serving requests, each on its own socket (Linux only)",
+          1, MAX_THREADS, DEFAULT_THREADS,
+          G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+  g_object_class_install_property (gobject_class, PROP_BATCH_SIZE,
+      g_param_spec_uint ("batch-size", "Batch size",
+          "Maximum number of requests read and answered with one system call "
+          "(Linux only). Without kernel-timestamps all requests of a batch get "
+          "the same receive time", 1, MAX_BATCH_SIZE, DEFAULT_BATCH_SIZE,
+          G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
 }
 
 static void
@@ -138,11 +192,14 @@ gst_dvb_css_wc_server_init (GstDvbCssWcServer * self)
 
   self->priv->port = DEFAULT_PORT;
   self->priv->address = g_strdup (DEFAULT_ADDRESS);
-  self->priv->thread = NULL;
+  self->priv->workers = NULL;
+  self->priv->n_threads = DEFAULT_THREADS;
+  self->priv->batch_size = DEFAULT_BATCH_SIZE;
   self->priv->active = TRUE;
   self->priv->followup = FALSE;
   self->priv->precision_secs = 0;
   self->priv->max_freq_error_ppm = 0;
+  self->priv->kernel_timestamps = FALSE;
 }
 
 static void
@@ -150,9 +207,9 @@ gst_dvb_css_wc_server_finalize (GObject * object)
 {
   GstDvbCssWcServer *self = GST_DVB_CSS_WC_SERVER (object);
 
-  if (self->priv->thread) {
+  if (self->priv->workers) {
     gst_dvb_css_wc_server_stop (self);
-    g_assert (self->priv->thread == NULL);
+    g_assert (self->priv->workers == NULL);
   }
 
   g_free (self->priv->address);
@@ -168,20 +225,31 @@ gst_dvb_css_wc_server_finalize (GObject * object)
 static gpointer
 gst_dvb_css_wc_server_thread (gpointer data)
 {
-  GstDvbCssWcServer *self = data;
+  GstDvbCssWcServerWorker *worker = data;
+  GstDvbCssWcServer *self = worker->server;
   GCancellable *cancel = self->priv->cancel;
-  GSocket *socket = self->priv->socket;
-  GstDvbCssWcPacket *packet, *reply, *followupReply;
+  GSocket *socket = worker->socket;
+  /* the hot path keeps everything on the stack */
+  GstDvbCssWcPacket packet, reply, followupReply;
+  GstDvbCssWcAddress sender_addr;
   GError *err = NULL;
   GstClock *clock = self->priv->clock;
   GstClockTime time;
-
-  self->priv->precision_secs = measure_precision_sec (clock);
+  GstClockTimeDiff age;
+  gboolean kernel_timestamps = self->priv->kernel_timestamps;
+  gboolean transmit_timestamps = self->priv->transmit_timestamps;
+  gboolean followup;
+  gboolean sent;
+  /* the kernel numbers the transmit timestamps of the socket in send order */
+  guint32 tx_id = 0;
 
   GST_TRACE_OBJECT (self, "dvb css wc server thread is running");
 
   while (TRUE) {
-    GSocketAddress *sender_addr = NULL;
+    /* a transmit timestamp left in the error queue would keep the socket
+     * signalled and make the wait below return straight away */
+    if (transmit_timestamps)
+      gst_dvb_css_wc_packet_drain_transmit_timestamps (socket);
 
     GST_TRACE_OBJECT (self, "waiting on socket");
     if (!g_socket_condition_wait (socket, G_IO_IN, cancel, &err)) {
@@ -197,9 +265,19 @@ gst_dvb_css_wc_server_thread (gpointer data)
       continue;
     }
 
+    /* woken up by the error queue only */
+    if (transmit_timestamps
+        && !(g_socket_condition_check (socket, G_IO_IN) & G_IO_IN))
+      continue;
+
     /* got data in */
-    time = gst_clock_get_time(clock);
-    packet = gst_dvb_css_wc_packet_receive (socket, &sender_addr, &err);
+    if (kernel_timestamps) {
+      gst_dvb_css_wc_packet_receive_into (socket, &packet, &sender_addr, &age, &err);
+      time = gst_clock_get_time(clock) - age;
+    } else {
+      time = gst_clock_get_time(clock);
+      gst_dvb_css_wc_packet_receive_into (socket, &packet, &sender_addr, NULL, &err);
+    }
     
     if (err != NULL) {
       GST_WARNING_OBJECT (self, "receive error: %s", err->message);
@@ -210,36 +288,42 @@ gst_dvb_css_wc_server_thread (gpointer data)
     }
     
     if (IS_ACTIVE (self)) {
-        if(packet->message_type == GST_DVB_CSS_WC_MSG_REQUEST
-           && packet->version == 0){
+        if(packet.message_type == GST_DVB_CSS_WC_MSG_REQUEST
+           && packet.version == 0){
         /* do what we were asked to and send the packet back */
-            reply = gst_dvb_css_wc_packet_copy(packet);
-            reply->receive_timevalue = time;
+            reply = packet;
+            reply.receive_timevalue = time;
+            followup = g_atomic_int_get (&self->priv->followup);
 
-            if(self->priv->followup)
-                reply->message_type = GST_DVB_CSS_WC_MSG_RESPONSE_WITH_FOLLOWUP;
+            if(followup)
+                reply.message_type = GST_DVB_CSS_WC_MSG_RESPONSE_WITH_FOLLOWUP;
             else
-                reply->message_type = GST_DVB_CSS_WC_MSG_RESPONSE;               
-            reply->precision = gst_dvb_css_wc_packet_encode_precision(self->priv->precision_secs);
-            reply->max_freq_error = gst_dvb_css_wc_packet_encode_max_freq_error(self->priv->max_freq_error_ppm);;
-            reply->transmit_timevalue = gst_clock_get_time(clock);
-            gst_dvb_css_wc_packet_send (reply, socket, sender_addr, NULL);
-
-            if(self->priv->followup){
-                followupReply = gst_dvb_css_wc_packet_copy(reply);
-                followupReply->message_type = GST_DVB_CSS_WC_MSG_FOLLOWUP;
-                // FIXME: transmit_timevalue should be set to more accurate
-                // measurement of the time of transmission of the previous response
-                //followupReply->transmit_timevalue = gst_clock_get_time(clock);
-                gst_dvb_css_wc_packet_send (followupReply, socket, sender_addr, NULL);
-                gst_dvb_css_wc_packet_free (followupReply);
+                reply.message_type = GST_DVB_CSS_WC_MSG_RESPONSE;               
+            reply.precision = gst_dvb_css_wc_packet_encode_precision(self->priv->precision_secs);
+            reply.max_freq_error = gst_dvb_css_wc_packet_encode_max_freq_error(self->priv->max_freq_error_ppm);;
+            reply.transmit_timevalue = gst_clock_get_time(clock);
+            sent = gst_dvb_css_wc_packet_send_to (&reply, socket, &sender_addr, NULL);
+            // the kernel numbers every packet sent, only responses with a followup wait for theirs
+            if (sent && transmit_timestamps) {
+                sent = followup && gst_dvb_css_wc_packet_get_transmit_age (socket, tx_id, &age);
+                tx_id++;
+            } else
+                sent = FALSE;
+
+            if(followup){
+                followupReply = reply;
+                followupReply.message_type = GST_DVB_CSS_WC_MSG_FOLLOWUP;
+                // the kernel knows when the response actually left
+                if (sent)
+                    followupReply.transmit_timevalue = gst_clock_get_time(clock) - age;
+                // its own transmit timestamp is dropped before the next wait
+                if (gst_dvb_css_wc_packet_send_to (&followupReply, socket, &sender_addr, NULL)
+                    && transmit_timestamps)
+                    tx_id++;
             }
-            gst_dvb_css_wc_packet_free (reply);
         }else
             GST_ERROR_OBJECT(self, "Received non request message");     
     }    
-    g_object_unref (sender_addr);
-    gst_dvb_css_wc_packet_free (packet);
   }
 
   g_error_free (err);
@@ -248,6 +332,181 @@ gst_dvb_css_wc_server_thread (gpointer data)
   return NULL;
 }
 
+#ifdef __linux__
+/* Serializes the replies with transmit_time and sends them all */
+static void
+gst_dvb_css_wc_server_send_batch (GstDvbCssWcServer * self, gint fd,
+    struct mmsghdr *msgs, GstDvbCssWcPacket * replies, gint count,
+    GstClockTime transmit_time)
+{
+  gint sent = 0;
+  gint ret;
+  gint i;
+
+  for (i = 0; i < count; i++) {
+    replies[i].transmit_timevalue = transmit_time;
+    gst_dvb_css_wc_packet_serialize_into (&replies[i], msgs[i].msg_hdr.msg_iov->iov_base);
+  }
+
+  while (sent < count) {
+    ret = sendmmsg (fd, msgs + sent, count - sent, MSG_DONTWAIT);
+    if (ret < 0) {
+      if (errno == EINTR)
+        continue;
+      GST_WARNING_OBJECT (self, "send error: %s", g_strerror (errno));
+      return;
+    }
+    sent += ret;
+  }
+}
+
+static gpointer
+gst_dvb_css_wc_server_batch_thread (gpointer data)
+{
+  GstDvbCssWcServerWorker *worker = data;
+  GstDvbCssWcServer *self = worker->server;
+  GCancellable *cancel = self->priv->cancel;
+  GSocket *socket = worker->socket;
+  GstClock *clock = self->priv->clock;
+  GError *err = NULL;
+  gint fd = g_socket_get_fd (socket);
+  guint batch_size = self->priv->batch_size;
+  gboolean kernel_timestamps = self->priv->kernel_timestamps;
+  gint8 precision = gst_dvb_css_wc_packet_encode_precision (self->priv->precision_secs);
+  guint32 max_freq_error = gst_dvb_css_wc_packet_encode_max_freq_error (self->priv->max_freq_error_ppm);
+  /* everything a batch needs is allocated up front */
+  struct mmsghdr *rx_msgs = g_new0 (struct mmsghdr, batch_size);
+  struct mmsghdr *tx_msgs = g_new0 (struct mmsghdr, batch_size);
+  struct iovec *rx_iov = g_new0 (struct iovec, batch_size);
+  struct iovec *tx_iov = g_new0 (struct iovec, batch_size);
+  struct sockaddr_storage *addrs = g_new0 (struct sockaddr_storage, batch_size);
+  guint8 *rx_buffers = g_malloc (batch_size * GST_DVB_CSS_WC_PACKET_SIZE);
+  guint8 *tx_buffers = g_malloc (batch_size * GST_DVB_CSS_WC_PACKET_SIZE);
+  guint8 *control = g_malloc (batch_size * BATCH_CONTROL_SIZE);
+  GstDvbCssWcPacket *replies = g_new0 (GstDvbCssWcPacket, batch_size);
+  guint i;
+
+  for (i = 0; i < batch_size; i++) {
+    rx_iov[i].iov_base = rx_buffers + i * GST_DVB_CSS_WC_PACKET_SIZE;
+    rx_iov[i].iov_len = GST_DVB_CSS_WC_PACKET_SIZE;
+    tx_iov[i].iov_base = tx_buffers + i * GST_DVB_CSS_WC_PACKET_SIZE;
+    tx_iov[i].iov_len = GST_DVB_CSS_WC_PACKET_SIZE;
+  }
+
+  GST_TRACE_OBJECT (self, "dvb css wc server batch thread is running");
+
+  while (TRUE) {
+    GstClockTime time;
+    gboolean followup;
+    gint received;
+    gint count = 0;
+    gint j;
+
+    GST_TRACE_OBJECT (self, "waiting on socket");
+    if (!g_socket_condition_wait (socket, G_IO_IN, cancel, &err)) {
+      if (err->code == G_IO_ERROR_CANCELLED)
+        break;
+
+      GST_WARNING_OBJECT (self, "socket error: %s", err->message);
+
+      /* try again */
+      g_usleep (G_USEC_PER_SEC / 10);
+      g_error_free (err);
+      err = NULL;
+      continue;
+    }
+
+    for (i = 0; i < batch_size; i++) {
+      struct msghdr *hdr = &rx_msgs[i].msg_hdr;
+      hdr->msg_name = &addrs[i];
+      hdr->msg_namelen = sizeof (addrs[i]);
+      hdr->msg_iov = &rx_iov[i];
+      hdr->msg_iovlen = 1;
+      hdr->msg_control = control + i * BATCH_CONTROL_SIZE;
+      hdr->msg_controllen = BATCH_CONTROL_SIZE;
+      hdr->msg_flags = 0;
+    }
+
+    /* got data in, take as much as is there */
+    received = recvmmsg (fd, rx_msgs, batch_size, MSG_DONTWAIT, NULL);
+    time = gst_clock_get_time (clock);
+
+    if (received < 0) {
+      if (errno != EAGAIN && errno != EINTR) {
+        GST_WARNING_OBJECT (self, "receive error: %s", g_strerror (errno));
+        g_usleep (G_USEC_PER_SEC / 10);
+      }
+      continue;
+    }
+
+    if (!IS_ACTIVE (self))
+      continue;
+
+    followup = self->priv->followup;
+    for (j = 0; j < received; j++) {
+      GstClockTimeDiff age = 0;
+
+      if (rx_msgs[j].msg_len < GST_DVB_CSS_WC_PACKET_SIZE) {
+        GST_DEBUG_OBJECT (self, "someone sent us a short packet (%u < %d)",
+            rx_msgs[j].msg_len, GST_DVB_CSS_WC_PACKET_SIZE);
+        continue;
+      }
+
+      gst_dvb_css_wc_packet_parse_into (rx_iov[j].iov_base, &replies[count]);
+      if (replies[count].message_type != GST_DVB_CSS_WC_MSG_REQUEST
+          || replies[count].version != 0) {
+        GST_ERROR_OBJECT (self, "Received non request message");
+        continue;
+      }
+
+      if (kernel_timestamps)
+        gst_dvb_css_wc_packet_get_cmsg_age (&rx_msgs[j].msg_hdr, &age);
+
+      replies[count].receive_timevalue = time - age;
+      replies[count].message_type = followup ?
+          GST_DVB_CSS_WC_MSG_RESPONSE_WITH_FOLLOWUP : GST_DVB_CSS_WC_MSG_RESPONSE;
+      replies[count].precision = precision;
+      replies[count].max_freq_error = max_freq_error;
+
+      memset (&tx_msgs[count], 0, sizeof (tx_msgs[count]));
+      tx_msgs[count].msg_hdr.msg_name = &addrs[j];
+      tx_msgs[count].msg_hdr.msg_namelen = rx_msgs[j].msg_hdr.msg_namelen;
+      tx_msgs[count].msg_hdr.msg_iov = &tx_iov[count];
+      tx_msgs[count].msg_hdr.msg_iovlen = 1;
+      count++;
+    }
+
+    if (count == 0)
+      continue;
+
+    gst_dvb_css_wc_server_send_batch (self, fd, tx_msgs, replies, count,
+        gst_clock_get_time (clock));
+
+    if (followup) {
+      /* the responses have just been handed to the kernel */
+      GstClockTime sent = gst_clock_get_time (clock);
+      for (j = 0; j < count; j++)
+        replies[j].message_type = GST_DVB_CSS_WC_MSG_FOLLOWUP;
+      gst_dvb_css_wc_server_send_batch (self, fd, tx_msgs, replies, count, sent);
+    }
+  }
+
+  g_error_free (err);
+  g_free (rx_msgs);
+  g_free (tx_msgs);
+  g_free (rx_iov);
+  g_free (tx_iov);
+  g_free (addrs);
+  g_free (rx_buffers);
+  g_free (tx_buffers);
+  g_free (control);
+  g_free (replies);
+
+  GST_TRACE_OBJECT (self, "dvb css wc server batch thread is stopping");
+  return NULL;
+}
+#endif
+
 static void
 gst_dvb_css_wc_server_set_property (GObject * object, guint prop_id,
     const GValue * value, GParamSpec * pspec)
@@ -279,6 +538,15 @@ gst_dvb_css_wc_server_set_property (GObject * object, guint prop_id,
     case PROP_MAX_FREQ_ERROR_PPM:
       self->priv->max_freq_error_ppm = g_value_get_uint (value);
       break;
+    case PROP_KERNEL_TIMESTAMPS:
+      self->priv->kernel_timestamps = g_value_get_boolean (value);
+      break;
+    case PROP_THREADS:
+      self->priv->n_threads = g_value_get_uint (value);
+      break;
+    case PROP_BATCH_SIZE:
+      self->priv->batch_size = g_value_get_uint (value);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
@@ -310,22 +578,75 @@ gst_dvb_css_wc_server_get_property (GObject * object, guint prop_id,
     case PROP_MAX_FREQ_ERROR_PPM:
       g_value_set_uint (value, self->priv->max_freq_error_ppm);
       break;
+    case PROP_KERNEL_TIMESTAMPS:
+      g_value_set_boolean (value, self->priv->kernel_timestamps);
+      break;
+    case PROP_THREADS:
+      g_value_set_uint (value, self->priv->n_threads);
+      break;
+    case PROP_BATCH_SIZE:
+      g_value_set_uint (value, self->priv->batch_size);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
       break;
   }
 }
 
+static GSocket *
+gst_dvb_css_wc_server_create_socket (GstDvbCssWcServer * self,
+    GInetAddress * inet_addr, gint port, GError ** error)
+{
+  GSocketAddress *socket_addr;
+  GSocket *socket;
+
+  GST_TRACE_OBJECT (self, "creating socket");
+  socket = g_socket_new (g_inet_address_get_family (inet_addr),
+      G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, error);
+
+  if (!socket) {
+    GST_ERROR_OBJECT (self, "could not create socket: %s", (*error)->message);
+    return NULL;
+  }
+
+  /* allow_reuse also sets SO_REUSEPORT on datagram sockets, which is what
+   * lets the sockets of all workers bind the same port */
+  GST_TRACE_OBJECT (self, "binding on port %d", port);
+  socket_addr = g_inet_socket_address_new (inet_addr, port);
+  if (!g_socket_bind (socket, socket_addr, TRUE, error)) {
+    GST_ERROR_OBJECT (self, "bind failed: %s", (*error)->message);
+    g_object_unref (socket_addr);
+    g_object_unref (socket);
+    return NULL;
+  }
+  g_object_unref (socket_addr);
+
+  return socket;
+}
+
 static gboolean
 gst_dvb_css_wc_server_start (GstDvbCssWcServer * self, GError ** error)
 {    
-  GSocketAddress *socket_addr, *bound_addr;
+  GSocketAddress *bound_addr;
   GInetAddress *inet_addr;
   GPollFD dummy_pollfd;
   GSocket *socket;  
   int port;
   gchar *address;
   GError *err = NULL;
+  GThreadFunc thread_func = gst_dvb_css_wc_server_thread;
+  guint i;
+
+#ifdef __linux__
+  if (self->priv->batch_size > 1)
+    thread_func = gst_dvb_css_wc_server_batch_thread;
+#else
+  if (self->priv->n_threads > 1 || self->priv->batch_size > 1) {
+    GST_WARNING_OBJECT (self, "multiple threads and batches are only supported on Linux");
+    self->priv->n_threads = 1;
+    self->priv->batch_size = 1;
+  }
+#endif
   
   if (self->priv->address) {
     inet_addr = g_inet_address_new_from_string (self->priv->address);
@@ -339,28 +660,20 @@ gst_dvb_css_wc_server_start (GstDvbCssWcServer * self, GError ** error)
     inet_addr = g_inet_address_new_any (G_SOCKET_FAMILY_IPV4);
   }
 
-  GST_TRACE_OBJECT (self, "creating socket");
-  socket = g_socket_new (g_inet_address_get_family (inet_addr),
-      G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, &err);
-
-  if (!socket)
-    goto no_socket;
-
-  GST_TRACE_OBJECT (self, "binding on port %d", self->priv->port);
-  socket_addr = g_inet_socket_address_new (inet_addr, self->priv->port);
-  if (!g_socket_bind (socket, socket_addr, TRUE, &err)) {
-    g_object_unref (socket_addr);
+  socket = gst_dvb_css_wc_server_create_socket (self, inet_addr, self->priv->port, &err);
+  if (!socket) {
     g_object_unref (inet_addr);
-    goto bind_error;
+    goto no_socket;
   }
-  g_object_unref (socket_addr);
-  g_object_unref (inet_addr);
+
+  self->priv->workers = g_new0 (GstDvbCssWcServerWorker, self->priv->n_threads);
+  self->priv->workers[0].server = self;
+  self->priv->workers[0].socket = socket;
 
   bound_addr = g_socket_get_local_address (socket, NULL);
   port = g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (bound_addr));
-  inet_addr =
-      g_inet_socket_address_get_address (G_INET_SOCKET_ADDRESS (bound_addr));
-  address = g_inet_address_to_string (inet_addr);
+  address = g_inet_address_to_string (
+      g_inet_socket_address_get_address (G_INET_SOCKET_ADDRESS (bound_addr)));
 
   if (g_strcmp0 (address, self->priv->address)) {
     g_free (self->priv->address);
@@ -379,16 +692,49 @@ gst_dvb_css_wc_server_start (GstDvbCssWcServer * self, GError ** error)
       self->priv->address, port);
   g_object_unref (bound_addr);
 
-  self->priv->socket = socket;
+  /* the other workers join the port the first one got */
+  for (i = 1; i < self->priv->n_threads; i++) {
+    socket = gst_dvb_css_wc_server_create_socket (self, inet_addr, port, &err);
+    if (!socket) {
+      g_object_unref (inet_addr);
+      goto no_socket;
+    }
+    self->priv->workers[i].server = self;
+    self->priv->workers[i].socket = socket;
+  }
+  g_object_unref (inet_addr);
+
+  /* in batches there is no telling which transmit timestamp belongs to which
+   * packet, so those only take receive timestamps. Without followups nothing
+   * would carry them, and reading them would only delay the next reply. */
+  self->priv->transmit_timestamps = self->priv->kernel_timestamps
+      && self->priv->batch_size == 1 && g_atomic_int_get (&self->priv->followup);
+  for (i = 0; i < self->priv->n_threads && self->priv->kernel_timestamps; i++) {
+    if (!gst_dvb_css_wc_packet_enable_timestamping (self->priv->workers[i].socket,
+            self->priv->transmit_timestamps)) {
+      GST_WARNING_OBJECT (self, "falling back to user space timestamps");
+      self->priv->kernel_timestamps = FALSE;
+      self->priv->transmit_timestamps = FALSE;
+      /* the sockets enabled so far would fill their error queues unread */
+      while (i-- > 0)
+        gst_dvb_css_wc_packet_disable_timestamping (self->priv->workers[i].socket);
+      break;
+    }
+  }
+
+  self->priv->precision_secs = measure_precision_sec (self->priv->clock);
+
   self->priv->cancel = g_cancellable_new ();
   self->priv->made_cancel_fd =
       g_cancellable_make_pollfd (self->priv->cancel, &dummy_pollfd);
 
-  self->priv->thread = g_thread_try_new ("GstDvbCssWcServer",
-      gst_dvb_css_wc_server_thread, self, &err);
+  for (i = 0; i < self->priv->n_threads; i++) {
+    self->priv->workers[i].thread = g_thread_try_new ("GstDvbCssWcServer",
+        thread_func, &self->priv->workers[i], &err);
 
-  if (!self->priv->thread)
-    goto no_thread;
+    if (!self->priv->workers[i].thread)
+      goto no_thread;
+  }
 
   return TRUE;
 
@@ -401,49 +747,53 @@ invalid_address:
   }
 no_socket:
   {
-    GST_ERROR_OBJECT (self, "could not create socket: %s", err->message);
-    g_propagate_error (error, err);
-    g_object_unref (inet_addr);
-    return FALSE;
-  }
-bind_error:
-  {
-    GST_ERROR_OBJECT (self, "bind failed: %s", err->message);
     g_propagate_error (error, err);
-    g_object_unref (socket);
+    if (self->priv->workers)
+      gst_dvb_css_wc_server_stop (self);
     return FALSE;
   }
 no_thread:
   {
     GST_ERROR_OBJECT (self, "could not create thread: %s", err->message);
     g_propagate_error (error, err);
-    g_object_unref (self->priv->socket);
-    self->priv->socket = NULL;
-    g_object_unref (self->priv->cancel);
-    self->priv->cancel = NULL;
+    gst_dvb_css_wc_server_stop (self);
     return FALSE;
   }
 }
 
+/* Also cleans up after a start that failed halfway */
 static void
 gst_dvb_css_wc_server_stop (GstDvbCssWcServer * self)
 {
-  g_return_if_fail (self->priv->thread != NULL);
+  guint i;
+
+  g_return_if_fail (self->priv->workers != NULL);
 
   GST_TRACE_OBJECT (self, "stopping..");
-  g_cancellable_cancel (self->priv->cancel);
+  if (self->priv->cancel)
+    g_cancellable_cancel (self->priv->cancel);
+
+  for (i = 0; i < self->priv->n_threads; i++) {
+    GstDvbCssWcServerWorker *worker = &self->priv->workers[i];
 
-  g_thread_join (self->priv->thread);
-  self->priv->thread = NULL;
+    if (worker->thread)
+      g_thread_join (worker->thread);
+    worker->thread = NULL;
 
-  if (self->priv->made_cancel_fd)
-    g_cancellable_release_fd (self->priv->cancel);
+    if (worker->socket)
+      g_object_unref (worker->socket);
+    worker->socket = NULL;
+  }
+  g_free (self->priv->workers);
+  self->priv->workers = NULL;
 
-  g_object_unref (self->priv->cancel);
-  self->priv->cancel = NULL;
+  if (self->priv->cancel) {
+    if (self->priv->made_cancel_fd)
+      g_cancellable_release_fd (self->priv->cancel);
 
-  g_object_unref (self->priv->socket);
-  self->priv->socket = NULL;
+    g_object_unref (self->priv->cancel);
+    self->priv->cancel = NULL;
+  }
 
   GST_DEBUG_OBJECT (self, "stopped");
 }
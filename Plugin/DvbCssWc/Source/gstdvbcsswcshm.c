@@ -0,0 +1,695 @@
+/* GStreamer
+ * Copyright (C) 2016
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* One DVB CSS WC client clock per host talks to the server and publishes its
+ * calibration in a POSIX shared memory segment. Clocks in other processes
+ * read it without locks through a seqlock: the writer makes the sequence
+ * number odd, updates the fields and makes it even again, readers retry when
+ * it was odd or changed while they copied the fields.
+ *
+ * The calibration maps the publisher's internal time, so readers must use
+ * the same clock, which is why the segment carries the GstClockType.
+ *
+ * The writer holds an exclusive flock() on the segment for as long as it
+ * lives. The kernel drops it when the process dies, which is how readers and
+ * would-be writers tell a live publisher from a stale segment. */
+
+#include "gstdvbcsswcshm.h"
+
+#include <gio/gio.h>
+
+#if defined (G_OS_UNIX) && !defined (__ANDROID__)
+# define HAVE_SHM 1
+# include <errno.h>
+# include <fcntl.h>
+# include <unistd.h>
+# include <sys/file.h>
+# include <sys/mman.h>
+# include <sys/stat.h>
+#endif
+
+#define SHM_MAGIC    0x53435744  /* "DWCS" */
+#define SHM_VERSION  1
+/* A writer that died halfway through an update leaves the sequence odd.
+ * Readers check whether it still lives after this many attempts, and give up
+ * after SHM_READ_ATTEMPTS: they keep running on the last calibration they
+ * read and report the clock as unsynced */
+#define SHM_WRITER_CHECK_ATTEMPTS 100
+#define SHM_READ_ATTEMPTS 10000
+/* How often readers look for the segment and for the publisher's state */
+#define WATCH_INTERVAL (100 * G_TIME_SPAN_MILLISECOND)
+
+GST_DEBUG_CATEGORY_STATIC (dvbcss_wc_shm);
+#define GST_CAT_DEFAULT   (dvbcss_wc_shm)
+#define _do_init GST_DEBUG_CATEGORY_INIT (dvbcss_wc_shm, "dvbcss_wc_shm", 0, "DVB CSS WC shared memory clock");
+
+typedef struct
+{
+  guint32 magic;
+  guint32 version;
+  gint32  clock_type;
+  gint    seq;          /* odd while the writer updates the fields below */
+  guint64 epoch;        /* bumped every time a new writer takes over */
+  gint32  synced;
+  guint32 reserved;
+  guint64 internal;
+  guint64 external;
+  guint64 rate_num;
+  guint64 rate_denom;
+  guint64 dispersion;
+} ShmSegment;
+
+typedef struct
+{
+  guint64      epoch;
+  gboolean     synced;
+  GstClockTime internal;
+  GstClockTime external;
+  GstClockTime rate_num;
+  GstClockTime rate_denom;
+  GstClockTime dispersion;
+} ShmCalibration;
+
+#ifdef HAVE_SHM
+/* TRUE if a writer holds the segment open */
+static gboolean
+shm_has_writer (gint fd)
+{
+  if (flock (fd, LOCK_SH | LOCK_NB) == 0)
+  {
+    flock (fd, LOCK_UN);
+    return FALSE;
+  }
+  return errno == EWOULDBLOCK;
+}
+
+/* Copies a consistent calibration out of the segment, returns FALSE if the
+ * writer kept it busy or died while updating it, which is only checked when
+ * fd is the segment's descriptor. Whether the copy can be used is up to
+ * shm_usable(). */
+static gboolean
+shm_read (ShmSegment *segment, ShmCalibration *calibration, gint fd)
+{
+  guint attempt;
+
+  for (attempt = 0; attempt < SHM_READ_ATTEMPTS; attempt++)
+  {
+    gint begin = g_atomic_int_get (&segment->seq);
+    if (begin & 1)
+    {
+      /* the writer is in the middle of an update, which takes nanoseconds */
+      if (attempt == SHM_WRITER_CHECK_ATTEMPTS && fd >= 0 && !shm_has_writer (fd))
+      {
+        return FALSE;
+      }
+      continue;
+    }
+
+    calibration->epoch      = segment->epoch;
+    calibration->synced     = segment->synced;
+    calibration->internal   = segment->internal;
+    calibration->external   = segment->external;
+    calibration->rate_num   = segment->rate_num;
+    calibration->rate_denom = segment->rate_denom;
+    calibration->dispersion = segment->dispersion;
+
+    /* the copies above must be complete before the sequence is read again */
+    __sync_synchronize ();
+    if (g_atomic_int_get (&segment->seq) == begin)
+    {
+      return TRUE;
+    }
+  }
+  return FALSE;
+}
+
+/* TRUE if the publisher was synced when it wrote calibration */
+static gboolean
+shm_usable (const ShmCalibration *calibration)
+{
+  return calibration->synced && calibration->rate_denom != 0;
+}
+
+/* Stores calibration in segment for shm_read(), there must be one writer only */
+static void
+shm_write (ShmSegment *segment, const ShmCalibration *calibration)
+{
+  g_atomic_int_inc (&segment->seq);
+  segment->epoch      = calibration->epoch;
+  segment->synced     = calibration->synced;
+  segment->internal   = calibration->internal;
+  segment->external   = calibration->external;
+  segment->rate_num   = calibration->rate_num;
+  segment->rate_denom = calibration->rate_denom;
+  segment->dispersion = calibration->dispersion;
+  g_atomic_int_inc (&segment->seq);
+}
+
+#endif
+
+gboolean
+gst_dvb_css_wc_shm_is_published (const gchar *shm_name)
+{
+#ifdef HAVE_SHM
+  gboolean published;
+  gint     fd;
+
+  g_return_val_if_fail (shm_name != NULL, FALSE);
+
+  fd = shm_open (shm_name, O_RDONLY, 0);
+  if (fd < 0)
+  {
+    return FALSE;
+  }
+  published = shm_has_writer (fd);
+  close (fd);
+  return published;
+#else
+  return FALSE;
+#endif
+}
+
+
+//==============================================================================
+// GstDvbCssWcShmWriter
+//==============================================================================
+
+struct _GstDvbCssWcShmWriter
+{
+  gchar      *name;
+  gint        fd;
+  ShmSegment *segment;
+};
+
+/**
+ * gst_dvb_css_wc_shm_writer_new:
+ * @shm_name: name of the shared memory segment
+ * @clock_type: the clock the published internal times are taken from
+ * @error: return address for a #GError, or NULL
+ *
+ * Creates or takes over @shm_name. Fails if another writer, in this or
+ * another process, already publishes in it.
+ *
+ * Returns: the writer, or NULL on error.
+ */
+GstDvbCssWcShmWriter *
+gst_dvb_css_wc_shm_writer_new (const gchar *shm_name, GstClockType clock_type, GError **error)
+{
+#ifdef HAVE_SHM
+  GstDvbCssWcShmWriter *writer;
+  ShmSegment           *segment;
+  guint64               epoch = 1;
+  gint                  fd;
+  gint                  errsv;
+
+  g_return_val_if_fail (shm_name != NULL, NULL);
+  g_type_ensure (GST_TYPE_DVB_CSS_WC_SHM_CLOCK);
+
+  fd = shm_open (shm_name, O_RDWR | O_CREAT, 0644);
+  if (fd < 0)
+  {
+    goto failed;
+  }
+  if (flock (fd, LOCK_EX | LOCK_NB) < 0)
+  {
+    errsv = errno;
+    close (fd);
+    errno = errsv;
+    goto failed;
+  }
+  if (ftruncate (fd, sizeof (ShmSegment)) < 0)
+  {
+    errsv = errno;
+    close (fd);
+    errno = errsv;
+    goto failed;
+  }
+  segment = mmap (NULL, sizeof (ShmSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (segment == MAP_FAILED)
+  {
+    errsv = errno;
+    close (fd);
+    errno = errsv;
+    goto failed;
+  }
+
+  /* readers of the last writer keep their mapping, so the segment is reused */
+  if (segment->magic == SHM_MAGIC && segment->version == SHM_VERSION)
+  {
+    epoch = segment->epoch + 1;
+  }
+  /* the last writer may have died in the middle of an update */
+  if (g_atomic_int_get (&segment->seq) & 1)
+  {
+    g_atomic_int_inc (&segment->seq);
+  }
+
+  g_atomic_int_inc (&segment->seq);
+  segment->magic      = SHM_MAGIC;
+  segment->version    = SHM_VERSION;
+  segment->clock_type = clock_type;
+  segment->epoch      = epoch;
+  segment->synced     = FALSE;
+  g_atomic_int_inc (&segment->seq);
+
+  writer          = g_new0 (GstDvbCssWcShmWriter, 1);
+  writer->name    = g_strdup (shm_name);
+  writer->fd      = fd;
+  writer->segment = segment;
+
+  GST_INFO ("publishing in %s, epoch %" G_GUINT64_FORMAT, shm_name, epoch);
+  return writer;
+
+failed:
+  {
+    errsv = errno;
+    g_set_error (error, G_IO_ERROR, g_io_error_from_errno (errsv),
+        "cannot publish in %s: %s", shm_name,
+        errsv == EWOULDBLOCK ? "already published by another clock" : g_strerror (errsv));
+    return NULL;
+  }
+#else
+  g_set_error (error, G_IO_ERROR, G_IO_ERROR_NOT_SUPPORTED,
+      "shared memory clocks are not supported on this platform");
+  return NULL;
+#endif
+}
+
+/**
+ * gst_dvb_css_wc_shm_writer_publish:
+ * @writer: a #GstDvbCssWcShmWriter
+ * @synced: whether the calibration is valid
+ * @internal: calibration internal time
+ * @external: calibration external time
+ * @rate_num: calibration rate numerator
+ * @rate_denom: calibration rate denominator
+ * @dispersion: the error bound of the calibration
+ *
+ * Publishes a calibration, readers see either all of it or none.
+ */
+void
+gst_dvb_css_wc_shm_writer_publish (GstDvbCssWcShmWriter *writer, gboolean synced,
+    GstClockTime internal, GstClockTime external,
+    GstClockTime rate_num, GstClockTime rate_denom,
+    GstClockTime dispersion)
+{
+#ifdef HAVE_SHM
+  ShmSegment *segment = writer->segment;
+
+  g_atomic_int_inc (&segment->seq);
+  segment->synced     = synced;
+  segment->internal   = internal;
+  segment->external   = external;
+  segment->rate_num   = rate_num;
+  segment->rate_denom = rate_denom;
+  segment->dispersion = dispersion;
+  g_atomic_int_inc (&segment->seq);
+#endif
+}
+
+/**
+ * gst_dvb_css_wc_shm_writer_free:
+ * @writer: a #GstDvbCssWcShmWriter
+ *
+ * Stops publishing. Readers report themselves unsynced and keep running on
+ * the last calibration until another writer takes over.
+ */
+void
+gst_dvb_css_wc_shm_writer_free (GstDvbCssWcShmWriter *writer)
+{
+#ifdef HAVE_SHM
+  ShmSegment *segment = writer->segment;
+
+  g_atomic_int_inc (&segment->seq);
+  segment->synced = FALSE;
+  g_atomic_int_inc (&segment->seq);
+
+  munmap (segment, sizeof (ShmSegment));
+  close (writer->fd);
+  g_free (writer->name);
+  g_free (writer);
+#endif
+}
+
+
+//==============================================================================
+// GST_DVB_CSS_WC_SHM_CLOCK
+//==============================================================================
+
+enum
+{
+  PROP_0,
+  PROP_SHM_NAME,
+};
+
+#define GST_DVB_CSS_WC_SHM_CLOCK_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), GST_TYPE_DVB_CSS_WC_SHM_CLOCK, GstDvbCssWcShmClockPrivate))
+
+struct _GstDvbCssWcShmClockPrivate
+{
+  gchar      *shm_name;
+  gint        fd;
+  ShmSegment *segment;   /* ATOMIC, mapped once and then never changed */
+  /* whether a writer held the segment when last checked. A dead writer's
+   * segment is not read at all, it may be stuck in the middle of an update */
+  gint        writer_alive;  /* ATOMIC */
+  /* epoch of the writer the thread last followed */
+  guint64     epoch;
+
+  GThread    *thread;
+  GMutex      lock;
+  GCond       cond;
+  gboolean    stopping;  /* protected by lock */
+
+  /* the last calibration the publisher was synced with, which the clock keeps
+   * running on while the publisher is gone. Only written by the thread, read
+   * like the segment */
+  ShmSegment  last;
+};
+
+G_DEFINE_TYPE_WITH_CODE (GstDvbCssWcShmClock, gst_dvb_css_wc_shm_clock, GST_TYPE_SYSTEM_CLOCK, _do_init);
+
+static void         gst_dvb_css_wc_shm_clock_finalize          (GObject *object);
+static void         gst_dvb_css_wc_shm_clock_set_property      (GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec);
+static void         gst_dvb_css_wc_shm_clock_get_property      (GObject *object, guint prop_id, GValue *value, GParamSpec *pspec);
+static void         gst_dvb_css_wc_shm_clock_constructed       (GObject *object);
+static GstClockTime gst_dvb_css_wc_shm_clock_get_internal_time (GstClock *clock);
+static gpointer     gst_dvb_css_wc_shm_clock_thread            (gpointer data);
+
+static void
+gst_dvb_css_wc_shm_clock_class_init (GstDvbCssWcShmClockClass *klass)
+{
+  GObjectClass  *gobject_class = G_OBJECT_CLASS (klass);
+  GstClockClass *clock_class   = GST_CLOCK_CLASS (klass);
+
+  g_type_class_add_private (klass, sizeof (GstDvbCssWcShmClockPrivate));
+
+  gobject_class->finalize       = gst_dvb_css_wc_shm_clock_finalize;
+  gobject_class->get_property   = gst_dvb_css_wc_shm_clock_get_property;
+  gobject_class->set_property   = gst_dvb_css_wc_shm_clock_set_property;
+  gobject_class->constructed    = gst_dvb_css_wc_shm_clock_constructed;
+  clock_class->get_internal_time = gst_dvb_css_wc_shm_clock_get_internal_time;
+
+  g_object_class_install_property (gobject_class, PROP_SHM_NAME,
+      g_param_spec_string ("shm-name", "Shared memory name",
+          "Name of the shared memory segment the calibration is read from", NULL,
+          G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS));
+}
+
+static void
+gst_dvb_css_wc_shm_clock_init (GstDvbCssWcShmClock *self)
+{
+  GstDvbCssWcShmClockPrivate *priv;
+
+  GST_OBJECT_FLAG_SET (self, GST_CLOCK_FLAG_NEEDS_STARTUP_SYNC);
+
+  self->priv = priv = GST_DVB_CSS_WC_SHM_CLOCK_GET_PRIVATE (self);
+  priv->shm_name = NULL;
+  priv->fd       = -1;
+  priv->segment  = NULL;
+  priv->writer_alive = FALSE;
+  priv->epoch    = 0;
+  priv->thread   = NULL;
+  priv->stopping = FALSE;
+  g_mutex_init (&priv->lock);
+  g_cond_init (&priv->cond);
+  priv->last.seq        = 0;
+  priv->last.synced     = FALSE;
+  priv->last.rate_denom = 0;
+}
+
+static void
+gst_dvb_css_wc_shm_clock_finalize (GObject *object)
+{
+  GstDvbCssWcShmClock *self = GST_DVB_CSS_WC_SHM_CLOCK (object);
+
+  if (self->priv->thread != NULL)
+  {
+    g_mutex_lock (&self->priv->lock);
+    self->priv->stopping = TRUE;
+    g_cond_signal (&self->priv->cond);
+    g_mutex_unlock (&self->priv->lock);
+    g_thread_join (self->priv->thread);
+  }
+
+#ifdef HAVE_SHM
+  if (self->priv->segment != NULL)
+  {
+    munmap (self->priv->segment, sizeof (ShmSegment));
+  }
+  if (self->priv->fd >= 0)
+  {
+    close (self->priv->fd);
+  }
+#endif
+
+  g_free (self->priv->shm_name);
+  g_mutex_clear (&self->priv->lock);
+  g_cond_clear (&self->priv->cond);
+
+  G_OBJECT_CLASS (gst_dvb_css_wc_shm_clock_parent_class)->finalize (object);
+}
+
+static void
+gst_dvb_css_wc_shm_clock_set_property (GObject *object, guint prop_id, const GValue *value, GParamSpec *pspec)
+{
+  GstDvbCssWcShmClock *self = GST_DVB_CSS_WC_SHM_CLOCK (object);
+
+  switch (prop_id)
+  {
+    case PROP_SHM_NAME:
+    {
+      g_free (self->priv->shm_name);
+      self->priv->shm_name = g_value_dup_string (value);
+      break;
+    }
+    default:
+    {
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+  }
+}
+
+static void
+gst_dvb_css_wc_shm_clock_get_property (GObject *object, guint prop_id, GValue *value, GParamSpec *pspec)
+{
+  GstDvbCssWcShmClock *self = GST_DVB_CSS_WC_SHM_CLOCK (object);
+
+  switch (prop_id)
+  {
+    case PROP_SHM_NAME:
+    {
+      g_value_set_string (value, self->priv->shm_name);
+      break;
+    }
+    default:
+    {
+      G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
+      break;
+    }
+  }
+}
+
+/* Maps the segment once a writer created it */
+static gboolean
+gst_dvb_css_wc_shm_clock_open (GstDvbCssWcShmClock *self)
+{
+#ifdef HAVE_SHM
+  ShmSegment  *segment;
+  struct stat  st;
+  gint         fd;
+
+  fd = shm_open (self->priv->shm_name, O_RDONLY, 0);
+  if (fd < 0)
+  {
+    return FALSE;
+  }
+  if (fstat (fd, &st) < 0 || st.st_size < (off_t) sizeof (ShmSegment))
+  {
+    close (fd);
+    return FALSE;
+  }
+  /* read-only, but the sequence number is read with atomic operations */
+  segment = mmap (NULL, sizeof (ShmSegment), PROT_READ, MAP_SHARED, fd, 0);
+  if (segment == MAP_FAILED)
+  {
+    close (fd);
+    return FALSE;
+  }
+  if (segment->magic != SHM_MAGIC || segment->version != SHM_VERSION)
+  {
+    GST_WARNING_OBJECT (self, "%s is not a clock segment of this version", self->priv->shm_name);
+    munmap (segment, sizeof (ShmSegment));
+    close (fd);
+    return FALSE;
+  }
+
+  /* read the same clock the publisher calibrated */
+  g_object_set (self, "clock-type", (GstClockType) segment->clock_type, NULL);
+
+  self->priv->fd = fd;
+  g_atomic_int_set (&self->priv->writer_alive, shm_has_writer (fd));
+  g_atomic_pointer_set (&self->priv->segment, segment);
+  GST_DEBUG_OBJECT (self, "reading calibration from %s", self->priv->shm_name);
+  return TRUE;
+#else
+  return FALSE;
+#endif
+}
+
+static void
+gst_dvb_css_wc_shm_clock_constructed (GObject *object)
+{
+  GstDvbCssWcShmClock *self = GST_DVB_CSS_WC_SHM_CLOCK (object);
+
+  G_OBJECT_CLASS (gst_dvb_css_wc_shm_clock_parent_class)->constructed (object);
+
+  gst_dvb_css_wc_shm_clock_open (self);
+  self->priv->thread = g_thread_new ("GstDvbCssWcShmClock", gst_dvb_css_wc_shm_clock_thread, self);
+}
+
+/* Follows the synced state of the publisher, and waits for the segment if
+ * it did not exist yet. The time itself is read without this thread. */
+static gpointer
+gst_dvb_css_wc_shm_clock_thread (gpointer data)
+{
+  GstDvbCssWcShmClock *self = data;
+
+  g_mutex_lock (&self->priv->lock);
+  while (!self->priv->stopping)
+  {
+    gint64 deadline = g_get_monotonic_time () + WATCH_INTERVAL;
+
+    g_mutex_unlock (&self->priv->lock);
+#ifdef HAVE_SHM
+    {
+      ShmSegment     *segment = g_atomic_pointer_get (&self->priv->segment);
+      ShmCalibration  calibration;
+      gboolean        synced  = FALSE;
+      gboolean        alive;
+
+      if (segment == NULL && gst_dvb_css_wc_shm_clock_open (self))
+      {
+        segment = self->priv->segment;
+      }
+      if (segment != NULL)
+      {
+        /* a publisher that died cannot say so, its lock tells */
+        alive = shm_has_writer (self->priv->fd);
+        g_atomic_int_set (&self->priv->writer_alive, alive);
+        synced = alive && shm_read (segment, &calibration, self->priv->fd) && shm_usable (&calibration);
+      }
+      /* a new publisher may be synced to another session of the server, so
+       * users are told the clock was lost for one round before following it */
+      if (synced && calibration.epoch != self->priv->epoch)
+      {
+        if (self->priv->epoch != 0 && gst_clock_is_synced (GST_CLOCK_CAST (self)))
+        {
+          GST_INFO_OBJECT (self, "publisher changed, epoch %" G_GUINT64_FORMAT, calibration.epoch);
+          synced = FALSE;
+        }
+        else
+        {
+          self->priv->epoch = calibration.epoch;
+        }
+      }
+      if (synced)
+      {
+        shm_write (&self->priv->last, &calibration);
+      }
+      if (synced != gst_clock_is_synced (GST_CLOCK_CAST (self)))
+      {
+        GST_INFO_OBJECT (self, "publisher %s", synced ? "synced" : "lost");
+        gst_clock_set_synced (GST_CLOCK_CAST (self), synced);
+      }
+    }
+#endif
+    g_mutex_lock (&self->priv->lock);
+    while (!self->priv->stopping && g_cond_wait_until (&self->priv->cond, &self->priv->lock, deadline))
+      ;
+  }
+  g_mutex_unlock (&self->priv->lock);
+  return NULL;
+}
+
+static GstClockTime
+gst_dvb_css_wc_shm_clock_get_internal_time (GstClock *clock)
+{
+  GstDvbCssWcShmClock *self = GST_DVB_CSS_WC_SHM_CLOCK (clock);
+  GstClockTime         now;
+
+  now = GST_CLOCK_CLASS (gst_dvb_css_wc_shm_clock_parent_class)->get_internal_time (clock);
+#ifdef HAVE_SHM
+  {
+    ShmSegment     *segment = g_atomic_pointer_get (&self->priv->segment);
+    ShmCalibration  calibration;
+    gboolean        valid   = FALSE;
+
+    /* a torn read or an unsynced publisher must not make the time jump back to
+     * the local clock, the thread reports the loss of sync */
+    if (segment != NULL && g_atomic_int_get (&self->priv->writer_alive))
+    {
+      valid = shm_read (segment, &calibration, self->priv->fd);
+      if (!valid)
+      {
+        /* until the thread sees the writer again */
+        g_atomic_int_set (&self->priv->writer_alive, FALSE);
+      }
+      valid = valid && shm_usable (&calibration);
+    }
+    if (valid || (shm_read (&self->priv->last, &calibration, -1) && shm_usable (&calibration)))
+    {
+      return gst_clock_adjust_with_calibration (clock, now, calibration.internal, calibration.external,
+          calibration.rate_num, calibration.rate_denom);
+    }
+  }
+#endif
+  return now;
+}
+
+GstClockTime
+gst_dvb_css_wc_shm_clock_get_dispersion (GstClock *clock)
+{
+#ifdef HAVE_SHM
+  GstDvbCssWcShmClock *self;
+  ShmCalibration       calibration;
+
+  g_return_val_if_fail (GST_IS_DVB_CSS_WC_SHM_CLOCK (clock), GST_CLOCK_TIME_NONE);
+
+  self = GST_DVB_CSS_WC_SHM_CLOCK (clock);
+  if (shm_read (&self->priv->last, &calibration, -1) && shm_usable (&calibration))
+  {
+    return calibration.dispersion;
+  }
+#endif
+  return GST_CLOCK_TIME_NONE;
+}
+
+GstClock*
+gst_dvb_css_wc_shm_clock_new (const gchar *name, const gchar *shm_name)
+{
+  g_return_val_if_fail (shm_name != NULL, NULL);
+
+#ifdef HAVE_SHM
+  return g_object_new (GST_TYPE_DVB_CSS_WC_SHM_CLOCK, "name", name, "shm-name", shm_name, NULL);
+#else
+  GST_ERROR ("shared memory clocks are not supported on this platform");
+  return NULL;
+#endif
+}
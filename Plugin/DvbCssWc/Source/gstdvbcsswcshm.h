@@ -0,0 +1,112 @@
+#ifndef __DVB_CSS_WC_SHM_H__
+#define __DVB_CSS_WC_SHM_H__
+
+/* GStreamer
+ * Copyright (C) 2016
+ *
+ * gstdvbcsswcshm.h: publishes the calibration of a DVB CSS WC client clock
+ * in shared memory, and a clock reading it in other processes
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#include <gst/gst.h>
+#include <gst/gstsystemclock.h>
+
+G_BEGIN_DECLS
+
+#define GST_TYPE_DVB_CSS_WC_SHM_CLOCK            (gst_dvb_css_wc_shm_clock_get_type())
+#define GST_DVB_CSS_WC_SHM_CLOCK(obj)            (G_TYPE_CHECK_INSTANCE_CAST((obj), GST_TYPE_DVB_CSS_WC_SHM_CLOCK, GstDvbCssWcShmClock))
+#define GST_DVB_CSS_WC_SHM_CLOCK_CLASS(klass)    (G_TYPE_CHECK_CLASS_CAST((klass),  GST_TYPE_DVB_CSS_WC_SHM_CLOCK, GstDvbCssWcShmClockClass))
+#define GST_IS_DVB_CSS_WC_SHM_CLOCK(obj)         (G_TYPE_CHECK_INSTANCE_TYPE((obj), GST_TYPE_DVB_CSS_WC_SHM_CLOCK))
+#define GST_IS_DVB_CSS_WC_SHM_CLOCK_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass),  GST_TYPE_DVB_CSS_WC_SHM_CLOCK))
+
+typedef struct _GstDvbCssWcShmClock        GstDvbCssWcShmClock;
+typedef struct _GstDvbCssWcShmClockClass   GstDvbCssWcShmClockClass;
+typedef struct _GstDvbCssWcShmClockPrivate GstDvbCssWcShmClockPrivate;
+
+/**
+ * GstDvbCssWcShmClock:
+ *
+ * Opaque #GstDvbCssWcShmClock structure.
+ */
+struct _GstDvbCssWcShmClock
+{
+  GstSystemClock clock;
+
+  /*< private >*/
+  GstDvbCssWcShmClockPrivate *priv;
+  gpointer _gst_reserved[GST_PADDING];
+};
+
+struct _GstDvbCssWcShmClockClass
+{
+  GstSystemClockClass parent_class;
+
+  /*< private >*/
+  gpointer _gst_reserved[GST_PADDING];
+};
+
+/**
+ * GstDvbCssWcShmWriter:
+ *
+ * Publishes a calibration in a shared memory segment. Only one writer per
+ * segment can exist on a host at a time.
+ */
+typedef struct _GstDvbCssWcShmWriter GstDvbCssWcShmWriter;
+
+/**
+ * gst_dvb_css_wc_shm_clock_new:
+ * @name: a name for the clock
+ * @shm_name: name of the shared memory segment, e.g. "/dvbcsswc-5000"
+ *
+ * Create a new #GstClock that reports the time of the DVB CSS WC client
+ * clock publishing in @shm_name, see the "shm-name" property of
+ * #GstDvbCssWcClientClock. Reading the time takes no lock and makes no
+ * system call beyond reading the local clock. The clock is synced while the
+ * publisher is, and reports itself unsynced once when another publisher
+ * takes over the segment.
+ *
+ * Returns: a new #GstClock, or NULL where shared memory is not supported.
+ */
+GstClock*             gst_dvb_css_wc_shm_clock_new       (const gchar *name, const gchar *shm_name);
+GType                 gst_dvb_css_wc_shm_clock_get_type  (void);
+
+/**
+ * gst_dvb_css_wc_shm_clock_get_dispersion:
+ * @clock: a #GstDvbCssWcShmClock
+ *
+ * Returns: the error bound the publisher gave with the calibration the clock
+ * runs on, or GST_CLOCK_TIME_NONE if it has none.
+ */
+GstClockTime          gst_dvb_css_wc_shm_clock_get_dispersion (GstClock *clock);
+
+GstDvbCssWcShmWriter* gst_dvb_css_wc_shm_writer_new      (const gchar *shm_name, GstClockType clock_type, GError **error);
+void                  gst_dvb_css_wc_shm_writer_publish  (GstDvbCssWcShmWriter *writer, gboolean synced,
+                                                          GstClockTime internal, GstClockTime external,
+                                                          GstClockTime rate_num, GstClockTime rate_denom,
+                                                          GstClockTime dispersion);
+void                  gst_dvb_css_wc_shm_writer_free     (GstDvbCssWcShmWriter *writer);
+
+gboolean              gst_dvb_css_wc_shm_is_published    (const gchar *shm_name);
+
+#ifdef G_DEFINE_AUTOPTR_CLEANUP_FUNC
+G_DEFINE_AUTOPTR_CLEANUP_FUNC(GstDvbCssWcShmClock, gst_object_unref)
+#endif
+
+G_END_DECLS
+
+#endif /* __DVB_CSS_WC_SHM_H__ */
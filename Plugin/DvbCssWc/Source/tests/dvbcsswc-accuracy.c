@@ -0,0 +1,273 @@
+/* GStreamer
+ *
+ * dvbcsswc-accuracy.c: How well a WC client clock follows the server through
+ * an impaired network
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* The server, the impairment proxy and the client run in this process, so
+ * the true offset error is known at any time: it is the difference between
+ * the client clock and the clock the server publishes, read back to back.
+ * The server clock is a system clock calibrated with --offset and --drift,
+ * which from the client's point of view is the same as running the client
+ * on an offset, drifting clock.
+ *
+ * Prints the error every second, then the convergence time (from which on
+ * the error stays within --threshold), the steady-state bias and jitter.
+ * Exits with 1 if the client did not converge. */
+
+#include <stdlib.h>
+#include <math.h>
+#include <gst/gst.h>
+#include <gstdvbcsswcserver.h>
+#include <gstdvbcsswcclient.h>
+#include "dvbcsswc-impair.h"
+
+#define SAMPLE_INTERVAL (50 * GST_MSECOND)
+
+typedef struct
+{
+  const gchar *name;
+  gdouble      delay_ms;
+  gdouble      asymmetry_ms;
+  gdouble      jitter_ms;
+  const gchar *distribution;
+  gdouble      loss;
+  gdouble      reorder;
+} Preset;
+
+static const Preset presets[] = {
+  { "none",       0,  0,   0,   "uniform",     0,    0    },
+  { "lan",        0.2, 0,  0.1, "exponential", 0,    0    },
+  { "wifi",       2,  0,   3,   "exponential", 0.01, 0.01 },
+  { "asymmetric", 5,  4,   0.5, "normal",      0,    0    },
+  { "lossy",      10, 0,   5,   "normal",      0.2,  0.05 },
+};
+
+static gchar   *preset_name   = NULL;
+static gdouble  delay_ms      = 1;
+static gdouble  asymmetry_ms  = 0;
+static gdouble  jitter_ms     = 0.5;
+static gchar   *distribution  = NULL;
+static gdouble  loss          = 0;
+static gdouble  reorder       = 0;
+static gdouble  reorder_ms    = 20;
+static gint     seed          = 1;
+static gdouble  offset_s      = 1000;
+static gdouble  drift_ppm     = 50;
+static gint     duration      = 60;
+static gdouble  threshold_us  = 1000;
+static gchar   *filter_name   = NULL;
+static gdouble  slew_ms       = 0;
+
+static GOptionEntry entries[] = {
+  {"preset", 0, 0, G_OPTION_ARG_STRING, &preset_name, "none, lan, wifi, asymmetric or lossy, overrides the network options", "NAME"},
+  {"delay", 0, 0, G_OPTION_ARG_DOUBLE, &delay_ms, "One-way delay in ms (1)", "MS"},
+  {"asymmetry", 0, 0, G_OPTION_ARG_DOUBLE, &asymmetry_ms, "Extra delay of the return path in ms (0)", "MS"},
+  {"jitter", 0, 0, G_OPTION_ARG_DOUBLE, &jitter_ms, "Scale of the random delay in ms (0.5)", "MS"},
+  {"distribution", 0, 0, G_OPTION_ARG_STRING, &distribution, "uniform, exponential or normal (uniform)", "NAME"},
+  {"loss", 0, 0, G_OPTION_ARG_DOUBLE, &loss, "Probability a packet is lost (0)", "P"},
+  {"reorder", 0, 0, G_OPTION_ARG_DOUBLE, &reorder, "Probability a packet is reordered (0)", "P"},
+  {"reorder-delay", 0, 0, G_OPTION_ARG_DOUBLE, &reorder_ms, "How long reordered packets are held back in ms (20)", "MS"},
+  {"seed", 0, 0, G_OPTION_ARG_INT, &seed, "Seed of the impairments (1)", "N"},
+  {"offset", 0, 0, G_OPTION_ARG_DOUBLE, &offset_s, "Offset of the server clock in s (1000)", "S"},
+  {"drift", 0, 0, G_OPTION_ARG_DOUBLE, &drift_ppm, "Drift of the server clock in ppm (50)", "PPM"},
+  {"duration", 0, 0, G_OPTION_ARG_INT, &duration, "Seconds to run (60)", "SECS"},
+  {"threshold", 0, 0, G_OPTION_ARG_DOUBLE, &threshold_us, "Error in us the client must stay within (1000)", "US"},
+  {"slew-threshold", 0, 0, G_OPTION_ARG_DOUBLE, &slew_ms, "Slew corrections up to this size in ms instead of stepping (0)", "MS"},
+  {"filter", 0, 0, G_OPTION_ARG_STRING, &filter_name, "Offset filter of the client: dispersion, lowest-rtt, median or huber", "NAME"},
+  {NULL}
+};
+
+static gboolean
+apply_preset (const gchar *name, Impairment *impairment)
+{
+  guint i;
+
+  for (i = 0; i < G_N_ELEMENTS (presets); i++)
+  {
+    if (g_strcmp0 (presets[i].name, name) != 0)
+    {
+      continue;
+    }
+    impairment->delay     = (GstClockTime) (presets[i].delay_ms * GST_MSECOND);
+    impairment->asymmetry = (GstClockTimeDiff) (presets[i].asymmetry_ms * GST_MSECOND);
+    impairment->jitter    = (GstClockTime) (presets[i].jitter_ms * GST_MSECOND);
+    impairment->loss      = presets[i].loss;
+    impairment->reorder   = presets[i].reorder;
+    impair_distribution_from_string (presets[i].distribution, &impairment->distribution);
+    return TRUE;
+  }
+  return FALSE;
+}
+
+int main (int argc, char *argv[])
+{
+  GOptionContext    *ctx;
+  GError            *err        = NULL;
+  Impairment         impairment = { 0, };
+  ImpairProxy       *proxy;
+  GstClock          *server_clock;
+  GstClock          *client_clock;
+  GstDvbCssWcServer *server;
+  GArray            *errors;
+  gint               port;
+  gint64             start;
+  gint64             converged_at = -1;
+  guint64            forwarded, dropped, reordered;
+  gdouble            sum = 0, sum_sq = 0, max_abs = 0;
+  guint              n = 0;
+  guint              i;
+
+  ctx = g_option_context_new ("- measure WC client clock accuracy");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err))
+  {
+    g_printerr ("Error initializing: %s\n", err->message);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  impairment.delay         = (GstClockTime) (delay_ms * GST_MSECOND);
+  impairment.asymmetry     = (GstClockTimeDiff) (asymmetry_ms * GST_MSECOND);
+  impairment.jitter        = (GstClockTime) (jitter_ms * GST_MSECOND);
+  impairment.loss          = loss;
+  impairment.reorder       = reorder;
+  impairment.reorder_delay = (GstClockTime) (reorder_ms * GST_MSECOND);
+  impairment.seed          = seed;
+  if (distribution != NULL && !impair_distribution_from_string (distribution, &impairment.distribution))
+  {
+    g_printerr ("Unknown distribution '%s'\n", distribution);
+    return 1;
+  }
+  if (preset_name != NULL && !apply_preset (preset_name, &impairment))
+  {
+    g_printerr ("Unknown preset '%s'\n", preset_name);
+    return 1;
+  }
+
+  /* the clock the server publishes, offset and drifting against ours */
+  server_clock = g_object_new (GST_TYPE_SYSTEM_CLOCK, "name", "server-clock", NULL);
+  gst_object_ref_sink (server_clock);
+  gst_clock_set_calibration (server_clock, gst_clock_get_internal_time (server_clock),
+      (GstClockTime) (offset_s * GST_SECOND), (GstClockTime) (1000000 + drift_ppm), 1000000);
+
+  server = gst_dvb_css_wc_server_new (server_clock, "127.0.0.1", 0, TRUE, 500);
+  if (server == NULL)
+  {
+    g_printerr ("Failed to start server\n");
+    return 1;
+  }
+  g_object_get (server, "port", &port, NULL);
+
+  proxy = impair_proxy_new ("127.0.0.1", port, &impairment, &err);
+  if (proxy == NULL)
+  {
+    g_printerr ("Failed to start proxy: %s\n", err->message);
+    return 1;
+  }
+
+  client_clock = gst_dvb_css_wc_client_clock_new ("client-clock", "127.0.0.1", impair_proxy_get_port (proxy), 0);
+  if (filter_name != NULL)
+  {
+    gst_util_set_object_arg (G_OBJECT (client_clock), "filter", filter_name);
+  }
+  g_object_set (client_clock, "slew-threshold", (guint64) (slew_ms * GST_MSECOND), NULL);
+
+  g_print ("delay %.2fms, asymmetry %.2fms, jitter %.2fms, loss %.1f%%, reorder %.1f%%, drift %.1fppm\n",
+      impairment.delay / 1e6, impairment.asymmetry / 1e6, impairment.jitter / 1e6,
+      impairment.loss * 100, impairment.reorder * 100, drift_ppm);
+  if (impairment.asymmetry != 0)
+  {
+    g_print ("an asymmetry of the path shows up as a bias of %.3fms\n", -impairment.asymmetry / 2e6);
+  }
+  g_print ("\n  time  synced   mean err (us)     min (us)     max (us)\n");
+
+  /* errors in ns, one every SAMPLE_INTERVAL */
+  errors = g_array_new (FALSE, FALSE, sizeof (gdouble));
+  start  = g_get_monotonic_time ();
+  while (g_get_monotonic_time () - start < (gint64) duration * G_USEC_PER_SEC)
+  {
+    gdouble second_sum = 0, second_min = G_MAXDOUBLE, second_max = -G_MAXDOUBLE;
+    guint   samples    = GST_SECOND / SAMPLE_INTERVAL;
+
+    for (i = 0; i < samples; i++)
+    {
+      GstClockTime client_time = gst_clock_get_time (client_clock);
+      GstClockTime server_time = gst_clock_get_time (server_clock);
+      gdouble      error       = (gdouble) GST_CLOCK_DIFF (server_time, client_time);
+
+      g_array_append_val (errors, error);
+      second_sum += error;
+      second_min  = MIN (second_min, error);
+      second_max  = MAX (second_max, error);
+      g_usleep (SAMPLE_INTERVAL / GST_USECOND);
+    }
+
+    g_print ("%6u  %6s  %14.1f  %11.1f  %11.1f\n", errors->len / samples,
+        gst_clock_is_synced (client_clock) ? "yes" : "no",
+        second_sum / samples / 1000, second_min / 1000, second_max / 1000);
+  }
+
+  /* converged from the first sample after the last one out of bounds */
+  for (i = errors->len; i > 0; i--)
+  {
+    if (fabs (g_array_index (errors, gdouble, i - 1)) > threshold_us * 1000)
+    {
+      break;
+    }
+  }
+  if (i < errors->len)
+  {
+    converged_at = (gint64) i * SAMPLE_INTERVAL;
+  }
+
+  for (; i < errors->len; i++)
+  {
+    gdouble error = g_array_index (errors, gdouble, i);
+    sum     += error;
+    sum_sq  += error * error;
+    max_abs  = MAX (max_abs, fabs (error));
+    n++;
+  }
+
+  impair_proxy_get_stats (proxy, &forwarded, &dropped, &reordered);
+  impair_proxy_free (proxy);
+
+  g_print ("\npackets:    %" G_GUINT64_FORMAT " forwarded, %" G_GUINT64_FORMAT " lost, %" G_GUINT64_FORMAT " reordered\n",
+      forwarded, dropped, reordered);
+  if (converged_at < 0)
+  {
+    g_print ("did not converge to within %.0fus in %ds\n", threshold_us, duration);
+  }
+  else
+  {
+    gdouble mean = sum / n;
+    g_print ("converged:  after %.2fs to within %.0fus\n", converged_at / 1e9, threshold_us);
+    g_print ("bias:       %.1fus\n", mean / 1000);
+    g_print ("jitter:     %.1fus (standard deviation)\n", sqrt (MAX (sum_sq / n - mean * mean, 0)) / 1000);
+    g_print ("max error:  %.1fus\n", max_abs / 1000);
+  }
+
+  g_array_free (errors, TRUE);
+  gst_object_unref (client_clock);
+  gst_object_unref (server);
+  gst_object_unref (server_clock);
+
+  return converged_at < 0 ? 1 : 0;
+}
@@ -0,0 +1,447 @@
+/* GStreamer
+ *
+ * dvbcsswc-bench.c: Load generator and latency benchmark for the WC server
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Simulates many WC clients from one process. Every client has its own UDP
+ * socket, so the server sees as many peers as there are clients, and sends
+ * requests at a fixed rate. The originate time of a request carries the
+ * client and a sequence number, which the server echoes back.
+ *
+ * Without --address a server is started in this process on loopback, with
+ * --server-threads and --batch-size. Run it against a separate server (see
+ * examples/dvbcsswc-server.c) to keep the load generator out of the server's
+ * CPU figures. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <gst/gst.h>
+#include <gstdvbcsswcpacket.h>
+#include <gstdvbcsswcserver.h>
+
+/* send times of the requests a client may still get answers for */
+#define SEND_RING 64
+/* replies arriving later than this after the last request are dropped */
+#define GRACE_PERIOD_NS (500 * GST_MSECOND)
+/* a worker that fell behind sends at most this many requests at once */
+#define MAX_CATCH_UP 64
+
+typedef struct
+{
+  GSocket *socket;
+  guint32 seq;
+  guint64 sent_at[SEND_RING];
+} BenchClient;
+
+typedef struct
+{
+  GThread *thread;
+  BenchClient *clients;
+  guint n_clients;
+
+  guint64 sent;
+  guint64 received;
+  guint64 late;
+  guint64 errors;
+  /* RTTs in nanoseconds, allocated up front */
+  guint32 *rtts;
+  guint64 n_rtts;
+  guint64 max_rtts;
+} BenchWorker;
+
+static gchar *address = NULL;
+static gint port = 0;
+static gint n_clients = 1000;
+static gint n_workers = 2;
+static gdouble rate = 1.0;
+static gint duration = 10;
+static gint server_threads = 1;
+static gint batch_size = 32;
+static gboolean followup = FALSE;
+
+static GstDvbCssWcAddress server_address;
+static guint64 start_ns;
+static guint64 stop_ns;
+
+static GOptionEntry entries[] = {
+  {"address", 'a', 0, G_OPTION_ARG_STRING, &address,
+      "Server to load, default: start one on 127.0.0.1", "ADDRESS"},
+  {"port", 'p', 0, G_OPTION_ARG_INT, &port, "Port of the server", "PORT"},
+  {"clients", 'c', 0, G_OPTION_ARG_INT, &n_clients,
+      "Number of simulated clients (1000)", "N"},
+  {"workers", 'w', 0, G_OPTION_ARG_INT, &n_workers,
+      "Number of load generator threads (2)", "N"},
+  {"rate", 'r', 0, G_OPTION_ARG_DOUBLE, &rate,
+      "Requests per second of every client (1)", "RATE"},
+  {"duration", 'd', 0, G_OPTION_ARG_INT, &duration,
+      "Seconds to send requests for (10)", "SECS"},
+  {"server-threads", 't', 0, G_OPTION_ARG_INT, &server_threads,
+      "Threads of the in-process server (1)", "N"},
+  {"batch-size", 'b', 0, G_OPTION_ARG_INT, &batch_size,
+      "Batch size of the in-process server (32)", "N"},
+  {"followup", 'f', 0, G_OPTION_ARG_NONE, &followup,
+      "Have the in-process server send followups", NULL},
+  {NULL}
+};
+
+static guint64
+now_ns (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return GST_TIMESPEC_TO_TIME (ts);
+}
+
+//==============================================================================
+// CPU usage
+//==============================================================================
+
+typedef struct
+{
+  guint64 busy;
+  guint64 total;
+} CpuTimes;
+
+/* Reads the busy and total jiffies of every core from /proc/stat */
+static guint
+read_cpu_times (CpuTimes * times, guint max)
+{
+  gchar *contents = NULL;
+  gchar **lines;
+  guint n = 0;
+  guint i;
+
+  if (!g_file_get_contents ("/proc/stat", &contents, NULL, NULL))
+    return 0;
+
+  lines = g_strsplit (contents, "\n", -1);
+  for (i = 0; lines[i] != NULL && n < max; i++) {
+    guint64 user, nice, system, idle, iowait, irq, softirq, steal;
+
+    /* the "cpu " line is the sum of all cores */
+    if (!g_str_has_prefix (lines[i], "cpu") || lines[i][3] == ' ')
+      continue;
+    if (sscanf (lines[i], "%*s %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT
+            " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT
+            " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT " %" G_GUINT64_FORMAT,
+            &user, &nice, &system, &idle, &iowait, &irq, &softirq, &steal) != 8)
+      continue;
+
+    times[n].busy = user + nice + system + irq + softirq + steal;
+    times[n].total = times[n].busy + idle + iowait;
+    n++;
+  }
+
+  g_strfreev (lines);
+  g_free (contents);
+  return n;
+}
+
+//==============================================================================
+// Load generation
+//==============================================================================
+
+static void
+send_request (BenchWorker * worker, guint index)
+{
+  BenchClient *client = &worker->clients[index];
+  GstDvbCssWcPacket req;
+  guint64 now = now_ns ();
+
+  gst_dvb_css_wc_packet_parse_into (NULL, &req);
+  req.originate_timevalue_secs = index;
+  req.originate_timevalue_nanos = client->seq;
+  client->sent_at[client->seq % SEND_RING] = now;
+  client->seq++;
+
+  if (gst_dvb_css_wc_packet_send_to (&req, client->socket, &server_address,
+          NULL))
+    worker->sent++;
+  else
+    worker->errors++;
+}
+
+/* Reads everything waiting on the socket of a client */
+static void
+receive_replies (BenchWorker * worker, BenchClient * client)
+{
+  GstDvbCssWcPacket resp;
+
+  while (gst_dvb_css_wc_packet_receive_into (client->socket, &resp, NULL,
+          NULL, NULL)) {
+    guint64 now = now_ns ();
+    guint32 seq = resp.originate_timevalue_nanos;
+
+    if (resp.message_type == GST_DVB_CSS_WC_MSG_FOLLOWUP)
+      continue;
+    if (resp.originate_timevalue_secs >= worker->n_clients
+        || &worker->clients[resp.originate_timevalue_secs] != client) {
+      worker->errors++;
+      continue;
+    }
+
+    /* too old to still know when it was sent */
+    if (client->seq - seq > SEND_RING) {
+      worker->late++;
+      continue;
+    }
+
+    worker->received++;
+    if (worker->n_rtts < worker->max_rtts)
+      worker->rtts[worker->n_rtts++] =
+          (guint32) MIN (now - client->sent_at[seq % SEND_RING], G_MAXUINT32);
+  }
+}
+
+static gpointer
+worker_thread (gpointer data)
+{
+  BenchWorker *worker = data;
+  GPollFD *fds = g_new0 (GPollFD, worker->n_clients);
+  guint64 interval = (guint64) (GST_SECOND / (rate * worker->n_clients));
+  guint64 next_send = start_ns;
+  guint next_client = 0;
+  guint i;
+
+  for (i = 0; i < worker->n_clients; i++) {
+    fds[i].fd = g_socket_get_fd (worker->clients[i].socket);
+    fds[i].events = G_IO_IN;
+  }
+
+  while (TRUE) {
+    guint64 now = now_ns ();
+    gint timeout;
+
+    if (now >= stop_ns + GRACE_PERIOD_NS)
+      break;
+
+    /* clients take turns, so every one sends at the requested rate */
+    for (i = 0; i < MAX_CATCH_UP && now < stop_ns && now >= next_send; i++) {
+      send_request (worker, next_client);
+      next_client = (next_client + 1) % worker->n_clients;
+      next_send += interval;
+    }
+    if (now >= next_send && now < stop_ns)
+      next_send = now;
+
+    if (now < stop_ns)
+      timeout = (gint) ((MAX (next_send, now) - now) / GST_MSECOND);
+    else
+      timeout = (gint) ((stop_ns + GRACE_PERIOD_NS - now) / GST_MSECOND);
+
+    if (g_poll (fds, worker->n_clients, timeout) <= 0)
+      continue;
+
+    for (i = 0; i < worker->n_clients; i++) {
+      if (fds[i].revents & G_IO_IN)
+        receive_replies (worker, &worker->clients[i]);
+      fds[i].revents = 0;
+    }
+  }
+
+  g_free (fds);
+  return NULL;
+}
+
+static gint
+compare_rtt (gconstpointer a, gconstpointer b)
+{
+  guint32 x = *(const guint32 *) a;
+  guint32 y = *(const guint32 *) b;
+
+  return (x > y) - (x < y);
+}
+
+static gdouble
+percentile_us (const guint32 * sorted, guint64 count, gdouble p)
+{
+  if (count == 0)
+    return 0;
+  return sorted[(guint64) (p * (count - 1))] / 1000.0;
+}
+
+gint
+main (gint argc, gchar * argv[])
+{
+  GOptionContext *ctx;
+  GError *err = NULL;
+  GstDvbCssWcServer *server = NULL;
+  GSocketAddress *servaddr;
+  GInetAddress *inetaddr;
+  GInetAddress *anyaddr;
+  GSocketAddress *bindaddr;
+  BenchWorker *workers;
+  BenchClient *clients;
+  CpuTimes cpu_before[256], cpu_after[256];
+  guint n_cpus;
+  struct rusage usage;
+  struct rlimit limit;
+  guint64 sent = 0, received = 0, late = 0, errors = 0, n_rtts = 0;
+  guint32 *rtts;
+  gdouble elapsed;
+  gint i, j;
+
+  ctx = g_option_context_new ("- load a DVB-CSS-WC server and report latency");
+  g_option_context_add_main_entries (ctx, entries, NULL);
+  g_option_context_add_group (ctx, gst_init_get_option_group ());
+  if (!g_option_context_parse (ctx, &argc, &argv, &err)) {
+    g_printerr ("Error initializing: %s\n", err->message);
+    g_option_context_free (ctx);
+    return 1;
+  }
+  g_option_context_free (ctx);
+
+  if (n_clients < 1 || n_workers < 1 || rate <= 0 || duration < 1) {
+    g_printerr ("clients, workers, rate and duration must be positive\n");
+    return 1;
+  }
+  n_workers = MIN (n_workers, n_clients);
+
+  /* one socket per client */
+  if (getrlimit (RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+    limit.rlim_cur = limit.rlim_max;
+    setrlimit (RLIMIT_NOFILE, &limit);
+  }
+
+  if (address == NULL) {
+    GstClock *clock = gst_system_clock_obtain ();
+
+    server = g_initable_new (GST_TYPE_DVB_CSS_WC_SERVER, NULL, &err,
+        "clock", clock, "address", "127.0.0.1", "port", port,
+        "followup", followup, "threads", server_threads,
+        "batch-size", batch_size, NULL);
+    gst_object_unref (clock);
+    if (server == NULL) {
+      g_printerr ("Failed to start server: %s\n", err->message);
+      return 1;
+    }
+    g_object_get (server, "port", &port, NULL);
+    address = g_strdup ("127.0.0.1");
+  }
+
+  inetaddr = g_inet_address_new_from_string (address);
+  if (inetaddr == NULL || port <= 0) {
+    g_printerr ("Need a numeric address and a port\n");
+    return 1;
+  }
+  servaddr = g_inet_socket_address_new (inetaddr, port);
+  gst_dvb_css_wc_address_set (&server_address, servaddr);
+  g_object_unref (servaddr);
+
+  anyaddr = g_inet_address_new_any (g_inet_address_get_family (inetaddr));
+  bindaddr = g_inet_socket_address_new (anyaddr, 0);
+  clients = g_new0 (BenchClient, n_clients);
+  for (i = 0; i < n_clients; i++) {
+    clients[i].socket = g_socket_new (g_inet_address_get_family (inetaddr),
+        G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, &err);
+    if (clients[i].socket == NULL
+        || !g_socket_bind (clients[i].socket, bindaddr, FALSE, &err)) {
+      g_printerr ("Failed to create client %d: %s\n", i, err->message);
+      return 1;
+    }
+    g_socket_set_blocking (clients[i].socket, FALSE);
+  }
+  g_object_unref (bindaddr);
+  g_object_unref (anyaddr);
+  g_object_unref (inetaddr);
+
+  g_print ("%d clients sending %.2f requests/s each to %s:%d for %ds\n",
+      n_clients, rate, address, port, duration);
+
+  /* workers take contiguous slices of the clients */
+  workers = g_new0 (BenchWorker, n_workers);
+  for (i = 0, j = 0; i < n_workers; i++) {
+    BenchWorker *worker = &workers[i];
+
+    worker->clients = clients + j;
+    worker->n_clients = n_clients / n_workers + (i < n_clients % n_workers);
+    worker->max_rtts = (guint64) (rate * worker->n_clients * duration) + 1;
+    worker->rtts = g_new (guint32, worker->max_rtts);
+    j += worker->n_clients;
+  }
+
+  n_cpus = read_cpu_times (cpu_before, G_N_ELEMENTS (cpu_before));
+  start_ns = now_ns ();
+  stop_ns = start_ns + duration * GST_SECOND;
+
+  for (i = 0; i < n_workers; i++)
+    workers[i].thread = g_thread_new ("dvbcsswc-bench", worker_thread,
+        &workers[i]);
+  for (i = 0; i < n_workers; i++)
+    g_thread_join (workers[i].thread);
+
+  elapsed = (gdouble) duration;
+  read_cpu_times (cpu_after, n_cpus);
+  getrusage (RUSAGE_SELF, &usage);
+
+  for (i = 0; i < n_workers; i++) {
+    sent += workers[i].sent;
+    received += workers[i].received;
+    late += workers[i].late;
+    errors += workers[i].errors;
+    n_rtts += workers[i].n_rtts;
+  }
+
+  rtts = g_new (guint32, MAX (n_rtts, 1));
+  for (i = 0, j = 0; i < n_workers; i++) {
+    memcpy (rtts + j, workers[i].rtts, workers[i].n_rtts * sizeof (guint32));
+    j += workers[i].n_rtts;
+  }
+  qsort (rtts, n_rtts, sizeof (guint32), compare_rtt);
+
+  g_print ("\nrequests:   %" G_GUINT64_FORMAT " sent, %.0f/s\n", sent,
+      sent / elapsed);
+  g_print ("responses:  %" G_GUINT64_FORMAT " received, %.0f/s\n", received,
+      received / elapsed);
+  g_print ("dropped:    %" G_GUINT64_FORMAT " (%.3f%%), %" G_GUINT64_FORMAT
+      " too late, %" G_GUINT64_FORMAT " errors\n", sent - MIN (sent, received),
+      sent ? 100.0 * (sent - MIN (sent, received)) / sent : 0.0, late, errors);
+  g_print ("rtt (us):   min %.1f  p50 %.1f  p90 %.1f  p99 %.1f  p99.9 %.1f  "
+      "max %.1f\n", percentile_us (rtts, n_rtts, 0), percentile_us (rtts,
+          n_rtts, 0.5), percentile_us (rtts, n_rtts, 0.9),
+      percentile_us (rtts, n_rtts, 0.99), percentile_us (rtts, n_rtts, 0.999),
+      percentile_us (rtts, n_rtts, 1));
+
+  g_print ("process:    %.2fs user, %.2fs system%s\n",
+      usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6,
+      usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6,
+      server ? " (includes the server)" : "");
+  for (i = 0; i < (gint) n_cpus; i++) {
+    guint64 total = cpu_after[i].total - cpu_before[i].total;
+    guint64 busy = cpu_after[i].busy - cpu_before[i].busy;
+
+    g_print ("cpu%-3d      %5.1f%%\n", i, total ? 100.0 * busy / total : 0.0);
+  }
+
+  g_free (rtts);
+  for (i = 0; i < n_workers; i++)
+    g_free (workers[i].rtts);
+  g_free (workers);
+  for (i = 0; i < n_clients; i++)
+    g_object_unref (clients[i].socket);
+  g_free (clients);
+  if (server)
+    gst_object_unref (server);
+  g_free (address);
+
+  return 0;
+}
@@ -0,0 +1,398 @@
+/* GStreamer
+ *
+ * dvbcsswc-impair.c: UDP proxy impairing the traffic between WC clients and
+ * a server
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+/* Clients send to the port of the proxy, which forwards every packet to the
+ * server from a socket of its own for each client, and the answers back the
+ * same way. Packets are queued until their delay is over, so jitter and
+ * reordering come out of one queue ordered by release time. */
+
+#include <math.h>
+#include <string.h>
+#include "dvbcsswc-impair.h"
+
+/* the proxy never sleeps longer, so that it notices being stopped */
+#define MAX_WAIT_US 10000
+#define MAX_DATAGRAM 1500
+
+typedef struct
+{
+  GSocketAddress *address;
+  GSocket        *upstream;
+} ImpairPeer;
+
+typedef struct
+{
+  gint64          release;
+  GSocket        *socket;
+  GSocketAddress *to;
+  gsize           size;
+  guint8          data[MAX_DATAGRAM];
+} ImpairPacket;
+
+struct _ImpairProxy
+{
+  Impairment      impairment;
+  GRand          *rand;
+  GSocket        *socket;
+  GSocketAddress *server;
+  GPtrArray      *peers;
+  GQueue          queue;
+  GThread        *thread;
+  gint            running;
+  gint            port;
+
+  guint64         forwarded;
+  guint64         dropped;
+  guint64         reordered;
+};
+
+gboolean
+impair_distribution_from_string (const gchar *name, ImpairDistribution *distribution)
+{
+  if (g_strcmp0 (name, "uniform") == 0)
+    *distribution = IMPAIR_DISTRIBUTION_UNIFORM;
+  else if (g_strcmp0 (name, "exponential") == 0)
+    *distribution = IMPAIR_DISTRIBUTION_EXPONENTIAL;
+  else if (g_strcmp0 (name, "normal") == 0)
+    *distribution = IMPAIR_DISTRIBUTION_NORMAL;
+  else
+    return FALSE;
+  return TRUE;
+}
+
+static gdouble
+random_jitter (ImpairProxy *proxy)
+{
+  gdouble jitter = (gdouble) proxy->impairment.jitter;
+  gdouble u;
+
+  switch (proxy->impairment.distribution)
+  {
+    case IMPAIR_DISTRIBUTION_EXPONENTIAL:
+    {
+      u = g_rand_double (proxy->rand);
+      return -jitter * log (1.0 - u);
+    }
+    case IMPAIR_DISTRIBUTION_NORMAL:
+    {
+      /* Box-Muller, folded so that packets never arrive early */
+      u = g_rand_double (proxy->rand);
+      return fabs (jitter * sqrt (-2.0 * log (1.0 - u)) * cos (2 * G_PI * g_rand_double (proxy->rand)));
+    }
+    case IMPAIR_DISTRIBUTION_UNIFORM:
+    default:
+    {
+      return jitter * g_rand_double (proxy->rand);
+    }
+  }
+}
+
+static gint
+compare_release (gconstpointer a, gconstpointer b, gpointer user_data)
+{
+  const ImpairPacket *x = a;
+  const ImpairPacket *y = b;
+
+  return (x->release > y->release) - (x->release < y->release);
+}
+
+/* Decides the fate of a packet and queues it unless it is lost */
+static void
+impair_proxy_queue (ImpairProxy *proxy, const guint8 *data, gsize size, GSocket *socket, GSocketAddress *to, gboolean to_client)
+{
+  Impairment   *impairment = &proxy->impairment;
+  ImpairPacket *packet;
+  gdouble       delay;
+
+  if (g_rand_double (proxy->rand) < impairment->loss)
+  {
+    proxy->dropped++;
+    return;
+  }
+
+  delay = (gdouble) impairment->delay + random_jitter (proxy);
+  if (to_client)
+  {
+    delay += (gdouble) impairment->asymmetry;
+  }
+  if (g_rand_double (proxy->rand) < impairment->reorder)
+  {
+    delay += (gdouble) impairment->reorder_delay;
+    proxy->reordered++;
+  }
+
+  packet          = g_new (ImpairPacket, 1);
+  packet->release = g_get_monotonic_time () + (gint64) (MAX (delay, 0) / GST_USECOND);
+  packet->socket  = socket;
+  packet->to      = g_object_ref (to);
+  packet->size    = size;
+  memcpy (packet->data, data, size);
+
+  g_queue_insert_sorted (&proxy->queue, packet, compare_release, NULL);
+}
+
+static ImpairPeer *
+impair_proxy_find_peer (ImpairProxy *proxy, GSocketAddress *address)
+{
+  GInetSocketAddress *inet = G_INET_SOCKET_ADDRESS (address);
+  GSocketAddress     *any;
+  GInetAddress       *anyaddr;
+  ImpairPeer         *peer;
+  guint               i;
+
+  for (i = 0; i < proxy->peers->len; i++)
+  {
+    GInetSocketAddress *known;
+
+    peer  = g_ptr_array_index (proxy->peers, i);
+    known = G_INET_SOCKET_ADDRESS (peer->address);
+    if (g_inet_socket_address_get_port (known) == g_inet_socket_address_get_port (inet)
+        && g_inet_address_equal (g_inet_socket_address_get_address (known), g_inet_socket_address_get_address (inet)))
+    {
+      return peer;
+    }
+  }
+
+  /* the server tells clients apart by their address, so each gets a socket */
+  peer           = g_new0 (ImpairPeer, 1);
+  peer->address  = g_object_ref (address);
+  peer->upstream = g_socket_new (g_socket_address_get_family (address), G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, NULL);
+  anyaddr        = g_inet_address_new_any (g_socket_address_get_family (address));
+  any            = g_inet_socket_address_new (anyaddr, 0);
+  g_socket_bind (peer->upstream, any, FALSE, NULL);
+  g_socket_set_blocking (peer->upstream, FALSE);
+  g_object_unref (any);
+  g_object_unref (anyaddr);
+
+  g_ptr_array_add (proxy->peers, peer);
+  return peer;
+}
+
+static void
+impair_proxy_release (ImpairProxy *proxy, gint64 now)
+{
+  ImpairPacket *packet;
+
+  while ((packet = g_queue_peek_head (&proxy->queue)) != NULL && packet->release <= now)
+  {
+    g_queue_pop_head (&proxy->queue);
+    g_socket_send_to (packet->socket, packet->to, (const gchar *) packet->data, packet->size, NULL, NULL);
+    proxy->forwarded++;
+    g_object_unref (packet->to);
+    g_free (packet);
+  }
+}
+
+static gpointer
+impair_proxy_thread (gpointer data)
+{
+  ImpairProxy *proxy = data;
+  guint8       buffer[MAX_DATAGRAM];
+  GPollFD     *fds   = NULL;
+
+  while (g_atomic_int_get (&proxy->running))
+  {
+    ImpairPacket *next;
+    gint64        now = g_get_monotonic_time ();
+    gint64        wait = MAX_WAIT_US;
+    guint         n_fds;
+    guint         i;
+
+    impair_proxy_release (proxy, now);
+
+    next = g_queue_peek_head (&proxy->queue);
+    if (next != NULL)
+    {
+      wait = MIN (wait, next->release - now);
+    }
+
+    /* poll only has millisecond resolution, sleep out short delays exactly */
+    if (wait < 1000)
+    {
+      g_usleep (MAX (wait, 0));
+      wait = 0;
+    }
+
+    n_fds = proxy->peers->len + 1;
+    fds   = g_renew (GPollFD, fds, n_fds);
+    fds[0].fd      = g_socket_get_fd (proxy->socket);
+    fds[0].events  = G_IO_IN;
+    fds[0].revents = 0;
+    for (i = 1; i < n_fds; i++)
+    {
+      ImpairPeer *peer = g_ptr_array_index (proxy->peers, i - 1);
+      fds[i].fd      = g_socket_get_fd (peer->upstream);
+      fds[i].events  = G_IO_IN;
+      fds[i].revents = 0;
+    }
+
+    if (g_poll (fds, n_fds, (gint) (wait / 1000)) <= 0)
+    {
+      continue;
+    }
+
+    /* from the clients to the server */
+    if (fds[0].revents & G_IO_IN)
+    {
+      GSocketAddress *from = NULL;
+      gssize          size;
+
+      while ((size = g_socket_receive_from (proxy->socket, &from, (gchar *) buffer, sizeof (buffer), NULL, NULL)) >= 0)
+      {
+        ImpairPeer *peer = impair_proxy_find_peer (proxy, from);
+        impair_proxy_queue (proxy, buffer, size, peer->upstream, proxy->server, FALSE);
+        g_object_unref (from);
+        from = NULL;
+      }
+    }
+
+    /* from the server back to the clients */
+    for (i = 1; i < n_fds; i++)
+    {
+      ImpairPeer *peer = g_ptr_array_index (proxy->peers, i - 1);
+      gssize      size;
+
+      if (!(fds[i].revents & G_IO_IN))
+      {
+        continue;
+      }
+      while ((size = g_socket_receive (peer->upstream, (gchar *) buffer, sizeof (buffer), NULL, NULL)) >= 0)
+      {
+        impair_proxy_queue (proxy, buffer, size, proxy->socket, peer->address, TRUE);
+      }
+    }
+  }
+
+  g_free (fds);
+  return NULL;
+}
+
+/**
+ * impair_proxy_new:
+ * @server_address: address of the WC server
+ * @server_port: port of the WC server
+ * @impairment: what to do to the packets
+ * @error: return address for a #GError, or NULL
+ *
+ * Starts a proxy on a free port of 127.0.0.1, see impair_proxy_get_port().
+ *
+ * Returns: the proxy, or NULL on error.
+ */
+ImpairProxy *
+impair_proxy_new (const gchar *server_address, gint server_port, const Impairment *impairment, GError **error)
+{
+  ImpairProxy    *proxy;
+  GInetAddress   *inetaddr;
+  GSocketAddress *bindaddr;
+  GSocketAddress *local;
+
+  inetaddr = g_inet_address_new_from_string (server_address);
+  if (inetaddr == NULL)
+  {
+    g_set_error (error, G_IO_ERROR, G_IO_ERROR_INVALID_ARGUMENT, "not an address: %s", server_address);
+    return NULL;
+  }
+
+  proxy             = g_new0 (ImpairProxy, 1);
+  proxy->impairment = *impairment;
+  proxy->rand       = g_rand_new_with_seed (impairment->seed);
+  proxy->server     = g_inet_socket_address_new (inetaddr, server_port);
+  proxy->peers      = g_ptr_array_new ();
+  g_queue_init (&proxy->queue);
+  g_object_unref (inetaddr);
+
+  proxy->socket = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM, G_SOCKET_PROTOCOL_UDP, error);
+  if (proxy->socket == NULL)
+  {
+    impair_proxy_free (proxy);
+    return NULL;
+  }
+
+  inetaddr = g_inet_address_new_from_string ("127.0.0.1");
+  bindaddr = g_inet_socket_address_new (inetaddr, 0);
+  g_object_unref (inetaddr);
+  if (!g_socket_bind (proxy->socket, bindaddr, FALSE, error))
+  {
+    g_object_unref (bindaddr);
+    impair_proxy_free (proxy);
+    return NULL;
+  }
+  g_object_unref (bindaddr);
+  g_socket_set_blocking (proxy->socket, FALSE);
+
+  local = g_socket_get_local_address (proxy->socket, NULL);
+  proxy->port = g_inet_socket_address_get_port (G_INET_SOCKET_ADDRESS (local));
+  g_object_unref (local);
+
+  proxy->running = TRUE;
+  proxy->thread  = g_thread_new ("impair-proxy", impair_proxy_thread, proxy);
+  return proxy;
+}
+
+gint
+impair_proxy_get_port (ImpairProxy *proxy)
+{
+  return proxy->port;
+}
+
+/* Read while the proxy runs, so the counts may be a packet behind */
+void
+impair_proxy_get_stats (ImpairProxy *proxy, guint64 *forwarded, guint64 *dropped, guint64 *reordered)
+{
+  *forwarded = proxy->forwarded;
+  *dropped   = proxy->dropped;
+  *reordered = proxy->reordered;
+}
+
+void
+impair_proxy_free (ImpairProxy *proxy)
+{
+  ImpairPacket *packet;
+  guint         i;
+
+  if (proxy->thread != NULL)
+  {
+    g_atomic_int_set (&proxy->running, FALSE);
+    g_thread_join (proxy->thread);
+  }
+
+  while ((packet = g_queue_pop_head (&proxy->queue)) != NULL)
+  {
+    g_object_unref (packet->to);
+    g_free (packet);
+  }
+  for (i = 0; i < proxy->peers->len; i++)
+  {
+    ImpairPeer *peer = g_ptr_array_index (proxy->peers, i);
+    g_object_unref (peer->address);
+    g_object_unref (peer->upstream);
+    g_free (peer);
+  }
+  g_ptr_array_free (proxy->peers, TRUE);
+
+  if (proxy->socket != NULL)
+  {
+    g_object_unref (proxy->socket);
+  }
+  g_object_unref (proxy->server);
+  g_rand_free (proxy->rand);
+  g_free (proxy);
+}
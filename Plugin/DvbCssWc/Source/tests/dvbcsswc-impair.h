@@ -0,0 +1,76 @@
+/* GStreamer
+ *
+ * dvbcsswc-impair.h: UDP proxy impairing the traffic between WC clients and
+ * a server
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Library General Public
+ * License as published by the Free Software Foundation; either
+ * version 2 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Library General Public License for more details.
+ *
+ * You should have received a copy of the GNU Library General Public
+ * License along with this library; if not, write to the
+ * Free Software Foundation, Inc., 51 Franklin St, Fifth Floor,
+ * Boston, MA 02110-1301, USA.
+ */
+
+#ifndef __DVB_CSS_WC_IMPAIR_H__
+#define __DVB_CSS_WC_IMPAIR_H__
+
+#include <gst/gst.h>
+#include <gio/gio.h>
+
+G_BEGIN_DECLS
+
+typedef enum
+{
+  IMPAIR_DISTRIBUTION_UNIFORM,
+  IMPAIR_DISTRIBUTION_EXPONENTIAL,
+  IMPAIR_DISTRIBUTION_NORMAL
+} ImpairDistribution;
+
+/**
+ * Impairment:
+ * @delay: one-way delay from the client to the server
+ * @asymmetry: added to the delay from the server back to the client
+ * @jitter: scale of the random delay added to every packet: the upper bound
+ *          of a uniform, the mean of an exponential or the standard
+ *          deviation of a (folded) normal distribution
+ * @distribution: how the random delay is distributed
+ * @loss: probability that a packet is dropped
+ * @reorder: probability that a packet is held back by @reorder_delay more,
+ *           so that later packets overtake it
+ * @reorder_delay: how long reordered packets are held back
+ * @seed: seed of the random numbers, the same seed impairs the same way
+ *
+ * What the proxy does to every packet, in each direction.
+ */
+typedef struct
+{
+  GstClockTime       delay;
+  GstClockTimeDiff   asymmetry;
+  GstClockTime       jitter;
+  ImpairDistribution distribution;
+  gdouble            loss;
+  gdouble            reorder;
+  GstClockTime       reorder_delay;
+  guint32            seed;
+} Impairment;
+
+typedef struct _ImpairProxy ImpairProxy;
+
+ImpairProxy *impair_proxy_new        (const gchar *server_address, gint server_port, const Impairment *impairment, GError **error);
+gint         impair_proxy_get_port   (ImpairProxy *proxy);
+void         impair_proxy_get_stats  (ImpairProxy *proxy, guint64 *forwarded, guint64 *dropped, guint64 *reordered);
+void         impair_proxy_free       (ImpairProxy *proxy);
+
+gboolean     impair_distribution_from_string (const gchar *name, ImpairDistribution *distribution);
+
+G_END_DECLS
+
+#endif /* __DVB_CSS_WC_IMPAIR_H__ */
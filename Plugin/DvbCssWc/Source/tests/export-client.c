@@ -10,6 +10,12 @@ int main(int argc, char *argv[])
     GstClockTime time      = gst_dvb_css_wc_client_get_time(dvb_client);
     gboolean     is_synced = gst_dvb_css_wc_client_is_synced(dvb_client);
     g_print("%03d: time = %015" G_GUINT64_FORMAT " \tis_synced = %d \n", counter, time, is_synced);
+    GstDvbCssWcClientStats stats;
+    if(gst_dvb_css_wc_client_get_stats(dvb_client, &stats))
+    {
+      g_print("     offset = %" G_GINT64_FORMAT " \trtt = %" G_GUINT64_FORMAT " \tdispersion = %" G_GUINT64_FORMAT " \tage = %" G_GUINT64_FORMAT " \n",
+              stats.offset, stats.rtt, stats.dispersion, stats.candidate_age);
+    }
     g_usleep(G_USEC_PER_SEC);
     ++counter;
   }
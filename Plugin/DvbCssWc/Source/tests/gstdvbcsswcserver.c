@@ -24,8 +24,48 @@
 
 #include <unistd.h>
 #include <math.h>
+#include <string.h>
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
 
-//#include "gstdvbcsswcserver.h"
+#include "gstdvbcsswcserver.h"
+#include "gstdvbcsswcclient.h"
+#include "gstdvbcsswcpacket.h"
+#include "gstdvbcsswcshm.h"
+#include "dvbcsswc-impair.h"
+
+/* Error of the client clock against the clock the server publishes, both
+ * read back to back in this process */
+static GstClockTimeDiff
+client_error (GstClock * client, GstClock * server)
+{
+  GstClockTime client_time = gst_clock_get_time (client);
+  GstClockTime server_time = gst_clock_get_time (server);
+
+  return GST_CLOCK_DIFF (server_time, client_time);
+}
+
+/* A system clock running offset seconds ahead of ours */
+static GstClock *
+offset_clock_new (GstClockTime offset)
+{
+  GstClock *clock = g_object_new (GST_TYPE_SYSTEM_CLOCK, "name", "server-clock", NULL);
+
+  gst_object_ref_sink (clock);
+  gst_clock_set_calibration (clock, gst_clock_get_internal_time (clock), offset, 1, 1);
+  return clock;
+}
+
+/* Moves the time clock publishes by step */
+static void
+step_clock (GstClock * clock, GstClockTimeDiff step)
+{
+  GstClockTime internal, external, num, denom;
+
+  gst_clock_get_calibration (clock, &internal, &external, &num, &denom);
+  gst_clock_set_calibration (clock, internal, external + step, num, denom);
+}
 
 GST_START_TEST (test_refcounts)
 {
@@ -69,12 +109,10 @@ GST_START_TEST (test_packet)
   packet->originate_timevalue_nanos = 5;
   packet->receive_timevalue = 320000000009;
   packet->transmit_timevalue = 7;
-  gst_dvb_css_wc_packet_print(packet);
   buf = gst_dvb_css_wc_packet_serialize(packet);      
   g_free (packet);
   
   packet = gst_dvb_css_wc_packet_new (buf);
-  gst_dvb_css_wc_packet_print(packet);
   fail_unless (packet != NULL, "failed to create packet");  
   
   fail_unless(packet->message_type == 1, "Wrong type");
@@ -210,16 +248,710 @@ GST_START_TEST (test_functioning)
 
 GST_END_TEST;
 
+GST_START_TEST (test_packet_into)
+{
+  GstDvbCssWcServer *wc;
+  GstDvbCssWcPacket packet, parsed;
+  GstDvbCssWcAddress server_address, from;
+  guint8 buf[GST_DVB_CSS_WC_PACKET_SIZE];
+  guint8 *allocated;
+  GstClock *clock;
+  GSocketAddress *server_addr;
+  GInetAddress *addr;
+  GSocket *socket;
+  gint port = -1;
+
+  /* the stack variants encode exactly like the allocating ones */
+  gst_dvb_css_wc_packet_parse_into (NULL, &packet);
+  fail_unless (packet.message_type == GST_DVB_CSS_WC_MSG_REQUEST, "Wrong type");
+  packet.precision = -10;
+  packet.max_freq_error = 12800;
+  packet.originate_timevalue_secs = 4;
+  packet.originate_timevalue_nanos = 5;
+  packet.receive_timevalue = 320000000009;
+  packet.transmit_timevalue = 7;
+
+  gst_dvb_css_wc_packet_serialize_into (&packet, buf);
+  allocated = gst_dvb_css_wc_packet_serialize (&packet);
+  fail_unless (memcmp (buf, allocated, GST_DVB_CSS_WC_PACKET_SIZE) == 0, "serialize differs");
+  g_free (allocated);
+
+  gst_dvb_css_wc_packet_parse_into (buf, &parsed);
+  fail_unless (parsed.precision == -10, "Wrong precision");
+  fail_unless (parsed.max_freq_error == 12800, "Wrong max_freq_error");
+  fail_unless (parsed.originate_timevalue_secs == 4, "Wrong originate_timevalue_secs");
+  fail_unless (parsed.originate_timevalue_nanos == 5, "Wrong originate_timevalue_nanos");
+  fail_unless (parsed.receive_timevalue == 320000000009, "Wrong receive_timevalue");
+  fail_unless (parsed.transmit_timevalue == 7, "Wrong transmit_timevalue");
+
+  clock = gst_system_clock_obtain ();
+  fail_unless (clock != NULL, "failed to get system clock");
+  wc = gst_dvb_css_wc_server_new (clock, "127.0.0.1", 0, FALSE, 500);
+  fail_unless (wc != NULL, "failed to create dvb css wc server");
+
+  g_object_get (wc, "port", &port, NULL);
+  fail_unless (port > 0);
+
+  socket = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM,
+      G_SOCKET_PROTOCOL_UDP, NULL);
+  fail_unless (socket != NULL, "could not create socket");
+
+  addr = g_inet_address_new_from_string ("127.0.0.1");
+  server_addr = g_inet_socket_address_new (addr, port);
+  g_object_unref (addr);
+  fail_unless (gst_dvb_css_wc_address_set (&server_address, server_addr));
+
+  fail_unless (gst_dvb_css_wc_packet_send_to (&packet, socket, &server_address, NULL));
+  /* sending must not change the blocking mode of the socket */
+  fail_unless (g_socket_get_blocking (socket));
+
+  fail_unless (gst_dvb_css_wc_packet_receive_into (socket, &parsed, &from, NULL, NULL),
+      "failed to receive packet");
+  fail_unless (parsed.message_type == GST_DVB_CSS_WC_MSG_RESPONSE, "wrong msg type");
+  fail_unless (parsed.originate_timevalue_secs == 4, "originate_timevalue_secs is not the same");
+  fail_unless (parsed.receive_timevalue <= parsed.transmit_timevalue, "remote time not after local time");
+  fail_unless (from.length == server_address.length
+      && memcmp (from.native, server_address.native, from.length) == 0, "wrong sender");
+
+  /* nothing else is coming */
+  g_socket_set_blocking (socket, FALSE);
+  fail_if (gst_dvb_css_wc_packet_receive_into (socket, &parsed, NULL, NULL, NULL));
+
+  g_object_unref (socket);
+  g_object_unref (server_addr);
+
+  gst_object_unref (wc);
+  gst_object_unref (clock);
+}
+
+GST_END_TEST;
+
+#ifdef __linux__
+GST_START_TEST (test_batched)
+{
+  GstDvbCssWcServer *wc;
+  GstDvbCssWcPacket *packet;
+  GstClock *clock;
+  GSocketAddress *server_addr;
+  GInetAddress *addr;
+  /* the workers share the port by the source address, so spread the requests
+   * over several source ports */
+  GSocket *sockets[4];
+  gboolean seen[40] = { FALSE };
+  gint port = -1;
+  guint threads = 0;
+  guint32 i;
+
+  clock = gst_system_clock_obtain ();
+  fail_unless (clock != NULL, "failed to get system clock");
+  wc = g_initable_new (GST_TYPE_DVB_CSS_WC_SERVER, NULL, NULL, "clock", clock,
+      "address", "127.0.0.1", "port", 0, "followup", FALSE,
+      "max_freq_error_ppm", 500, "threads", 4, "batch-size", 16, NULL);
+  fail_unless (wc != NULL, "failed to create dvb css wc server");
+
+  g_object_get (wc, "port", &port, "threads", &threads, NULL);
+  fail_unless (port > 0);
+  fail_unless (threads == 4);
+
+  for (i = 0; i < G_N_ELEMENTS (sockets); i++) {
+    sockets[i] = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM,
+        G_SOCKET_PROTOCOL_UDP, NULL);
+    fail_unless (sockets[i] != NULL, "could not create socket");
+  }
+
+  addr = g_inet_address_new_from_string ("127.0.0.1");
+  server_addr = g_inet_socket_address_new (addr, port);
+  g_object_unref (addr);
+
+  /* more requests than fit in one batch, all must be answered */
+  for (i = 0; i < G_N_ELEMENTS (seen); i++) {
+    packet = gst_dvb_css_wc_packet_new (NULL);
+    packet->message_type = GST_DVB_CSS_WC_MSG_REQUEST;
+    packet->originate_timevalue_secs = i;
+    fail_unless (gst_dvb_css_wc_packet_send (packet,
+            sockets[i % G_N_ELEMENTS (sockets)], server_addr, NULL));
+    g_free (packet);
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (seen); i++) {
+    GSocket *socket = sockets[i % G_N_ELEMENTS (sockets)];
+
+    fail_unless (g_socket_condition_timed_wait (socket, G_IO_IN, G_USEC_PER_SEC,
+            NULL, NULL), "a request was not answered");
+    packet = gst_dvb_css_wc_packet_receive (socket, NULL, NULL);
+    fail_unless (packet != NULL, "failed to receive packet");
+    fail_unless (packet->message_type == GST_DVB_CSS_WC_MSG_RESPONSE, "wrong msg type");
+    fail_unless (packet->originate_timevalue_secs < G_N_ELEMENTS (seen),
+        "originate_timevalue_secs is not ours");
+    fail_unless (packet->originate_timevalue_secs % G_N_ELEMENTS (sockets) ==
+        i % G_N_ELEMENTS (sockets), "answered to the wrong socket");
+    fail_unless (!seen[packet->originate_timevalue_secs], "answered twice");
+    fail_unless (packet->receive_timevalue <= packet->transmit_timevalue, "remote time not after local time");
+    seen[packet->originate_timevalue_secs] = TRUE;
+    g_free (packet);
+  }
+
+  for (i = 0; i < G_N_ELEMENTS (seen); i++)
+    fail_unless (seen[i], "request %u was not answered", i);
+
+  for (i = 0; i < G_N_ELEMENTS (sockets); i++)
+    g_object_unref (sockets[i]);
+  g_object_unref (server_addr);
+
+  gst_object_unref (wc);
+  gst_object_unref (clock);
+}
+
+GST_END_TEST;
+#endif
+
+GST_START_TEST (test_shared_settings)
+{
+  GstClock *first, *second;
+  GstDvbCssWcClientFilter filter;
+  GstClockTime slew_threshold;
+  guint burst_size;
+
+  first = g_object_new (GST_TYPE_DVB_CSS_WC_CLIENT_CLOCK, "address", "127.0.0.1",
+      "port", 37035, "filter", GST_DVB_CSS_WC_CLIENT_FILTER_MEDIAN, "burst-size", 3,
+      "slew-threshold", 10 * GST_MSECOND, NULL);
+  fail_unless (first != NULL, "failed to create client clock");
+
+  /* a clock of the same server with defaults shares the internal clock and does not reset it */
+  second = g_object_new (GST_TYPE_DVB_CSS_WC_CLIENT_CLOCK, "address", "127.0.0.1",
+      "port", 37035, NULL);
+  fail_unless (second != NULL, "failed to create client clock");
+
+  g_object_get (first, "filter", &filter, NULL);
+  fail_unless (filter == GST_DVB_CSS_WC_CLIENT_FILTER_MEDIAN, "filter was reset");
+  g_object_get (second, "filter", &filter, NULL);
+  fail_unless (filter == GST_DVB_CSS_WC_CLIENT_FILTER_MEDIAN, "filter is not shared");
+  g_object_get (second, "burst-size", &burst_size, NULL);
+  fail_unless (burst_size == 3, "burst-size was reset");
+  g_object_get (second, "slew-threshold", &slew_threshold, NULL);
+  fail_unless (slew_threshold == 10 * GST_MSECOND, "slew-threshold was reset");
+
+  gst_object_unref (second);
+  gst_object_unref (first);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_stats)
+{
+  GstDvbCssWcServer *wc;
+  GstDvbCssWcClientStats stats;
+  GstClock *clock, *client;
+  GstMessage *message;
+  const GstStructure *s;
+  GstClockTime dispersion;
+  GstBus *bus;
+  gint port = -1;
+
+  clock = gst_system_clock_obtain ();
+  wc = gst_dvb_css_wc_server_new (clock, "127.0.0.1", 0, FALSE, 500);
+  fail_unless (wc != NULL, "failed to create dvb css wc server");
+  g_object_get (wc, "port", &port, NULL);
+  fail_unless (port > 0);
+
+  bus = gst_bus_new ();
+  client = g_object_new (GST_TYPE_DVB_CSS_WC_CLIENT_CLOCK, "address", "127.0.0.1",
+      "port", port, "bus", bus, NULL);
+  fail_unless (client != NULL, "failed to create client clock");
+  fail_unless (gst_clock_wait_for_sync (client, 5 * GST_SECOND), "client clock not synced");
+
+  fail_unless (gst_dvb_css_wc_client_clock_get_stats (client, &stats));
+  fail_unless (stats.synced);
+  fail_unless (stats.responses > 0);
+  fail_unless (GST_CLOCK_TIME_IS_VALID (stats.rtt));
+  fail_unless (GST_CLOCK_TIME_IS_VALID (stats.dispersion));
+  fail_unless (GST_CLOCK_TIME_IS_VALID (stats.candidate_age));
+  /* same clock on both ends */
+  fail_unless (ABS (stats.offset) < 10 * GST_MSECOND, "offset too large");
+
+  message = gst_bus_timed_pop_filtered (bus, GST_SECOND, GST_MESSAGE_ELEMENT);
+  fail_unless (message != NULL, "no statistics posted");
+  s = gst_message_get_structure (message);
+  fail_unless (gst_structure_has_name (s, "dvbcsswc-clock-statistics"));
+  fail_unless (gst_structure_get_uint64 (s, "dispersion", &dispersion));
+  fail_unless (GST_CLOCK_TIME_IS_VALID (dispersion));
+  gst_message_unref (message);
+
+  gst_object_unref (client);
+  gst_object_unref (bus);
+  gst_object_unref (wc);
+  gst_object_unref (clock);
+}
+
+GST_END_TEST;
+
+#ifdef __linux__
+GST_START_TEST (test_shm)
+{
+  GstDvbCssWcShmWriter *writer;
+  GstClock *clock, *local;
+  GstClockTime internal, external, time;
+  GError *error = NULL;
+  gchar *name;
+  gint i;
+
+  name = g_strdup_printf ("/dvbcsswc-test-%d", (gint) getpid ());
+  fail_if (gst_dvb_css_wc_shm_is_published (name));
+
+  writer = gst_dvb_css_wc_shm_writer_new (name, GST_CLOCK_TYPE_MONOTONIC, &error);
+  fail_unless (writer != NULL, "failed to create writer");
+  fail_unless (gst_dvb_css_wc_shm_is_published (name));
+
+  /* a second writer on the same segment is refused */
+  fail_unless (gst_dvb_css_wc_shm_writer_new (name, GST_CLOCK_TYPE_MONOTONIC, &error) == NULL);
+  fail_unless (error != NULL);
+  g_clear_error (&error);
+
+  local = g_object_new (GST_TYPE_SYSTEM_CLOCK, "clock-type", GST_CLOCK_TYPE_MONOTONIC, NULL);
+  internal = gst_clock_get_internal_time (local);
+  external = internal + 1000 * GST_SECOND;
+  gst_dvb_css_wc_shm_writer_publish (writer, TRUE, internal, external, 1, 1, GST_MSECOND);
+
+  clock = gst_dvb_css_wc_shm_clock_new ("shm", name);
+  fail_unless (clock != NULL, "failed to create shm clock");
+  fail_unless (gst_clock_wait_for_sync (clock, GST_SECOND), "shm clock not synced");
+
+  for (i = 0; i < 10; i++) {
+    time = gst_clock_get_time (clock);
+    internal = gst_clock_get_internal_time (local);
+    fail_unless (ABS (GST_CLOCK_DIFF (internal + 1000 * GST_SECOND, time)) < 10 * GST_MSECOND,
+        "shm clock does not follow the calibration");
+  }
+
+  /* the readers lose sync when the writer goes away, but keep the time */
+  gst_dvb_css_wc_shm_writer_free (writer);
+  fail_if (gst_dvb_css_wc_shm_is_published (name));
+  for (i = 0; i < 20 && gst_clock_is_synced (clock); i++)
+    g_usleep (G_USEC_PER_SEC / 20);
+  fail_if (gst_clock_is_synced (clock), "shm clock still synced");
+  time = gst_clock_get_time (clock);
+  internal = gst_clock_get_internal_time (local);
+  fail_unless (ABS (GST_CLOCK_DIFF (internal + 1000 * GST_SECOND, time)) < 10 * GST_MSECOND,
+      "shm clock jumped back to the local time");
+
+  gst_object_unref (clock);
+  gst_object_unref (local);
+  shm_unlink (name);
+  g_free (name);
+}
+
+GST_END_TEST;
+#endif
+
+GST_START_TEST (test_filters)
+{
+  static const GstDvbCssWcClientFilter filters[] = {
+    GST_DVB_CSS_WC_CLIENT_FILTER_DISPERSION,
+    GST_DVB_CSS_WC_CLIENT_FILTER_LOWEST_RTT,
+    GST_DVB_CSS_WC_CLIENT_FILTER_MEDIAN,
+    GST_DVB_CSS_WC_CLIENT_FILTER_HUBER
+  };
+  /* symmetric on average, so every filter must end up close to the server */
+  Impairment impairment = { 0, };
+  GstDvbCssWcServer *wc;
+  GstClock *clock, *client;
+  ImpairProxy *proxy;
+  GError *error = NULL;
+  GstClockTimeDiff err;
+  gint port = -1;
+  guint i, j;
+
+  impairment.delay = GST_MSECOND;
+  impairment.jitter = GST_MSECOND;
+  impairment.distribution = IMPAIR_DISTRIBUTION_EXPONENTIAL;
+  impairment.seed = 1;
+
+  clock = offset_clock_new (1000 * GST_SECOND);
+  wc = gst_dvb_css_wc_server_new (clock, "127.0.0.1", 0, FALSE, 500);
+  fail_unless (wc != NULL, "failed to create dvb css wc server");
+  g_object_get (wc, "port", &port, NULL);
+
+  for (i = 0; i < G_N_ELEMENTS (filters); i++) {
+    /* clocks of the same server share their settings, so each filter gets
+     * a proxy of its own */
+    proxy = impair_proxy_new ("127.0.0.1", port, &impairment, &error);
+    fail_unless (proxy != NULL, "failed to create proxy");
+
+    client = g_object_new (GST_TYPE_DVB_CSS_WC_CLIENT_CLOCK, "address", "127.0.0.1",
+        "port", impair_proxy_get_port (proxy), "filter", filters[i],
+        "max-poll-interval", 200 * GST_MSECOND, NULL);
+    fail_unless (client != NULL, "failed to create client clock");
+    fail_unless (gst_clock_wait_for_sync (client, 5 * GST_SECOND),
+        "client clock not synced with filter %d", filters[i]);
+
+    /* let the history fill */
+    g_usleep (G_USEC_PER_SEC);
+    for (j = 0; j < 10; j++) {
+      err = client_error (client, clock);
+      fail_unless (ABS (err) < 2 * GST_MSECOND,
+          "filter %d off by %" G_GINT64_FORMAT "ns", filters[i], err);
+      g_usleep (G_USEC_PER_SEC / 20);
+    }
+
+    gst_object_unref (client);
+    impair_proxy_free (proxy);
+  }
+
+  gst_object_unref (wc);
+  gst_object_unref (clock);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_burst_backoff)
+{
+  /* the dispersion of every measurement is half its round trip, 1ms here,
+   * so the client backs off until waiting would cost as much */
+  Impairment impairment = { 0, };
+  GstDvbCssWcClientStats stats;
+  GstDvbCssWcServer *wc;
+  GstClock *clock, *client;
+  ImpairProxy *proxy;
+  GError *error = NULL;
+  guint64 responses;
+  gint port = -1;
+  gint i;
+
+  impairment.delay = GST_MSECOND;
+
+  clock = gst_system_clock_obtain ();
+  wc = gst_dvb_css_wc_server_new (clock, "127.0.0.1", 0, FALSE, 500);
+  fail_unless (wc != NULL, "failed to create dvb css wc server");
+  g_object_get (wc, "port", &port, NULL);
+  proxy = impair_proxy_new ("127.0.0.1", port, &impairment, &error);
+  fail_unless (proxy != NULL, "failed to create proxy");
+
+  client = g_object_new (GST_TYPE_DVB_CSS_WC_CLIENT_CLOCK, "address", "127.0.0.1",
+      "port", impair_proxy_get_port (proxy), "burst-size", 4,
+      "min-poll-interval", 20 * GST_MSECOND, "max-poll-interval", 320 * GST_MSECOND, NULL);
+  fail_unless (client != NULL, "failed to create client clock");
+  fail_unless (gst_clock_wait_for_sync (client, 5 * GST_SECOND), "client clock not synced");
+
+  /* the burst polls at the minimum interval, then the interval doubles up to the maximum */
+  for (i = 0; i < 60; i++) {
+    fail_unless (gst_dvb_css_wc_client_clock_get_stats (client, &stats));
+    if (stats.poll_interval == 320 * GST_MSECOND)
+      break;
+    fail_unless (stats.poll_interval >= 20 * GST_MSECOND
+        && stats.poll_interval <= 320 * GST_MSECOND, "poll interval out of bounds");
+    g_usleep (G_USEC_PER_SEC / 10);
+  }
+  fail_unless (stats.poll_interval == 320 * GST_MSECOND, "client did not back off");
+  fail_unless (stats.missed_responses == 0);
+
+  /* a new burst size starts a new burst with the next request. Backed off,
+   * the client gets at most four responses a second, with the burst and the
+   * back off after it seven */
+  g_usleep (G_USEC_PER_SEC / 2);
+  fail_unless (gst_dvb_css_wc_client_clock_get_stats (client, &stats));
+  responses = stats.responses;
+  g_object_set (client, "burst-size", 4, NULL);
+  g_usleep (G_USEC_PER_SEC);
+  fail_unless (gst_dvb_css_wc_client_clock_get_stats (client, &stats));
+  fail_unless (stats.responses >= responses + 6, "no burst after setting burst-size, %"
+      G_GUINT64_FORMAT " responses", stats.responses - responses);
+
+  /* unanswered requests are counted and make the client poll faster */
+  g_object_set (wc, "active", FALSE, NULL);
+  for (i = 0; i < 40; i++) {
+    fail_unless (gst_dvb_css_wc_client_clock_get_stats (client, &stats));
+    if (stats.missed_responses >= 3)
+      break;
+    g_usleep (G_USEC_PER_SEC / 10);
+  }
+  fail_unless (stats.missed_responses >= 3, "unanswered requests not counted");
+  fail_unless (stats.poll_interval < 320 * GST_MSECOND, "client did not poll faster");
+
+  gst_object_unref (client);
+  impair_proxy_free (proxy);
+  gst_object_unref (wc);
+  gst_object_unref (clock);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_slew)
+{
+  GstDvbCssWcServer *wc;
+  GstClock *clock, *client;
+  GstClockTime last, now;
+  GstClockTimeDiff err;
+  gint64 start;
+  gint port = -1;
+
+  clock = offset_clock_new (1000 * GST_SECOND);
+  wc = gst_dvb_css_wc_server_new (clock, "127.0.0.1", 0, FALSE, 500);
+  fail_unless (wc != NULL, "failed to create dvb css wc server");
+  g_object_get (wc, "port", &port, NULL);
+
+  client = g_object_new (GST_TYPE_DVB_CSS_WC_CLIENT_CLOCK, "address", "127.0.0.1",
+      "port", port, "slew-threshold", 20 * GST_MSECOND, "max-slew", 500,
+      "max-poll-interval", 100 * GST_MSECOND, NULL);
+  fail_unless (client != NULL, "failed to create client clock");
+  /* the first update steps however far off the clock is */
+  fail_unless (gst_clock_wait_for_sync (client, 5 * GST_SECOND), "client clock not synced");
+  g_usleep (G_USEC_PER_SEC);
+  err = client_error (client, clock);
+  fail_unless (ABS (err) < GST_MSECOND, "not converged, off by %" G_GINT64_FORMAT "ns", err);
+
+  /* below the threshold the error is slewed away at no more than
+   * max-slew plus the frequency estimate, and the time never goes back */
+  step_clock (clock, -10 * GST_MSECOND);
+  last = gst_clock_get_time (client);
+  start = g_get_monotonic_time ();
+  while (g_get_monotonic_time () - start < G_USEC_PER_SEC / 2) {
+    now = gst_clock_get_time (client);
+    fail_unless (now >= last, "client clock went back while slewing");
+    last = now;
+    g_usleep (G_USEC_PER_SEC / 100);
+  }
+  err = client_error (client, clock);
+  fail_unless (err > 8 * GST_MSECOND, "error was not slewed, but stepped to %"
+      G_GINT64_FORMAT "ns", err);
+
+  /* above it the clock is stepped */
+  g_object_set (client, "slew-threshold", GST_MSECOND, NULL);
+  step_clock (clock, 30 * GST_MSECOND);
+  g_usleep (G_USEC_PER_SEC / 2);
+  err = client_error (client, clock);
+  fail_unless (ABS (err) < GST_MSECOND, "clock was not stepped, off by %" G_GINT64_FORMAT "ns", err);
+
+  gst_object_unref (client);
+  gst_object_unref (wc);
+  gst_object_unref (clock);
+}
+
+GST_END_TEST;
+
+#ifdef __linux__
+GST_START_TEST (test_kernel_timestamps)
+{
+  GstDvbCssWcServer *wc;
+  GstDvbCssWcPacket packet, response, followup;
+  GstDvbCssWcAddress server_address;
+  GstClock *clock, *client;
+  GSocketAddress *server_addr;
+  GInetAddress *addr;
+  GSocket *socket;
+  GstClockTimeDiff err;
+  gboolean kernel_timestamps = FALSE;
+  gint port = -1;
+  guint32 i;
+
+  clock = offset_clock_new (1000 * GST_SECOND);
+  wc = g_initable_new (GST_TYPE_DVB_CSS_WC_SERVER, NULL, NULL, "clock", clock,
+      "address", "127.0.0.1", "port", 0, "followup", TRUE,
+      "max_freq_error_ppm", 500, "kernel-timestamps", TRUE, NULL);
+  fail_unless (wc != NULL, "failed to create dvb css wc server");
+  g_object_get (wc, "port", &port, "kernel-timestamps", &kernel_timestamps, NULL);
+  fail_unless (kernel_timestamps, "kernel timestamps not supported");
+
+  socket = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM,
+      G_SOCKET_PROTOCOL_UDP, NULL);
+  fail_unless (socket != NULL, "could not create socket");
+  addr = g_inet_address_new_from_string ("127.0.0.1");
+  server_addr = g_inet_socket_address_new (addr, port);
+  g_object_unref (addr);
+  fail_unless (gst_dvb_css_wc_address_set (&server_address, server_addr));
+
+  /* every response is followed by one carrying the time it actually left,
+   * after the time it was received and before it was read here. The
+   * transmit timestamps of the server must not hold up later requests. */
+  for (i = 0; i < 20; i++) {
+    gst_dvb_css_wc_packet_parse_into (NULL, &packet);
+    packet.originate_timevalue_secs = i;
+    fail_unless (gst_dvb_css_wc_packet_send_to (&packet, socket, &server_address, NULL));
+
+    fail_unless (g_socket_condition_timed_wait (socket, G_IO_IN, G_USEC_PER_SEC / 10,
+            NULL, NULL), "request %u was not answered in time", i);
+    fail_unless (gst_dvb_css_wc_packet_receive_into (socket, &response, NULL, NULL, NULL));
+    fail_unless (g_socket_condition_timed_wait (socket, G_IO_IN, G_USEC_PER_SEC / 10,
+            NULL, NULL), "no followup to request %u", i);
+    fail_unless (gst_dvb_css_wc_packet_receive_into (socket, &followup, NULL, NULL, NULL));
+
+    fail_unless (response.message_type == GST_DVB_CSS_WC_MSG_RESPONSE_WITH_FOLLOWUP, "wrong msg type");
+    fail_unless (followup.message_type == GST_DVB_CSS_WC_MSG_FOLLOWUP, "wrong msg type");
+    fail_unless (response.originate_timevalue_secs == i && followup.originate_timevalue_secs == i,
+        "answered the wrong request");
+    fail_unless (followup.receive_timevalue == response.receive_timevalue);
+    fail_unless (followup.receive_timevalue <= followup.transmit_timevalue,
+        "transmitted before it was received");
+    fail_unless (followup.transmit_timevalue <= gst_clock_get_time (clock),
+        "transmitted in the future");
+  }
+
+  /* a client taking its receive times from the kernel follows the server as well */
+  client = g_object_new (GST_TYPE_DVB_CSS_WC_CLIENT_CLOCK, "address", "127.0.0.1",
+      "port", port, "kernel-timestamps", TRUE, NULL);
+  fail_unless (client != NULL, "failed to create client clock");
+  fail_unless (gst_clock_wait_for_sync (client, 5 * GST_SECOND), "client clock not synced");
+  g_object_get (client, "kernel-timestamps", &kernel_timestamps, NULL);
+  fail_unless (kernel_timestamps, "client fell back to user space timestamps");
+  g_usleep (G_USEC_PER_SEC / 2);
+  err = client_error (client, clock);
+  fail_unless (ABS (err) < GST_MSECOND, "off by %" G_GINT64_FORMAT "ns", err);
+
+  gst_object_unref (client);
+  g_object_unref (socket);
+  g_object_unref (server_addr);
+  gst_object_unref (wc);
+  gst_object_unref (clock);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_kernel_timestamps_no_followup)
+{
+  GstDvbCssWcServer *wc;
+  GstDvbCssWcPacket packet, response;
+  GstDvbCssWcAddress server_address;
+  GstClock *clock;
+  GSocketAddress *server_addr;
+  GInetAddress *addr;
+  GSocket *socket;
+  gint port = -1;
+  guint32 i;
+
+  /* receive timestamps only, nothing waits for the transmit ones */
+  clock = gst_system_clock_obtain ();
+  wc = g_initable_new (GST_TYPE_DVB_CSS_WC_SERVER, NULL, NULL, "clock", clock,
+      "address", "127.0.0.1", "port", 0, "followup", FALSE,
+      "max_freq_error_ppm", 500, "kernel-timestamps", TRUE, NULL);
+  fail_unless (wc != NULL, "failed to create dvb css wc server");
+  g_object_get (wc, "port", &port, NULL);
+
+  socket = g_socket_new (G_SOCKET_FAMILY_IPV4, G_SOCKET_TYPE_DATAGRAM,
+      G_SOCKET_PROTOCOL_UDP, NULL);
+  fail_unless (socket != NULL, "could not create socket");
+  addr = g_inet_address_new_from_string ("127.0.0.1");
+  server_addr = g_inet_socket_address_new (addr, port);
+  g_object_unref (addr);
+  fail_unless (gst_dvb_css_wc_address_set (&server_address, server_addr));
+
+  for (i = 0; i < 20; i++) {
+    gst_dvb_css_wc_packet_parse_into (NULL, &packet);
+    packet.originate_timevalue_secs = i;
+    fail_unless (gst_dvb_css_wc_packet_send_to (&packet, socket, &server_address, NULL));
+    fail_unless (g_socket_condition_timed_wait (socket, G_IO_IN, G_USEC_PER_SEC / 10,
+            NULL, NULL), "request %u was not answered in time", i);
+    fail_unless (gst_dvb_css_wc_packet_receive_into (socket, &response, NULL, NULL, NULL));
+    fail_unless (response.message_type == GST_DVB_CSS_WC_MSG_RESPONSE, "wrong msg type");
+    fail_unless (response.originate_timevalue_secs == i, "answered the wrong request");
+    fail_unless (response.receive_timevalue <= response.transmit_timevalue,
+        "transmitted before it was received");
+  }
+
+  /* and no followup comes after all */
+  fail_if (g_socket_condition_timed_wait (socket, G_IO_IN, G_USEC_PER_SEC / 10, NULL, NULL));
+
+  g_object_unref (socket);
+  g_object_unref (server_addr);
+  gst_object_unref (wc);
+  gst_object_unref (clock);
+}
+
+GST_END_TEST;
+
+GST_START_TEST (test_shm_reader)
+{
+  GstDvbCssWcShmWriter *writer;
+  GstDvbCssWcClientStats stats;
+  GstClock *local, *client, *internal_clock;
+  GstClockTime internal;
+  GstClockTimeDiff err;
+  GError *error = NULL;
+  guint burst_size = 0;
+  gchar *name;
+  gint i;
+
+  name = g_strdup_printf ("/dvbcsswc-test-reader-%d", (gint) getpid ());
+  local = g_object_new (GST_TYPE_SYSTEM_CLOCK, "clock-type", GST_CLOCK_TYPE_MONOTONIC, NULL);
+
+  /* the process that got there first publishes */
+  writer = gst_dvb_css_wc_shm_writer_new (name, GST_CLOCK_TYPE_MONOTONIC, &error);
+  fail_unless (writer != NULL, "failed to create writer");
+  internal = gst_clock_get_internal_time (local);
+  gst_dvb_css_wc_shm_writer_publish (writer, TRUE, internal, internal + 1000 * GST_SECOND,
+      1, 1, GST_MSECOND);
+
+  /* nothing listens there, the client must not need the server */
+  client = g_object_new (GST_TYPE_DVB_CSS_WC_CLIENT_CLOCK, "address", "127.0.0.1",
+      "port", 9, "shm-name", name, "burst-size", 2, NULL);
+  fail_unless (client != NULL, "failed to create client clock");
+  g_object_get (client, "internal-clock", &internal_clock, NULL);
+  fail_unless (GST_IS_DVB_CSS_WC_SHM_CLOCK (internal_clock), "client does not read the published time");
+  gst_object_unref (internal_clock);
+
+  fail_unless (gst_clock_wait_for_sync (client, GST_SECOND), "client clock not synced");
+  err = GST_CLOCK_DIFF (gst_clock_get_internal_time (local) + 1000 * GST_SECOND,
+      gst_clock_get_time (client));
+  fail_unless (ABS (err) < 10 * GST_MSECOND, "off by %" G_GINT64_FORMAT "ns", err);
+
+  fail_unless (gst_dvb_css_wc_client_clock_get_stats (client, &stats));
+  fail_unless (stats.synced);
+  fail_unless (stats.dispersion == GST_MSECOND);
+
+  /* settings of a reader wait for a clock that polls */
+  g_object_get (client, "burst-size", &burst_size, NULL);
+  fail_unless (burst_size == 2);
+
+  /* a publisher taking over after the first one died is followed after a
+   * round of being unsynced */
+  gst_dvb_css_wc_shm_writer_free (writer);
+  for (i = 0; i < 20 && gst_clock_is_synced (client); i++)
+    g_usleep (G_USEC_PER_SEC / 20);
+  fail_if (gst_clock_is_synced (client), "client still synced");
+
+  writer = gst_dvb_css_wc_shm_writer_new (name, GST_CLOCK_TYPE_MONOTONIC, &error);
+  fail_unless (writer != NULL, "failed to take over");
+  internal = gst_clock_get_internal_time (local);
+  gst_dvb_css_wc_shm_writer_publish (writer, TRUE, internal, internal + 2000 * GST_SECOND,
+      1, 1, 2 * GST_MSECOND);
+  fail_unless (gst_clock_wait_for_sync (client, GST_SECOND), "client clock not synced again");
+  err = GST_CLOCK_DIFF (gst_clock_get_internal_time (local) + 2000 * GST_SECOND,
+      gst_clock_get_time (client));
+  fail_unless (ABS (err) < 10 * GST_MSECOND, "off by %" G_GINT64_FORMAT "ns", err);
+
+  gst_object_unref (client);
+  gst_dvb_css_wc_shm_writer_free (writer);
+  gst_object_unref (local);
+  shm_unlink (name);
+  g_free (name);
+}
+
+GST_END_TEST;
+#endif
+
 static Suite *
 gst_net_time_provider_suite (void)
 {
   Suite *s = suite_create ("GstNetTimeProvider");
   TCase *tc_chain = tcase_create ("generic tests");
 
+  /* the clock tests wait for clients to converge */
+  tcase_set_timeout (tc_chain, 60);
   suite_add_tcase (s, tc_chain);
   tcase_add_test (tc_chain, test_refcounts);
   tcase_add_test (tc_chain, test_packet);
   tcase_add_test (tc_chain, test_functioning);
+  tcase_add_test (tc_chain, test_packet_into);
+  tcase_add_test (tc_chain, test_shared_settings);
+  tcase_add_test (tc_chain, test_stats);
+  tcase_add_test (tc_chain, test_filters);
+  tcase_add_test (tc_chain, test_burst_backoff);
+  tcase_add_test (tc_chain, test_slew);
+#ifdef __linux__
+  tcase_add_test (tc_chain, test_batched);
+  tcase_add_test (tc_chain, test_kernel_timestamps);
+  tcase_add_test (tc_chain, test_kernel_timestamps_no_followup);
+  tcase_add_test (tc_chain, test_shm);
+  tcase_add_test (tc_chain, test_shm_reader);
+#endif
 
   return s;
 }
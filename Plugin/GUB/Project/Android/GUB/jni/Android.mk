@@ -8,10 +8,12 @@ DVB_CSS_WC_PROJECT_PATH := $(IMMERSIATV_PLAYER_ROOT)/Plugin/DvbCssWc/Project/And
 
 LOCAL_MODULE            := GstUnityBridge
 LOCAL_C_INCLUDES        := $(DVB_CSS_WC_HEADERS_PATH)
-LOCAL_SRC_FILES         := $(GUB_SOURCE_PATH)/gub_graphics.c \
+LOCAL_SRC_FILES         := $(GUB_SOURCE_PATH)/gub_convert.c \
+                           $(GUB_SOURCE_PATH)/gub_graphics.c \
                            $(GUB_SOURCE_PATH)/gub_gstreamer.c \
                            $(GUB_SOURCE_PATH)/gub_pipeline.c \
-                           $(GUB_SOURCE_PATH)/gub_log.c
+                           $(GUB_SOURCE_PATH)/gub_log.c \
+                           $(GUB_SOURCE_PATH)/gub_clock.c
 LOCAL_SHARED_LIBRARIES  := gstreamer_android DvbCssWc
 LOCAL_LDLIBS            := -llog -lGLESv2
 include $(BUILD_SHARED_LIBRARY)
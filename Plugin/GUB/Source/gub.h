@@ -22,6 +22,7 @@
 #define __GUB_H__
 
 #include <gst/gst.h>
+#include <gst/video/video.h>
 
 #if _WIN32
 #define EXPORT_API __declspec(dllexport)
@@ -32,11 +33,20 @@
 /* Created from the gst pipeline */
 typedef void GUBGraphicContext;
 
+/* How decoded frames travel to the graphic backend. Backends which do not support a mode use RGB. */
+typedef enum {
+    GUB_VIDEO_UPLOAD_RGB = 0,           /* Converted to RGB on the CPU */
+    GUB_VIDEO_UPLOAD_PLANAR_YUV = 1,    /* Native I420/NV12 planes, converted to RGB in a shader */
+    GUB_VIDEO_UPLOAD_GL_MEMORY = 2      /* Uploaded by GStreamer into textures shared with Unity's context */
+} GUBVideoUploadMode;
+
 GUBGraphicContext *gub_create_graphic_context(GstPipeline *pipeline, float crop_left, float crop_top, float crop_right, float crop_bottom);
 GstContext *gub_provide_graphic_context(GUBGraphicContext *gcontext, const gchar *type);
 void gub_destroy_graphic_context(GUBGraphicContext *context);
-gboolean gub_blit_image(GUBGraphicContext *gcontext, GstSample *sample, void *texture_native_ptr);
-const gchar *gub_get_video_branch_description();
+gboolean gub_blit_image(GUBGraphicContext *gcontext, GstSample *sample, GstVideoInfo *video_info, void *texture_native_ptr);
+/* Called from the streaming thread with each new frame, so the backend can start moving it towards the GPU there */
+void gub_stage_image(GUBGraphicContext *gcontext, GstSample *sample);
+const gchar *gub_get_video_branch_description(GUBVideoUploadMode mode);
 
 void gub_log(const char *format, ...);
 void gub_log_error(const char *message);
@@ -0,0 +1,331 @@
+/*
+*  GStreamer - Unity3D bridge (GUB).
+*  Copyright (C) 2016  Fundacio i2CAT, Internet i Innovacio digital a Catalunya
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Lesser General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Lesser General Public License for more details.
+*
+*  You should have received a copy of the GNU Lesser General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*  Authors:  Xavi Artigas <xavi.artigas@i2cat.net>
+*/
+
+#include <gst/net/gstnet.h>
+#include <gstdvbcsswcclient.h>
+#include <gstdvbcsswcshm.h>
+#include "gub_clock.h"
+
+#define NTP_DEFAULT_PORT 123
+#define PTP_DEFAULT_DOMAIN 0
+#define PTP_MAX_DOMAIN 255
+
+typedef struct _GUBClockProvider {
+    gchar *scheme;
+    gint default_port;
+    GUBClockCreatePFN create;
+    GUBClockEstimateErrorPFN estimate_error;
+} GUBClockProvider;
+
+/* What gub_clock_new attaches to the clocks it creates */
+typedef struct _GUBClockState {
+    GUBClockEstimateErrorPFN estimate_error;
+    /* Statistics posted by the clock, for clocks with a "bus" property */
+    GstBus *bus;
+    gint64 error_estimate; /* protected by clock_state */
+} GUBClockState;
+
+G_LOCK_DEFINE_STATIC(clock_state);
+G_LOCK_DEFINE_STATIC(providers);
+static GSList *providers = NULL;
+
+/* Last correction of each PTP domain, as reported by the PTP statistics */
+G_LOCK_DEFINE_STATIC(ptp_statistics);
+static gint64 ptp_discontinuity[PTP_MAX_DOMAIN + 1];
+
+static GQuark gub_clock_state_quark(void)
+{
+    return g_quark_from_static_string("gub-clock-state");
+}
+
+static void clock_state_free(GUBClockState *state)
+{
+    if (state->bus) {
+        gst_object_unref(state->bus);
+    }
+    g_free(state);
+}
+
+static GstClock *create_gstnet_clock(const gchar *name, const gchar *host, gint port)
+{
+    return port < 0 ? NULL : gst_net_client_clock_new(name, host, port, 0);
+}
+
+static GstClock *create_dvbcsswc_clock(const gchar *name, const gchar *host, gint port)
+{
+    return port < 0 ? NULL : gst_dvb_css_wc_client_clock_new(name, host, port, 0);
+}
+
+/* The host of a DVB CSS shared memory URI names the segment another process publishes in */
+static GstClock *create_dvbcsswc_shm_clock(const gchar *name, const gchar *host, gint port)
+{
+    GstClock *clock;
+    gchar *shm_name;
+
+    if (!host || !*host) {
+        return NULL;
+    }
+    shm_name = g_strconcat("/", host, NULL);
+    clock = gst_dvb_css_wc_shm_clock_new(name, shm_name);
+    g_free(shm_name);
+    return clock;
+}
+
+static GstClock *create_ntp_clock(const gchar *name, const gchar *host, gint port)
+{
+    return gst_ntp_clock_new(name, host, port, 0);
+}
+
+static gboolean ptp_statistics(guint8 domain, const GstStructure *stats, gpointer user_data)
+{
+    gint64 discontinuity;
+
+    if (gst_structure_has_name(stats, GST_PTP_STATISTICS_TIME_UPDATED) &&
+        gst_structure_get_int64(stats, "discontinuity", &discontinuity)) {
+        G_LOCK(ptp_statistics);
+        ptp_discontinuity[domain] = ABS(discontinuity);
+        G_UNLOCK(ptp_statistics);
+    }
+    return TRUE;
+}
+
+/* The host of a PTP URI is the domain */
+static GstClock *create_ptp_clock(const gchar *name, const gchar *host, gint port)
+{
+    static gsize initialized = 0;
+    guint64 domain = PTP_DEFAULT_DOMAIN;
+
+    if (g_once_init_enter(&initialized)) {
+        // Runs the gst-ptp-helper, which needs the privileges to bind the PTP ports
+        gboolean ok = gst_ptp_init(GST_PTP_CLOCK_ID_NONE, NULL);
+        if (ok) {
+            gst_ptp_statistics_callback_add(ptp_statistics, NULL, NULL);
+        }
+        else {
+            gub_log("Could not initialize PTP support");
+        }
+        g_once_init_leave(&initialized, ok ? 1 : 2);
+    }
+    if (initialized != 1) {
+        return NULL;
+    }
+
+    if (host && *host && !g_ascii_string_to_unsigned(host, 10, 0, PTP_MAX_DOMAIN, &domain, NULL)) {
+        gub_log("Invalid PTP domain %s", host);
+        return NULL;
+    }
+    return gst_ptp_clock_new(name, (guint)domain);
+}
+
+/* Network clocks post their statistics on the bus they are given, from their own thread.
+They are only kept as an estimate, so that nothing piles up on the bus. */
+static GstBusSyncReply clock_statistics(GstBus *bus, GstMessage *message, gpointer user_data)
+{
+    GUBClockState *state = user_data;
+    const GstStructure *stats = gst_message_get_structure(message);
+    GstClockTime rtt;
+
+    if (stats && gst_structure_has_name(stats, "gst-netclock-statistics") &&
+        gst_structure_get_clock_time(stats, "rtt-average", &rtt) && GST_CLOCK_TIME_IS_VALID(rtt)) {
+        // The answer may have taken any part of the round trip to come back
+        G_LOCK(clock_state);
+        state->error_estimate = rtt / 2;
+        G_UNLOCK(clock_state);
+    }
+    return GST_BUS_DROP;
+}
+
+static gint64 estimate_net_clock_error(GstClock *clock)
+{
+    GUBClockState *state = g_object_get_qdata(G_OBJECT(clock), gub_clock_state_quark());
+    gint64 error;
+
+    G_LOCK(clock_state);
+    error = state->bus ? state->error_estimate : -1;
+    G_UNLOCK(clock_state);
+    return error;
+}
+
+/* The dispersion bounds the error of the wall clock, and keeps growing while no better answer arrives */
+static gint64 estimate_dvbcsswc_clock_error(GstClock *clock)
+{
+    GstDvbCssWcClientStats stats;
+
+    if (!gst_dvb_css_wc_client_clock_get_stats(clock, &stats) || !GST_CLOCK_TIME_IS_VALID(stats.dispersion)) {
+        return -1;
+    }
+    return (gint64)stats.dispersion;
+}
+
+static gint64 estimate_dvbcsswc_shm_clock_error(GstClock *clock)
+{
+    GstClockTime dispersion = gst_dvb_css_wc_shm_clock_get_dispersion(clock);
+
+    return GST_CLOCK_TIME_IS_VALID(dispersion) ? (gint64)dispersion : -1;
+}
+
+static gint64 estimate_ptp_clock_error(GstClock *clock)
+{
+    guint domain;
+    gint64 error;
+
+    g_object_get(clock, "domain", &domain, NULL);
+    G_LOCK(ptp_statistics);
+    error = ptp_discontinuity[domain & PTP_MAX_DOMAIN];
+    G_UNLOCK(ptp_statistics);
+    return error;
+}
+
+static void add_provider(const gchar *scheme, gint default_port,
+    GUBClockCreatePFN create, GUBClockEstimateErrorPFN estimate_error)
+{
+    GUBClockProvider *provider = NULL;
+    GSList *l;
+
+    G_LOCK(providers);
+    for (l = providers; l; l = l->next) {
+        if (g_ascii_strcasecmp(((GUBClockProvider *)l->data)->scheme, scheme) == 0) {
+            provider = l->data;
+            break;
+        }
+    }
+    if (!provider) {
+        provider = g_new0(GUBClockProvider, 1);
+        provider->scheme = g_strdup(scheme);
+        providers = g_slist_prepend(providers, provider);
+    }
+    provider->default_port = default_port;
+    provider->create = create;
+    provider->estimate_error = estimate_error;
+    G_UNLOCK(providers);
+}
+
+static void register_builtin_providers(void)
+{
+    static gsize registered = 0;
+
+    if (g_once_init_enter(&registered)) {
+        int i;
+        for (i = 0; i <= PTP_MAX_DOMAIN; i++) {
+            ptp_discontinuity[i] = -1;
+        }
+        add_provider("gstnet", -1, create_gstnet_clock, estimate_net_clock_error);
+        add_provider("dvbcsswc", -1, create_dvbcsswc_clock, estimate_dvbcsswc_clock_error);
+        add_provider("dvbcsswc-shm", -1, create_dvbcsswc_shm_clock, estimate_dvbcsswc_shm_clock_error);
+        add_provider("ntp", NTP_DEFAULT_PORT, create_ntp_clock, estimate_net_clock_error);
+        add_provider("ptp", -1, create_ptp_clock, estimate_ptp_clock_error);
+        g_once_init_leave(&registered, 1);
+    }
+}
+
+EXPORT_API void gub_clock_register_provider(const gchar *scheme, gint default_port,
+    GUBClockCreatePFN create, GUBClockEstimateErrorPFN estimate_error)
+{
+    // So that the built in ones do not replace this one later
+    register_builtin_providers();
+    add_provider(scheme, default_port, create, estimate_error);
+}
+
+static void set_clock_property(gpointer key, gpointer value, gpointer clock)
+{
+    if (!value || !g_object_class_find_property(G_OBJECT_GET_CLASS(clock), key)) {
+        gub_log("Clock %s has no property %s", GST_OBJECT_NAME(clock), (const gchar *)key);
+        return;
+    }
+    gst_util_set_object_arg(G_OBJECT(clock), key, value);
+}
+
+GstClock *gub_clock_new(const gchar *name, const gchar *uri)
+{
+    GstUri *parsed;
+    GUBClockProvider provider = { NULL };
+    GUBClockState *state;
+    GstClock *clock;
+    GHashTable *query;
+    const gchar *scheme;
+    gboolean found = FALSE;
+    guint port;
+    GSList *l;
+
+    register_builtin_providers();
+
+    parsed = gst_uri_from_string(uri);
+    scheme = parsed ? gst_uri_get_scheme(parsed) : NULL;
+    if (!scheme) {
+        gub_log("Invalid clock URI %s", uri);
+        if (parsed) {
+            gst_uri_unref(parsed);
+        }
+        return NULL;
+    }
+
+    G_LOCK(providers);
+    for (l = providers; l; l = l->next) {
+        if (g_ascii_strcasecmp(((GUBClockProvider *)l->data)->scheme, scheme) == 0) {
+            provider = *(GUBClockProvider *)l->data;
+            found = TRUE;
+            break;
+        }
+    }
+    G_UNLOCK(providers);
+    if (!found) {
+        gub_log("No clock provider for %s", uri);
+        gst_uri_unref(parsed);
+        return NULL;
+    }
+
+    port = gst_uri_get_port(parsed);
+    clock = provider.create(name, gst_uri_get_host(parsed), port == GST_URI_NO_PORT ? provider.default_port : (gint)port);
+    if (!clock) {
+        gub_log("Could not create clock for %s", uri);
+        gst_uri_unref(parsed);
+        return NULL;
+    }
+
+    query = gst_uri_get_query_table(parsed);
+    if (query) {
+        g_hash_table_foreach(query, set_clock_property, clock);
+        g_hash_table_unref(query);
+    }
+    gst_uri_unref(parsed);
+
+    state = g_new0(GUBClockState, 1);
+    state->estimate_error = provider.estimate_error;
+    state->error_estimate = -1;
+    if (g_object_class_find_property(G_OBJECT_GET_CLASS(clock), "bus")) {
+        state->bus = gst_bus_new();
+        gst_bus_set_sync_handler(state->bus, clock_statistics, state, NULL);
+        g_object_set(clock, "bus", state->bus, NULL);
+    }
+    g_object_set_qdata_full(G_OBJECT(clock), gub_clock_state_quark(), state, (GDestroyNotify)clock_state_free);
+
+    return clock;
+}
+
+gboolean gub_clock_get_sync_quality(GstClock *clock, gint64 *error_estimate)
+{
+    GUBClockState *state = g_object_get_qdata(G_OBJECT(clock), gub_clock_state_quark());
+
+    *error_estimate = -1;
+    if (state && state->estimate_error) {
+        *error_estimate = state->estimate_error(clock);
+    }
+    return gst_clock_is_synced(clock);
+}
@@ -0,0 +1,49 @@
+/*
+*  GStreamer - Unity3D bridge (GUB).
+*  Copyright (C) 2016  Fundacio i2CAT, Internet i Innovacio digital a Catalunya
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Lesser General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Lesser General Public License for more details.
+*
+*  You should have received a copy of the GNU Lesser General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*  Authors:  Xavi Artigas <xavi.artigas@i2cat.net>
+*/
+
+#include <gst/gst.h>
+#include "gub.h"
+
+/* Creates the clock for a URI of one of the registered providers. Built in are:
+gstnet://host:port      GstNetTimeProvider (GstNetClientClock)
+dvbcsswc://host:port    DVB CSS wall clock server
+dvbcsswc-shm://name     DVB CSS wall clock another process on this host publishes in shared memory "/name",
+                        see its "shm-name" property. Not available on Windows and Android.
+ntp://host[:port]       NTP server, port 123 by default
+ptp://[domain]          PTP (IEEE 1588) master on the local network, domain 0 by default
+Query parameters are set as properties of the clock, to tune each provider,
+e.g. "dvbcsswc://10.0.0.1:6677?slew-threshold=2000000&max-poll-interval=2000000000".
+Returns NULL if the scheme is unknown or the clock cannot be created. */
+GstClock *gub_clock_new(const gchar *name, const gchar *uri);
+
+/* Creates the clock of a provider. port is -1 when the URI has none and the provider has no default. */
+typedef GstClock *(*GUBClockCreatePFN)(const gchar *name, const gchar *host, gint port);
+
+/* How far off the clock might currently be in nanoseconds, or -1 if the provider cannot tell */
+typedef gint64(*GUBClockEstimateErrorPFN)(GstClock *clock);
+
+/* Adds a provider for scheme, or replaces the one registered for it. estimate_error may be NULL.
+Exported, so that an application can plug in its own clocks before creating pipelines. */
+EXPORT_API void gub_clock_register_provider(const gchar *scheme, gint default_port,
+    GUBClockCreatePFN create, GUBClockEstimateErrorPFN estimate_error);
+
+/* Returns whether a clock created by gub_clock_new is synced and, in error_estimate,
+how far off it might be in nanoseconds (-1 if its provider cannot tell) */
+gboolean gub_clock_get_sync_quality(GstClock *clock, gint64 *error_estimate);
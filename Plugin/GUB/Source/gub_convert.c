@@ -0,0 +1,448 @@
+/*
+*  GStreamer - Unity3D bridge (GUB).
+*  Copyright (C) 2016  Fundacio i2CAT, Internet i Innovacio digital a Catalunya
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Lesser General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Lesser General Public License for more details.
+*
+*  You should have received a copy of the GNU Lesser General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*  Authors:  Xavi Artigas <xavi.artigas@i2cat.net>
+*/
+
+
+#include "gub.h"
+#include "gub_convert.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define GUB_CONVERT_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define GUB_CONVERT_NEON 1
+#include <arm_neon.h>
+#endif
+
+/* GCC and Clang only allow intrinsics of extensions enabled for the function using them,
+ * which lets us build AVX2 kernels without requiring AVX2 for the whole library */
+#if defined(__GNUC__)
+#define GUB_TARGET_SSE2 __attribute__((target("sse2")))
+#define GUB_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define GUB_TARGET_SSE2
+#define GUB_TARGET_AVX2
+#endif
+
+/* Luma for a row of RGBA pixels */
+typedef void(*GUBConvertYRowPFN)(const guint8 *rgba, guint8 *y, gint width);
+/* Chroma for a pair of RGBA rows, subsampled 2x2. With interleaved, u receives CbCr pairs and v is unused. */
+typedef void(*GUBConvertUVRowPFN)(const guint8 *rgba0, const guint8 *rgba1, guint8 *u, guint8 *v, gint width, gboolean interleaved);
+
+typedef struct _GUBConvertKernels {
+    const gchar *name;
+    GUBConvertYRowPFN y_row;
+    GUBConvertUVRowPFN uv_row;
+} GUBConvertKernels;
+
+// --------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------ Scalar ------------------------------------------------------
+// --------------------------------------------------------------------------------------------------------------------
+// BT.601 limited range, in 8 bit fixed point. Chroma is computed from the sum of 2 vertically averaged pixels,
+// hence the extra bit of shift. All SIMD kernels produce exactly the same output as these.
+
+#define GUB_AVG(a, b) (((a) + (b) + 1) >> 1)
+
+static void gub_convert_y_row_c(const guint8 *rgba, guint8 *y, gint width)
+{
+    gint x;
+
+    for (x = 0; x < width; x++, rgba += 4) {
+        y[x] = (guint8)(((66 * rgba[0] + 129 * rgba[1] + 25 * rgba[2] + 128) >> 8) + 16);
+    }
+}
+
+static void gub_convert_uv_row_c(const guint8 *rgba0, const guint8 *rgba1, guint8 *u, guint8 *v, gint width, gboolean interleaved)
+{
+    gint x;
+
+    for (x = 0; x < width; x += 2, rgba0 += 8, rgba1 += 8) {
+        // On odd widths the last chroma sample only covers one column
+        gint next = x + 1 < width ? 4 : 0;
+        gint r = GUB_AVG(rgba0[0], rgba1[0]) + GUB_AVG(rgba0[next + 0], rgba1[next + 0]);
+        gint g = GUB_AVG(rgba0[1], rgba1[1]) + GUB_AVG(rgba0[next + 1], rgba1[next + 1]);
+        gint b = GUB_AVG(rgba0[2], rgba1[2]) + GUB_AVG(rgba0[next + 2], rgba1[next + 2]);
+        guint8 cb = (guint8)(((-38 * r - 74 * g + 112 * b + 256) >> 9) + 128);
+        guint8 cr = (guint8)(((112 * r - 94 * g - 18 * b + 256) >> 9) + 128);
+
+        if (interleaved) {
+            u[x] = cb;
+            u[x + 1] = cr;
+        }
+        else {
+            u[x / 2] = cb;
+            v[x / 2] = cr;
+        }
+    }
+}
+
+static const GUBConvertKernels gub_convert_kernels_c = {
+    "scalar", gub_convert_y_row_c, gub_convert_uv_row_c
+};
+
+#if GUB_CONVERT_X86
+// --------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- SSE2 -------------------------------------------------------
+// --------------------------------------------------------------------------------------------------------------------
+
+/* Adds the two halves of each pixel's madd result: [p0a p0b p1a p1b] [p2a p2b p3a p3b] -> [p0 p1 p2 p3] */
+static GUB_TARGET_SSE2 __m128i gub_hadd_pairs_sse2(__m128i lo, __m128i hi)
+{
+    __m128i even = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+    __m128i odd = _mm_castps_si128(_mm_shuffle_ps(_mm_castsi128_ps(lo), _mm_castsi128_ps(hi), _MM_SHUFFLE(3, 1, 3, 1)));
+    return _mm_add_epi32(even, odd);
+}
+
+/* Sums horizontally adjacent pixels of 4 RGBA pixels, as 16 bit: [R01 G01 B01 A01 R23 G23 B23 A23] */
+static GUB_TARGET_SSE2 __m128i gub_sum_pairs_sse2(__m128i p)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i lo = _mm_unpacklo_epi8(p, zero);
+    __m128i hi = _mm_unpackhi_epi8(p, zero);
+    lo = _mm_add_epi16(lo, _mm_srli_si128(lo, 8));
+    hi = _mm_add_epi16(hi, _mm_srli_si128(hi, 8));
+    return _mm_unpacklo_epi64(lo, hi);
+}
+
+static GUB_TARGET_SSE2 __m128i gub_y4_sse2(__m128i p)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i coeffs = _mm_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0);
+    __m128i lo = _mm_madd_epi16(_mm_unpacklo_epi8(p, zero), coeffs);
+    __m128i hi = _mm_madd_epi16(_mm_unpackhi_epi8(p, zero), coeffs);
+    return _mm_srli_epi32(_mm_add_epi32(gub_hadd_pairs_sse2(lo, hi), _mm_set1_epi32(128)), 8);
+}
+
+static GUB_TARGET_SSE2 __m128i gub_c4_sse2(__m128i sums0, __m128i sums1, __m128i coeffs)
+{
+    __m128i c = gub_hadd_pairs_sse2(_mm_madd_epi16(sums0, coeffs), _mm_madd_epi16(sums1, coeffs));
+    c = _mm_srai_epi32(_mm_add_epi32(c, _mm_set1_epi32(256)), 9);
+    return _mm_add_epi32(c, _mm_set1_epi32(128));
+}
+
+static GUB_TARGET_SSE2 void gub_convert_y_row_sse2(const guint8 *rgba, guint8 *y, gint width)
+{
+    const __m128i offset = _mm_set1_epi16(16);
+    gint x;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+        __m128i y0 = gub_y4_sse2(_mm_loadu_si128((const __m128i *)(rgba + 4 * x)));
+        __m128i y1 = gub_y4_sse2(_mm_loadu_si128((const __m128i *)(rgba + 4 * x + 16)));
+        __m128i y16 = _mm_add_epi16(_mm_packs_epi32(y0, y1), offset);
+        _mm_storel_epi64((__m128i *)(y + x), _mm_packus_epi16(y16, y16));
+    }
+    gub_convert_y_row_c(rgba + 4 * x, y + x, width - x);
+}
+
+static GUB_TARGET_SSE2 void gub_convert_uv_row_sse2(const guint8 *rgba0, const guint8 *rgba1, guint8 *u, guint8 *v, gint width, gboolean interleaved)
+{
+    const __m128i cb_coeffs = _mm_setr_epi16(-38, -74, 112, 0, -38, -74, 112, 0);
+    const __m128i cr_coeffs = _mm_setr_epi16(112, -94, -18, 0, 112, -94, -18, 0);
+    gint x;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+        __m128i a0 = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(rgba0 + 4 * x)), _mm_loadu_si128((const __m128i *)(rgba1 + 4 * x)));
+        __m128i a1 = _mm_avg_epu8(_mm_loadu_si128((const __m128i *)(rgba0 + 4 * x + 16)), _mm_loadu_si128((const __m128i *)(rgba1 + 4 * x + 16)));
+        __m128i sums0 = gub_sum_pairs_sse2(a0);
+        __m128i sums1 = gub_sum_pairs_sse2(a1);
+        __m128i cb = gub_c4_sse2(sums0, sums1, cb_coeffs);
+        __m128i cr = gub_c4_sse2(sums0, sums1, cr_coeffs);
+        // Low 8 bytes: cb0 cb1 cb2 cb3 cr0 cr1 cr2 cr3
+        __m128i c = _mm_packus_epi16(_mm_packs_epi32(cb, cr), _mm_setzero_si128());
+
+        if (interleaved) {
+            _mm_storel_epi64((__m128i *)(u + x), _mm_unpacklo_epi8(c, _mm_srli_si128(c, 4)));
+        }
+        else {
+            gint32 cb4 = _mm_cvtsi128_si32(c);
+            gint32 cr4 = _mm_cvtsi128_si32(_mm_srli_si128(c, 4));
+            memcpy(u + x / 2, &cb4, 4);
+            memcpy(v + x / 2, &cr4, 4);
+        }
+    }
+    gub_convert_uv_row_c(rgba0 + 4 * x, rgba1 + 4 * x, interleaved ? u + x : u + x / 2, interleaved ? NULL : v + x / 2, width - x, interleaved);
+}
+
+static const GUBConvertKernels gub_convert_kernels_sse2 = {
+    "SSE2", gub_convert_y_row_sse2, gub_convert_uv_row_sse2
+};
+
+// --------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- AVX2 -------------------------------------------------------
+// --------------------------------------------------------------------------------------------------------------------
+// Same arithmetic as SSE2 on twice the pixels. Unpacking and packing work within 128 bit lanes, so results
+// are put back in order with cross-lane permutes.
+
+static GUB_TARGET_AVX2 __m256i gub_hadd_pairs_avx2(__m256i lo, __m256i hi)
+{
+    __m256i even = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(lo), _mm256_castsi256_ps(hi), _MM_SHUFFLE(2, 0, 2, 0)));
+    __m256i odd = _mm256_castps_si256(_mm256_shuffle_ps(_mm256_castsi256_ps(lo), _mm256_castsi256_ps(hi), _MM_SHUFFLE(3, 1, 3, 1)));
+    return _mm256_add_epi32(even, odd);
+}
+
+/* Pair sums of 8 RGBA pixels: [p01 p23 | p45 p67] */
+static GUB_TARGET_AVX2 __m256i gub_sum_pairs_avx2(__m256i p)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i lo = _mm256_unpacklo_epi8(p, zero);
+    __m256i hi = _mm256_unpackhi_epi8(p, zero);
+    lo = _mm256_add_epi16(lo, _mm256_srli_si256(lo, 8));
+    hi = _mm256_add_epi16(hi, _mm256_srli_si256(hi, 8));
+    return _mm256_unpacklo_epi64(lo, hi);
+}
+
+/* Luma of 8 RGBA pixels, as 32 bit, in order */
+static GUB_TARGET_AVX2 __m256i gub_y8_avx2(__m256i p)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i coeffs = _mm256_setr_epi16(66, 129, 25, 0, 66, 129, 25, 0, 66, 129, 25, 0, 66, 129, 25, 0);
+    __m256i lo = _mm256_madd_epi16(_mm256_unpacklo_epi8(p, zero), coeffs);
+    __m256i hi = _mm256_madd_epi16(_mm256_unpackhi_epi8(p, zero), coeffs);
+    return _mm256_srli_epi32(_mm256_add_epi32(gub_hadd_pairs_avx2(lo, hi), _mm256_set1_epi32(128)), 8);
+}
+
+/* Chroma of 16 RGBA pixel pairs sums, as 32 bit, in order */
+static GUB_TARGET_AVX2 __m256i gub_c8_avx2(__m256i sums0, __m256i sums1, __m256i coeffs)
+{
+    __m256i c = gub_hadd_pairs_avx2(_mm256_madd_epi16(sums0, coeffs), _mm256_madd_epi16(sums1, coeffs));
+    // [c0 c1 c4 c5 | c2 c3 c6 c7] -> [c0 ... c7]
+    c = _mm256_permutevar8x32_epi32(c, _mm256_setr_epi32(0, 1, 4, 5, 2, 3, 6, 7));
+    c = _mm256_srai_epi32(_mm256_add_epi32(c, _mm256_set1_epi32(256)), 9);
+    return _mm256_add_epi32(c, _mm256_set1_epi32(128));
+}
+
+static GUB_TARGET_AVX2 void gub_convert_y_row_avx2(const guint8 *rgba, guint8 *y, gint width)
+{
+    const __m256i offset = _mm256_set1_epi16(16);
+    gint x;
+
+    for (x = 0; x + 16 <= width; x += 16) {
+        __m256i y0 = gub_y8_avx2(_mm256_loadu_si256((const __m256i *)(rgba + 4 * x)));
+        __m256i y1 = gub_y8_avx2(_mm256_loadu_si256((const __m256i *)(rgba + 4 * x + 32)));
+        __m256i y16 = _mm256_permute4x64_epi64(_mm256_packs_epi32(y0, y1), _MM_SHUFFLE(3, 1, 2, 0));
+        y16 = _mm256_add_epi16(y16, offset);
+        _mm_storeu_si128((__m128i *)(y + x), _mm_packus_epi16(_mm256_castsi256_si128(y16), _mm256_extracti128_si256(y16, 1)));
+    }
+    gub_convert_y_row_sse2(rgba + 4 * x, y + x, width - x);
+}
+
+static GUB_TARGET_AVX2 void gub_convert_uv_row_avx2(const guint8 *rgba0, const guint8 *rgba1, guint8 *u, guint8 *v, gint width, gboolean interleaved)
+{
+    const __m256i cb_coeffs = _mm256_setr_epi16(-38, -74, 112, 0, -38, -74, 112, 0, -38, -74, 112, 0, -38, -74, 112, 0);
+    const __m256i cr_coeffs = _mm256_setr_epi16(112, -94, -18, 0, 112, -94, -18, 0, 112, -94, -18, 0, 112, -94, -18, 0);
+    gint x;
+
+    for (x = 0; x + 16 <= width; x += 16) {
+        __m256i a0 = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i *)(rgba0 + 4 * x)), _mm256_loadu_si256((const __m256i *)(rgba1 + 4 * x)));
+        __m256i a1 = _mm256_avg_epu8(_mm256_loadu_si256((const __m256i *)(rgba0 + 4 * x + 32)), _mm256_loadu_si256((const __m256i *)(rgba1 + 4 * x + 32)));
+        __m256i sums0 = gub_sum_pairs_avx2(a0);
+        __m256i sums1 = gub_sum_pairs_avx2(a1);
+        __m256i cb = gub_c8_avx2(sums0, sums1, cb_coeffs);
+        __m256i cr = gub_c8_avx2(sums0, sums1, cr_coeffs);
+        // cb0..cb7 cr0..cr7
+        __m128i c = _mm_packus_epi16(
+            _mm_packs_epi32(_mm256_castsi256_si128(cb), _mm256_extracti128_si256(cb, 1)),
+            _mm_packs_epi32(_mm256_castsi256_si128(cr), _mm256_extracti128_si256(cr, 1)));
+
+        if (interleaved) {
+            _mm_storeu_si128((__m128i *)(u + x), _mm_unpacklo_epi8(c, _mm_srli_si128(c, 8)));
+        }
+        else {
+            _mm_storel_epi64((__m128i *)(u + x / 2), c);
+            _mm_storel_epi64((__m128i *)(v + x / 2), _mm_srli_si128(c, 8));
+        }
+    }
+    gub_convert_uv_row_sse2(rgba0 + 4 * x, rgba1 + 4 * x, interleaved ? u + x : u + x / 2, interleaved ? NULL : v + x / 2, width - x, interleaved);
+}
+
+static const GUBConvertKernels gub_convert_kernels_avx2 = {
+    "AVX2", gub_convert_y_row_avx2, gub_convert_uv_row_avx2
+};
+
+static gboolean gub_convert_cpu_has_sse2()
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return TRUE;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+static gboolean gub_convert_cpu_has_avx2()
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return FALSE;
+    // AVX needs OS support for saving the YMM registers
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+        return FALSE;
+    if ((_xgetbv(0) & 6) != 6)
+        return FALSE;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif
+
+#if GUB_CONVERT_NEON
+// --------------------------------------------------------------------------------------------------------------------
+// ------------------------------------------------------- NEON -------------------------------------------------------
+// --------------------------------------------------------------------------------------------------------------------
+
+static void gub_convert_y_row_neon(const guint8 *rgba, guint8 *y, gint width)
+{
+    gint x;
+
+    for (x = 0; x + 16 <= width; x += 16) {
+        uint8x16x4_t p = vld4q_u8(rgba + 4 * x);
+        uint16x8_t lo = vmull_u8(vget_low_u8(p.val[0]), vdup_n_u8(66));
+        uint16x8_t hi = vmull_u8(vget_high_u8(p.val[0]), vdup_n_u8(66));
+        lo = vmlal_u8(lo, vget_low_u8(p.val[1]), vdup_n_u8(129));
+        hi = vmlal_u8(hi, vget_high_u8(p.val[1]), vdup_n_u8(129));
+        lo = vmlal_u8(lo, vget_low_u8(p.val[2]), vdup_n_u8(25));
+        hi = vmlal_u8(hi, vget_high_u8(p.val[2]), vdup_n_u8(25));
+        // Rounding narrowing shift adds the 128 of the scalar version
+        vst1q_u8(y + x, vaddq_u8(vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)), vdupq_n_u8(16)));
+    }
+    gub_convert_y_row_c(rgba + 4 * x, y + x, width - x);
+}
+
+static uint8x8_t gub_c8_neon(int16x8_t r, int16x8_t g, int16x8_t b, int16_t kr, int16_t kg, int16_t kb)
+{
+    int32x4_t lo = vmull_n_s16(vget_low_s16(r), kr);
+    int32x4_t hi = vmull_n_s16(vget_high_s16(r), kr);
+    int16x8_t c;
+    lo = vmlal_n_s16(lo, vget_low_s16(g), kg);
+    hi = vmlal_n_s16(hi, vget_high_s16(g), kg);
+    lo = vmlal_n_s16(lo, vget_low_s16(b), kb);
+    hi = vmlal_n_s16(hi, vget_high_s16(b), kb);
+    c = vcombine_s16(vmovn_s32(vrshrq_n_s32(lo, 9)), vmovn_s32(vrshrq_n_s32(hi, 9)));
+    return vqmovun_s16(vaddq_s16(c, vdupq_n_s16(128)));
+}
+
+static void gub_convert_uv_row_neon(const guint8 *rgba0, const guint8 *rgba1, guint8 *u, guint8 *v, gint width, gboolean interleaved)
+{
+    gint x;
+
+    for (x = 0; x + 16 <= width; x += 16) {
+        uint8x16x4_t p0 = vld4q_u8(rgba0 + 4 * x);
+        uint8x16x4_t p1 = vld4q_u8(rgba1 + 4 * x);
+        int16x8_t r = vreinterpretq_s16_u16(vpaddlq_u8(vrhaddq_u8(p0.val[0], p1.val[0])));
+        int16x8_t g = vreinterpretq_s16_u16(vpaddlq_u8(vrhaddq_u8(p0.val[1], p1.val[1])));
+        int16x8_t b = vreinterpretq_s16_u16(vpaddlq_u8(vrhaddq_u8(p0.val[2], p1.val[2])));
+        uint8x8_t cb = gub_c8_neon(r, g, b, -38, -74, 112);
+        uint8x8_t cr = gub_c8_neon(r, g, b, 112, -94, -18);
+
+        if (interleaved) {
+            uint8x8x2_t c;
+            c.val[0] = cb;
+            c.val[1] = cr;
+            vst2_u8(u + x, c);
+        }
+        else {
+            vst1_u8(u + x / 2, cb);
+            vst1_u8(v + x / 2, cr);
+        }
+    }
+    gub_convert_uv_row_c(rgba0 + 4 * x, rgba1 + 4 * x, interleaved ? u + x : u + x / 2, interleaved ? NULL : v + x / 2, width - x, interleaved);
+}
+
+static const GUBConvertKernels gub_convert_kernels_neon = {
+    "NEON", gub_convert_y_row_neon, gub_convert_uv_row_neon
+};
+
+#endif
+
+// --------------------------------------------------------------------------------------------------------------------
+// ---------------------------------------------------- Public API ----------------------------------------------------
+// --------------------------------------------------------------------------------------------------------------------
+
+static const GUBConvertKernels *gub_convert_get_kernels()
+{
+    static const GUBConvertKernels *kernels = NULL;
+    static gsize initialized = 0;
+
+    if (g_once_init_enter(&initialized)) {
+        kernels = &gub_convert_kernels_c;
+#if GUB_CONVERT_X86
+        if (gub_convert_cpu_has_avx2()) {
+            kernels = &gub_convert_kernels_avx2;
+        }
+        else if (gub_convert_cpu_has_sse2()) {
+            kernels = &gub_convert_kernels_sse2;
+        }
+#elif GUB_CONVERT_NEON
+        kernels = &gub_convert_kernels_neon;
+#endif
+        gub_log("Using %s image conversion kernels", kernels->name);
+        g_once_init_leave(&initialized, 1);
+    }
+    return kernels;
+}
+
+void gub_convert_rgba_flipped(const guint8 *rgba, gint width, gint height, GstVideoFrame *dst)
+{
+    const GUBConvertKernels *kernels = gub_convert_get_kernels();
+    gsize src_stride = (gsize)width * 4;
+    const guint8 *src = rgba + (height - 1) * src_stride;
+    gint line;
+
+    switch (GST_VIDEO_FRAME_FORMAT(dst)) {
+    case GST_VIDEO_FORMAT_I420:
+    case GST_VIDEO_FORMAT_NV12:
+    {
+        gboolean interleaved = GST_VIDEO_FRAME_FORMAT(dst) == GST_VIDEO_FORMAT_NV12;
+        for (line = 0; line < height; line++, src -= src_stride) {
+            kernels->y_row(src, (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(dst, 0) + line * GST_VIDEO_FRAME_PLANE_STRIDE(dst, 0), width);
+            if ((line & 1) == 0) {
+                // On odd heights the last chroma row only covers one line
+                const guint8 *next = line + 1 < height ? src - src_stride : src;
+                guint8 *u = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(dst, 1) + (line / 2) * GST_VIDEO_FRAME_PLANE_STRIDE(dst, 1);
+                guint8 *v = interleaved ? NULL : (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(dst, 2) + (line / 2) * GST_VIDEO_FRAME_PLANE_STRIDE(dst, 2);
+                kernels->uv_row(src, next, u, v, width, interleaved);
+            }
+        }
+        break;
+    }
+    default:
+        // A plain flip: memcpy is already vectorized by the C library
+        for (line = 0; line < height; line++, src -= src_stride) {
+            memcpy((guint8 *)GST_VIDEO_FRAME_PLANE_DATA(dst, 0) + line * GST_VIDEO_FRAME_PLANE_STRIDE(dst, 0), src, src_stride);
+        }
+        break;
+    }
+}
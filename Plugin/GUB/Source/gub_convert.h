@@ -0,0 +1,33 @@
+/*
+*  GStreamer - Unity3D bridge (GUB).
+*  Copyright (C) 2016  Fundacio i2CAT, Internet i Innovacio digital a Catalunya
+*
+*  This program is free software: you can redistribute it and/or modify
+*  it under the terms of the GNU Lesser General Public License as published by
+*  the Free Software Foundation, either version 3 of the License, or
+*  (at your option) any later version.
+*
+*  This program is distributed in the hope that it will be useful,
+*  but WITHOUT ANY WARRANTY; without even the implied warranty of
+*  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*  GNU Lesser General Public License for more details.
+*
+*  You should have received a copy of the GNU Lesser General Public License
+*  along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*  Authors:  Xavi Artigas <xavi.artigas@i2cat.net>
+*/
+
+
+#ifndef __GUB_CONVERT_H__
+#define __GUB_CONVERT_H__
+
+#include <gst/gst.h>
+#include <gst/video/video.h>
+
+/* Copies a bottom-up RGBA image (as read back from Unity) into a top-down video frame,
+ * converting it on the way when the frame is I420 or NV12 (BT.601, limited range).
+ * The fastest kernel supported by the running CPU (SSE2, AVX2 or NEON) is picked on first use. */
+void gub_convert_rgba_flipped(const guint8 *rgba, gint width, gint height, GstVideoFrame *dst);
+
+#endif
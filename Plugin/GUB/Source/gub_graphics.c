@@ -24,6 +24,7 @@
 #include <gst/video/video.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #if defined(_WIN32)
 #define SUPPORT_OPENGL 0
@@ -44,7 +45,8 @@ typedef GUBGraphicContext* (*GUBCreateGraphicContextPFN)(GstPipeline *pipeline,
 typedef GstContext* (*GUBProvideGraphicContextPFN)(GUBGraphicContext *gcontext, const gchar *type);
 typedef void(*GUBDestroyGraphicContextPFN)(GUBGraphicContext *gcontext);
 typedef void(*GUBCopyTexturePFN)(GUBGraphicContext *gcontext, GstVideoInfo *video_info, GstBuffer *buffer, void *native_texture_ptr);
-typedef const gchar* (*GUBGetVideoBranchDescriptionPFN)();
+typedef const gchar* (*GUBGetVideoBranchDescriptionPFN)(GUBVideoUploadMode mode);
+typedef void(*GUBStageFramePFN)(GUBGraphicContext *gcontext, GstBuffer *buffer, GstCaps *caps);
 
 typedef struct _GUBGraphicBackend {
     GUBCreateGraphicDevicePFN create_graphic_device;
@@ -54,6 +56,7 @@ typedef struct _GUBGraphicBackend {
     GUBDestroyGraphicContextPFN destroy_graphic_context;
     GUBCopyTexturePFN copy_texture;
     GUBGetVideoBranchDescriptionPFN get_video_branch_description;
+    GUBStageFramePFN stage_frame;
 } GUBGraphicBackend;
 
 GUBGraphicBackend *gub_graphic_backend = NULL;
@@ -131,9 +134,9 @@ static void gub_copy_texture_d3d9(GUBGraphicContextD3D9 *gcontext, GstVideoInfo
     }
 }
 
-static const gchar *gub_get_video_branch_description_d3d9()
+static const gchar *gub_get_video_branch_description_d3d9(GUBVideoUploadMode mode)
 {
-    return "videoconvert ! video/x-raw,format=BGRA ! fakesink sync=1 qos=1 name=sink";
+    return "videoconvert ! video/x-raw,format=BGRA ! appsink sync=1 qos=1 enable-last-sample=0 max-buffers=1 drop=1 name=sink";
 }
 
 GUBGraphicBackend gub_graphic_backend_d3d9 = {
@@ -143,7 +146,8 @@ GUBGraphicBackend gub_graphic_backend_d3d9 = {
     /* provide_graphic_context */      NULL,
     /* destroy_graphic_context */      (GUBDestroyGraphicContextPFN)gub_destroy_graphic_context_d3d9,
     /* copy_texture */                 (GUBCopyTexturePFN)gub_copy_texture_d3d9,
-    /* get_video_branch_description */ (GUBGetVideoBranchDescriptionPFN)gub_get_video_branch_description_d3d9
+    /* get_video_branch_description */ (GUBGetVideoBranchDescriptionPFN)gub_get_video_branch_description_d3d9,
+    /* stage_frame */                  NULL
 };
 
 #endif
@@ -225,9 +229,9 @@ static void gub_destroy_graphic_device_d3d11(GUBGraphicDeviceD3D11 *gdevice)
     free(gdevice);
 }
 
-static const gchar *gub_get_video_branch_description_d3d11()
+static const gchar *gub_get_video_branch_description_d3d11(GUBVideoUploadMode mode)
 {
-    return "videoconvert ! video/x-raw,format=RGBA ! videocrop name=crop ! fakesink sync=1 qos=1 name=sink";
+    return "videoconvert ! video/x-raw,format=RGBA ! videocrop name=crop ! appsink sync=1 qos=1 enable-last-sample=0 max-buffers=1 drop=1 name=sink";
 }
 
 GUBGraphicBackend gub_graphic_backend_d3d11 = {
@@ -237,113 +241,125 @@ GUBGraphicBackend gub_graphic_backend_d3d11 = {
     /* provide_graphic_context */      NULL,
     /* destroy_graphic_context */      (GUBDestroyGraphicContextPFN)gub_destroy_graphic_context_d3d11,
     /* copy_texture */                 (GUBCopyTexturePFN)gub_copy_texture_d3d11,
-    /* get_video_branch_description */ (GUBGetVideoBranchDescriptionPFN)gub_get_video_branch_description_d3d11
+    /* get_video_branch_description */ (GUBGetVideoBranchDescriptionPFN)gub_get_video_branch_description_d3d11,
+    /* stage_frame */                  NULL
 };
 
 #endif
 
-#if SUPPORT_OPENGL
+#if SUPPORT_OPENGL || SUPPORT_EGL
 // --------------------------------------------------------------------------------------------------------------------
-// -------------------------------------------------- OPENGL SUPPORT --------------------------------------------------
+// ------------------------------------------------ GL SHADER SUPPORT -------------------------------------------------
 // --------------------------------------------------------------------------------------------------------------------
 
 #define GST_USE_UNSTABLE_API
-#include <gst/gl/gstglcontext.h>
-
-#if GST_GL_HAVE_PLATFORM_WGL
-#define GUB_GL_PLATFORM GST_GL_PLATFORM_WGL
-#elif GST_GL_HAVE_PLATFORM_GLX
-#define GUB_GL_PLATFORM GST_GL_PLATFORM_GLX
-#else
-#error "Unsupport GST_GL_PLATFORM"
+#if SUPPORT_OPENGL
+// libGL exports the GL 2.0+ entry points, but the headers only declare them when asked to
+#define GL_GLEXT_PROTOTYPES 1
 #endif
+#include <gst/gl/gstglcontext.h>
+#include <gst/gl/gstglfuncs.h>
+#include <gst/gl/gstglmemory.h>
+#include <gst/gl/gstglsyncmeta.h>
 
-typedef struct _GUBGraphicContextOpenGL {
-    GstGLDisplay *display;
-} GUBGraphicContextOpenGL;
-
-static void gub_copy_texture_opengl(GUBGraphicContext *gcontext, GstVideoInfo *video_info, GstBuffer *buffer, void *native_texture_ptr)
-{
-    if (native_texture_ptr)
-    {
-        GLuint gltex = (GLuint)(size_t)(native_texture_ptr);
-        GstVideoFrame video_frame;
-        glBindTexture(GL_TEXTURE_2D, gltex);
-        gst_video_frame_map(&video_frame, video_info, buffer, GST_MAP_READ);
-        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, video_info->width, video_info->height, GL_RGB, GL_UNSIGNED_BYTE, GST_VIDEO_FRAME_PLANE_DATA(&video_frame, 0));
-        gst_video_frame_unmap(&video_frame);
-    }
-}
-
-static GUBGraphicContext *gub_create_graphic_context_opengl(GstPipeline *pipeline, float crop_left, float crop_top, float crop_right, float crop_bottom)
-{
-    GUBGraphicContextOpenGL *gcontext = NULL;
-    guintptr raw_context = gst_gl_context_get_current_gl_context(GUB_GL_PLATFORM);
-    if (raw_context) {
-        GstGLDisplay *display = gst_gl_display_new();
-        GstGLContext *gl_context = gst_gl_context_new_wrapped(display, raw_context, GUB_GL_PLATFORM, GST_GL_API_OPENGL);
-
-        gcontext = (GUBGraphicContextOpenGL *)malloc(sizeof(GUBGraphicContextOpenGL));
-        gcontext->display = display;
-    }
-    else {
-        gub_log("Could not retrieve current GL context");
-    }
-
-    return gcontext;
-}
-
-static void gub_destroy_graphic_context_opengl(GUBGraphicContextOpenGL *gcontext)
-{
-    if (gcontext) {
-        if (gcontext->display) {
-            gst_object_unref(gcontext->display);
-        }
-        free(gcontext);
-    }
-}
+/* Prepended to every shader so the same sources build for GLSL ES 1.00, GLSL 1.20 and GLSL 1.50 core */
+typedef struct _GUBShaderHeaders {
+    const char *vertex;
+    const char *fragment;
+} GUBShaderHeaders;
 
-static const gchar *gub_get_video_branch_description_opengl()
-{
-    return "videoconvert ! video/x-raw,format=RGB ! fakesink sync=1 qos=1 name=sink";
-}
+#if SUPPORT_EGL
+static const GUBShaderHeaders gub_shader_headers_gles2 = {
+    "#define GUB_ATTRIBUTE attribute\n"
+    "#define GUB_VARYING_OUT varying\n",
+    "precision mediump float;\n"
+    "#define GUB_VARYING_IN varying\n"
+    "#define GUB_TEXTURE texture2D\n"
+    "#define GUB_FRAG_COLOR gl_FragColor\n"
+    "#define GUB_UV_SWIZZLE ra\n"
+};
+#endif
 
-GUBGraphicBackend gub_graphic_backend_opengl = {
-    /* create_graphic_device   */      NULL,
-    /* destroy_graphic_device  */      NULL,
-    /* create_graphic_context  */      (GUBCreateGraphicContextPFN)gub_create_graphic_context_opengl,
-    /* provide_graphic_context */      NULL,
-    /* destroy_graphic_context */      (GUBDestroyGraphicContextPFN)gub_destroy_graphic_context_opengl,
-    /* copy_texture */                 (GUBCopyTexturePFN)gub_copy_texture_opengl,
-    /* get_video_branch_description */ (GUBGetVideoBranchDescriptionPFN)gub_get_video_branch_description_opengl
+#if SUPPORT_OPENGL
+/* Legacy contexts get chroma planes as GL_LUMINANCE_ALPHA textures */
+static const GUBShaderHeaders gub_shader_headers_glsl120 = {
+    "#version 120\n"
+    "#define GUB_ATTRIBUTE attribute\n"
+    "#define GUB_VARYING_OUT varying\n",
+    "#version 120\n"
+    "#define GUB_VARYING_IN varying\n"
+    "#define GUB_TEXTURE texture2D\n"
+    "#define GUB_FRAG_COLOR gl_FragColor\n"
+    "#define GUB_UV_SWIZZLE ra\n"
 };
 
+/* Core contexts get chroma planes as GL_RG textures */
+static const GUBShaderHeaders gub_shader_headers_glsl150 = {
+    "#version 150\n"
+    "#define GUB_ATTRIBUTE in\n"
+    "#define GUB_VARYING_OUT out\n",
+    "#version 150\n"
+    "#define GUB_VARYING_IN in\n"
+    "#define GUB_TEXTURE texture\n"
+    "out vec4 gub_frag_color;\n"
+    "#define GUB_FRAG_COLOR gub_frag_color\n"
+    "#define GUB_UV_SWIZZLE rg\n"
+};
 #endif
 
-#if SUPPORT_EGL
-// --------------------------------------------------------------------------------------------------------------------
-// --------------------------------------------------- EGL SUPPORT ----------------------------------------------------
-// --------------------------------------------------------------------------------------------------------------------
-
-#define GST_USE_UNSTABLE_API
-#include <gst/gl/gstglcontext.h>
+static const char gub_vertex_shader_str[] =
+    "GUB_ATTRIBUTE vec4 aPosition;    \n"
+    "GUB_ATTRIBUTE vec2 aTexCoord;    \n"
+    "GUB_VARYING_OUT vec2 vTexCoord;  \n"
+    "void main()                      \n"
+    "{                                \n"
+    "   gl_Position = aPosition;      \n"
+    "   vTexCoord = aTexCoord;        \n"
+    "}                                \n";
+
+static const char gub_fragment_shader_rgb_str[] =
+    "GUB_VARYING_IN vec2 vTexCoord;                         \n"
+    "uniform sampler2D sTexture;                            \n"
+    "void main()                                            \n"
+    "{                                                      \n"
+    "  GUB_FRAG_COLOR = GUB_TEXTURE(sTexture, vTexCoord);   \n"
+    "}                                                      \n";
 
-typedef struct _GUBGraphicContextEGL {
-    GstGLContext *gl;
-    GstGLDisplay *display;
-    GLuint fbo;
-    GLuint po;
-    GLuint vao;
-    GLuint vbo;
-    GLint samplerLoc;
-    float crop_left;
-    float crop_top;
-    float crop_right;
-    float crop_bottom;
-} GUBGraphicContextEGL;
+#if SUPPORT_OPENGL
+/* Y, U and V in three single-channel textures */
+static const char gub_fragment_shader_i420_str[] =
+    "GUB_VARYING_IN vec2 vTexCoord;                         \n"
+    "uniform sampler2D sTexture;                            \n"
+    "uniform sampler2D sTextureU;                           \n"
+    "uniform sampler2D sTextureV;                           \n"
+    "uniform mat3 uYUVMatrix;                               \n"
+    "uniform vec3 uYUVOffset;                               \n"
+    "void main()                                            \n"
+    "{                                                      \n"
+    "  vec3 yuv = vec3(GUB_TEXTURE(sTexture, vTexCoord).r,  \n"
+    "                  GUB_TEXTURE(sTextureU, vTexCoord).r, \n"
+    "                  GUB_TEXTURE(sTextureV, vTexCoord).r);\n"
+    "  GUB_FRAG_COLOR = vec4(uYUVMatrix * (yuv - uYUVOffset), 1.0);\n"
+    "}                                                      \n";
+
+/* Y in a single-channel texture, interleaved UV in a two-channel texture */
+static const char gub_fragment_shader_nv12_str[] =
+    "GUB_VARYING_IN vec2 vTexCoord;                         \n"
+    "uniform sampler2D sTexture;                            \n"
+    "uniform sampler2D sTextureU;                           \n"
+    "uniform mat3 uYUVMatrix;                               \n"
+    "uniform vec3 uYUVOffset;                               \n"
+    "void main()                                            \n"
+    "{                                                      \n"
+    "  vec3 yuv = vec3(GUB_TEXTURE(sTexture, vTexCoord).r,  \n"
+    "                  GUB_TEXTURE(sTextureU, vTexCoord).GUB_UV_SWIZZLE);\n"
+    "  GUB_FRAG_COLOR = vec4(uYUVMatrix * (yuv - uYUVOffset), 1.0);\n"
+    "}                                                      \n";
+#endif
 
-static GLuint gub_load_shader(GLenum type, const char *shaderSrc)
+static GLuint gub_load_shader(GLenum type, const char *header, const char *shaderSrc)
 {
+    const char *sources[2] = { header, shaderSrc };
     GLuint shader;
     GLint compiled;
 
@@ -354,7 +370,7 @@ static GLuint gub_load_shader(GLenum type, const char *shaderSrc)
         return 0;
 
     // Load the shader source
-    glShaderSource(shader, 1, &shaderSrc, NULL);
+    glShaderSource(shader, 2, sources, NULL);
 
     // Compile the shader
     glCompileShader(shader);
@@ -378,35 +394,16 @@ static GLuint gub_load_shader(GLenum type, const char *shaderSrc)
     return shader;
 }
 
-static int gub_create_program()
+static GLuint gub_create_program(const GUBShaderHeaders *headers, const char *fShaderStr)
 {
-    GLbyte vShaderStr[] =
-        "attribute vec4 aPosition;    \n"
-        "attribute vec2 aTexCoord;    \n"
-        "varying vec2 vTexCoord;      \n"
-        "void main()                  \n"
-        "{                            \n"
-        "   gl_Position = aPosition;  \n"
-        "   vTexCoord = aTexCoord;    \n"
-        "}                            \n";
-
-    GLbyte fShaderStr[] =
-        "precision mediump float;                          \n"
-        "varying vec2 vTexCoord;                           \n"
-        "uniform sampler2D sTexture;                       \n"
-        "void main()                                       \n"
-        "{                                                 \n"
-        "  gl_FragColor = texture2D(sTexture, vTexCoord);  \n"
-        "}                                                 \n";
-
     GLuint vertexShader;
     GLuint fragmentShader;
     GLuint programObject;
     GLint linked;
 
     // Load the vertex/fragment shaders
-    vertexShader = gub_load_shader(GL_VERTEX_SHADER, vShaderStr);
-    fragmentShader = gub_load_shader(GL_FRAGMENT_SHADER, fShaderStr);
+    vertexShader = gub_load_shader(GL_VERTEX_SHADER, headers->vertex, gub_vertex_shader_str);
+    fragmentShader = gub_load_shader(GL_FRAGMENT_SHADER, headers->fragment, fShaderStr);
 
     // Create the program object
     programObject = glCreateProgram();
@@ -424,6 +421,10 @@ static int gub_create_program()
     // Link the program
     glLinkProgram(programObject);
 
+    // The program keeps the shaders alive for as long as it needs them
+    glDeleteShader(vertexShader);
+    glDeleteShader(fragmentShader);
+
     // Check the link status
     glGetProgramiv(programObject, GL_LINK_STATUS, &linked);
 
@@ -444,6 +445,856 @@ static int gub_create_program()
     return programObject;
 }
 
+/* Answers GStreamer's GL context queries with Unity's context, so GL elements share textures with it */
+static GstContext *gub_provide_gl_context(GstGLDisplay *display, GstGLContext *gl, const gchar *type)
+{
+    GstContext *context = NULL;
+
+    if (type != NULL) {
+        if (g_strcmp0(type, GST_GL_DISPLAY_CONTEXT_TYPE) == 0) {
+            context = gst_context_new(GST_GL_DISPLAY_CONTEXT_TYPE, TRUE);
+            gst_context_set_gl_display(context, display);
+        }
+        else if (g_strcmp0(type, "gst.gl.app_context") == 0) {
+            GstStructure *s;
+            context = gst_context_new("gst.gl.app_context", TRUE);
+            s = gst_context_writable_structure(context);
+            gst_structure_set(s, "context", GST_GL_TYPE_CONTEXT, gl, NULL);
+        }
+        else if (g_strcmp0(type, "gst.gl.local_context") == 0) {
+            GstGLContext *local_context = gst_gl_context_new(display);
+            GError *error = NULL;
+            gst_gl_context_create(local_context, gl, &error);
+            if (error) {
+                gub_log("Cannot create local context: %s", error->message);
+                g_error_free(error);
+            }
+            else {
+                GstStructure *s;
+                context = gst_context_new("gst.gl.local_context", TRUE);
+                s = gst_context_writable_structure(context);
+                gst_structure_set(s, "context", GST_GL_TYPE_CONTEXT, local_context, NULL);
+            }
+            gst_object_unref(local_context);
+        }
+    }
+    return context;
+}
+
+/* Full-screen quad: position (x, y) followed by texture coordinates (s, t) */
+static const GLfloat gub_quad_vertices[] = {
+    -1.f, -1.f,   0.f, 0.f,
+    -1.f,  1.f,   0.f, 1.f,
+     1.f, -1.f,   1.f, 0.f,
+     1.f,  1.f,   1.f, 1.f
+};
+
+#endif
+
+#if SUPPORT_OPENGL
+// --------------------------------------------------------------------------------------------------------------------
+// -------------------------------------------------- OPENGL SUPPORT --------------------------------------------------
+// --------------------------------------------------------------------------------------------------------------------
+
+#if GST_GL_HAVE_PLATFORM_WGL
+#define GUB_GL_PLATFORM GST_GL_PLATFORM_WGL
+#elif GST_GL_HAVE_PLATFORM_GLX
+#define GUB_GL_PLATFORM GST_GL_PLATFORM_GLX
+#include <GL/glx.h>
+#include <gst/gl/x11/gstgldisplay_x11.h>
+#else
+#error "Unsupport GST_GL_PLATFORM"
+#endif
+
+#ifndef GL_PIXEL_UNPACK_BUFFER
+#define GL_PIXEL_UNPACK_BUFFER 0x88EC
+#endif
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+/* glBufferStorage is only exposed through GstGLFuncs in recent GStreamer versions */
+#define GUB_GL_HAVE_BUFFER_STORAGE GST_CHECK_VERSION(1, 14, 0)
+
+/* Number of pixel buffer objects frames are streamed through. While the GPU is still
+ * reading from one of them, the next frames are written into the others. */
+#define GUB_GL_PBO_COUNT 3
+
+/* Planar formats handled by the shader path (I420 and NV12) have at most 3 planes */
+#define GUB_GL_MAX_PLANES 3
+
+/* State of a persistently-mapped PBO. Frames are copied into free ones on the streaming thread
+ * (gub_stage_frame_opengl), so the render thread only has to start the upload from them. */
+typedef enum {
+    GUB_GL_PBO_FREE,      /* Neither the CPU nor the GPU uses it */
+    GUB_GL_PBO_WRITING,   /* A frame is being copied in, without pbo_lock */
+    GUB_GL_PBO_STAGED,    /* Holds pbo_frame, waiting for the render thread */
+    GUB_GL_PBO_IN_FLIGHT  /* The GPU reads from it until pbo_fence is signalled */
+} GUBGLPboState;
+
+typedef struct _GUBGraphicContextOpenGL {
+    GstGLContext *gl;
+    GstGLDisplay *display;
+    float crop_left;
+    float crop_top;
+    float crop_right;
+    float crop_bottom;
+    /* Pixel buffer objects used as staging area for texture uploads */
+    GLuint pbo[GUB_GL_PBO_COUNT];
+    /* Persistent mapping of each PBO, or NULL when buffer storage is not available */
+    void *pbo_ptr[GUB_GL_PBO_COUNT];
+    /* Signalled when the GPU is done reading the corresponding PBO, only used by the render thread */
+    GLsync pbo_fence[GUB_GL_PBO_COUNT];
+    /* Protects pbo_state, pbo_frame, pbo_offsets, and pbo_size and pbo_persistent against the streaming thread */
+    GMutex pbo_lock;
+    GUBGLPboState pbo_state[GUB_GL_PBO_COUNT];
+    /* The frame copied into each STAGED PBO, reffed, and where its planes start */
+    GstBuffer *pbo_frame[GUB_GL_PBO_COUNT];
+    gsize pbo_offsets[GUB_GL_PBO_COUNT][GST_VIDEO_MAX_PLANES];
+    gsize pbo_size;
+    /* Next PBO of the ring when they are not persistent */
+    guint pbo_index;
+    gboolean pbo_supported;
+    gboolean pbo_persistent;
+    /* Caps of the last staged frame and their video info, only used by the streaming thread */
+    GstCaps *stage_caps;
+    GstVideoInfo stage_info;
+    /* Planar YUV frames are uploaded plane by plane and converted to RGB by these programs */
+    /* Planar YUV frames are uploaded plane by plane and converted to RGB by these programs */
+    const GUBShaderHeaders *shader_headers;
+    gboolean legacy_textures;
+    GLuint fbo;
+    GLuint vao;
+    GLuint vbo;
+    GLuint po_i420;
+    GLuint po_nv12;
+    /* Copies GL memory frames, which already are RGBA textures */
+    GLuint po_rgb;
+    GLuint plane_tex[GUB_GL_MAX_PLANES];
+    gint plane_tex_width[GUB_GL_MAX_PLANES];
+    gint plane_tex_height[GUB_GL_MAX_PLANES];
+} GUBGraphicContextOpenGL;
+
+/* Must be called with pbo_lock held, and no PBO being written to */
+static void gub_release_pbos_opengl(GUBGraphicContextOpenGL *gcontext)
+{
+    const GstGLFuncs *gl = gcontext->gl->gl_vtable;
+    int i;
+
+    for (i = 0; i < GUB_GL_PBO_COUNT; i++) {
+        if (gcontext->pbo_fence[i]) {
+            gl->DeleteSync(gcontext->pbo_fence[i]);
+            gcontext->pbo_fence[i] = NULL;
+        }
+        if (gcontext->pbo_ptr[i]) {
+            gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, gcontext->pbo[i]);
+            gl->UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            gcontext->pbo_ptr[i] = NULL;
+        }
+        gst_buffer_replace(&gcontext->pbo_frame[i], NULL);
+        gcontext->pbo_state[i] = GUB_GL_PBO_FREE;
+    }
+    gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (gcontext->pbo[0]) {
+        gl->DeleteBuffers(GUB_GL_PBO_COUNT, gcontext->pbo);
+        memset(gcontext->pbo, 0, sizeof(gcontext->pbo));
+    }
+    gcontext->pbo_size = 0;
+    gcontext->pbo_index = 0;
+}
+
+/* (Re)creates the PBO ring so each buffer can hold at least size bytes. Must be called with pbo_lock held. */
+static gboolean gub_allocate_pbos_opengl(GUBGraphicContextOpenGL *gcontext, gsize size)
+{
+    const GstGLFuncs *gl = gcontext->gl->gl_vtable;
+    int i;
+
+    // The streaming thread is still copying a frame into one of them, try again with the next frame
+    for (i = 0; i < GUB_GL_PBO_COUNT; i++) {
+        if (gcontext->pbo_state[i] == GUB_GL_PBO_WRITING)
+            return FALSE;
+    }
+
+    gub_release_pbos_opengl(gcontext);
+
+    gl->GenBuffers(GUB_GL_PBO_COUNT, gcontext->pbo);
+    for (i = 0; i < GUB_GL_PBO_COUNT; i++) {
+        gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, gcontext->pbo[i]);
+        if (gcontext->pbo_persistent) {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+#if GUB_GL_HAVE_BUFFER_STORAGE
+            gl->BufferStorage(GL_PIXEL_UNPACK_BUFFER, size, NULL, flags);
+#endif
+            gcontext->pbo_ptr[i] = gl->MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, flags);
+            if (!gcontext->pbo_ptr[i]) {
+                gub_log("Could not map PBO persistently, falling back to per-frame mapping");
+                gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+                gcontext->pbo_persistent = FALSE;
+                return gub_allocate_pbos_opengl(gcontext, size);
+            }
+        }
+        else {
+            gl->BufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        }
+    }
+    gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    gcontext->pbo_size = size;
+    gub_log("Allocated %d %s PBOs of %" G_GSIZE_FORMAT " bytes", GUB_GL_PBO_COUNT,
+        gcontext->pbo_persistent ? "persistent" : "streaming", size);
+    return TRUE;
+}
+
+/* Computes where each plane of the frame starts inside a PBO and returns the size it needs */
+static gsize gub_get_pbo_layout(GstVideoFrame *frame, gsize offsets[GST_VIDEO_MAX_PLANES])
+{
+    guint plane;
+    gsize size = 0;
+
+    for (plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(frame); plane++) {
+        offsets[plane] = size;
+        size += (gsize)GST_VIDEO_FRAME_PLANE_STRIDE(frame, plane) * GST_VIDEO_FRAME_COMP_HEIGHT(frame, plane);
+    }
+    return size;
+}
+
+static void gub_write_pbo(GstVideoFrame *frame, guint8 *ptr, const gsize offsets[GST_VIDEO_MAX_PLANES])
+{
+    guint plane;
+
+    for (plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(frame); plane++) {
+        memcpy(ptr + offsets[plane], GST_VIDEO_FRAME_PLANE_DATA(frame, plane),
+            (gsize)GST_VIDEO_FRAME_PLANE_STRIDE(frame, plane) * GST_VIDEO_FRAME_COMP_HEIGHT(frame, plane));
+    }
+}
+
+/* Picks a persistent PBO to copy a frame into and marks it WRITING, giving up a frame staged in it earlier
+ * if none is free. Returns -1 when all of them are in use. Must be called with pbo_lock held. */
+static gint gub_claim_pbo_opengl(GUBGraphicContextOpenGL *gcontext)
+{
+    gint i;
+
+    for (i = 0; i < GUB_GL_PBO_COUNT; i++) {
+        if (gcontext->pbo_state[i] == GUB_GL_PBO_FREE) {
+            gcontext->pbo_state[i] = GUB_GL_PBO_WRITING;
+            return i;
+        }
+    }
+    for (i = 0; i < GUB_GL_PBO_COUNT; i++) {
+        if (gcontext->pbo_state[i] == GUB_GL_PBO_STAGED) {
+            gst_buffer_replace(&gcontext->pbo_frame[i], NULL);
+            gcontext->pbo_state[i] = GUB_GL_PBO_WRITING;
+            return i;
+        }
+    }
+    return -1;
+}
+
+/* Frees the persistent PBOs the GPU is done reading from, without waiting for the others */
+static void gub_reclaim_pbos_opengl(GUBGraphicContextOpenGL *gcontext)
+{
+    const GstGLFuncs *gl = gcontext->gl->gl_vtable;
+    int i;
+
+    g_mutex_lock(&gcontext->pbo_lock);
+    for (i = 0; i < GUB_GL_PBO_COUNT; i++) {
+        if (gcontext->pbo_state[i] != GUB_GL_PBO_IN_FLIGHT)
+            continue;
+        if (gcontext->pbo_fence[i]) {
+            if (gl->ClientWaitSync(gcontext->pbo_fence[i], GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED)
+                continue;
+            gl->DeleteSync(gcontext->pbo_fence[i]);
+            gcontext->pbo_fence[i] = NULL;
+        }
+        gcontext->pbo_state[i] = GUB_GL_PBO_FREE;
+    }
+    g_mutex_unlock(&gcontext->pbo_lock);
+}
+
+/* Returns the persistent PBO the streaming thread already copied buffer into, marked IN_FLIGHT, or -1 */
+static gint gub_take_staged_pbo_opengl(GUBGraphicContextOpenGL *gcontext, GstBuffer *buffer, gsize offsets[GST_VIDEO_MAX_PLANES])
+{
+    gint i, slot = -1;
+
+    g_mutex_lock(&gcontext->pbo_lock);
+    for (i = 0; i < GUB_GL_PBO_COUNT; i++) {
+        if (gcontext->pbo_state[i] == GUB_GL_PBO_STAGED && gcontext->pbo_frame[i] == buffer) {
+            memcpy(offsets, gcontext->pbo_offsets[i], sizeof(gcontext->pbo_offsets[i]));
+            gst_buffer_replace(&gcontext->pbo_frame[i], NULL);
+            gcontext->pbo_state[i] = GUB_GL_PBO_IN_FLIGHT;
+            slot = i;
+            break;
+        }
+    }
+    g_mutex_unlock(&gcontext->pbo_lock);
+    return slot;
+}
+
+/* Copies every plane of a frame the streaming thread did not stage into a PBO, on the render thread.
+ * offsets receives where each plane starts inside it. Returns the PBO, marked IN_FLIGHT when persistent,
+ * or -1 if the caller has to upload straight from system memory instead. */
+static gint gub_fill_pbo_opengl(GUBGraphicContextOpenGL *gcontext, GstVideoFrame *frame, gsize offsets[GST_VIDEO_MAX_PLANES])
+{
+    const GstGLFuncs *gl = gcontext->gl->gl_vtable;
+    gsize size = gub_get_pbo_layout(frame, offsets);
+    gboolean persistent = FALSE;
+    gint slot = -1;
+    guint8 *ptr = NULL;
+
+    g_mutex_lock(&gcontext->pbo_lock);
+    if (size <= gcontext->pbo_size || gub_allocate_pbos_opengl(gcontext, size)) {
+        persistent = gcontext->pbo_persistent;
+        if (persistent) {
+            // All of them can be on their way to the GPU already
+            slot = gub_claim_pbo_opengl(gcontext);
+            if (slot >= 0)
+                ptr = gcontext->pbo_ptr[slot];
+        }
+        else {
+            slot = gcontext->pbo_index;
+            gcontext->pbo_index = (gcontext->pbo_index + 1) % GUB_GL_PBO_COUNT;
+        }
+    }
+    g_mutex_unlock(&gcontext->pbo_lock);
+    if (slot < 0)
+        return -1;
+
+    if (!persistent) {
+        // Orphan the previous storage so the driver does not have to wait for the GPU
+        gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, gcontext->pbo[slot]);
+        gl->BufferData(GL_PIXEL_UNPACK_BUFFER, gcontext->pbo_size, NULL, GL_STREAM_DRAW);
+        ptr = gl->MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (!ptr) {
+            gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return -1;
+        }
+    }
+
+    gub_write_pbo(frame, ptr, offsets);
+
+    if (persistent) {
+        g_mutex_lock(&gcontext->pbo_lock);
+        gcontext->pbo_state[slot] = GUB_GL_PBO_IN_FLIGHT;
+        g_mutex_unlock(&gcontext->pbo_lock);
+    }
+    else {
+        gl->UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    return slot;
+}
+
+/* Copies a system memory frame into a free persistent PBO as soon as it is decoded, on the streaming thread,
+ * so copy_texture only has to start the upload from it. Frames that cannot be staged are copied by
+ * copy_texture itself, which is also what allocates the PBOs. Makes no GL calls. */
+static void gub_stage_frame_opengl(GUBGraphicContextOpenGL *gcontext, GstBuffer *buffer, GstCaps *caps)
+{
+    GstVideoFrame frame;
+    gsize offsets[GST_VIDEO_MAX_PLANES];
+    gsize size;
+    gint i, slot = -1;
+    guint8 *ptr = NULL;
+
+    if (!gcontext || gst_is_gl_memory(gst_buffer_peek_memory(buffer, 0)))
+        return;
+
+    if (caps != gcontext->stage_caps) {
+        if (!gst_video_info_from_caps(&gcontext->stage_info, caps))
+            return;
+        gst_caps_replace(&gcontext->stage_caps, caps);
+    }
+    if (!gst_video_frame_map(&frame, &gcontext->stage_info, buffer, GST_MAP_READ))
+        return;
+    size = gub_get_pbo_layout(&frame, offsets);
+
+    g_mutex_lock(&gcontext->pbo_lock);
+    if (gcontext->pbo_persistent && size <= gcontext->pbo_size) {
+        for (i = 0; i < GUB_GL_PBO_COUNT; i++) {
+            if (gcontext->pbo_state[i] == GUB_GL_PBO_STAGED && gcontext->pbo_frame[i] == buffer)
+                break;
+        }
+        if (i == GUB_GL_PBO_COUNT) {
+            slot = gub_claim_pbo_opengl(gcontext);
+            if (slot >= 0)
+                ptr = gcontext->pbo_ptr[slot];
+        }
+    }
+    g_mutex_unlock(&gcontext->pbo_lock);
+
+    if (slot >= 0) {
+        gub_write_pbo(&frame, ptr, offsets);
+
+        g_mutex_lock(&gcontext->pbo_lock);
+        memcpy(gcontext->pbo_offsets[slot], offsets, sizeof(offsets));
+        gcontext->pbo_frame[slot] = gst_buffer_ref(buffer);
+        gcontext->pbo_state[slot] = GUB_GL_PBO_STAGED;
+        g_mutex_unlock(&gcontext->pbo_lock);
+    }
+    gst_video_frame_unmap(&frame);
+}
+
+/* Builds the matrix and offset that turn normalized (Y, Cb, Cr) samples into RGB for the frame colorimetry */
+static void gub_get_yuv_conversion(GstVideoInfo *video_info, GLfloat matrix[9], GLfloat offset[3])
+{
+    GstVideoColorimetry *colorimetry = &GST_VIDEO_INFO_COLORIMETRY(video_info);
+    gdouble Kr, Kb, Kg, y_scale, c_scale;
+
+    if (!gst_video_color_matrix_get_Kr_Kb(colorimetry->matrix, &Kr, &Kb)) {
+        // BT.601
+        Kr = 0.299;
+        Kb = 0.114;
+    }
+    Kg = 1.0 - Kr - Kb;
+
+    if (colorimetry->range == GST_VIDEO_COLOR_RANGE_0_255) {
+        y_scale = c_scale = 1.0;
+        offset[0] = 0.f;
+    }
+    else {
+        y_scale = 255.0 / 219.0;
+        c_scale = 255.0 / 224.0;
+        offset[0] = 16.f / 255.f;
+    }
+    offset[1] = offset[2] = 128.f / 255.f;
+
+    // Column-major, one column per input component
+    matrix[0] = (GLfloat)y_scale;
+    matrix[1] = (GLfloat)y_scale;
+    matrix[2] = (GLfloat)y_scale;
+    matrix[3] = 0.f;
+    matrix[4] = (GLfloat)(-c_scale * 2.0 * Kb * (1.0 - Kb) / Kg);
+    matrix[5] = (GLfloat)(c_scale * 2.0 * (1.0 - Kb));
+    matrix[6] = (GLfloat)(c_scale * 2.0 * (1.0 - Kr));
+    matrix[7] = (GLfloat)(-c_scale * 2.0 * Kr * (1.0 - Kr) / Kg);
+    matrix[8] = 0.f;
+}
+
+/* Lazily creates the objects needed to draw frames into Unity's texture, so RGB mode never pays for them */
+static gboolean gub_setup_programs_opengl(GUBGraphicContextOpenGL *gcontext)
+{
+    const GstGLFuncs *gl = gcontext->gl->gl_vtable;
+
+    if (gcontext->fbo)
+        return gcontext->po_i420 && gcontext->po_nv12 && gcontext->po_rgb;
+
+    gl->GenFramebuffers(1, &gcontext->fbo);
+
+    if (gl->GenVertexArrays)
+        gl->GenVertexArrays(1, &gcontext->vao);
+
+    gl->GenBuffers(1, &gcontext->vbo);
+    gl->BindBuffer(GL_ARRAY_BUFFER, gcontext->vbo);
+    gl->BufferData(GL_ARRAY_BUFFER, sizeof(gub_quad_vertices), gub_quad_vertices, GL_STATIC_DRAW);
+    gl->BindBuffer(GL_ARRAY_BUFFER, 0);
+
+    gl->GenTextures(GUB_GL_MAX_PLANES, gcontext->plane_tex);
+
+    gcontext->po_i420 = gub_create_program(gcontext->shader_headers, gub_fragment_shader_i420_str);
+    gcontext->po_nv12 = gub_create_program(gcontext->shader_headers, gub_fragment_shader_nv12_str);
+    gcontext->po_rgb = gub_create_program(gcontext->shader_headers, gub_fragment_shader_rgb_str);
+    if (!gcontext->po_i420 || !gcontext->po_nv12 || !gcontext->po_rgb) {
+        gub_log("Could not create blit programs");
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/* Uploads one plane of the frame into the currently bound texture, from the bound PBO when pixels is an offset */
+static void gub_upload_plane_opengl(GUBGraphicContextOpenGL *gcontext, GstVideoFrame *frame, guint plane, const void *pixels)
+{
+    const GstGLFuncs *gl = gcontext->gl->gl_vtable;
+    gint width = GST_VIDEO_FRAME_COMP_WIDTH(frame, plane);
+    gint height = GST_VIDEO_FRAME_COMP_HEIGHT(frame, plane);
+    gint pstride = GST_VIDEO_FRAME_COMP_PSTRIDE(frame, plane);
+    GLenum format;
+    GLint internal_format;
+
+    if (gcontext->legacy_textures) {
+        format = pstride == 2 ? GL_LUMINANCE_ALPHA : GL_LUMINANCE;
+        internal_format = format;
+    }
+    else {
+        format = pstride == 2 ? GL_RG : GL_RED;
+        internal_format = pstride == 2 ? GL_RG8 : GL_R8;
+    }
+
+    gl->PixelStorei(GL_UNPACK_ROW_LENGTH, GST_VIDEO_FRAME_PLANE_STRIDE(frame, plane) / pstride);
+    if (gcontext->plane_tex_width[plane] != width || gcontext->plane_tex_height[plane] != height) {
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        gl->TexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        gl->TexImage2D(GL_TEXTURE_2D, 0, internal_format, width, height, 0, format, GL_UNSIGNED_BYTE, pixels);
+        gcontext->plane_tex_width[plane] = width;
+        gcontext->plane_tex_height[plane] = height;
+    }
+    else {
+        gl->TexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, format, GL_UNSIGNED_BYTE, pixels);
+    }
+}
+
+/* Draws the given textures into Unity's texture with a full-screen quad, leaving Unity's GL state untouched.
+ * yuv_matrix and yuv_offset are only used by the YUV conversion programs. */
+static void gub_draw_textures_opengl(GUBGraphicContextOpenGL *gcontext, GstVideoInfo *video_info, GLuint po,
+    const GLuint *textures, guint n_textures, const GLfloat *yuv_matrix, const GLfloat *yuv_offset, GLuint unity_tex)
+{
+    const GstGLFuncs *gl = gcontext->gl->gl_vtable;
+    static const char *sampler_names[GUB_GL_MAX_PLANES] = { "sTexture", "sTextureU", "sTextureV" };
+    GLint previous_vp[4];
+    GLint previous_prog;
+    GLint previous_fbo;
+    GLint previous_active_tex;
+    GLint previous_tex[GUB_GL_MAX_PLANES];
+    GLint previous_ab;
+    GLint previous_vao = 0;
+    GLint previous_vaenabled[2];
+    GLenum status;
+    guint i;
+
+    gl->GetIntegerv(GL_VIEWPORT, previous_vp);
+    gl->GetIntegerv(GL_CURRENT_PROGRAM, &previous_prog);
+    gl->GetIntegerv(GL_FRAMEBUFFER_BINDING, &previous_fbo);
+    gl->GetIntegerv(GL_ACTIVE_TEXTURE, &previous_active_tex);
+    gl->GetIntegerv(GL_ARRAY_BUFFER_BINDING, &previous_ab);
+    if (gl->BindVertexArray)
+        gl->GetIntegerv(GL_VERTEX_ARRAY_BINDING, &previous_vao);
+
+    for (i = 0; i < n_textures; i++) {
+        gl->ActiveTexture(GL_TEXTURE0 + i);
+        gl->GetIntegerv(GL_TEXTURE_BINDING_2D, &previous_tex[i]);
+        gl->BindTexture(GL_TEXTURE_2D, textures[i]);
+    }
+
+    gl->BindFramebuffer(GL_FRAMEBUFFER, gcontext->fbo);
+    // Cropping happens here, by moving the parts we do not want outside of the viewport
+    gl->Viewport(
+        (GLint)(-video_info->width * gcontext->crop_left),
+        (GLint)(-video_info->height * gcontext->crop_top),
+        video_info->width, video_info->height);
+    gl->FramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, unity_tex, 0);
+    status = gl->CheckFramebufferStatus(GL_FRAMEBUFFER);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        gub_log("Frame buffer not complete, status 0x%x, unity_tex %d", status, unity_tex);
+    }
+
+    gl->Disable(GL_BLEND);
+    gl->Disable(GL_DEPTH_TEST);
+    gl->Disable(GL_CULL_FACE);
+    gl->Disable(GL_SCISSOR_TEST);
+
+    gl->UseProgram(po);
+    if (gl->BindVertexArray)
+        gl->BindVertexArray(gcontext->vao);
+    gl->GetVertexAttribiv(0, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &previous_vaenabled[0]);
+    gl->GetVertexAttribiv(1, GL_VERTEX_ATTRIB_ARRAY_ENABLED, &previous_vaenabled[1]);
+    gl->BindBuffer(GL_ARRAY_BUFFER, gcontext->vbo);
+    gl->EnableVertexAttribArray(0);
+    gl->VertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (const GLvoid *)(0));
+    gl->EnableVertexAttribArray(1);
+    gl->VertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), (const GLvoid *)(2 * sizeof(GLfloat)));
+    for (i = 0; i < n_textures; i++) {
+        gl->Uniform1i(gl->GetUniformLocation(po, sampler_names[i]), i);
+    }
+    if (yuv_matrix && yuv_offset) {
+        gl->UniformMatrix3fv(gl->GetUniformLocation(po, "uYUVMatrix"), 1, GL_FALSE, yuv_matrix);
+        gl->Uniform3fv(gl->GetUniformLocation(po, "uYUVOffset"), 1, yuv_offset);
+    }
+    gl->DrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    if (!previous_vaenabled[0])
+        gl->DisableVertexAttribArray(0);
+    if (!previous_vaenabled[1])
+        gl->DisableVertexAttribArray(1);
+    if (gl->BindVertexArray)
+        gl->BindVertexArray(previous_vao);
+    gl->BindFramebuffer(GL_FRAMEBUFFER, previous_fbo);
+    gl->Viewport(previous_vp[0], previous_vp[1], previous_vp[2], previous_vp[3]);
+    gl->UseProgram(previous_prog);
+    gl->BindBuffer(GL_ARRAY_BUFFER, previous_ab);
+    for (i = 0; i < n_textures; i++) {
+        gl->ActiveTexture(GL_TEXTURE0 + i);
+        gl->BindTexture(GL_TEXTURE_2D, previous_tex[i]);
+    }
+    gl->ActiveTexture(previous_active_tex);
+}
+
+/* Uploads the Y, U and V planes and converts them into Unity's texture */
+static void gub_copy_planes_opengl(GUBGraphicContextOpenGL *gcontext, GstVideoInfo *video_info, GstVideoFrame *frame,
+    const guint8 *base, gsize offsets[GST_VIDEO_MAX_PLANES], GLuint unity_tex)
+{
+    const GstGLFuncs *gl = gcontext->gl->gl_vtable;
+    GLint previous_tex;
+    GLfloat matrix[9], offset[3];
+    guint plane, n_planes = GST_VIDEO_FRAME_N_PLANES(frame);
+
+    if (!gub_setup_programs_opengl(gcontext))
+        return;
+
+    gl->ActiveTexture(GL_TEXTURE0);
+    gl->GetIntegerv(GL_TEXTURE_BINDING_2D, &previous_tex);
+    for (plane = 0; plane < n_planes; plane++) {
+        gl->BindTexture(GL_TEXTURE_2D, gcontext->plane_tex[plane]);
+        gub_upload_plane_opengl(gcontext, frame, plane, base + offsets[plane]);
+    }
+    gl->PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    gl->BindTexture(GL_TEXTURE_2D, previous_tex);
+
+    gub_get_yuv_conversion(video_info, matrix, offset);
+    gub_draw_textures_opengl(gcontext, video_info, n_planes == 2 ? gcontext->po_nv12 : gcontext->po_i420,
+        gcontext->plane_tex, n_planes, matrix, offset, unity_tex);
+}
+
+/* Blits a frame which GStreamer already uploaded into a texture shared with Unity's context */
+static void gub_copy_gl_memory_opengl(GUBGraphicContextOpenGL *gcontext, GstVideoInfo *video_info, GstBuffer *buffer, GLuint unity_tex)
+{
+    GstGLSyncMeta *sync_meta;
+    GstVideoFrame video_frame;
+    GLuint gst_tex;
+
+    if (!gub_setup_programs_opengl(gcontext))
+        return;
+
+    // GStreamer rendered the texture from its own context, make sure it is finished before sampling it
+    sync_meta = gst_buffer_get_gl_sync_meta(buffer);
+    if (sync_meta) {
+        gst_gl_sync_meta_wait(sync_meta, gcontext->gl);
+    }
+
+    if (!gst_video_frame_map(&video_frame, video_info, buffer, GST_MAP_READ | GST_MAP_GL))
+        return;
+    gst_tex = *(guint *)GST_VIDEO_FRAME_PLANE_DATA(&video_frame, 0);
+
+    gub_draw_textures_opengl(gcontext, video_info, gcontext->po_rgb, &gst_tex, 1, NULL, NULL, unity_tex);
+
+    gst_video_frame_unmap(&video_frame);
+}
+
+/* Uploads a packed RGB frame straight into Unity's texture */
+static void gub_copy_rgb_opengl(GUBGraphicContextOpenGL *gcontext, GstVideoInfo *video_info, GstVideoFrame *frame,
+    const guint8 *pixels, GLuint unity_tex)
+{
+    const GstGLFuncs *gl = gcontext->gl->gl_vtable;
+    gint width, height, skip_x, skip_y;
+
+    // Cropping happens here, by only unpacking the visible region of the frame
+    skip_x = (gint)(video_info->width * gcontext->crop_left);
+    skip_y = (gint)(video_info->height * gcontext->crop_top);
+    width = (gint)(video_info->width * (1 - gcontext->crop_left - gcontext->crop_right));
+    height = (gint)(video_info->height * (1 - gcontext->crop_top - gcontext->crop_bottom));
+
+    gl->BindTexture(GL_TEXTURE_2D, unity_tex);
+    gl->PixelStorei(GL_UNPACK_ROW_LENGTH, GST_VIDEO_FRAME_PLANE_STRIDE(frame, 0) / GST_VIDEO_FRAME_COMP_PSTRIDE(frame, 0));
+    gl->PixelStorei(GL_UNPACK_SKIP_PIXELS, skip_x);
+    gl->PixelStorei(GL_UNPACK_SKIP_ROWS, skip_y);
+    gl->TexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+    gl->PixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    gl->PixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+    gl->PixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+}
+
+static void gub_copy_texture_opengl(GUBGraphicContextOpenGL *gcontext, GstVideoInfo *video_info, GstBuffer *buffer, void *native_texture_ptr)
+{
+    if (!gcontext) return;
+
+    if (native_texture_ptr)
+    {
+        const GstGLFuncs *gl = gcontext->gl->gl_vtable;
+        GLuint gltex = (GLuint)(size_t)(native_texture_ptr);
+        GstVideoFrame video_frame;
+        gsize offsets[GST_VIDEO_MAX_PLANES] = { 0 };
+        const guint8 *base = NULL;
+        gint slot = -1;
+
+        if (gst_is_gl_memory(gst_buffer_peek_memory(buffer, 0))) {
+            gub_copy_gl_memory_opengl(gcontext, video_info, buffer, gltex);
+            return;
+        }
+
+        if (!gst_video_frame_map(&video_frame, video_info, buffer, GST_MAP_READ))
+            return;
+
+        if (gcontext->pbo_persistent) {
+            gub_reclaim_pbos_opengl(gcontext);
+            slot = gub_take_staged_pbo_opengl(gcontext, buffer, offsets);
+        }
+        if (slot < 0 && gcontext->pbo_supported) {
+            slot = gub_fill_pbo_opengl(gcontext, &video_frame, offsets);
+        }
+        if (slot >= 0) {
+            gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, gcontext->pbo[slot]);
+        }
+        else {
+            // Upload straight from the mapped planes: offsets become relative to the first one
+            guint plane;
+            base = GST_VIDEO_FRAME_PLANE_DATA(&video_frame, 0);
+            for (plane = 0; plane < GST_VIDEO_FRAME_N_PLANES(&video_frame); plane++) {
+                offsets[plane] = (guint8 *)GST_VIDEO_FRAME_PLANE_DATA(&video_frame, plane) - base;
+            }
+        }
+
+        gl->PixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        if (GST_VIDEO_INFO_IS_YUV(video_info)) {
+            gub_copy_planes_opengl(gcontext, video_info, &video_frame, base, offsets, gltex);
+        }
+        else {
+            gub_copy_rgb_opengl(gcontext, video_info, &video_frame, base + offsets[0], gltex);
+        }
+        gl->PixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+        if (slot >= 0) {
+            if (gcontext->pbo_persistent) {
+                gcontext->pbo_fence[slot] = gl->FenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            }
+            gl->BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+
+        gst_video_frame_unmap(&video_frame);
+    }
+}
+
+static GUBGraphicContext *gub_create_graphic_context_opengl(GstPipeline *pipeline, float crop_left, float crop_top, float crop_right, float crop_bottom)
+{
+    GUBGraphicContextOpenGL *gcontext = NULL;
+    guintptr raw_context = gst_gl_context_get_current_gl_context(GUB_GL_PLATFORM);
+    if (raw_context) {
+#if GST_GL_HAVE_PLATFORM_GLX
+        // GStreamer's contexts can only share objects with Unity's if they live on the same X connection
+        GstGLDisplay *display = (GstGLDisplay *)gst_gl_display_x11_new_with_display(glXGetCurrentDisplay());
+#else
+        GstGLDisplay *display = gst_gl_display_new();
+#endif
+        GstGLContext *gl_context = gst_gl_context_new_wrapped(display, raw_context, GUB_GL_PLATFORM, GST_GL_API_OPENGL);
+        GError *error = NULL;
+        const GstGLFuncs *gl;
+
+        // Wrapped contexts need to query the function table from the current context themselves
+        gst_gl_context_activate(gl_context, TRUE);
+        if (!gst_gl_context_fill_info(gl_context, &error)) {
+            gub_log("Could not retrieve GL context info: %s", error ? error->message : "unknown error");
+            g_clear_error(&error);
+        }
+        gl = gl_context->gl_vtable;
+
+        gcontext = (GUBGraphicContextOpenGL *)malloc(sizeof(GUBGraphicContextOpenGL));
+        memset(gcontext, 0, sizeof(GUBGraphicContextOpenGL));
+        g_mutex_init(&gcontext->pbo_lock);
+        gcontext->gl = gl_context;
+        gcontext->display = display;
+        gcontext->crop_left = crop_left;
+        gcontext->crop_top = crop_top;
+        gcontext->crop_right = crop_right;
+        gcontext->crop_bottom = crop_bottom;
+
+        gcontext->pbo_supported = gl->GenBuffers && gl->BindBuffer && gl->BufferData &&
+            gl->MapBufferRange && gl->UnmapBuffer && gl->DeleteBuffers;
+#if GUB_GL_HAVE_BUFFER_STORAGE
+        gcontext->pbo_persistent = gcontext->pbo_supported && gl->BufferStorage &&
+            gl->FenceSync && gl->ClientWaitSync && gl->DeleteSync;
+#endif
+        gub_log("Texture upload through %s", gcontext->pbo_persistent ? "persistently-mapped PBOs" :
+            gcontext->pbo_supported ? "streaming PBOs" : "system memory");
+
+        // Single and two-channel textures and GLSL 1.50 are only guaranteed from GL 3.2 on
+        {
+            gint major = 0, minor = 0;
+            gst_gl_context_get_gl_version(gl_context, &major, &minor);
+            gcontext->legacy_textures = major < 3 || (major == 3 && minor < 2);
+            gcontext->shader_headers = gcontext->legacy_textures ? &gub_shader_headers_glsl120 : &gub_shader_headers_glsl150;
+        }
+    }
+    else {
+        gub_log("Could not retrieve current GL context");
+    }
+
+    return gcontext;
+}
+
+static void gub_destroy_graphic_context_opengl(GUBGraphicContextOpenGL *gcontext)
+{
+    if (gcontext) {
+        const GstGLFuncs *gl = gcontext->gl->gl_vtable;
+        if (gcontext->pbo_supported) {
+            g_mutex_lock(&gcontext->pbo_lock);
+            gub_release_pbos_opengl(gcontext);
+            g_mutex_unlock(&gcontext->pbo_lock);
+        }
+        g_mutex_clear(&gcontext->pbo_lock);
+        gst_caps_replace(&gcontext->stage_caps, NULL);
+        if (gcontext->fbo) {
+            gl->DeleteFramebuffers(1, &gcontext->fbo);
+            gl->DeleteProgram(gcontext->po_i420);
+            gl->DeleteProgram(gcontext->po_nv12);
+            gl->DeleteProgram(gcontext->po_rgb);
+            if (gl->DeleteVertexArrays)
+                gl->DeleteVertexArrays(1, &gcontext->vao);
+            gl->DeleteBuffers(1, &gcontext->vbo);
+            gl->DeleteTextures(GUB_GL_MAX_PLANES, gcontext->plane_tex);
+        }
+        if (gcontext->gl) {
+            gst_object_unref(gcontext->gl);
+        }
+        if (gcontext->display) {
+            gst_object_unref(gcontext->display);
+        }
+        free(gcontext);
+    }
+}
+
+static GstContext *gub_provide_graphic_context_opengl(GUBGraphicContextOpenGL *gcontext, const gchar *type)
+{
+    gub_log("Providing context. gub_context=%p, type=%s", gcontext, type);
+
+    if (!gcontext) return NULL;
+
+    return gub_provide_gl_context(gcontext->display, gcontext->gl, type);
+}
+
+static const gchar *gub_get_video_branch_description_opengl(GUBVideoUploadMode mode)
+{
+    if (mode == GUB_VIDEO_UPLOAD_GL_MEMORY) {
+        return "glupload ! glcolorconvert ! video/x-raw(memory:GLMemory),format=RGBA,texture-target=2D ! appsink sync=1 qos=1 enable-last-sample=0 max-buffers=1 drop=1 name=sink";
+    }
+    if (mode == GUB_VIDEO_UPLOAD_PLANAR_YUV) {
+        // videoconvert is passthrough when the decoder already produces one of these
+        return "videoconvert ! video/x-raw,format={I420,NV12} ! appsink sync=1 qos=1 enable-last-sample=0 max-buffers=1 drop=1 name=sink";
+    }
+    return "videoconvert ! video/x-raw,format=RGB ! appsink sync=1 qos=1 enable-last-sample=0 max-buffers=1 drop=1 name=sink";
+}
+
+GUBGraphicBackend gub_graphic_backend_opengl = {
+    /* create_graphic_device   */      NULL,
+    /* destroy_graphic_device  */      NULL,
+    /* create_graphic_context  */      (GUBCreateGraphicContextPFN)gub_create_graphic_context_opengl,
+    /* provide_graphic_context */      (GUBProvideGraphicContextPFN)gub_provide_graphic_context_opengl,
+    /* destroy_graphic_context */      (GUBDestroyGraphicContextPFN)gub_destroy_graphic_context_opengl,
+    /* copy_texture */                 (GUBCopyTexturePFN)gub_copy_texture_opengl,
+    /* get_video_branch_description */ (GUBGetVideoBranchDescriptionPFN)gub_get_video_branch_description_opengl,
+    /* stage_frame */                  (GUBStageFramePFN)gub_stage_frame_opengl
+};
+
+#endif
+
+#if SUPPORT_EGL
+// --------------------------------------------------------------------------------------------------------------------
+// --------------------------------------------------- EGL SUPPORT ----------------------------------------------------
+// --------------------------------------------------------------------------------------------------------------------
+
+typedef struct _GUBGraphicContextEGL {
+    GstGLContext *gl;
+    GstGLDisplay *display;
+    GLuint fbo;
+    GLuint po;
+    GLuint vao;
+    GLuint vbo;
+    GLint samplerLoc;
+    float crop_left;
+    float crop_top;
+    float crop_right;
+    float crop_bottom;
+} GUBGraphicContextEGL;
+
 static void gub_copy_texture_egl(GUBGraphicContextEGL *gcontext, GstVideoInfo *video_info, GstBuffer *buffer, void *native_texture_ptr)
 {
     if (!gcontext) return;
@@ -524,12 +1375,6 @@ static void gub_copy_texture_egl(GUBGraphicContextEGL *gcontext, GstVideoInfo *v
 
 static GUBGraphicContext *gub_create_graphic_context_egl(GstPipeline *pipeline, float crop_left, float crop_top, float crop_right, float crop_bottom)
 {
-    static const GLfloat vVertices[] = {
-        -1.f, -1.f,   0.f, 0.f,
-        -1.f,  1.f,   0.f, 1.f,
-         1.f, -1.f,   1.f, 0.f,
-         1.f,  1.f,   1.f, 1.f
-    };
     guintptr raw_context;
     GstStructure *s;
     GstGLDisplay *display;
@@ -569,10 +1414,10 @@ static GUBGraphicContext *gub_create_graphic_context_egl(GstPipeline *pipeline,
 
     glGenBuffers(1, &gcontext->vbo);
     glBindBuffer(GL_ARRAY_BUFFER, gcontext->vbo);
-    glBufferData(GL_ARRAY_BUFFER, 16 * sizeof(GLfloat), vVertices, GL_STATIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(gub_quad_vertices), gub_quad_vertices, GL_STATIC_DRAW);
     glBindBuffer(GL_ARRAY_BUFFER, 0);
 
-    gcontext->po = gub_create_program();
+    gcontext->po = gub_create_program(&gub_shader_headers_gles2, gub_fragment_shader_rgb_str);
 
     gcontext->samplerLoc = glGetUniformLocation(gcontext->po, "sTexture");
 
@@ -581,40 +1426,11 @@ static GUBGraphicContext *gub_create_graphic_context_egl(GstPipeline *pipeline,
 
 static GstContext *gub_provide_graphic_context_egl(GUBGraphicContextEGL *gcontext, const gchar *type)
 {
-    GstContext *context = NULL;
-
     gub_log("Providing context. gub_context=%p, type=%s", gcontext, type);
 
     if (!gcontext) return NULL;
 
-    if (type != NULL) {
-        if (g_strcmp0(type, GST_GL_DISPLAY_CONTEXT_TYPE) == 0) {
-            context = gst_context_new(GST_GL_DISPLAY_CONTEXT_TYPE, TRUE);
-            gst_context_set_gl_display(context, gcontext->display);
-        }
-        else if (g_strcmp0(type, "gst.gl.app_context") == 0) {
-            GstStructure *s;
-            context = gst_context_new("gst.gl.app_context", TRUE);
-            s = gst_context_writable_structure(context);
-            gst_structure_set(s, "context", GST_GL_TYPE_CONTEXT, gcontext->gl, NULL);
-        }
-        else if (g_strcmp0(type, "gst.gl.local_context") == 0) {
-            GstGLContext *local_context = gst_gl_context_new(gcontext->display);
-            GError *error = NULL;
-            gst_gl_context_create(local_context, gcontext->gl, &error);
-            if (error) {
-                gub_log("Cannot create local context: %s", error->message);
-                g_error_free(error);
-            }
-            else {
-                GstStructure *s;
-                context = gst_context_new("gst.gl.local_context", TRUE);
-                s = gst_context_writable_structure(context);
-                gst_structure_set(s, "context", GST_GL_TYPE_CONTEXT, local_context, NULL);
-            }
-        }
-    }
-    return context;
+    return gub_provide_gl_context(gcontext->display, gcontext->gl, type);
 }
 
 static void gub_destroy_graphic_context_egl(GUBGraphicContextEGL *gcontext)
@@ -632,9 +1448,9 @@ static void gub_destroy_graphic_context_egl(GUBGraphicContextEGL *gcontext)
     }
 }
 
-static const gchar *gub_get_video_branch_description_egl()
+static const gchar *gub_get_video_branch_description_egl(GUBVideoUploadMode mode)
 {
-    return "glupload ! glcolorconvert ! video/x-raw(memory:GLMemory),texture-target=2D ! fakesink sync=1 qos=1 name=sink";
+    return "glupload ! glcolorconvert ! video/x-raw(memory:GLMemory),texture-target=2D ! appsink sync=1 qos=1 enable-last-sample=0 max-buffers=1 drop=1 name=sink";
 }
 
 GUBGraphicBackend gub_graphic_backend_egl = {
@@ -644,7 +1460,8 @@ GUBGraphicBackend gub_graphic_backend_egl = {
     /* provide_graphic_context */      (GUBProvideGraphicContextPFN)gub_provide_graphic_context_egl,
     /* destroy_graphic_context */      (GUBDestroyGraphicContextPFN)gub_destroy_graphic_context_egl,
     /* copy_texture */                 (GUBCopyTexturePFN)gub_copy_texture_egl,
-    /* get_video_branch_description */ (GUBGetVideoBranchDescriptionPFN)gub_get_video_branch_description_egl
+    /* get_video_branch_description */ (GUBGetVideoBranchDescriptionPFN)gub_get_video_branch_description_egl,
+    /* stage_frame */                  NULL
 };
 
 #endif
@@ -679,11 +1496,9 @@ void gub_destroy_graphic_context(GUBGraphicContext *gcontext)
     }
 }
 
-gboolean gub_blit_image(GUBGraphicContext *gcontext, GstSample *sample, void *texture_native_ptr)
+gboolean gub_blit_image(GUBGraphicContext *gcontext, GstSample *sample, GstVideoInfo *video_info, void *texture_native_ptr)
 {
     GstBuffer *buffer = NULL;
-    GstCaps *caps = NULL;
-    GstVideoInfo video_info;
 
     if (!gub_graphic_backend || !gub_graphic_backend->copy_texture) {
         return FALSE;
@@ -695,15 +1510,24 @@ gboolean gub_blit_image(GUBGraphicContext *gcontext, GstSample *sample, void *te
         return FALSE;
     }
 
-    caps = gst_sample_get_caps(sample);
-    gst_video_info_from_caps(&video_info, caps);
-
-    gub_graphic_backend->copy_texture(gcontext, &video_info, buffer, texture_native_ptr);
+    gub_graphic_backend->copy_texture(gcontext, video_info, buffer, texture_native_ptr);
 
     return TRUE;
 }
 
-const gchar *gub_get_video_branch_description()
+void gub_stage_image(GUBGraphicContext *gcontext, GstSample *sample)
+{
+    GstBuffer *buffer = gst_sample_get_buffer(sample);
+    GstCaps *caps = gst_sample_get_caps(sample);
+
+    if (!gcontext || !buffer || !caps || !gub_graphic_backend || !gub_graphic_backend->stage_frame) {
+        return;
+    }
+
+    gub_graphic_backend->stage_frame(gcontext, buffer, caps);
+}
+
+const gchar *gub_get_video_branch_description(GUBVideoUploadMode mode)
 {
     const gchar *description = NULL;
 
@@ -717,7 +1541,7 @@ const gchar *gub_get_video_branch_description()
 #endif
 
     if (gub_graphic_backend && gub_graphic_backend->get_video_branch_description) {
-        description = gub_graphic_backend->get_video_branch_description();
+        description = gub_graphic_backend->get_video_branch_description(mode);
     }
     return description;
 }
@@ -19,26 +19,125 @@
 */
 
 #include <gst/video/video.h>
-#include <gst/net/gstnet.h>
+#include <gst/app/gstappsink.h>
 #include <gst/pbutils/encoding-profile.h>
-#include <gstdvbcsswcclient.h>
 #include <memory.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "gub.h"
 #include "gub_pipeline.h"
+#include "gub_convert.h"
+#include "gub_clock.h"
 
 #define MAX_JITTERBUFFER_DELAY_MS 40
 #define MAX_PIPELINE_DELAY_MS 500
 
+/* Buffers preallocated for captured frames. The pool grows beyond this if the encoder holds on
+to more frames (x264enc keeps its whole lookahead), and then keeps recycling them. */
+#define ENCODING_POOL_MIN_BUFFERS 4
+
+/* How long the network clock gets to synchronize before playback starts anyway */
+#define CLOCK_SYNC_TIMEOUT_MS 30000
+/* Once synced, the clock gets this long to refine its first estimate before playback starts */
+#define CLOCK_SYNC_SETTLE_MS 500
+
+/* How long the seek joining the session gets to complete before its position is taken anyway */
+#define SYNC_SEEK_TIMEOUT_MS 5000
+
+/* GStreamer before 1.14 has no name for it, but never hands out 0 either */
+#if !GST_CHECK_VERSION(1, 14, 0)
+#define GST_SEQNUM_INVALID (0)
+#endif
+
+/* How often the position of a synced pipeline is checked against the session */
+#define DRIFT_CHECK_INTERVAL_MS 1000
+/* Errors below this are left alone, above it they are corrected by playing slightly faster or slower */
+#define DRIFT_DEADBAND_MS 10
+/* Errors above this are corrected by seeking back into the session */
+#define DRIFT_SEEK_THRESHOLD_MS 250
+/* A correction is spread over this long, but never changes the playback rate by more than DRIFT_MAX_RATE_ADJUST */
+#define DRIFT_CORRECTION_S 10
+#define DRIFT_MAX_RATE_ADJUST 0.005
+
+/* Default number of captured images gub_pipeline_consume_image_async lets wait for the worker thread */
+#define CAPTURE_QUEUE_DEFAULT_MAX_PENDING 2
+
+/* Encoding profile used when gub_pipeline_setup_encoding_with_profile is not told otherwise */
+#define DEFAULT_CONTAINER_CAPS "video/quicktime,variant=iso"
+#define DEFAULT_VIDEO_CAPS "video/x-h264,profile=main"
+
+/* An image handed over by gub_pipeline_consume_image_async, owned by us until release_handler is called */
+typedef struct _GUBCaptureRequest {
+    guint8 *rawdata;
+    int size;
+    gint64 submitted; /* g_get_monotonic_time() when it was handed over */
+    GUBPipelineOnImageReleasedPFN release_handler;
+    void *release_userdata;
+} GUBCaptureRequest;
+
+typedef enum {
+    GUB_CLOCK_SYNC_WAITING,
+    GUB_CLOCK_SYNC_DONE,
+    GUB_CLOCK_SYNC_FAILED
+} GUBClockSyncState;
+
+/* Network clock acquisition, driven by the clock's "synced" signal and timeouts on the GUB main loop.
+Reference counted because these can still fire after the pipeline has let go of it, and then do nothing
+as pipeline is NULL. The handler is called with lock held, so the pipeline cannot go away meanwhile,
+or between clock_sync_enter and clock_sync_leave when it has to run without it. */
+typedef struct _GUBClockSync {
+    gint refcount;
+    GMutex lock;
+    GCond idle;
+    guint busy;
+    GUBPipeline *pipeline;
+    GstClock *clock;
+    gulong synced_id;
+    GSource *timeout;
+    GSource *settle;
+    GSource *drift;
+    gint state; /* GUBClockSyncState, atomic */
+    gint64 start;
+    /* Seqnum of the seek joining the synced session, until its ASYNC_DONE arrives (GST_SEQNUM_INVALID otherwise).
+    seek_timeout finishes it in case that never happens, see sync_seek_timed_out. */
+    guint32 seek_seqnum;
+    GstClockTime seek_target;
+    GSource *seek_timeout;
+} GUBClockSync;
+
 struct _GUBPipeline {
     char *name;
+    /* Created on the render thread by grab_frame. graphic_lock keeps it alive while
+    the streaming thread uses it, see stage_sample and pad_probe. */
     GUBGraphicContext *graphic_context;
+    GMutex graphic_lock;
+    GUBVideoUploadMode video_upload_mode;
     gboolean supports_cropping_blit;
 
     GstElement *pipeline;
+    GstElement *sink;
     GstSample *last_sample;
+
+    /* Video info parsed from video_caps, only refreshed when the sample caps change */
+    GstCaps *video_caps;
+    GstVideoInfo video_info;
+
+    /* Push mode: the appsink callbacks leave the newest decoded sample here
+    (protected by sample_lock) and grab_frame just picks it up. */
+    gboolean push_mode;
+    GMutex sample_lock;
+    GstSample *pending_sample;
+
+    /* Incremented every time the sink delivers a frame different from the previous one.
+    seen_buffer is that previous frame. It is reffed, so a pooled decoder cannot hand its
+    memory out again as a new frame while it is compared against. */
+    guint64 frame_seq;
+    GstBuffer *seen_buffer;
+
     GstClock *net_clock;
+    GUBClockSync *clock_sync;
+    /* Written by Unity's thread and read by the capture worker, protected by sample_lock.
+    Whoever sees play_requested first makes the transition to PLAYING, see claim_play_transition. */
     gboolean playing;
     gboolean play_requested;
     int video_index;
@@ -52,13 +151,44 @@ struct _GUBPipeline {
     GUBPipelineOnEosPFN on_eos_handler;
     GUBPipelineOnErrorPFN on_error_handler;
     GUBPipelineOnQosPFN on_qos_handler;
+    GUBPipelineOnClockSyncPFN on_clock_sync_handler;
     void *userdata;
 
     GstAppSrc *appsrc;
+    /* Recycles the buffers captured frames are converted into, once the encoder releases them */
+    GstBufferPool *buffer_pool;
+    /* Properties for the encoder encodebin picks. Named after the element factory, or "encoder" for any. */
+    GstStructure *encoder_settings;
+
+    /* Asynchronous capture: images wait in capture_queue (protected by capture_lock) until
+    capture_thread converts and pushes them. capture_cond signals queue and worker changes. */
+    GThread *capture_thread;
+    GMutex capture_lock;
+    GCond capture_cond;
+    GQueue capture_queue;
+    guint capture_max_pending;
+    GUBCaptureQueuePolicy capture_policy;
+    gboolean capture_busy;
+    gboolean capture_stopping;
+    guint64 captures_dropped;
+    /* Timestamp of the last image pushed, images are stamped and pushed with capture_lock held */
+    GstClockTime capture_last_pts;
+
+    /* Read by the sink's measure_drift, protected by sample_lock */
     GstClockTime basetime;
     gboolean synced;
+
+    /* Drift control: the sink adds up how far each rendered frame is from where the session is
+    (protected by sample_lock), and correct_drift acts on the average every DRIFT_CHECK_INTERVAL_MS.
+    Only pushing sinks report their frames as they render them, so polled pipelines are not corrected. */
+    gint64 drift_error_sum;
+    guint drift_error_count;
+    gdouble drift_rate;
+    gboolean drift_rate_unsupported;
 };
 
+static void correct_drift(GUBPipeline *pipeline);
+
 void gub_log_pipeline(GUBPipeline *pipeline, const char *format, ...)
 {
     va_list argptr;
@@ -71,9 +201,208 @@ void gub_log_pipeline(GUBPipeline *pipeline, const char *format, ...)
     g_free(final_string);
 }
 
+static GUBClockSync *clock_sync_ref(GUBClockSync *sync)
+{
+    g_atomic_int_inc(&sync->refcount);
+    return sync;
+}
+
+static void clock_sync_unref(GUBClockSync *sync)
+{
+    if (g_atomic_int_dec_and_test(&sync->refcount)) {
+        gst_object_unref(sync->clock);
+        g_mutex_clear(&sync->lock);
+        g_cond_clear(&sync->idle);
+        g_free(sync);
+    }
+}
+
+static GSource *clock_sync_add_timeout(GUBClockSync *sync, guint interval_ms, GSourceFunc func)
+{
+    // The default context is the one the GUB main loop runs, like the bus watch
+    GSource *source = g_timeout_source_new(interval_ms);
+    g_source_set_callback(source, func, clock_sync_ref(sync), (GDestroyNotify)clock_sync_unref);
+    g_source_attach(source, NULL);
+    return source;
+}
+
+static void clock_sync_drop_source(GSource **source)
+{
+    if (*source) {
+        g_source_destroy(*source);
+        g_source_unref(*source);
+        *source = NULL;
+    }
+}
+
+/* Must be called with lock held. Returns the pipeline, which the caller may then use without the lock
+until it calls clock_sync_leave, or NULL if it is gone already. */
+static GUBPipeline *clock_sync_enter(GUBClockSync *sync)
+{
+    if (sync->pipeline) {
+        sync->busy++;
+    }
+    return sync->pipeline;
+}
+
+static void clock_sync_leave(GUBClockSync *sync)
+{
+    g_mutex_lock(&sync->lock);
+    if (--sync->busy == 0) {
+        g_cond_broadcast(&sync->idle);
+    }
+    g_mutex_unlock(&sync->lock);
+}
+
+/* Must be called with lock held. Returns the handler to tell, with its userdata, which the caller
+calls once it has released the lock: the handler may well close the pipeline, which takes it. */
+static GUBPipelineOnClockSyncPFN clock_sync_finish(GUBClockSync *sync, GUBClockSyncState state, void **userdata)
+{
+    GUBPipeline *pipeline = sync->pipeline;
+    gdouble elapsed = (g_get_monotonic_time() - sync->start) / 1e6;
+
+    clock_sync_drop_source(&sync->timeout);
+    clock_sync_drop_source(&sync->settle);
+    g_atomic_int_set(&sync->state, state);
+
+    if (state == GUB_CLOCK_SYNC_DONE) {
+        gub_log_pipeline(pipeline, "Synchronized to network clock in %g seconds", elapsed);
+    }
+    else {
+        gub_log_pipeline(pipeline, "Could not synchronize to network clock after %g seconds", elapsed);
+    }
+    *userdata = pipeline->userdata;
+    return pipeline->on_clock_sync_handler;
+}
+
+static gboolean clock_sync_timed_out(GUBClockSync *sync)
+{
+    GUBPipelineOnClockSyncPFN handler = NULL;
+    void *userdata = NULL;
+
+    g_mutex_lock(&sync->lock);
+    if (sync->pipeline && g_atomic_int_get(&sync->state) == GUB_CLOCK_SYNC_WAITING) {
+        handler = clock_sync_finish(sync, GUB_CLOCK_SYNC_FAILED, &userdata);
+    }
+    g_mutex_unlock(&sync->lock);
+    if (handler != NULL) {
+        handler(userdata, FALSE);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+static gboolean clock_sync_settled(GUBClockSync *sync)
+{
+    GUBPipelineOnClockSyncPFN handler = NULL;
+    void *userdata = NULL;
+
+    g_mutex_lock(&sync->lock);
+    if (sync->pipeline && g_atomic_int_get(&sync->state) == GUB_CLOCK_SYNC_WAITING) {
+        if (gst_clock_is_synced(sync->clock)) {
+            handler = clock_sync_finish(sync, GUB_CLOCK_SYNC_DONE, &userdata);
+        }
+        else {
+            clock_sync_drop_source(&sync->settle);
+        }
+    }
+    g_mutex_unlock(&sync->lock);
+    if (handler != NULL) {
+        handler(userdata, TRUE);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+/* Emitted from the clock's own thread */
+static void clock_synced(GstClock *clock, gboolean synced, GUBClockSync *sync)
+{
+    g_mutex_lock(&sync->lock);
+    if (sync->pipeline && g_atomic_int_get(&sync->state) == GUB_CLOCK_SYNC_WAITING) {
+        if (synced && !sync->settle) {
+            sync->settle = clock_sync_add_timeout(sync, CLOCK_SYNC_SETTLE_MS, (GSourceFunc)clock_sync_settled);
+        }
+        else if (!synced) {
+            clock_sync_drop_source(&sync->settle);
+        }
+    }
+    g_mutex_unlock(&sync->lock);
+}
+
+static gboolean clock_sync_drift_tick(GUBClockSync *sync)
+{
+    GUBPipeline *pipeline;
+
+    // Without the lock, correct_drift can seek, which would hold up clock_synced and clock_sync_stop
+    clock_sync_ref(sync);
+    g_mutex_lock(&sync->lock);
+    pipeline = clock_sync_enter(sync);
+    g_mutex_unlock(&sync->lock);
+    if (pipeline) {
+        correct_drift(pipeline);
+        clock_sync_leave(sync);
+    }
+    clock_sync_unref(sync);
+    return G_SOURCE_CONTINUE;
+}
+
+/* Waits for the network clock without blocking the caller, see clock_sync_finish */
+static void clock_sync_start(GUBPipeline *pipeline, GstClock *clock)
+{
+    GUBClockSync *sync = g_new0(GUBClockSync, 1);
+    sync->refcount = 1;
+    g_mutex_init(&sync->lock);
+    g_cond_init(&sync->idle);
+    sync->pipeline = pipeline;
+    sync->clock = gst_object_ref(clock);
+    sync->state = GUB_CLOCK_SYNC_WAITING;
+    sync->start = g_get_monotonic_time();
+    sync->seek_seqnum = GST_SEQNUM_INVALID;
+    pipeline->clock_sync = sync;
+
+    g_mutex_lock(&sync->lock);
+    sync->synced_id = g_signal_connect_data(clock, "synced", G_CALLBACK(clock_synced),
+        clock_sync_ref(sync), (GClosureNotify)clock_sync_unref, 0);
+    sync->timeout = clock_sync_add_timeout(sync, CLOCK_SYNC_TIMEOUT_MS, (GSourceFunc)clock_sync_timed_out);
+    // Clocks shared with other pipelines might have synchronized already
+    if (gst_clock_is_synced(clock)) {
+        sync->settle = clock_sync_add_timeout(sync, CLOCK_SYNC_SETTLE_MS, (GSourceFunc)clock_sync_settled);
+    }
+    sync->drift = clock_sync_add_timeout(sync, DRIFT_CHECK_INTERVAL_MS, (GSourceFunc)clock_sync_drift_tick);
+    g_mutex_unlock(&sync->lock);
+}
+
+static void clock_sync_stop(GUBPipeline *pipeline)
+{
+    GUBClockSync *sync = pipeline->clock_sync;
+    if (!sync) {
+        return;
+    }
+
+    g_signal_handler_disconnect(sync->clock, sync->synced_id);
+    g_mutex_lock(&sync->lock);
+    sync->pipeline = NULL;
+    clock_sync_drop_source(&sync->timeout);
+    clock_sync_drop_source(&sync->settle);
+    clock_sync_drop_source(&sync->drift);
+    clock_sync_drop_source(&sync->seek_timeout);
+    // Wait for a callback still using the pipeline
+    while (sync->busy > 0) {
+        g_cond_wait(&sync->idle, &sync->lock);
+    }
+    g_mutex_unlock(&sync->lock);
+    clock_sync_unref(sync);
+    pipeline->clock_sync = NULL;
+}
+
+/* TRUE once there is no network clock to wait for anymore */
+static gboolean clock_sync_is_over(GUBPipeline *pipeline)
+{
+    return pipeline->clock_sync == NULL ||
+        g_atomic_int_get(&pipeline->clock_sync->state) != GUB_CLOCK_SYNC_WAITING;
+}
+
 EXPORT_API void *gub_pipeline_create(const char *name,
     GUBPipelineOnEosPFN eos_handler, GUBPipelineOnErrorPFN error_handler, GUBPipelineOnQosPFN qos_handler,
-    void *userdata)
+    GUBPipelineOnClockSyncPFN clock_sync_handler, void *userdata)
 {
     GUBPipeline *pipeline = (GUBPipeline *)malloc(sizeof(GUBPipeline));
     memset(pipeline, 0, sizeof(GUBPipeline));
@@ -81,27 +410,138 @@ EXPORT_API void *gub_pipeline_create(const char *name,
     pipeline->on_eos_handler = eos_handler;
     pipeline->on_error_handler = error_handler;
     pipeline->on_qos_handler = qos_handler;
+    pipeline->on_clock_sync_handler = clock_sync_handler;
     pipeline->userdata = userdata;
+    g_mutex_init(&pipeline->sample_lock);
+    g_mutex_init(&pipeline->graphic_lock);
+    g_mutex_init(&pipeline->capture_lock);
+    g_cond_init(&pipeline->capture_cond);
+    g_queue_init(&pipeline->capture_queue);
+    pipeline->capture_max_pending = CAPTURE_QUEUE_DEFAULT_MAX_PENDING;
+    pipeline->capture_policy = GUB_CAPTURE_DROP_OLDEST;
+    pipeline->capture_last_pts = GST_CLOCK_TIME_NONE;
+    pipeline->drift_rate = 1.0;
 
     return pipeline;
 }
 
+static void release_capture_request(GUBCaptureRequest *request)
+{
+    if (request->release_handler) {
+        request->release_handler(request->release_userdata, request->rawdata);
+    }
+    g_free(request);
+}
+
+/* Stops the capture worker, giving back the images it did not get to */
+static void stop_capture_thread(GUBPipeline *pipeline)
+{
+    GUBCaptureRequest *request;
+    GQueue pending = G_QUEUE_INIT;
+
+    g_mutex_lock(&pipeline->capture_lock);
+    while ((request = g_queue_pop_head(&pipeline->capture_queue)) != NULL) {
+        g_queue_push_tail(&pending, request);
+        pipeline->captures_dropped++;
+    }
+    pipeline->capture_stopping = TRUE;
+    g_cond_broadcast(&pipeline->capture_cond);
+    g_mutex_unlock(&pipeline->capture_lock);
+
+    while ((request = g_queue_pop_head(&pending)) != NULL) {
+        release_capture_request(request);
+    }
+
+    if (pipeline->capture_thread) {
+        g_thread_join(pipeline->capture_thread);
+        pipeline->capture_thread = NULL;
+    }
+}
+
 EXPORT_API void gub_pipeline_close(GUBPipeline *pipeline)
 {
-    gub_destroy_graphic_context(pipeline->graphic_context);
+    GUBGraphicContext *graphic_context;
+
+    // The capture worker uses the pipeline, so it goes first
+    stop_capture_thread(pipeline);
+    pipeline->capture_stopping = FALSE;
+    pipeline->captures_dropped = 0;
+    pipeline->capture_last_pts = GST_CLOCK_TIME_NONE;
+
+    // So does the drift check, which waits here for a check already running
+    clock_sync_stop(pipeline);
+    // Waits for the streaming thread to be done staging a frame into it
+    g_mutex_lock(&pipeline->graphic_lock);
+    graphic_context = pipeline->graphic_context;
+    pipeline->graphic_context = NULL;
+    g_mutex_unlock(&pipeline->graphic_lock);
+    gub_destroy_graphic_context(graphic_context);
     if (pipeline->pipeline) {
         gst_element_set_state(GST_ELEMENT(pipeline->pipeline), GST_STATE_NULL);
         gst_object_unref(pipeline->pipeline);
+        pipeline->pipeline = NULL;
+    }
+    if (pipeline->sink) {
+        gst_object_unref(pipeline->sink);
+        pipeline->sink = NULL;
     }
     if (pipeline->last_sample) {
         gst_sample_unref(pipeline->last_sample);
+        pipeline->last_sample = NULL;
     }
-    memset(pipeline, 0, sizeof(GUBPipeline));
+    gst_caps_replace(&pipeline->video_caps, NULL);
+    g_mutex_lock(&pipeline->sample_lock);
+    if (pipeline->pending_sample) {
+        gst_sample_unref(pipeline->pending_sample);
+        pipeline->pending_sample = NULL;
+    }
+    gst_buffer_replace(&pipeline->seen_buffer, NULL);
+    g_mutex_unlock(&pipeline->sample_lock);
+    if (pipeline->net_clock) {
+        gst_object_unref(pipeline->net_clock);
+        pipeline->net_clock = NULL;
+    }
+    if (pipeline->appsrc) {
+        // The pipeline (already released) owned it
+        pipeline->appsrc = NULL;
+    }
+    if (pipeline->buffer_pool) {
+        gst_buffer_pool_set_active(pipeline->buffer_pool, FALSE);
+        gst_object_unref(pipeline->buffer_pool);
+        pipeline->buffer_pool = NULL;
+    }
+    if (pipeline->encoder_settings) {
+        gst_structure_free(pipeline->encoder_settings);
+        pipeline->encoder_settings = NULL;
+    }
+
+    // Keep the name, handlers, userdata and lock, as this object can be set up again
+    pipeline->supports_cropping_blit = FALSE;
+    pipeline->push_mode = FALSE;
+    g_mutex_lock(&pipeline->sample_lock);
+    pipeline->playing = FALSE;
+    pipeline->play_requested = FALSE;
+    pipeline->basetime = 0;
+    pipeline->synced = FALSE;
+    pipeline->drift_error_sum = 0;
+    pipeline->drift_error_count = 0;
+    g_mutex_unlock(&pipeline->sample_lock);
+    pipeline->video_index = 0;
+    pipeline->audio_index = 0;
+    pipeline->video_crop_left = pipeline->video_crop_top = 0;
+    pipeline->video_crop_right = pipeline->video_crop_bottom = 0;
+    pipeline->video_width = pipeline->video_height = 0;
+    pipeline->drift_rate = 1.0;
+    pipeline->drift_rate_unsupported = FALSE;
 }
 
 EXPORT_API void gub_pipeline_destroy(GUBPipeline *pipeline)
 {
     gub_pipeline_close(pipeline);
+    g_mutex_clear(&pipeline->sample_lock);
+    g_mutex_clear(&pipeline->graphic_lock);
+    g_mutex_clear(&pipeline->capture_lock);
+    g_cond_clear(&pipeline->capture_cond);
     g_free(pipeline->name);
     free(pipeline);
 }
@@ -112,7 +552,24 @@ EXPORT_API void gub_pipeline_play(GUBPipeline *pipeline)
     on Android, the application has not yet provided a GL context at that point.
     Instead, we will start the pipeline from the grab_frame method, which is called
     when the app has initialized GL (Script OnGui). */
+    g_mutex_lock(&pipeline->sample_lock);
     pipeline->play_requested = TRUE;
+    g_mutex_unlock(&pipeline->sample_lock);
+}
+
+/* TRUE if the caller has to set the pipeline to PLAYING. Only one caller gets TRUE for every request.
+The state change must not be made with sample_lock held, the streaming threads take it. */
+static gboolean claim_play_transition(GUBPipeline *pipeline)
+{
+    gboolean claimed;
+
+    g_mutex_lock(&pipeline->sample_lock);
+    claimed = !pipeline->playing && pipeline->play_requested;
+    if (claimed) {
+        pipeline->playing = TRUE;
+    }
+    g_mutex_unlock(&pipeline->sample_lock);
+    return claimed;
 }
 
 EXPORT_API void gub_pipeline_pause(GUBPipeline *pipeline)
@@ -121,8 +578,10 @@ EXPORT_API void gub_pipeline_pause(GUBPipeline *pipeline)
         gub_log_pipeline(pipeline, "Setting pipeline to PAUSED");
         gst_element_set_state(GST_ELEMENT(pipeline->pipeline), GST_STATE_PAUSED);
         gub_log_pipeline(pipeline, "State change completed");
+        g_mutex_lock(&pipeline->sample_lock);
         pipeline->play_requested = FALSE;
         pipeline->playing = FALSE;
+        g_mutex_unlock(&pipeline->sample_lock);
     }
 }
 
@@ -142,7 +601,12 @@ EXPORT_API gint32 gub_pipeline_is_loaded(GUBPipeline *pipeline)
 
 EXPORT_API gint32 gub_pipeline_is_playing(GUBPipeline *pipeline)
 {
-    return pipeline->playing;
+    gboolean playing;
+
+    g_mutex_lock(&pipeline->sample_lock);
+    playing = pipeline->playing;
+    g_mutex_unlock(&pipeline->sample_lock);
+    return playing;
 }
 
 EXPORT_API double gub_pipeline_get_duration(GUBPipeline *pipeline)
@@ -191,24 +655,339 @@ static void source_created(GstBin *playbin, GstElement *source, GUBPipeline *pip
     g_signal_connect(source, "select-stream", G_CALLBACK(select_stream), pipeline);
 }
 
-static void sync_video_position(GUBPipeline *pipeline) 
-{    
-    if (!pipeline->synced) {
-        gint64 position = GST_CLOCK_TIME_NONE;
-	gint64 current_time = gst_clock_get_time(pipeline->net_clock) + MAX_PIPELINE_DELAY_MS*GST_MSECOND;
-	if (current_time < pipeline->basetime) {
-	    gub_log_pipeline(pipeline, "ERROR: %lldns : %lldns", current_time, pipeline->basetime);
-	} else {
-	    gboolean seek = gst_element_seek_simple(pipeline->pipeline, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT, current_time - pipeline->basetime);
-	    gub_log_pipeline(pipeline, "Seeked: %lldns : %d", current_time - pipeline->basetime, seek);	    
-	    while(position == GST_CLOCK_TIME_NONE){gst_element_query_position(pipeline->pipeline, GST_FORMAT_TIME, &position);}
-	    gub_log_pipeline(pipeline, "Setting basetime to %lldns + position %lldns", pipeline->basetime, position);
-	}
-	gst_element_set_base_time(pipeline->pipeline, pipeline->basetime+position); //pipeline->basetime+position);
+/* Must be called with sample_lock held */
+static gboolean is_new_frame(GUBPipeline *pipeline, GstSample *sample)
+{
+    GstBuffer *buffer = gst_sample_get_buffer(sample);
+
+    // The prerolled buffer is delivered again when the pipeline goes to PLAYING,
+    // and a polled sink keeps returning the same sample until a new one is rendered.
+    // Timestamps cannot tell frames apart, they repeat after a seek or a loop.
+    if (buffer == pipeline->seen_buffer) {
+        return FALSE;
+    }
+    gst_buffer_replace(&pipeline->seen_buffer, buffer);
+    pipeline->frame_seq++;
+    return TRUE;
+}
+
+/* Lets the graphic backend copy the frame towards the GPU on the streaming thread, so the
+render thread has less to do when gub_pipeline_blit_image picks it up */
+static void stage_sample(GUBPipeline *pipeline, GstSample *sample)
+{
+    g_mutex_lock(&pipeline->graphic_lock);
+    if (pipeline->graphic_context) {
+        gub_stage_image(pipeline->graphic_context, sample);
+    }
+    g_mutex_unlock(&pipeline->graphic_lock);
+}
+
+static void store_pending_sample(GUBPipeline *pipeline, GstSample *sample)
+{
+    gboolean repeated;
+
+    // In push mode only the streaming thread changes seen_buffer, so it is still valid below.
+    // Staging happens before the frame can be picked up, and outside sample_lock.
+    g_mutex_lock(&pipeline->sample_lock);
+    repeated = gst_sample_get_buffer(sample) == pipeline->seen_buffer;
+    g_mutex_unlock(&pipeline->sample_lock);
+    if (!repeated) {
+        stage_sample(pipeline, sample);
+    }
+
+    g_mutex_lock(&pipeline->sample_lock);
+    if (!is_new_frame(pipeline, sample)) {
+        g_mutex_unlock(&pipeline->sample_lock);
+        gst_sample_unref(sample);
+        return;
+    }
+    if (pipeline->pending_sample) {
+        // Never picked up by grab_frame: Unity is rendering slower than we decode
+        gst_sample_unref(pipeline->pending_sample);
+    }
+    pipeline->pending_sample = sample;
+    g_mutex_unlock(&pipeline->sample_lock);
+}
+
+static GstFlowReturn appsink_new_preroll(GstAppSink *appsink, GUBPipeline *pipeline)
+{
+    GstSample *sample = gst_app_sink_pull_preroll(appsink);
+    if (sample) {
+        store_pending_sample(pipeline, sample);
+    }
+    return GST_FLOW_OK;
+}
+
+/* Called as the sink renders each frame, so only in push mode. All players sharing basetime show position
+clock - basetime - latency, see finish_sync, so the difference is how far this one is behind. */
+static void measure_drift(GUBPipeline *pipeline, GstSample *sample)
+{
+    GstBuffer *buffer = gst_sample_get_buffer(sample);
+    GstSegment *segment = gst_sample_get_segment(sample);
+    GstClockTime position, latency, now;
+
+    if (!pipeline->net_clock || !buffer || !segment || !GST_BUFFER_PTS_IS_VALID(buffer)) {
+        return;
+    }
+    position = gst_segment_to_stream_time(segment, GST_FORMAT_TIME, GST_BUFFER_PTS(buffer));
+    if (!GST_CLOCK_TIME_IS_VALID(position)) {
+        return;
+    }
+    latency = gst_pipeline_get_latency(GST_PIPELINE(pipeline->pipeline));
+    if (!GST_CLOCK_TIME_IS_VALID(latency)) {
+        latency = 0;
+    }
+    now = gst_clock_get_time(pipeline->net_clock);
+
+    g_mutex_lock(&pipeline->sample_lock);
+    if (pipeline->synced) {
+        pipeline->drift_error_sum += GST_CLOCK_DIFF(position, now - pipeline->basetime - latency);
+        pipeline->drift_error_count++;
+    }
+    g_mutex_unlock(&pipeline->sample_lock);
+}
+
+static GstFlowReturn appsink_new_sample(GstAppSink *appsink, GUBPipeline *pipeline)
+{
+    GstSample *sample = gst_app_sink_pull_sample(appsink);
+    if (sample) {
+        measure_drift(pipeline, sample);
+        store_pending_sample(pipeline, sample);
+    }
+    return GST_FLOW_OK;
+}
+
+static void set_base_time_foreach(const GValue *item, gpointer base_time)
+{
+    gst_element_set_base_time(GST_ELEMENT(g_value_get_object(item)), *(GstClockTime *)base_time);
+}
+
+static void set_pipeline_base_time(GUBPipeline *pipeline, GstClockTime base_time)
+{
+    GstIterator *it;
+
+    gst_element_set_base_time(pipeline->pipeline, base_time);
+    // A running pipeline only hands its base time down on its next PAUSED to PLAYING change
+    it = gst_bin_iterate_recurse(GST_BIN(pipeline->pipeline));
+    while (gst_iterator_foreach(it, set_base_time_foreach, &base_time) == GST_ITERATOR_RESYNC) {
+        gst_iterator_resync(it);
+    }
+    gst_iterator_free(it);
+}
+
+/* Running time 0 maps to basetime + position on the network clock, so all players sharing basetime
+show the same frame at the same time. */
+static void finish_sync(GUBPipeline *pipeline, GstClockTime position)
+{
+    GUBClockSync *sync = pipeline->clock_sync;
+    GstClockTime basetime;
+
+    g_mutex_lock(&pipeline->sample_lock);
+    basetime = pipeline->basetime;
+    g_mutex_unlock(&pipeline->sample_lock);
+
+    gub_log_pipeline(pipeline, "Setting basetime to %lldns + position %lldns", basetime, position);
+    set_pipeline_base_time(pipeline, basetime + position);
+
+    // Disable GstPipeline automatic handling of basetime
+    gst_element_set_start_time(pipeline->pipeline, GST_CLOCK_TIME_NONE);
+    if (sync) {
+        g_mutex_lock(&sync->lock);
+        sync->seek_seqnum = GST_SEQNUM_INVALID;
+        clock_sync_drop_source(&sync->seek_timeout);
+        g_mutex_unlock(&sync->lock);
+    }
+
+    // The flushing seek also ended any rate correction, and frames rendered before it do not count
+    pipeline->drift_rate = 1.0;
+    g_mutex_lock(&pipeline->sample_lock);
+    pipeline->synced = TRUE;
+    pipeline->drift_error_sum = 0;
+    pipeline->drift_error_count = 0;
+    g_mutex_unlock(&pipeline->sample_lock);
+}
+
+static gboolean sync_seek_timed_out(GUBClockSync *sync);
+
+/* Seeks to where the synced session is by now. The base time is only set once the seek is done,
+when its ASYNC_DONE arrives, so that the bus is never held up waiting for it. */
+static void sync_video_position(GUBPipeline *pipeline)
+{
+    GUBClockSync *sync = pipeline->clock_sync;
+    GstClockTime current_time, basetime, target;
+    GstEvent *seek;
+    guint32 seqnum;
+    gboolean synced;
 
-	// Disable GstPipeline automatic handling of basetime
-	gst_element_set_start_time(pipeline->pipeline, GST_CLOCK_TIME_NONE);
-	pipeline->synced = TRUE;
+    g_mutex_lock(&pipeline->sample_lock);
+    synced = pipeline->synced;
+    basetime = pipeline->basetime;
+    g_mutex_unlock(&pipeline->sample_lock);
+
+    if (synced || !sync) {
+        return;
+    }
+
+    g_mutex_lock(&sync->lock);
+    if (!sync->pipeline || sync->seek_seqnum != GST_SEQNUM_INVALID) {
+        g_mutex_unlock(&sync->lock);
+        return;
+    }
+    current_time = gst_clock_get_time(pipeline->net_clock) + MAX_PIPELINE_DELAY_MS*GST_MSECOND;
+    if (current_time < basetime) {
+        g_mutex_unlock(&sync->lock);
+        gub_log_pipeline(pipeline, "ERROR: %lldns : %lldns", current_time, basetime);
+        finish_sync(pipeline, 0);
+        return;
+    }
+    target = sync->seek_target = current_time - basetime;
+    seek = gst_event_new_seek(1.0, GST_FORMAT_TIME, GST_SEEK_FLAG_FLUSH | GST_SEEK_FLAG_KEY_UNIT,
+        GST_SEEK_TYPE_SET, target, GST_SEEK_TYPE_NONE, GST_CLOCK_TIME_NONE);
+    seqnum = gst_event_get_seqnum(seek);
+    // Set before sending, the ASYNC_DONE can arrive before gst_element_send_event returns
+    sync->seek_seqnum = seqnum;
+    g_mutex_unlock(&sync->lock);
+
+    // Not with the lock held, flushing can take a while
+    if (!gst_element_send_event(pipeline->pipeline, seek)) {
+        gub_log_pipeline(pipeline, "Could not seek to %lldns", target);
+        finish_sync(pipeline, 0);
+        return;
+    }
+    gub_log_pipeline(pipeline, "Seeking to %lldns", target);
+
+    // Like the bus watch, on the default context, so it never runs alongside message_received
+    g_mutex_lock(&sync->lock);
+    if (sync->pipeline && sync->seek_seqnum == seqnum && !sync->seek_timeout) {
+        sync->seek_timeout = clock_sync_add_timeout(sync, SYNC_SEEK_TIMEOUT_MS, (GSourceFunc)sync_seek_timed_out);
+    }
+    g_mutex_unlock(&sync->lock);
+}
+
+/* Whether message is the ASYNC_DONE of the seek joining the session. Elements carry the seek's seqnum
+over to the ASYNC_DONE it causes. Not all of them do, and then the first ASYNC_DONE of the pipeline
+after the seek is the one. */
+static gboolean is_sync_seek_done(GUBPipeline *pipeline, GstMessage *message)
+{
+    GUBClockSync *sync = pipeline->clock_sync;
+    gboolean done;
+
+    if (!sync) {
+        return FALSE;
+    }
+    g_mutex_lock(&sync->lock);
+    done = sync->seek_seqnum != GST_SEQNUM_INVALID &&
+        (gst_message_get_seqnum(message) == sync->seek_seqnum ||
+         GST_MESSAGE_SRC(message) == GST_OBJECT(pipeline->pipeline));
+    g_mutex_unlock(&sync->lock);
+    return done;
+}
+
+/* The flushing seek has prerolled, so the position is known now */
+static void sync_seek_done(GUBPipeline *pipeline)
+{
+    GUBClockSync *sync = pipeline->clock_sync;
+    gint64 position = GST_CLOCK_TIME_NONE;
+
+    if (!gst_element_query_position(pipeline->pipeline, GST_FORMAT_TIME, &position) || position < 0) {
+        // KEY_UNIT might have moved it, but this is the best guess left
+        g_mutex_lock(&sync->lock);
+        position = sync->seek_target;
+        g_mutex_unlock(&sync->lock);
+    }
+    finish_sync(pipeline, position);
+}
+
+static gboolean sync_seek_timed_out(GUBClockSync *sync)
+{
+    GUBPipeline *pipeline = NULL;
+
+    g_mutex_lock(&sync->lock);
+    if (sync->seek_seqnum != GST_SEQNUM_INVALID) {
+        pipeline = clock_sync_enter(sync);
+    }
+    g_mutex_unlock(&sync->lock);
+    if (pipeline) {
+        gub_log_pipeline(pipeline, "Seek did not complete after %dms, taking the position anyway", SYNC_SEEK_TIMEOUT_MS);
+        sync_seek_done(pipeline);
+        clock_sync_leave(sync);
+    }
+    return G_SOURCE_REMOVE;
+}
+
+/* Plays slightly faster or slower without a seek. Needs instant rate changes (GStreamer 1.18) and
+demuxers supporting them. */
+static gboolean set_drift_rate(GUBPipeline *pipeline, gdouble rate)
+{
+#if GST_CHECK_VERSION(1, 18, 0)
+    GstEvent *seek = gst_event_new_seek(rate, GST_FORMAT_TIME, GST_SEEK_FLAG_INSTANT_RATE_CHANGE,
+        GST_SEEK_TYPE_NONE, 0, GST_SEEK_TYPE_NONE, 0);
+    return gst_element_send_event(pipeline->pipeline, seek);
+#else
+    return FALSE;
+#endif
+}
+
+/* Keeps a synced pipeline where the session is. Small errors change the playback rate until they
+are gone, or, where that is not possible, move the base time a little every check. Large ones seek. */
+static void correct_drift(GUBPipeline *pipeline)
+{
+    GstClockTimeDiff error = 0, step;
+    guint count;
+    gboolean active;
+    gdouble rate;
+
+    g_mutex_lock(&pipeline->sample_lock);
+    count = pipeline->drift_error_count;
+    active = pipeline->synced && pipeline->playing && count > 0;
+    if (active) {
+        error = pipeline->drift_error_sum / count;
+        if (ABS(error) > DRIFT_SEEK_THRESHOLD_MS * GST_MSECOND) {
+            // Stops measure_drift until the seek is done
+            pipeline->synced = FALSE;
+        }
+    }
+    pipeline->drift_error_sum = 0;
+    pipeline->drift_error_count = 0;
+    g_mutex_unlock(&pipeline->sample_lock);
+
+    if (!active) {
+        return;
+    }
+
+    if (ABS(error) > DRIFT_SEEK_THRESHOLD_MS * GST_MSECOND) {
+        gub_log_pipeline(pipeline, "Off by %lldns, seeking back into the session", error);
+        sync_video_position(pipeline);
+        return;
+    }
+
+    rate = 1.0;
+    if (ABS(error) > DRIFT_DEADBAND_MS * GST_MSECOND) {
+        rate += CLAMP((gdouble)error / (DRIFT_CORRECTION_S * GST_SECOND), -DRIFT_MAX_RATE_ADJUST, DRIFT_MAX_RATE_ADJUST);
+    }
+
+    if (!pipeline->drift_rate_unsupported) {
+        if (rate != pipeline->drift_rate) {
+            if (set_drift_rate(pipeline, rate)) {
+                gub_log_pipeline(pipeline, "Off by %lldns, playing at rate %g", error, rate);
+                pipeline->drift_rate = rate;
+            }
+            else {
+                gub_log_pipeline(pipeline, "Playback rate cannot be changed on the fly, moving the base time instead");
+                pipeline->drift_rate_unsupported = TRUE;
+            }
+        }
+        if (!pipeline->drift_rate_unsupported) {
+            return;
+        }
+    }
+
+    if (rate != 1.0) {
+        // No instant rate changes: the same correction, in one step per check. An earlier
+        // base time makes the sinks consider the next frames due sooner.
+        step = (GstClockTimeDiff)((rate - 1.0) * DRIFT_CHECK_INTERVAL_MS * GST_MSECOND);
+        gub_log_pipeline(pipeline, "Off by %lldns, moving base time by %lldns", error, -step);
+        set_pipeline_base_time(pipeline, gst_element_get_base_time(pipeline->pipeline) - step);
     }
 }
 
@@ -261,6 +1040,11 @@ static void message_received(GstBus *bus, GstMessage *message, GUBPipeline *pipe
 		}
 	    }
 	    break;
+	case GST_MESSAGE_ASYNC_DONE:
+	    if (is_sync_seek_done(pipeline, message)) {
+		sync_seek_done(pipeline);
+	    }
+	    break;
     }
 }
 
@@ -280,7 +1064,9 @@ static GstPadProbeReturn pad_probe(GstPad *pad, GstPadProbeInfo *info, gpointer
 
     gst_query_parse_context_type(query, &context_type);
 
+    g_mutex_lock(&pipeline->graphic_lock);
     context = gub_provide_graphic_context(pipeline->graphic_context, context_type);
+    g_mutex_unlock(&pipeline->graphic_lock);
     if (context) {
         gst_query_set_context(query, context);
         ret = GST_PAD_PROBE_HANDLED;
@@ -292,9 +1078,18 @@ beach:
     return ret;
 }
 
-EXPORT_API void gub_pipeline_setup_decoding_clock(GUBPipeline *pipeline, const gchar *uri, int video_index, int audio_index,
-    const gchar *net_clock_addr, int net_clock_port, guint64 basetime,
-    float crop_left, float crop_top, float crop_right, float crop_bottom, gboolean isDvbWc)
+EXPORT_API void gub_pipeline_set_video_upload_mode(GUBPipeline *pipeline, gint32 mode)
+{
+    if (mode != GUB_VIDEO_UPLOAD_RGB && mode != GUB_VIDEO_UPLOAD_PLANAR_YUV && mode != GUB_VIDEO_UPLOAD_GL_MEMORY) {
+        gub_log_pipeline(pipeline, "Unknown video upload mode %d", mode);
+        return;
+    }
+    pipeline->video_upload_mode = (GUBVideoUploadMode)mode;
+}
+
+EXPORT_API void gub_pipeline_setup_decoding_clock_uri(GUBPipeline *pipeline, const gchar *uri, int video_index, int audio_index,
+    const gchar *clock_uri, guint64 basetime,
+    float crop_left, float crop_top, float crop_right, float crop_bottom)
 {
     GError *err = NULL;
     GstElement *vsink;
@@ -315,8 +1110,8 @@ EXPORT_API void gub_pipeline_setup_decoding_clock(GUBPipeline *pipeline, const g
         return;
     }
 
-    vsink = gst_parse_bin_from_description(gub_get_video_branch_description(), TRUE, NULL);
-    gub_log_pipeline(pipeline, "Using video sink: %s", gub_get_video_branch_description());
+    vsink = gst_parse_bin_from_description(gub_get_video_branch_description(pipeline->video_upload_mode), TRUE, NULL);
+    gub_log_pipeline(pipeline, "Using video sink: %s", gub_get_video_branch_description(pipeline->video_upload_mode));
     g_object_set(pipeline->pipeline, "video-sink", vsink, NULL);
     g_object_set(pipeline->pipeline, "flags", 0x0003, NULL);
 
@@ -336,13 +1131,24 @@ EXPORT_API void gub_pipeline_setup_decoding_clock(GUBPipeline *pipeline, const g
                 gub_log_pipeline(pipeline, "Sink pad probe id is %d", id);
                 gst_object_unref(pad);
             }
-            gst_object_unref(sink);
+            // An appsink hands us every frame as soon as it is rendered, so grab_frame
+            // does not need to poll the sink's "last-sample"
+            if (GST_IS_APP_SINK(sink)) {
+                GstAppSinkCallbacks callbacks = { NULL,
+                    (GstFlowReturn(*)(GstAppSink *, gpointer))appsink_new_preroll,
+                    (GstFlowReturn(*)(GstAppSink *, gpointer))appsink_new_sample };
+                gst_app_sink_set_callbacks(GST_APP_SINK(sink), &callbacks, pipeline, NULL);
+                pipeline->push_mode = TRUE;
+            }
+            // Keep the reference, so grab_frame does not need to look the sink up every frame
+            pipeline->sink = sink;
         }
     }
+    gub_log_pipeline(pipeline, "Video frames are %s", pipeline->push_mode ? "pushed by the sink" : "polled from the sink");
 
     // If the video branch does not have a "videocrop" element, we assume this graphic backend
     // is doing cropping during blitting.
-    if (g_strstr_len(gub_get_video_branch_description(), -1, "videocrop") == NULL) {
+    if (g_strstr_len(gub_get_video_branch_description(pipeline->video_upload_mode), -1, "videocrop") == NULL) {
         pipeline->supports_cropping_blit = TRUE;
     }
     gub_log_pipeline(pipeline, "Video branch %s cropping and blitting in one operation",
@@ -361,46 +1167,52 @@ EXPORT_API void gub_pipeline_setup_decoding_clock(GUBPipeline *pipeline, const g
 
     g_signal_connect(pipeline->pipeline, "source-setup", G_CALLBACK(source_created), pipeline);
 
-    if (net_clock_addr != NULL) {
-        gint64 start, stop;
-        gub_log_pipeline(pipeline, "Trying to synchronize to network clock at %s %d", net_clock_addr, net_clock_port);
-	    if (isDvbWc == FALSE) {
-		pipeline->net_clock = gst_net_client_clock_new("net_clock", net_clock_addr, net_clock_port, 0);
-	    }
-	    else{
-		pipeline->net_clock = gst_dvb_css_wc_client_clock_new("dvb_clock", net_clock_addr, net_clock_port, 0);
-	    }
+    if (clock_uri != NULL && *clock_uri) {
+        gub_log_pipeline(pipeline, "Trying to synchronize to network clock %s", clock_uri);
+        pipeline->net_clock = gub_clock_new("net_clock", clock_uri);
         if (!pipeline->net_clock) {
-            gub_log_pipeline(pipeline, "Could not create network clock at %s %d", net_clock_addr, net_clock_port);
+            gub_log_pipeline(pipeline, "Could not create network clock %s", clock_uri);
             return;
         }
 
-	gint64 current_time = gst_clock_get_time(pipeline->net_clock);
-	gub_log_pipeline(pipeline, "CURRENT_TIME: %lldns", current_time);
-	current_time = gst_clock_get_internal_time(pipeline->net_clock);
-	gub_log_pipeline(pipeline, "INTERNAL_TIME: %lldns", current_time);
-	
-        start = g_get_monotonic_time();
-        gst_clock_wait_for_sync(pipeline->net_clock, 30 * GST_SECOND);
-        stop = g_get_monotonic_time();
-        if (gst_clock_is_synced(pipeline->net_clock)) {
-            gub_log_pipeline(pipeline, "Synchronized to network clock in %g seconds", (stop - start) / 1e6);
-        }
-        else {
-            gub_log_pipeline(pipeline, "Could not synchronize to network clock after %g seconds", (stop - start) / 1e6);
-        }
-	
-	current_time = gst_clock_get_time(pipeline->net_clock);
-	gub_log_pipeline(pipeline, "CURRENT_TIME2: %lldns", current_time);
-	current_time = gst_clock_get_internal_time(pipeline->net_clock);
-	gub_log_pipeline(pipeline, "INTERNAL_TIME2: %lldns", current_time);
+        // Do not hold up the caller (Unity's main thread) while the clock synchronizes,
+        // grab_frame only starts playback once it has
+        clock_sync_start(pipeline, pipeline->net_clock);
 
         gst_pipeline_use_clock(GST_PIPELINE(pipeline->pipeline), pipeline->net_clock);
         gst_pipeline_set_latency(GST_PIPELINE(pipeline->pipeline), MAX_PIPELINE_DELAY_MS * GST_MSECOND);
     }
     
+    g_mutex_lock(&pipeline->sample_lock);
     pipeline->basetime = basetime;
     pipeline->synced = (basetime == 0);
+    g_mutex_unlock(&pipeline->sample_lock);
+}
+
+EXPORT_API void gub_pipeline_setup_decoding_clock(GUBPipeline *pipeline, const gchar *uri, int video_index, int audio_index,
+    const gchar *net_clock_addr, int net_clock_port, guint64 basetime,
+    float crop_left, float crop_top, float crop_right, float crop_bottom, gboolean isDvbWc)
+{
+    gchar *clock_uri = NULL;
+
+    if (net_clock_addr != NULL) {
+        // IPv6 addresses need brackets to be told apart from the port
+        gboolean ipv6 = g_strstr_len(net_clock_addr, -1, ":") != NULL;
+        clock_uri = g_strdup_printf("%s://%s%s%s:%d", isDvbWc ? "dvbcsswc" : "gstnet",
+            ipv6 ? "[" : "", net_clock_addr, ipv6 ? "]" : "", net_clock_port);
+    }
+    gub_pipeline_setup_decoding_clock_uri(pipeline, uri, video_index, audio_index, clock_uri, basetime,
+        crop_left, crop_top, crop_right, crop_bottom);
+    g_free(clock_uri);
+}
+
+EXPORT_API gint32 gub_pipeline_get_clock_quality(GUBPipeline *pipeline, gint64 *error_estimate)
+{
+    *error_estimate = -1;
+    if (!pipeline || !pipeline->net_clock) {
+        return 0;
+    }
+    return gub_clock_get_sync_quality(pipeline->net_clock, error_estimate);
 }
 
 EXPORT_API void gub_pipeline_setup_decoding(GUBPipeline *pipeline, const gchar *uri, int video_index, int audio_index,
@@ -411,23 +1223,29 @@ EXPORT_API void gub_pipeline_setup_decoding(GUBPipeline *pipeline, const gchar *
 }
 
 EXPORT_API gint32 gub_pipeline_grab_frame(GUBPipeline *pipeline, int *width, int *height)
+{
+    guint64 frame_seq;
+    return gub_pipeline_grab_frame_ex(pipeline, width, height, &frame_seq);
+}
+
+EXPORT_API gint32 gub_pipeline_grab_frame_ex(GUBPipeline *pipeline, int *width, int *height, guint64 *frame_seq)
 {
     //GST_DEBUG_BIN_TO_DOT_FILE((GstBin*)pipeline->pipeline, GST_DEBUG_GRAPH_SHOW_ALL, "pipeline");
-    GstElement *sink = gst_bin_get_by_name(GST_BIN(pipeline->pipeline), "sink");
     GstCaps *last_caps = NULL;
-    GstVideoInfo info;
 
     if (!pipeline->graphic_context) {
-        pipeline->graphic_context = gub_create_graphic_context(
+        GUBGraphicContext *graphic_context = gub_create_graphic_context(
             GST_PIPELINE(pipeline->pipeline),
             pipeline->video_crop_left, pipeline->video_crop_top, pipeline->video_crop_right, pipeline->video_crop_bottom);
+        g_mutex_lock(&pipeline->graphic_lock);
+        pipeline->graphic_context = graphic_context;
+        g_mutex_unlock(&pipeline->graphic_lock);
     }
 
-    if (pipeline->playing == FALSE && pipeline->play_requested == TRUE) {
+    if (clock_sync_is_over(pipeline) && claim_play_transition(pipeline)) {
         gub_log_pipeline(pipeline, "Setting pipeline to PLAYING");
         gst_element_set_state(GST_ELEMENT(pipeline->pipeline), GST_STATE_PLAYING);
         gub_log_pipeline(pipeline, "State change completed");
-        pipeline->playing = TRUE;
     }
 
     if (pipeline->last_sample) {
@@ -435,29 +1253,62 @@ EXPORT_API gint32 gub_pipeline_grab_frame(GUBPipeline *pipeline, int *width, int
         pipeline->last_sample = NULL;
     }
 
-    if (!sink) {
-     //   gub_log_pipeline(pipeline, "Pipeline does not contain a sink named 'sink'");
-        return 0;
+    if (pipeline->push_mode) {
+        // Cheap check: only take the sample if the sink delivered a new one since last time
+        g_mutex_lock(&pipeline->sample_lock);
+        pipeline->last_sample = pipeline->pending_sample;
+        pipeline->pending_sample = NULL;
+        *frame_seq = pipeline->frame_seq;
+        g_mutex_unlock(&pipeline->sample_lock);
+        if (!pipeline->last_sample) {
+            return 0;
+        }
     }
+    else {
+        gboolean new_frame;
+        if (!pipeline->sink) {
+         //   gub_log_pipeline(pipeline, "Pipeline does not contain a sink named 'sink'");
+            return 0;
+        }
 
-    g_object_get(sink, "last-sample", &pipeline->last_sample, NULL);
-    gst_object_unref(sink);
-    if (!pipeline->last_sample) {
-      //  gub_log_pipeline(pipeline, "Could not read property 'last-sample' from sink %s",
-        //    gst_plugin_feature_get_name(gst_element_get_factory(sink)));
-        return 0;
+        g_object_get(pipeline->sink, "last-sample", &pipeline->last_sample, NULL);
+        if (!pipeline->last_sample) {
+          //  gub_log_pipeline(pipeline, "Could not read property 'last-sample' from sink %s",
+            //    gst_plugin_feature_get_name(gst_element_get_factory(pipeline->sink)));
+            return 0;
+        }
+
+        g_mutex_lock(&pipeline->sample_lock);
+        new_frame = is_new_frame(pipeline, pipeline->last_sample);
+        *frame_seq = pipeline->frame_seq;
+        g_mutex_unlock(&pipeline->sample_lock);
+        if (!new_frame) {
+            // Same frame as last time, nothing to upload
+            gst_sample_unref(pipeline->last_sample);
+            pipeline->last_sample = NULL;
+            return 0;
+        }
     }
 
     last_caps = gst_sample_get_caps(pipeline->last_sample);
     if (!last_caps) {
-        gub_log_pipeline(pipeline, "Sample contains no caps in sink %s",
-            gst_plugin_feature_get_name(gst_element_get_factory(sink)));
+        gub_log_pipeline(pipeline, "Sample contains no caps");
         gst_sample_unref(pipeline->last_sample);
         pipeline->last_sample = NULL;
         return 0;
     }
 
-    gst_video_info_from_caps(&info, last_caps);
+    // Samples share the sink's current caps object, so a different pointer means a caps change
+    if (last_caps != pipeline->video_caps) {
+        gst_caps_replace(&pipeline->video_caps, last_caps);
+        if (!gst_video_info_from_caps(&pipeline->video_info, last_caps)) {
+            gub_log_pipeline(pipeline, "Could not parse video caps");
+            gst_caps_replace(&pipeline->video_caps, NULL);
+            gst_sample_unref(pipeline->last_sample);
+            pipeline->last_sample = NULL;
+            return 0;
+        }
+    }
 
 #if 0
     // Uncomment to have some timing debug information
@@ -473,12 +1324,12 @@ EXPORT_API gint32 gub_pipeline_grab_frame(GUBPipeline *pipeline, int *width, int
 #endif
 
     if (pipeline->supports_cropping_blit) {
-        *width = (int)(info.width  * (1 - pipeline->video_crop_left - pipeline->video_crop_right));
-        *height = (int)(info.height * (1 - pipeline->video_crop_top - pipeline->video_crop_bottom));
+        *width = (int)(pipeline->video_info.width  * (1 - pipeline->video_crop_left - pipeline->video_crop_right));
+        *height = (int)(pipeline->video_info.height * (1 - pipeline->video_crop_top - pipeline->video_crop_bottom));
     }
     else {
-        *width = info.width;
-        *height = info.height;
+        *width = pipeline->video_info.width;
+        *height = pipeline->video_info.height;
     }
 
     return 1;
@@ -495,30 +1346,82 @@ EXPORT_API void gub_pipeline_blit_image(GUBPipeline *pipeline, void *_TextureNat
         return;
     }
 
-    gub_blit_image(pipeline->graphic_context, pipeline->last_sample, _TextureNativePtr);
+    gub_blit_image(pipeline->graphic_context, pipeline->last_sample, &pipeline->video_info, _TextureNativePtr);
 
     gst_sample_unref(pipeline->last_sample);
     pipeline->last_sample = NULL;
 }
 
-GstEncodingProfile * gub_pipeline_create_mp4_h264_profile(void)
+static GstEncodingProfile *create_encoding_profile(GUBPipeline *pipeline, const gchar *container_caps_description, const gchar *video_caps_description)
 {
     GstEncodingContainerProfile *prof;
+    GstEncodingVideoProfile *video_prof;
     GstCaps *caps;
 
-    caps = gst_caps_from_string("video/quicktime,variant=iso");
-    prof = gst_encoding_container_profile_new("mp4/H.264", "Standard mp4/H.264", caps, NULL);
+    caps = gst_caps_from_string(container_caps_description);
+    if (!caps) {
+        gub_log_pipeline(pipeline, "Could not parse container caps '%s'", container_caps_description);
+        return NULL;
+    }
+    prof = gst_encoding_container_profile_new("gub", "GUB capture", caps, NULL);
     gst_caps_unref(caps);
 
-    caps = gst_caps_from_string("video/x-h264,profile=main");
-    gst_encoding_container_profile_add_profile(prof, (GstEncodingProfile*)gst_encoding_video_profile_new(caps, NULL, NULL, 0));
+    caps = gst_caps_from_string(video_caps_description);
+    if (!caps) {
+        gub_log_pipeline(pipeline, "Could not parse video caps '%s'", video_caps_description);
+        gst_encoding_profile_unref(prof);
+        return NULL;
+    }
+    video_prof = gst_encoding_video_profile_new(caps, NULL, NULL, 0);
+    gst_encoding_container_profile_add_profile(prof, (GstEncodingProfile*)video_prof);
     gst_caps_unref(caps);
 
+    gub_log_pipeline(pipeline, "Encoding to %s in %s", video_caps_description, container_caps_description);
     return (GstEncodingProfile*)prof;
 }
 
+static void apply_encoder_settings(GstBin *bin, GstBin *sub_bin, GstElement *element, GUBPipeline *pipeline)
+{
+    GstElementFactory *factory = gst_element_get_factory(element);
+    const gchar *target;
+    gint i;
+
+    if (!factory || !pipeline->encoder_settings) return;
+
+    target = gst_structure_get_name(pipeline->encoder_settings);
+    if (g_strcmp0(target, "encoder") == 0) {
+        if (!gst_element_factory_list_is_type(factory, GST_ELEMENT_FACTORY_TYPE_ENCODER | GST_ELEMENT_FACTORY_TYPE_MEDIA_VIDEO))
+            return;
+    }
+    else if (g_strcmp0(target, gst_plugin_feature_get_name(GST_PLUGIN_FEATURE(factory))) != 0) {
+        return;
+    }
+
+    for (i = 0; i < gst_structure_n_fields(pipeline->encoder_settings); i++) {
+        const gchar *field = gst_structure_nth_field_name(pipeline->encoder_settings, i);
+        const GValue *value = gst_structure_get_value(pipeline->encoder_settings, field);
+        // Let the property type decide how to parse the value, so enums can be given by nick
+        gchar *str = G_VALUE_HOLDS_STRING(value) ? g_value_dup_string(value) : gst_value_serialize(value);
+
+        if (g_object_class_find_property(G_OBJECT_GET_CLASS(element), field)) {
+            gub_log_pipeline(pipeline, "Setting %s %s=%s", GST_ELEMENT_NAME(element), field, str);
+            gst_util_set_object_arg(G_OBJECT(element), field, str);
+        }
+        else {
+            gub_log_pipeline(pipeline, "Encoder %s has no property '%s'", GST_ELEMENT_NAME(element), field);
+        }
+        g_free(str);
+    }
+}
+
 EXPORT_API void gub_pipeline_setup_encoding(GUBPipeline *pipeline, const gchar *filename,
     int width, int height)
+{
+    gub_pipeline_setup_encoding_with_profile(pipeline, filename, width, height, NULL, NULL, NULL);
+}
+
+EXPORT_API void gub_pipeline_setup_encoding_with_profile(GUBPipeline *pipeline, const gchar *filename,
+    int width, int height, const gchar *container_caps, const gchar *video_caps, const gchar *encoder_settings)
 {
     GError *err = NULL;
     GstElement *encodebin, *filesink;
@@ -526,6 +1429,8 @@ EXPORT_API void gub_pipeline_setup_encoding(GUBPipeline *pipeline, const gchar *
     gchar *raw_caps_description = NULL;
     GstBus *bus = NULL;
     GstPad *encodebin_sink_pad = NULL, *appsrc_src_pad = NULL;
+    GstStructure *config;
+    GstEncodingProfile *profile;
 
     if (pipeline->pipeline) {
         gub_pipeline_close(pipeline);
@@ -535,25 +1440,55 @@ EXPORT_API void gub_pipeline_setup_encoding(GUBPipeline *pipeline, const gchar *
     pipeline->video_width = width;
     pipeline->video_height = height;
 
-    raw_caps_description = g_strdup_printf("video/x-raw,format=RGBA,width=%d,height=%d", width, height);
+    // Captured images are converted to I420 while they are flipped, so the encoder does not need to convert them.
+    // I420 cannot represent odd sizes, though.
+    raw_caps_description = g_strdup_printf("video/x-raw,format=%s,width=%d,height=%d",
+        (width % 2 == 0 && height % 2 == 0) ? "I420" : "RGBA", width, height);
     raw_caps = gst_caps_from_string(raw_caps_description);
     gub_log_pipeline(pipeline, "Using video caps: %s", raw_caps_description);
     g_free(raw_caps_description);
+    gst_video_info_from_caps(&pipeline->video_info, raw_caps);
+    gst_caps_replace(&pipeline->video_caps, raw_caps);
+
+    pipeline->buffer_pool = gst_video_buffer_pool_new();
+    config = gst_buffer_pool_get_config(pipeline->buffer_pool);
+    gst_buffer_pool_config_set_params(config, raw_caps, (guint)GST_VIDEO_INFO_SIZE(&pipeline->video_info), ENCODING_POOL_MIN_BUFFERS, 0);
+    if (!gst_buffer_pool_set_config(pipeline->buffer_pool, config) || !gst_buffer_pool_set_active(pipeline->buffer_pool, TRUE)) {
+        gub_log_pipeline(pipeline, "Could not set up buffer pool, captured frames will be allocated one by one");
+        gst_object_unref(pipeline->buffer_pool);
+        pipeline->buffer_pool = NULL;
+    }
 
     pipeline->appsrc = GST_APP_SRC(gst_element_factory_make("appsrc", "source"));
     gub_log_pipeline(pipeline, "Using appsrc: %p", pipeline->appsrc);
     gst_app_src_set_caps(pipeline->appsrc, raw_caps);
     g_object_set(pipeline->appsrc,
         "stream-type", 0,
-        "max-bytes", width*height * 4 * 10,
+        "max-bytes", (guint64)GST_VIDEO_INFO_SIZE(&pipeline->video_info) * 10,
         "is-live", TRUE,
-        "do-timestamp", TRUE,
         "format", GST_FORMAT_TIME,
         "min-latency", 0, NULL);
 
+    if (encoder_settings && *encoder_settings) {
+        pipeline->encoder_settings = gst_structure_from_string(encoder_settings, NULL);
+        if (!pipeline->encoder_settings) {
+            gub_log_pipeline(pipeline, "Could not parse encoder settings '%s'", encoder_settings);
+        }
+    }
+
+    profile = create_encoding_profile(pipeline,
+        container_caps && *container_caps ? container_caps : DEFAULT_CONTAINER_CAPS,
+        video_caps && *video_caps ? video_caps : DEFAULT_VIDEO_CAPS);
+    if (!profile) {
+        profile = create_encoding_profile(pipeline, DEFAULT_CONTAINER_CAPS, DEFAULT_VIDEO_CAPS);
+    }
+
     encodebin = gst_element_factory_make("encodebin", NULL);
     gub_log_pipeline(pipeline, "Using encodebin: %p", encodebin);
-    g_object_set(encodebin, "profile", gub_pipeline_create_mp4_h264_profile(), NULL);
+    g_object_set(encodebin, "profile", profile, NULL);
+    gst_encoding_profile_unref(profile);
+    // encodebin creates the encoder when the pad is requested
+    g_signal_connect(encodebin, "deep-element-added", G_CALLBACK(apply_encoder_settings), pipeline);
     g_signal_emit_by_name(encodebin, "request-pad", raw_caps, &encodebin_sink_pad);
     gub_log_pipeline(pipeline, "Using encodebin_sink_pad: %p", encodebin_sink_pad);
 
@@ -571,35 +1506,168 @@ EXPORT_API void gub_pipeline_setup_encoding(GUBPipeline *pipeline, const gchar *
     gst_bus_add_signal_watch(bus);
     gst_object_unref(bus);
     g_signal_connect(bus, "message", G_CALLBACK(message_received), pipeline);
+
+    gst_caps_unref(raw_caps);
 }
 
-EXPORT_API void gub_pipeline_consume_image(GUBPipeline *pipeline, guint8 *rawdata, int size)
+/* Running time at which an image handed over at submitted was captured. Must be called with
+capture_lock held, so that timestamps keep going forward in the order images are pushed. */
+static GstClockTime capture_timestamp(GUBPipeline *pipeline, gint64 submitted)
+{
+    GstClockTime timestamp = 0;
+    GstClock *clock = gst_element_get_clock(pipeline->pipeline);
+
+    // Before PLAYING there is no clock, and those images go at the very start
+    if (clock) {
+        GstClockTime now = gst_clock_get_time(clock) - gst_element_get_base_time(pipeline->pipeline);
+        GstClockTime age = (GstClockTime)MAX(g_get_monotonic_time() - submitted, 0) * GST_USECOND;
+        timestamp = now > age ? now - age : 0;
+        gst_object_unref(clock);
+    }
+    if (GST_CLOCK_TIME_IS_VALID(pipeline->capture_last_pts) && timestamp <= pipeline->capture_last_pts) {
+        timestamp = pipeline->capture_last_pts + 1;
+    }
+    pipeline->capture_last_pts = timestamp;
+    return timestamp;
+}
+
+/* Converts a captured image into a buffer, stamps it and pushes it into the encoding pipeline */
+static void push_captured_image(GUBPipeline *pipeline, guint8 *rawdata, int size, gint64 submitted)
 {
-    GstBuffer *buffer = gst_buffer_new_allocate(NULL, size, NULL);
-    GstMapInfo mi;
-    int line;
-    int stride = pipeline->video_width * 4;
+    GstBuffer *buffer;
+    GstVideoFrame video_frame;
 
-    gst_buffer_map(buffer, &mi, GST_MAP_WRITE);
-    for (line = 0; line < pipeline->video_height; line++)
-    {
-        memcpy(mi.data + line * stride, rawdata + (pipeline->video_height - 1 - line) * stride, stride);
+    if (!pipeline->appsrc) {
+        gub_log_pipeline(pipeline, "Pipeline is not set up for encoding");
+        return;
+    }
+    if (size < pipeline->video_width * pipeline->video_height * 4) {
+        gub_log_pipeline(pipeline, "Captured image is too small: %d bytes for %dx%d", size, pipeline->video_width, pipeline->video_height);
+        return;
+    }
+
+    buffer = NULL;
+    if (pipeline->buffer_pool) {
+        gst_buffer_pool_acquire_buffer(pipeline->buffer_pool, &buffer, NULL);
+    }
+    if (!buffer) {
+        buffer = gst_buffer_new_allocate(NULL, GST_VIDEO_INFO_SIZE(&pipeline->video_info), NULL);
     }
-    gst_buffer_unmap(buffer, &mi);
+    gst_video_frame_map(&video_frame, &pipeline->video_info, buffer, GST_MAP_WRITE);
+    gub_convert_rgba_flipped(rawdata, pipeline->video_width, pipeline->video_height, &video_frame);
+    gst_video_frame_unmap(&video_frame);
 
-    if (pipeline->playing == FALSE && pipeline->play_requested == TRUE) {
+    // Images from gub_pipeline_consume_image and from the worker are serialized here
+    g_mutex_lock(&pipeline->capture_lock);
+    if (claim_play_transition(pipeline)) {
         gub_log_pipeline(pipeline, "Setting pipeline to PLAYING");
         gst_element_set_state(GST_ELEMENT(pipeline->pipeline), GST_STATE_PLAYING);
         gub_log_pipeline(pipeline, "State change completed");
-        pipeline->playing = TRUE;
     }
-
+    GST_BUFFER_PTS(buffer) = capture_timestamp(pipeline, submitted);
     gst_app_src_push_buffer(pipeline->appsrc, buffer);
+    g_mutex_unlock(&pipeline->capture_lock);
+}
+
+EXPORT_API void gub_pipeline_consume_image(GUBPipeline *pipeline, guint8 *rawdata, int size)
+{
+    push_captured_image(pipeline, rawdata, size, g_get_monotonic_time());
+}
+
+static gpointer capture_thread_func(GUBPipeline *pipeline)
+{
+    g_mutex_lock(&pipeline->capture_lock);
+    while (TRUE) {
+        GUBCaptureRequest *request;
+
+        while (g_queue_is_empty(&pipeline->capture_queue) && !pipeline->capture_stopping) {
+            g_cond_wait(&pipeline->capture_cond, &pipeline->capture_lock);
+        }
+        request = g_queue_pop_head(&pipeline->capture_queue);
+        if (!request) break;
+        pipeline->capture_busy = TRUE;
+        // Producers blocked on a full queue can go on
+        g_cond_broadcast(&pipeline->capture_cond);
+        g_mutex_unlock(&pipeline->capture_lock);
+
+        push_captured_image(pipeline, request->rawdata, request->size, request->submitted);
+        release_capture_request(request);
+
+        g_mutex_lock(&pipeline->capture_lock);
+        pipeline->capture_busy = FALSE;
+        g_cond_broadcast(&pipeline->capture_cond);
+    }
+    g_mutex_unlock(&pipeline->capture_lock);
+    return NULL;
+}
+
+EXPORT_API gint32 gub_pipeline_consume_image_async(GUBPipeline *pipeline, guint8 *rawdata, int size,
+    GUBPipelineOnImageReleasedPFN release_handler, void *release_userdata)
+{
+    GUBCaptureRequest *request = g_new0(GUBCaptureRequest, 1);
+    GUBCaptureRequest *dropped = NULL;
+
+    request->rawdata = rawdata;
+    request->size = size;
+    request->release_handler = release_handler;
+    request->release_userdata = release_userdata;
+    // The image might reach appsrc much later, the worker stamps it back to this moment
+    request->submitted = g_get_monotonic_time();
+
+    g_mutex_lock(&pipeline->capture_lock);
+    if (!pipeline->capture_thread) {
+        pipeline->capture_stopping = FALSE;
+        pipeline->capture_thread = g_thread_new("gub-capture", (GThreadFunc)capture_thread_func, pipeline);
+    }
+    if (pipeline->capture_policy == GUB_CAPTURE_BLOCK) {
+        while (g_queue_get_length(&pipeline->capture_queue) >= pipeline->capture_max_pending && !pipeline->capture_stopping) {
+            g_cond_wait(&pipeline->capture_cond, &pipeline->capture_lock);
+        }
+    }
+    else if (g_queue_get_length(&pipeline->capture_queue) >= pipeline->capture_max_pending) {
+        dropped = g_queue_pop_head(&pipeline->capture_queue);
+        pipeline->captures_dropped++;
+    }
+    g_queue_push_tail(&pipeline->capture_queue, request);
+    g_cond_broadcast(&pipeline->capture_cond);
+    g_mutex_unlock(&pipeline->capture_lock);
+
+    if (dropped) {
+        release_capture_request(dropped);
+        return 0;
+    }
+    return 1;
+}
+
+EXPORT_API void gub_pipeline_set_capture_queue(GUBPipeline *pipeline, int max_pending, gint32 policy)
+{
+    g_mutex_lock(&pipeline->capture_lock);
+    pipeline->capture_max_pending = MAX(max_pending, 1);
+    pipeline->capture_policy = policy == GUB_CAPTURE_BLOCK ? GUB_CAPTURE_BLOCK : GUB_CAPTURE_DROP_OLDEST;
+    g_cond_broadcast(&pipeline->capture_cond);
+    g_mutex_unlock(&pipeline->capture_lock);
+}
+
+EXPORT_API guint64 gub_pipeline_get_dropped_captures(GUBPipeline *pipeline)
+{
+    guint64 dropped;
+
+    g_mutex_lock(&pipeline->capture_lock);
+    dropped = pipeline->captures_dropped;
+    g_mutex_unlock(&pipeline->capture_lock);
+    return dropped;
 }
 
 EXPORT_API void gub_pipeline_stop_encoding(GUBPipeline *pipeline)
 {
     if (pipeline && pipeline->appsrc != NULL) {
+        // Images already handed over must be encoded before the end of the stream
+        g_mutex_lock(&pipeline->capture_lock);
+        while (!g_queue_is_empty(&pipeline->capture_queue) || pipeline->capture_busy) {
+            g_cond_wait(&pipeline->capture_cond, &pipeline->capture_lock);
+        }
+        g_mutex_unlock(&pipeline->capture_lock);
+
         gst_app_src_end_of_stream(pipeline->appsrc);
     }
 }
@@ -29,12 +29,24 @@ typedef void(*GUBPipelineOnErrorPFN)(GUBPipeline *userdata, char *message);
 typedef void(*GUBPipelineOnQosPFN)(GUBPipeline *userdata,
     gint64 current_jitter, guint64 current_running_time, guint64 current_stream_time, guint64 current_timestamp,
     gdouble proportion, guint64 processed, guint64 dropped);
+/* Called from the GStreamer thread once the network clock is good enough to play (synced=1),
+or when it could not be synchronized in time (synced=0). Playback waits for this either way. */
+typedef void(*GUBPipelineOnClockSyncPFN)(GUBPipeline *userdata, gint32 synced);
+
+/* Called from the capture worker thread once an image given to gub_pipeline_consume_image_async is no longer needed */
+typedef void(*GUBPipelineOnImageReleasedPFN)(void *userdata, guint8 *rawdata);
+
+/* What gub_pipeline_consume_image_async does when the encoder cannot keep up */
+typedef enum {
+    GUB_CAPTURE_DROP_OLDEST = 0,    /* Release the oldest pending image without encoding it */
+    GUB_CAPTURE_BLOCK = 1           /* Wait until the worker takes a pending image */
+} GUBCaptureQueuePolicy;
 
 void gub_log_pipeline(GUBPipeline *pipeline, const char *format, ...);
 
 EXPORT_API void *gub_pipeline_create(const char *name,
     GUBPipelineOnEosPFN eos_handler, GUBPipelineOnErrorPFN error_handler, GUBPipelineOnQosPFN qos_handler,
-    void *userdata);
+    GUBPipelineOnClockSyncPFN clock_sync_handler, void *userdata);
 
 EXPORT_API void gub_pipeline_close(GUBPipeline *pipeline);
 
@@ -56,23 +68,62 @@ EXPORT_API double gub_pipeline_get_position(GUBPipeline *pipeline);
 
 EXPORT_API void gub_pipeline_set_position(GUBPipeline *pipeline, double position);
 
+/* How decoded frames reach the texture, a GUBVideoUploadMode. Applies from the next gub_pipeline_setup_decoding*. */
+EXPORT_API void gub_pipeline_set_video_upload_mode(GUBPipeline *pipeline, gint32 mode);
+
+/* Returns straight away. With a network clock, playback starts once the clock has synchronized,
+which is reported through the clock_sync_handler given to gub_pipeline_create. */
 EXPORT_API void gub_pipeline_setup_decoding_clock(GUBPipeline *pipeline, const gchar *uri, int video_index, int audio_index,
     const gchar *net_clock_addr, int net_clock_port, guint64 basetime,
     float crop_left, float crop_top, float crop_right, float crop_bottom, gboolean isDvbWc);
 
+/* Like gub_pipeline_setup_decoding_clock, with the network clock given as a URI (see gub_clock_new),
+e.g. "ptp://0" or "ntp://pool.ntp.org". NULL or empty for no network clock. */
+EXPORT_API void gub_pipeline_setup_decoding_clock_uri(GUBPipeline *pipeline, const gchar *uri, int video_index, int audio_index,
+    const gchar *clock_uri, guint64 basetime,
+    float crop_left, float crop_top, float crop_right, float crop_bottom);
+
+/* Returns whether the network clock is synced and, in error_estimate, how far off it might be
+in nanoseconds (-1 if unknown or there is no network clock) */
+EXPORT_API gint32 gub_pipeline_get_clock_quality(GUBPipeline *pipeline, gint64 *error_estimate);
+
 EXPORT_API void gub_pipeline_setup_decoding(GUBPipeline *pipeline, const gchar *uri, int video_index, int audio_index,
 	const gchar *net_clock_addr, int net_clock_port, guint64 basetime,
 	float crop_left, float crop_top, float crop_right, float crop_bottom);
 
 EXPORT_API gint32 gub_pipeline_grab_frame(GUBPipeline *pipeline, int *width, int *height);
 
+/* Like gub_pipeline_grab_frame, and also returns the sequence number of the current frame.
+Returns 1 only when a frame different from the previously grabbed one is ready to be blitted. */
+EXPORT_API gint32 gub_pipeline_grab_frame_ex(GUBPipeline *pipeline, int *width, int *height, guint64 *frame_seq);
+
 EXPORT_API void gub_pipeline_blit_image(GUBPipeline *pipeline, void *_TextureNativePtr);
 
 EXPORT_API void gub_pipeline_setup_encoding(GUBPipeline *pipeline, const gchar *filename,
     int width, int height);
 
+/* Like gub_pipeline_setup_encoding, with a configurable encoding profile. NULL or empty arguments use the defaults.
+container_caps: e.g. "video/quicktime,variant=iso" (default) or "video/x-matroska"
+video_caps: e.g. "video/x-h264,profile=main" (default) or "video/x-vp8"
+encoder_settings: properties for the encoder element, as a GstStructure named after its factory
+(or "encoder" for whichever video encoder is picked), e.g. "x264enc, speed-preset=ultrafast, tune=zerolatency, threads=4" */
+EXPORT_API void gub_pipeline_setup_encoding_with_profile(GUBPipeline *pipeline, const gchar *filename,
+    int width, int height, const gchar *container_caps, const gchar *video_caps, const gchar *encoder_settings);
+
 EXPORT_API void gub_pipeline_consume_image(GUBPipeline *pipeline, guint8 *rawdata, int size);
 
+/* Queues the image for a worker thread, which converts and pushes it and then calls release_handler.
+Returns 0 if an older pending image had to be dropped to make room for this one.
+Do not mix with gub_pipeline_consume_image on the same pipeline. */
+EXPORT_API gint32 gub_pipeline_consume_image_async(GUBPipeline *pipeline, guint8 *rawdata, int size,
+    GUBPipelineOnImageReleasedPFN release_handler, void *release_userdata);
+
+/* How many images gub_pipeline_consume_image_async keeps waiting, and what happens when there are more */
+EXPORT_API void gub_pipeline_set_capture_queue(GUBPipeline *pipeline, int max_pending, gint32 policy);
+
+/* Images dropped by gub_pipeline_consume_image_async since the pipeline was set up */
+EXPORT_API guint64 gub_pipeline_get_dropped_captures(GUBPipeline *pipeline);
+
 EXPORT_API void gub_pipeline_stop_encoding(GUBPipeline *pipeline);
 
 EXPORT_API void gub_pipeline_set_volume(GUBPipeline *pipeline, gdouble volume);
@@ -7,12 +7,23 @@ class GstUnityBridgeCapture : MonoBehaviour
 {
     public Texture2D m_Source = null;
     public string m_Filename = null;
+    [Tooltip("Container caps, e.g. video/quicktime,variant=iso (default) or video/x-matroska")]
+    public string m_ContainerCaps = "";
+    [Tooltip("Video caps, e.g. video/x-h264,profile=main (default) or video/x-vp8")]
+    public string m_VideoCaps = "";
+    [Tooltip("Encoder properties, e.g. x264enc, speed-preset=ultrafast, tune=zerolatency, threads=4")]
+    public string m_EncoderSettings = "";
+    [Tooltip("Captured frames waiting for the encoder. Older ones are dropped when there are more, unless Block Unity is set.")]
+    public int m_MaxPendingFrames = 2;
+    [Tooltip("Wait for the encoder instead of dropping frames")]
+    public bool m_BlockUnity = false;
 
     private GstUnityBridgePipeline m_Pipeline;
     private GCHandle m_instanceHandle;
 
     private bool m_EOS = false;
     private int m_width = 0, m_height = 0;
+    private ulong m_DroppedFrames = 0;
 
     void Awake()
     {
@@ -27,14 +38,20 @@ class GstUnityBridgeCapture : MonoBehaviour
         {
             m_width = m_Source.width;
             m_height = m_Source.height;
-            m_Pipeline.SetupEncoding(m_Filename, m_Source.width, m_Source.height);
+            m_Pipeline.SetupEncoding(m_Filename, m_Source.width, m_Source.height, m_ContainerCaps, m_VideoCaps, m_EncoderSettings);
+            m_Pipeline.SetCaptureQueue(m_MaxPendingFrames, m_BlockUnity);
             m_Pipeline.Play();
         }
 
-        var pixels = m_Source.GetPixels32();
-        var handle = GCHandle.Alloc(pixels, GCHandleType.Pinned);
-        m_Pipeline.ConsumeImage(handle.AddrOfPinnedObject(), pixels.Length * 4);
-        handle.Free();
+        if (!m_Pipeline.ConsumeImageAsync(m_Source.GetPixels32()))
+        {
+            ulong dropped = m_Pipeline.DroppedCaptures;
+            if (dropped - m_DroppedFrames >= 100 || m_DroppedFrames == 0)
+            {
+                Debug.LogWarning("GUB: Encoder is not keeping up, " + dropped + " captured frames dropped so far");
+                m_DroppedFrames = dropped;
+            }
+        }
     }
 
 
@@ -54,7 +71,7 @@ class GstUnityBridgeCapture : MonoBehaviour
 
         GStreamer.Ref("2", log_handler);
         m_instanceHandle = GCHandle.Alloc(this);
-        m_Pipeline = new GstUnityBridgePipeline(name + GetInstanceID(), OnFinish, null, null, (System.IntPtr)m_instanceHandle);
+        m_Pipeline = new GstUnityBridgePipeline(name + GetInstanceID(), OnFinish, null, null, null, (System.IntPtr)m_instanceHandle);
     }
 
     void Start()
@@ -67,7 +84,8 @@ class GstUnityBridgeCapture : MonoBehaviour
         }
         if (m_Source != null)
         {
-            m_Pipeline.SetupEncoding(m_Filename, m_Source.width, m_Source.height);
+            m_Pipeline.SetupEncoding(m_Filename, m_Source.width, m_Source.height, m_ContainerCaps, m_VideoCaps, m_EncoderSettings);
+            m_Pipeline.SetCaptureQueue(m_MaxPendingFrames, m_BlockUnity);
             m_Pipeline.Play();
         }
     }
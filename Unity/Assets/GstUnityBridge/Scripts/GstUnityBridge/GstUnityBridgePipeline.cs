@@ -52,6 +52,7 @@ public class GstUnityBridgePipeline
         System.IntPtr eos_pfn,
         System.IntPtr error_pfn,
         System.IntPtr qos_pfn,
+        System.IntPtr clock_sync_pfn,
         System.IntPtr userdata);
 
     [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
@@ -75,9 +76,27 @@ public class GstUnityBridgePipeline
         float crop_left, float crop_top, float crop_right, float crop_bottom,
         bool isDvbWc);
 
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    extern static private void gub_pipeline_set_video_upload_mode(System.IntPtr p, int mode);
+
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    extern static private void gub_pipeline_setup_decoding_clock_uri(System.IntPtr p,
+        [MarshalAs(UnmanagedType.LPStr)]string uri,
+        int video_index,
+        int audio_index,
+        [MarshalAs(UnmanagedType.LPStr)]string clock_uri,
+        ulong basetime,
+        float crop_left, float crop_top, float crop_right, float crop_bottom);
+
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    extern static private bool gub_pipeline_get_clock_quality(System.IntPtr p, ref long error_estimate);
+
     [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
     extern static private int gub_pipeline_grab_frame(System.IntPtr p, ref int w, ref int h);
 
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    extern static private int gub_pipeline_grab_frame_ex(System.IntPtr p, ref int w, ref int h, ref ulong frame_seq);
+
     [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
     extern static private void gub_pipeline_blit_image(System.IntPtr p, System.IntPtr _TextureNativePtr);
 
@@ -93,6 +112,9 @@ public class GstUnityBridgePipeline
         long current_jitter, ulong current_running_time, ulong current_stream_time, ulong current_timestamp,
     double proportion, ulong processed, ulong dropped);
 
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    internal delegate void GUBPipelineOnClockSyncPFN(System.IntPtr p, int synced);
+
     [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
     extern static private double gub_pipeline_get_duration(System.IntPtr p);
 
@@ -110,9 +132,31 @@ public class GstUnityBridgePipeline
         [MarshalAs(UnmanagedType.LPStr)]string filename,
         int width, int height);
 
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    extern static private void gub_pipeline_setup_encoding_with_profile(System.IntPtr p,
+        [MarshalAs(UnmanagedType.LPStr)]string filename,
+        int width, int height,
+        [MarshalAs(UnmanagedType.LPStr)]string container_caps,
+        [MarshalAs(UnmanagedType.LPStr)]string video_caps,
+        [MarshalAs(UnmanagedType.LPStr)]string encoder_settings);
+
     [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
     extern static private void gub_pipeline_consume_image(System.IntPtr p, System.IntPtr rawdata, int size);
 
+    [UnmanagedFunctionPointer(CallingConvention.Cdecl)]
+    internal delegate void GUBPipelineOnImageReleasedPFN(System.IntPtr userdata, System.IntPtr rawdata);
+
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    [return: MarshalAs(UnmanagedType.I4)]
+    extern static private bool gub_pipeline_consume_image_async(System.IntPtr p, System.IntPtr rawdata, int size,
+        GUBPipelineOnImageReleasedPFN release_handler, System.IntPtr release_userdata);
+
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    extern static private void gub_pipeline_set_capture_queue(System.IntPtr p, int max_pending, int policy);
+
+    [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
+    extern static private ulong gub_pipeline_get_dropped_captures(System.IntPtr p);
+
     [DllImport(DllName, CallingConvention = CallingConvention.Cdecl)]
     extern static private void gub_pipeline_stop_encoding(System.IntPtr p);
 
@@ -123,6 +167,34 @@ public class GstUnityBridgePipeline
     extern static private void gub_pipeline_set_adaptive_bitrate_limit(System.IntPtr p, float bitrate_limit);
 
     protected System.IntPtr m_Instance;
+    private ulong m_FrameSequence = 0;
+
+    // An image for ConsumeImageAsync, pinned once and reused for as long as the size does not change
+    private class CaptureBuffer
+    {
+        internal GstUnityBridgePipeline m_Owner;
+        internal Color32[] m_Pixels;
+        internal GCHandle m_PixelsHandle;
+        internal GCHandle m_Handle; // Passed to native code, see OnImageReleased
+
+        internal CaptureBuffer(GstUnityBridgePipeline owner, int length)
+        {
+            m_Owner = owner;
+            m_Pixels = new Color32[length];
+            m_PixelsHandle = GCHandle.Alloc(m_Pixels, GCHandleType.Pinned);
+            m_Handle = GCHandle.Alloc(this);
+        }
+
+        internal void Free()
+        {
+            m_PixelsHandle.Free();
+            m_Handle.Free();
+        }
+    }
+
+    // Buffers the encoder is done with. Returned from the capture worker thread, so protected by locking it.
+    // There are never more than the capture queue holds plus the one being encoded and the one being filled.
+    private System.Collections.Generic.Stack<CaptureBuffer> m_FreeCaptures = new System.Collections.Generic.Stack<CaptureBuffer>();
 
     internal bool IsLoaded
     {
@@ -142,7 +214,16 @@ public class GstUnityBridgePipeline
 
     internal void Destroy()
     {
+        // Gives back all the images it still held
         gub_pipeline_destroy(m_Instance);
+        lock (m_FreeCaptures)
+        {
+            foreach (CaptureBuffer buffer in m_FreeCaptures)
+            {
+                buffer.Free();
+            }
+            m_FreeCaptures.Clear();
+        }
     }
 
     internal void Play()
@@ -181,12 +262,20 @@ public class GstUnityBridgePipeline
         set { gub_pipeline_set_basetime(m_Instance, value); }
     }
 
-    internal GstUnityBridgePipeline(string name, GUBPipelineOnEosPFN eos_pfn, GUBPipelineOnErrorPFN error_pfn, GUBPipelineOnQosPFN qos_pfn, System.IntPtr userdata)
+    // Sequence number of the last frame returned by GrabFrame. Gaps mean frames were
+    // decoded but never displayed because the application did not grab them in time.
+    internal ulong FrameSequence
+    {
+        get { return m_FrameSequence; }
+    }
+
+    internal GstUnityBridgePipeline(string name, GUBPipelineOnEosPFN eos_pfn, GUBPipelineOnErrorPFN error_pfn, GUBPipelineOnQosPFN qos_pfn, GUBPipelineOnClockSyncPFN clock_sync_pfn, System.IntPtr userdata)
     {
         m_Instance = gub_pipeline_create(name,
             eos_pfn == null ? (System.IntPtr)null : Marshal.GetFunctionPointerForDelegate(eos_pfn),
             error_pfn == null ? (System.IntPtr)null : Marshal.GetFunctionPointerForDelegate(error_pfn),
             qos_pfn == null ? (System.IntPtr)null : Marshal.GetFunctionPointerForDelegate(qos_pfn),
+            clock_sync_pfn == null ? (System.IntPtr)null : Marshal.GetFunctionPointerForDelegate(clock_sync_pfn),
             userdata);
     }
 
@@ -202,10 +291,29 @@ public class GstUnityBridgePipeline
         }
     }
 
+    // Applies from the next SetupDecoding. Only the desktop OpenGL backend supports modes other than RGB.
+    internal void SetVideoUploadMode(GstUnityBridgeVideoUploadMode mode)
+    {
+        gub_pipeline_set_video_upload_mode(m_Instance, (int)mode);
+    }
+
+    // clock_uri selects the network clock, e.g. "ptp://0" or "ntp://pool.ntp.org". Null or empty for none.
+    internal void SetupDecodingClockUri(string uri, int video_index, int audio_index, string clock_uri, ulong basetime, float crop_left, float crop_top, float crop_right, float crop_bottom)
+    {
+        gub_pipeline_setup_decoding_clock_uri(m_Instance, uri, video_index, audio_index, clock_uri, basetime, crop_left, crop_top, crop_right, crop_bottom);
+    }
+
+    // Returns whether the network clock is synced. error_estimate is how far off it might be, in nanoseconds (-1 if unknown).
+    internal bool GetClockQuality(out long error_estimate)
+    {
+        error_estimate = -1;
+        return gub_pipeline_get_clock_quality(m_Instance, ref error_estimate);
+    }
+
     internal bool GrabFrame(ref Vector2 frameSize)
     {
         int w = 0, h = 0;
-        if (gub_pipeline_grab_frame(m_Instance, ref w, ref h) == 1)
+        if (gub_pipeline_grab_frame_ex(m_Instance, ref w, ref h, ref m_FrameSequence) == 1)
         {
             frameSize.x = w;
             frameSize.y = h;
@@ -226,11 +334,72 @@ public class GstUnityBridgePipeline
         gub_pipeline_setup_encoding(m_Instance, filename, width, height);
     }
 
+    // Empty or null arguments use the default profile (H.264 main in MP4)
+    internal void SetupEncoding(string filename, int width, int height, string containerCaps, string videoCaps, string encoderSettings)
+    {
+        gub_pipeline_setup_encoding_with_profile(m_Instance, filename, width, height, containerCaps, videoCaps, encoderSettings);
+    }
+
     internal void ConsumeImage(System.IntPtr ptr, int size)
     {
         gub_pipeline_consume_image(m_Instance, ptr, size);
     }
 
+    // Called from the capture worker thread, or from ConsumeImageAsync for a dropped image:
+    // the encoder is done with the CaptureBuffer, which goes back to the pool
+    private static void OnImageReleased(System.IntPtr userdata, System.IntPtr rawdata)
+    {
+        CaptureBuffer buffer = (CaptureBuffer)((GCHandle)userdata).Target;
+        lock (buffer.m_Owner.m_FreeCaptures)
+        {
+            buffer.m_Owner.m_FreeCaptures.Push(buffer);
+        }
+    }
+
+    // Keeps the delegate alive for as long as native code can call it
+    private static GUBPipelineOnImageReleasedPFN s_OnImageReleased = OnImageReleased;
+
+    private CaptureBuffer TakeCaptureBuffer(int length)
+    {
+        lock (m_FreeCaptures)
+        {
+            while (m_FreeCaptures.Count > 0)
+            {
+                CaptureBuffer buffer = m_FreeCaptures.Pop();
+                if (buffer.m_Pixels.Length == length)
+                {
+                    return buffer;
+                }
+                // Left over from before the size changed
+                buffer.Free();
+            }
+        }
+        return new CaptureBuffer(this, length);
+    }
+
+    // Copies the pixels into a pinned buffer the encoder keeps until it is done with it, so the caller never waits
+    // and nothing is pinned per frame. Returns false if an older image was dropped because the encoder is not keeping up.
+    internal bool ConsumeImageAsync(Color32[] pixels)
+    {
+        CaptureBuffer buffer = TakeCaptureBuffer(pixels.Length);
+        System.Array.Copy(pixels, buffer.m_Pixels, pixels.Length);
+        return gub_pipeline_consume_image_async(m_Instance, buffer.m_PixelsHandle.AddrOfPinnedObject(), pixels.Length * 4,
+            s_OnImageReleased, GCHandle.ToIntPtr(buffer.m_Handle));
+    }
+
+    internal void SetCaptureQueue(int maxPending, bool block)
+    {
+        gub_pipeline_set_capture_queue(m_Instance, maxPending, block ? 1 : 0);
+    }
+
+    internal ulong DroppedCaptures
+    {
+        get
+        {
+            return gub_pipeline_get_dropped_captures(m_Instance);
+        }
+    }
+
     internal void StopEncoding()
     {
         gub_pipeline_stop_encoding(m_Instance);
@@ -51,6 +51,9 @@ public class GstUnityBridgeSynchronizationParams
     public int m_MasterClockPort = 0;
     [Tooltip("Activate the Dvb Wallclock system, instead of GStreamers default")]
     public bool m_isDvbWC = false;
+    [Tooltip("Network clock URI, like ptp://0, ntp://pool.ntp.org or dvbcsswc://host:port. " +
+        "If set, the address, port and Dvb Wallclock items are unused")]
+    public string m_ClockUri = "";
 #if !EXPERIMENTAL
     [HideInInspector]
 #endif
@@ -75,6 +78,9 @@ public class GstUnityBridgeDebugParams
 [Serializable]
 public class StringEvent : UnityEvent<string> { }
 
+[Serializable]
+public class BoolEvent : UnityEvent<bool> { }
+
 // To understand the QoS (Quality of Service) data, read this:
 // https://gstreamer.freedesktop.org/data/doc/gstreamer/head/pwg/html/chapter-advanced-qos.html
 // https://gstreamer.freedesktop.org/data/doc/gstreamer/head/gstreamer/html/GstMessage.html#gst-message-parse-qos
@@ -112,6 +118,16 @@ public class GstUnityBridgeEventParams
     public StringEvent m_OnError;
     [Header("Called when a Quality Of Service event occurs")]
     public QosEvent m_OnQOS;
+    [Header("Called when the network clock is synchronized (true) or could not be (false). Playback starts after this")]
+    public BoolEvent m_OnClockSync;
+}
+
+// Must match GUBVideoUploadMode
+public enum GstUnityBridgeVideoUploadMode
+{
+    RGB = 0,
+    PlanarYUV = 1,
+    GLMemory = 2
 }
 
 public class GstUnityBridgeTexture : MonoBehaviour
@@ -146,6 +162,10 @@ public class GstUnityBridgeTexture : MonoBehaviour
     [Range(0, 1)]
     public float m_AdaptiveBitrateLimit = 1.0F;
 
+    [Tooltip("How decoded frames reach the texture. RGB converts them on the CPU, PlanarYUV converts them on the GPU " +
+        "and GLMemory keeps them on the GPU all the way (desktop OpenGL only)")]
+    public GstUnityBridgeVideoUploadMode m_VideoUploadMode = GstUnityBridgeVideoUploadMode.RGB;
+
     [SerializeField]
     [Tooltip("Leave always ON, unless you plan to activate it manually")]
     public bool m_InitializeOnStart = true;
@@ -229,6 +249,22 @@ public class GstUnityBridgeTexture : MonoBehaviour
         }
     }
 
+    private static void OnClockSync(IntPtr p, int synced)
+    {
+        GstUnityBridgeTexture self = ((GCHandle)p).Target as GstUnityBridgeTexture;
+
+        if (self != null)
+        {
+            if (self.m_Events.m_OnClockSync != null)
+            {
+                self.m_EventProcessor.QueueEvent(() =>
+                {
+                    self.m_Events.m_OnClockSync.Invoke(synced != 0);
+                });
+            }
+        }
+    }
+
     public void Initialize()
     {
         if (!m_HasBeenInitialized)
@@ -243,7 +279,7 @@ public class GstUnityBridgeTexture : MonoBehaviour
 
             m_instanceHandle = GCHandle.Alloc(this);
 
-            m_Pipeline = new GstUnityBridgePipeline(name + GetInstanceID(), OnFinish, OnError, OnQos, (IntPtr)m_instanceHandle);
+            m_Pipeline = new GstUnityBridgePipeline(name + GetInstanceID(), OnFinish, OnError, OnQos, OnClockSync, (IntPtr)m_instanceHandle);
 
             Resize(m_Width, m_Height);
 
@@ -318,6 +354,15 @@ public class GstUnityBridgeTexture : MonoBehaviour
         m_AudioIndex = _AudioIndex;
         if (m_Pipeline.IsLoaded || m_Pipeline.IsPlaying)
             m_Pipeline.Close();
+        m_Pipeline.SetVideoUploadMode(m_VideoUploadMode);
+        if (m_NetworkSynchronization.m_Enabled && !string.IsNullOrEmpty(m_NetworkSynchronization.m_ClockUri))
+        {
+            m_Pipeline.SetupDecodingClockUri(m_URI, m_VideoIndex, m_AudioIndex,
+                m_NetworkSynchronization.m_ClockUri,
+                m_NetworkSynchronization.m_BaseTime,
+                m_VideoCropping.m_Left, m_VideoCropping.m_Top, m_VideoCropping.m_Right, m_VideoCropping.m_Bottom);
+            return;
+        }
         m_Pipeline.SetupDecoding(m_URI, m_VideoIndex, m_AudioIndex,
             m_NetworkSynchronization.m_Enabled ? m_NetworkSynchronization.m_MasterClockAddress : null,
             m_NetworkSynchronization.m_MasterClockPort,
@@ -427,9 +472,13 @@ public class GstUnityBridgeTexture : MonoBehaviour
             return;
 
         Vector2 sz = Vector2.zero;
+        // GrabFrame only succeeds when there is a frame we have not painted yet
         if (m_Pipeline.GrabFrame(ref sz))
         {
-            Resize((int)sz.x, (int)sz.y);
+            if ((int)sz.x != m_Width || (int)sz.y != m_Height)
+            {
+                Resize((int)sz.x, (int)sz.y);
+            }
             if (m_Texture == null)
             {
                 Debug.LogWarning(string.Format("[{0}] The GUBTexture does not have a texture assigned and will not paint.", name + GetInstanceID()));